@@ -0,0 +1,242 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file benchmark.cpp
+   @brief Times the setup and solve phases of a Hierarchy on one graph.
+
+   The graph is either generated (Watts-Strogatz) or read from a file. The
+   wall time of each phase (maximum over processes), the memory high-water
+   mark and the operator complexity are printed as a JSON object on the last
+   line of the output, see runbenchmarks.py for sweeping over parameters.
+*/
+
+#include <cstring>
+#include <fstream>
+#include <sys/resource.h>
+#include <vector>
+
+#include "mfem.hpp"
+
+#include "../src/picojson.h"
+#include "../src/smoothG.hpp"
+
+using namespace smoothg;
+
+/// @return memory high-water mark of this process in MB
+double MemoryHighWaterMark()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+}
+
+/// @return maximum of a local value over all processes
+double GlobalMax(MPI_Comm comm, double local_value)
+{
+    double global_value;
+    MPI_Allreduce(&local_value, &global_value, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return global_value;
+}
+
+/// @return sum of a local value over all processes
+double GlobalSum(MPI_Comm comm, double local_value)
+{
+    double global_value;
+    MPI_Allreduce(&local_value, &global_value, 1, MPI_DOUBLE, MPI_SUM, comm);
+    return global_value;
+}
+
+/// Wall time of a phase, processes are synchronized before starting the clock
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(MPI_Comm comm) : comm_(comm)
+    {
+        MPI_Barrier(comm_);
+        chrono_.Clear();
+        chrono_.Start();
+    }
+
+    /// @return maximum wall time over all processes
+    double Stop()
+    {
+        chrono_.Stop();
+        return GlobalMax(comm_, chrono_.RealTime());
+    }
+private:
+    MPI_Comm comm_;
+    mfem::StopWatch chrono_;
+};
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid, num_procs;
+    MPI_Comm_rank(comm, &myid);
+    MPI_Comm_size(comm, &num_procs);
+
+    UpscaleParameters upscale_param;
+    mfem::OptionsParser args(argc, argv);
+    bool generate_graph = true;
+    args.AddOption(&generate_graph, "-gg", "--generate-graph", "-no-gg",
+                   "--no-generate-graph", "Generate a Watts-Strogatz graph (or read one).");
+    const char* graph_filename = "../../graphdata/vertex_edge_sample.txt";
+    args.AddOption(&graph_filename, "-g", "--graph",
+                   "File to load for graph connection data (if not generated).");
+    int num_vertices = 10000;
+    args.AddOption(&num_vertices, "-nv", "--num-vert",
+                   "Number of vertices of the graph to be generated.");
+    int mean_degree = 20;
+    args.AddOption(&mean_degree, "-md", "--mean-degree",
+                   "Average vertex degree of the graph to be generated.");
+    double beta = 0.15;
+    args.AddOption(&beta, "-b", "--beta",
+                   "Probability of rewiring in the Watts-Strogatz model.");
+    int seed = 0;
+    args.AddOption(&seed, "-s", "--seed",
+                   "Seed for the graph generator and the right hand side.");
+    int num_solves = 5;
+    args.AddOption(&num_solves, "-ns", "--num-solves",
+                   "Number of solves on each level (timings are averaged).");
+    const char* output_filename = "";
+    args.AddOption(&output_filename, "-o", "--output",
+                   "File to write the JSON results to (in addition to stdout).");
+    upscale_param.RegisterInOptionsParser(args);
+    args.Parse();
+    if (!args.Good())
+    {
+        if (myid == 0)
+        {
+            args.PrintUsage(std::cout);
+        }
+        return 1;
+    }
+    if (myid == 0)
+    {
+        args.PrintOptions(std::cout);
+    }
+
+    picojson::object timings;
+    picojson::object memory;
+
+    // Build (distributed) graph
+    PhaseTimer graph_timer(comm);
+    mfem::SparseMatrix vertex_edge = generate_graph ?
+                                     GenerateGraph(comm, num_vertices, mean_degree, beta, seed) :
+                                     ReadVertexEdge(graph_filename);
+    Graph graph(comm, vertex_edge);
+    timings["graph"] = picojson::value(graph_timer.Stop());
+    memory["graph"] = picojson::value(GlobalMax(comm, MemoryHighWaterMark()));
+
+    const int num_global_vertices = vertex_edge.NumRows();
+    const int num_global_edges = vertex_edge.NumCols();
+    vertex_edge.Clear();
+
+    // Build hierarchy (partitioning, local eigenproblems, coarse solvers)
+    PhaseTimer setup_timer(comm);
+    Hierarchy hierarchy(std::move(graph), upscale_param);
+    timings["setup"] = picojson::value(setup_timer.Stop());
+    memory["setup"] = picojson::value(GlobalMax(comm, MemoryHighWaterMark()));
+
+    // Random right hand side, orthogonal to constants, restricted to every level
+    std::vector<mfem::BlockVector> rhs;
+    rhs.reserve(hierarchy.NumLevels());
+    rhs.emplace_back(hierarchy.BlockOffsets(0));
+    rhs[0].GetBlock(0) = 0.0;
+    rhs[0].GetBlock(1).Randomize(seed + myid);
+    par_orthogonalize_from_constant(rhs[0].GetBlock(1), num_global_vertices);
+    for (int level = 1; level < hierarchy.NumLevels(); ++level)
+    {
+        rhs.emplace_back(hierarchy.BlockOffsets(level));
+        hierarchy.Restrict(level - 1, rhs[level - 1], rhs[level]);
+    }
+
+    picojson::array levels;
+    double total_solve_time = 0.0;
+    for (int level = 0; level < hierarchy.NumLevels(); ++level)
+    {
+        mfem::BlockVector sol(hierarchy.BlockOffsets(level));
+
+        PhaseTimer solve_timer(comm);
+        int iterations = 0;
+        for (int i = 0; i < num_solves; ++i)
+        {
+            sol = 0.0;
+            hierarchy.Solve(level, rhs[level], sol);
+            iterations = std::max(iterations, hierarchy.GetSolveIters(level));
+        }
+        const double solve_time = solve_timer.Stop() / std::max(num_solves, 1);
+        total_solve_time += solve_time;
+
+        const MixedMatrix& mgL = hierarchy.GetMatrix(level);
+
+        picojson::object level_info;
+        level_info["level"] = picojson::value((double) level);
+        level_info["num-vertices"] = picojson::value(GlobalSum(comm, hierarchy.NumVertices(level)));
+        level_info["num-vdofs"] = picojson::value(GlobalSum(comm, mgL.NumVDofs()));
+        level_info["num-edofs"] =
+            picojson::value((double) mgL.GetGraphSpace().EDofToTrueEDof().N());
+        level_info["operator-complexity"] =
+            picojson::value(hierarchy.OperatorComplexityAtLevel(level));
+        level_info["solve-time"] = picojson::value(solve_time);
+        level_info["solve-iterations"] = picojson::value((double) iterations);
+        levels.push_back(picojson::value(level_info));
+    }
+    timings["solve"] = picojson::value(total_solve_time);
+    memory["solve"] = picojson::value(GlobalMax(comm, MemoryHighWaterMark()));
+    memory["total"] = picojson::value(GlobalSum(comm, MemoryHighWaterMark()));
+
+    picojson::object parameters;
+    parameters["num-procs"] = picojson::value((double) num_procs);
+    parameters["generate-graph"] = picojson::value(generate_graph);
+    parameters["graph"] = picojson::value(std::string(generate_graph ? "" : graph_filename));
+    parameters["num-vertices"] = picojson::value((double) num_global_vertices);
+    parameters["num-edges"] = picojson::value((double) num_global_edges);
+    parameters["mean-degree"] = picojson::value((double) mean_degree);
+    parameters["coarse-factor"] = picojson::value((double) upscale_param.coarse_factor);
+    parameters["max-evects"] = picojson::value((double) upscale_param.max_evects);
+    parameters["max-traces"] = picojson::value((double) upscale_param.max_traces);
+    parameters["spect-tol"] = picojson::value(upscale_param.spect_tol);
+    parameters["max-levels"] = picojson::value((double) upscale_param.max_levels);
+    parameters["hybridization"] = picojson::value(upscale_param.hybridization);
+    parameters["num-solves"] = picojson::value((double) num_solves);
+
+    picojson::object serialize;
+    serialize["parameters"] = picojson::value(parameters);
+    serialize["timings"] = picojson::value(timings);
+    serialize["phase-timings"] = picojson::value(TimerRegistry::Get().Serialize(comm));
+    serialize["memory-hwm-mb"] = picojson::value(memory);
+    serialize["operator-complexity"] =
+        picojson::value(hierarchy.OperatorComplexity(hierarchy.NumLevels() - 1));
+    serialize["levels"] = picojson::value(levels);
+
+    if (myid == 0)
+    {
+        if (std::strlen(output_filename))
+        {
+            std::ofstream out(output_filename);
+            out << picojson::value(serialize).serialize(true) << std::endl;
+        }
+        std::cout << picojson::value(serialize).serialize() << std::endl;
+    }
+
+    return 0;
+}
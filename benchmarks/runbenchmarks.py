@@ -0,0 +1,160 @@
+# BHEADER ####################################################################
+#
+# Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+# Produced at the Lawrence Livermore National Laboratory.
+# LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+#
+# This file is part of smoothG. For more information and source code
+# availability, see https://www.github.com/llnl/smoothG.
+#
+# smoothG is free software; you can redistribute it and/or modify it under the
+# terms of the GNU Lesser General Public License (as published by the Free
+# Software Foundation) version 2.1 dated February 1999.
+#
+#################################################################### EHEADER #
+
+"""
+Run the benchmark driver over a sweep of graph sizes, coarsening factors,
+numbers of eigenvectors, hybridization on/off and numbers of processes.
+
+The results of all runs are collected in one JSON file. If a baseline file
+(the output of a previous run of this script) is given, timings and memory
+are compared run by run and regressions above a tolerance are reported.
+
+Example:
+    python runbenchmarks.py --sizes 10000 100000 --procs 1 4 \\
+        --output results.json --baseline results-last-release.json
+"""
+
+from __future__ import print_function
+
+import argparse
+import itertools
+import json
+import subprocess
+import sys
+
+graph_data = "@smoothG_GRAPHDATA@"
+
+
+def parse_last_json(lines):
+    """ Return the JSON object printed on the last line of the output """
+    for line in reversed(lines):
+        try:
+            return json.loads(line)
+        except ValueError:
+            pass
+    return None
+
+
+def run_benchmark(num_procs, options, verbose=False):
+    """ Run the driver with given options, return its JSON output or None """
+    command = ["./benchmark"] + options
+    if num_procs > 1:
+        command = ["mpirun", "-np", str(num_procs)] + command
+
+    if verbose:
+        print(" ".join(command))
+
+    p = subprocess.Popen(command, stdout=subprocess.PIPE,
+                         stderr=subprocess.PIPE, universal_newlines=True)
+    stdout, stderr = p.communicate()
+
+    if p.returncode != 0:
+        print("failed: " + " ".join(command))
+        print(stderr)
+        return None
+
+    return parse_last_json(stdout.splitlines())
+
+
+def make_runs(args):
+    """ Generate (num_procs, options) for every combination of the sweep """
+    graphs = [["--generate-graph", "--num-vert", str(size),
+               "--mean-degree", str(args.mean_degree)] for size in args.sizes]
+    if args.graphdata:
+        graphs.append(["--no-generate-graph",
+                       "--graph", graph_data + "/vertex_edge_sample.txt"])
+
+    hybridization = {"on": [True], "off": [False], "both": [False, True]}[args.hybridization]
+
+    for graph, coarse_factor, max_evects, hb, num_procs in itertools.product(
+            graphs, args.coarse_factors, args.max_evects, hybridization, args.procs):
+        options = graph + ["--coarse-factor", str(coarse_factor),
+                           "--max-evects", str(max_evects),
+                           "--max-levels", str(args.max_levels),
+                           "--num-solves", str(args.num_solves),
+                           "--hybridization" if hb else "--no-hybridization"]
+        yield num_procs, options
+
+
+def run_key(result):
+    """ Parameters identifying a run, used to match runs with the baseline """
+    p = result["parameters"]
+    return (p["graph"], p["num-vertices"], p["coarse-factor"], p["max-evects"],
+            p["max-levels"], p["hybridization"], p["num-procs"])
+
+
+def compare(results, baseline, tol):
+    """ Report timings and memory which grew by more than tol (relative) """
+    baseline_runs = dict((run_key(r), r) for r in baseline)
+    regressions = 0
+    for result in results:
+        old = baseline_runs.get(run_key(result))
+        if old is None:
+            continue
+        for group in ["timings", "memory-hwm-mb"]:
+            for phase, value in result[group].items():
+                old_value = old[group].get(phase)
+                if old_value and value > (1.0 + tol) * old_value:
+                    regressions += 1
+                    print("regression {0} {1}/{2}: {3:g} -> {4:g}".format(
+                        run_key(result), group, phase, old_value, value))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sizes", type=int, nargs="*", default=[10000, 100000],
+                        help="numbers of vertices of generated graphs")
+    parser.add_argument("--mean-degree", type=int, default=20)
+    parser.add_argument("--graphdata", action="store_true",
+                        help="also run on the bundled sample graph")
+    parser.add_argument("--coarse-factors", type=int, nargs="+", default=[32, 128])
+    parser.add_argument("--max-evects", type=int, nargs="+", default=[1, 4])
+    parser.add_argument("--max-levels", type=int, default=2)
+    parser.add_argument("--hybridization", choices=["on", "off", "both"], default="both")
+    parser.add_argument("--procs", type=int, nargs="+", default=[1, 2, 4])
+    parser.add_argument("--num-solves", type=int, default=5)
+    parser.add_argument("--output", default="benchmark-results.json")
+    parser.add_argument("--baseline", help="results of an earlier run to compare with")
+    parser.add_argument("--tolerance", type=float, default=0.2,
+                        help="relative growth reported as regression")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    results = []
+    failures = 0
+    for num_procs, options in make_runs(args):
+        result = run_benchmark(num_procs, options, args.verbose)
+        if result is None:
+            failures += 1
+        else:
+            results.append(result)
+
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    print("{0} runs written to {1}".format(len(results), args.output))
+
+    regressions = 0
+    if args.baseline:
+        with open(args.baseline) as f:
+            regressions = compare(results, json.load(f), args.tolerance)
+        print("{0} regressions found".format(regressions))
+
+    return 1 if failures or regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
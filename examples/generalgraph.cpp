@@ -56,6 +56,13 @@ int main(int argc, char* argv[])
     const char* graphFileName = "../../graphdata/vertex_edge_sample.txt";
     args.AddOption(&graphFileName, "-g", "--graph",
                    "File to load for graph connection data.");
+    bool binary_graph = false;
+    args.AddOption(&binary_graph, "-bg", "--binary-graph", "-no-bg",
+                   "--no-binary-graph", "Graph file is in binary format (see graphconvert).");
+    bool distributed_load = false;
+    args.AddOption(&distributed_load, "-dl", "--distributed-load", "-no-dl",
+                   "--no-distributed-load",
+                   "Each processor reads only its own part of the binary graph file.");
     const char* FiedlerFileName = "../../graphdata/fiedler_sample.txt";
     args.AddOption(&FiedlerFileName, "-f", "--fiedler",
                    "File to load for the Fiedler vector.");
@@ -115,38 +122,60 @@ int main(int argc, char* argv[])
     upscale_param.coarse_components = (upscale_param.coarse_components &&
                                        !upscale_param.hybridization);
 
-    /// [Load graph from file or generate one]
-    mfem::SparseMatrix global_vertex_edge;
-    if (generate_graph)
+    Graph graph;
+    if (distributed_load)
     {
-        mfem::SparseMatrix tmp = GenerateGraph(comm, gen_vertices, mean_degree, beta, seed);
-        global_vertex_edge.Swap(tmp);
+        /// [Read local part of graph from binary file]
+        MFEM_VERIFY(binary_graph && !generate_graph && !std::strlen(weight_filename),
+                    "--distributed-load requires --binary-graph (weights are read from file)");
+        graph = Graph(comm, std::string(graphFileName));
+        /// [Read local part of graph from binary file]
     }
     else
     {
-        mfem::SparseMatrix tmp = ReadVertexEdge(graphFileName);
-        global_vertex_edge.Swap(tmp);
-    }
+        /// [Load graph from file or generate one]
+        mfem::SparseMatrix global_vertex_edge;
+        unique_ptr<BinaryGraphFile> binary_graph_file;
+        if (generate_graph)
+        {
+            mfem::SparseMatrix tmp = GenerateGraph(comm, gen_vertices, mean_degree, beta, seed);
+            global_vertex_edge.Swap(tmp);
+        }
+        else if (binary_graph)
+        {
+            binary_graph_file = make_unique<BinaryGraphFile>(graphFileName);
+            global_vertex_edge.MakeRef(binary_graph_file->VertexToEdge());
+        }
+        else
+        {
+            mfem::SparseMatrix tmp = ReadVertexEdge(graphFileName);
+            global_vertex_edge.Swap(tmp);
+        }
 
-    const int nedges_global = global_vertex_edge.Width();
-    const int nvertices_global = global_vertex_edge.Height();
+        const int nedges_global = global_vertex_edge.Width();
 
-    /// [Load graph from file or generate one]
+        /// [Load graph from file or generate one]
 
-    /// [Load the edge weights]
-    mfem::Vector edge_weight(nedges_global);
-    if (std::strlen(weight_filename))
-    {
-        std::ifstream weight_file(weight_filename);
-        edge_weight.Load(weight_file, nedges_global);
-    }
-    else
-    {
-        edge_weight = 1.0;
-    }
-    /// [Load the edge weights]
+        /// [Load the edge weights]
+        mfem::Vector edge_weight(nedges_global);
+        if (std::strlen(weight_filename))
+        {
+            std::ifstream weight_file(weight_filename);
+            edge_weight.Load(weight_file, nedges_global);
+        }
+        else if (binary_graph_file && binary_graph_file->HasEdgeWeight())
+        {
+            edge_weight = binary_graph_file->EdgeWeight();
+        }
+        else
+        {
+            edge_weight = 1.0;
+        }
+        /// [Load the edge weights]
 
-    Graph graph(comm, global_vertex_edge, edge_weight);
+        graph = Graph(comm, global_vertex_edge, edge_weight);
+    }
+    const int nvertices_global = graph.VertexStarts().Last();
 
     /// [Partitioning]
     mfem::Array<int> partitioning;
@@ -0,0 +1,73 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @example
+   @file graphconvert.cpp
+   @brief Converts a text vertex_edge file into the binary graph format.
+
+   The output can be read by generalgraph with the --binary-graph flag.
+*/
+
+#include <cstring>
+
+#include "mfem.hpp"
+
+#include "../src/smoothG.hpp"
+
+using namespace smoothg;
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    int myid;
+    MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+
+    mfem::OptionsParser args(argc, argv);
+    const char* graph_filename = "../../graphdata/vertex_edge_sample.txt";
+    args.AddOption(&graph_filename, "-g", "--graph",
+                   "Text file of graph connection data.");
+    const char* weight_filename = "";
+    args.AddOption(&weight_filename, "-w", "--weight",
+                   "Text file of graph edge weights (optional).");
+    const char* output_filename = "vertex_edge.bin";
+    args.AddOption(&output_filename, "-o", "--output",
+                   "Binary graph file to write.");
+    args.Parse();
+    if (!args.Good())
+    {
+        if (myid == 0)
+        {
+            args.PrintUsage(std::cout);
+        }
+        return 1;
+    }
+    if (myid == 0)
+    {
+        args.PrintOptions(std::cout);
+    }
+
+    if (myid == 0)
+    {
+        ConvertVertexEdgeToBinary(graph_filename, output_filename, weight_filename);
+
+        BinaryGraphFile binary_graph(output_filename);
+        std::cout << "Wrote " << binary_graph.Header().num_vertices << " vertices and "
+                  << binary_graph.Header().num_edges << " edges to "
+                  << output_filename << std::endl;
+    }
+
+    return 0;
+}
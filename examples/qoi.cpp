@@ -45,6 +45,12 @@
    variance on the coarse grid, which is what justifies taking few samples
    on the fine grid.
 
+   With --num-groups, the processes are split into groups that each hold a
+   replica of the problem and take samples concurrently, so that cheap
+   coarse samples do not leave most processes idle. With --target-rmse, the
+   numbers of samples are chosen adaptively until the estimated error is
+   below the target.
+
    See Osborn, Vassilevski, and Villa, A multilevel, hierarchical sampling
    technique for spatially correlated random fields, SISC 39 (2017) pp. S543-S562
    and its references for more information on these techniques.
@@ -103,6 +109,15 @@ int main(int argc, char* argv[])
     int problem_size = 50;
     args.AddOption(&problem_size, "--problem-size", "--problem-size",
                    "Scale of problem (number of volumes in x,y directions)");
+    int num_groups = 1;
+    args.AddOption(&num_groups, "--num-groups", "--num-groups",
+                   "Number of process groups taking samples concurrently.");
+    double target_rmse = 0.0;
+    args.AddOption(&target_rmse, "--target-rmse", "--target-rmse",
+                   "Sample until the estimated error is below this (0: use --choose-samples).");
+    int batch_size = 10;
+    args.AddOption(&batch_size, "--batch-size", "--batch-size",
+                   "Maximum number of samples per group between updates of the allocation.");
 
     // Read upscaling options from command line into upscale_param object
     upscale_param.RegisterInOptionsParser(args);
@@ -127,6 +142,11 @@ int main(int argc, char* argv[])
     serialize["choose-samples"] = picojson::value((double) choose_samples);
     serialize["shared-samples"] = picojson::value((double) shared_samples);
     serialize["kappa"] = picojson::value(kappa);
+    serialize["num-groups"] = picojson::value((double) num_groups);
+
+    // every group of processes has its own replica of the problem
+    MLMCGroups groups(comm, num_groups);
+    MPI_Comm group_comm = groups.GetGroupComm();
     // serialize["coarsening-factor"] = picojson::value((double) coarsening_factor);
 
     // Setting up a mesh
@@ -135,13 +155,13 @@ int main(int argc, char* argv[])
     {
         mfem::Mesh mesh(problem_size, problem_size, 10, mfem::Element::HEXAHEDRON, 1,
                         problem_size * 100.0, problem_size * 100.0, 100.0);
-        pmesh = make_unique<mfem::ParMesh>(comm, mesh);
+        pmesh = make_unique<mfem::ParMesh>(group_comm, mesh);
     }
     else
     {
         mfem::Mesh mesh(problem_size, problem_size, mfem::Element::QUADRILATERAL, 1,
                         problem_size * 100.0, problem_size * 100.0);
-        pmesh = make_unique<mfem::ParMesh>(comm, mesh);
+        pmesh = make_unique<mfem::ParMesh>(group_comm, mesh);
     }
 
     // Construct a graph from a finite volume problem defined on the mesh
@@ -152,7 +172,10 @@ int main(int argc, char* argv[])
     Graph graph = fvproblem.GetFVGraph();
     Hierarchy hierarchy(graph, upscale_param, nullptr, &ess_attr);
 
-    hierarchy.PrintInfo();
+    if (groups.GroupId() == 0)
+    {
+        hierarchy.PrintInfo();
+    }
 
     mfem::BlockVector rhs_fine(hierarchy.BlockOffsets(0));
     rhs_fine = 0.0;
@@ -190,7 +213,19 @@ int main(int argc, char* argv[])
         mlmc.SetInitialSamplesLevel(num_levels - 1, coarse_samples);
     }
     mlmc.SetNumChooseSamples(choose_samples);
-    mlmc.Simulate(verbose);
+    if (target_rmse > 0.0)
+    {
+        const double rmse = mlmc.SimulateToTolerance(groups, target_rmse, batch_size, verbose);
+        serialize["estimated-rmse"] = picojson::value(rmse);
+    }
+    else if (num_groups > 1)
+    {
+        mlmc.Simulate(groups, verbose);
+    }
+    else
+    {
+        mlmc.Simulate(verbose);
+    }
 
     if (myid == 0)
     {
@@ -0,0 +1,301 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file
+
+    @brief Implements AgglomeratedSolver
+*/
+
+#include "AgglomeratedSolver.hpp"
+#include "MatrixUtilities.hpp"
+#include "Timer.hpp"
+
+namespace smoothg
+{
+
+AgglomeratedSolver::AgglomeratedSolver(const MixedMatrix& mgL,
+                                       const mfem::Array<int>* ess_attr,
+                                       int min_dofs_per_proc)
+    : MixedLaplacianSolver(mgL.GetComm(), mgL.BlockTrueOffsets(), mgL.CheckW()),
+      mgL_(mgL), group_comm_(MPI_COMM_NULL), active_comm_(MPI_COMM_NULL),
+      pipelined_krylov_(false), active_offsets_(3)
+{
+    MFEM_VERIFY(min_dofs_per_proc > 0, "min_dofs_per_proc has to be positive!");
+    MixedLaplacianSolver::Init(mgL, ess_attr);
+
+    int num_procs;
+    MPI_Comm_size(comm_, &num_procs);
+
+    // groups of consecutive processes keep the global numbering of true dofs
+    const auto& graph_space = mgL.GetGraphSpace();
+    const int global_dofs = graph_space.EDofToTrueEDof().N() + graph_space.VDofStarts().Last();
+    const int max_active_procs = std::min(std::max(global_dofs / min_dofs_per_proc, 1),
+                                          num_procs);
+    const int group_size = (num_procs + max_active_procs - 1) / max_active_procs;
+    num_active_procs_ = (num_procs + group_size - 1) / group_size;
+
+    const bool active = (myid_ % group_size == 0);
+    MPI_Comm_split(comm_, myid_ / group_size, myid_, &group_comm_);
+    MPI_Comm_split(comm_, active ? 0 : MPI_UNDEFINED, myid_, &active_comm_);
+
+    const mfem::Array<int>& true_offsets = mgL.BlockTrueOffsets();
+    for (int b = 0; b < 2; ++b)
+    {
+        int local_size = true_offsets[b + 1] - true_offsets[b];
+        counts_[b].resize(active ? group_size : 0);
+        MPI_Gather(&local_size, 1, MPI_INT, counts_[b].data(), 1, MPI_INT, 0, group_comm_);
+
+        displs_[b].resize(counts_[b].size() + 1, 0);
+        for (unsigned int p = 0; p < counts_[b].size(); ++p)
+        {
+            displs_[b][p + 1] = displs_[b][p] + counts_[b][p];
+        }
+    }
+    active_offsets_[0] = 0;
+    active_offsets_[1] = displs_[0].back();
+    active_offsets_[2] = active_offsets_[1] + displs_[1].back();
+
+    if (active)
+    {
+        active_rhs_ = make_unique<mfem::BlockVector>(active_offsets_);
+        active_sol_ = make_unique<mfem::BlockVector>(active_offsets_);
+    }
+
+    // D and W (as in BlockSolver), they do not change with the coefficient
+    mfem::SparseMatrix D_proc(mgL.GetD());
+    if (ess_edofs_.Size())
+    {
+        D_proc.EliminateCols(ess_edofs_);
+    }
+    if (!W_is_nonzero_ && remove_one_dof_ && myid_ == 0)
+    {
+        D_proc.EliminateRow(0);
+    }
+
+    std::unique_ptr<mfem::HypreParMatrix> hD(mgL.MakeParallelD(D_proc));
+    active_D_ = GatherRows(*hD, group_comm_, active_comm_);
+
+    // the removed dof is pinned as in BlockSolver, with a positive entry since
+    // the active solver adds W to its Schur complement
+    std::unique_ptr<mfem::SparseMatrix> W;
+    if (W_is_nonzero_)
+    {
+        W = make_unique<mfem::SparseMatrix>(mgL.GetW());
+    }
+    else if (remove_one_dof_)
+    {
+        W = make_unique<mfem::SparseMatrix>(mgL.NumVDofs());
+        if (myid_ == 0)
+        {
+            W->Add(0, 0, 1.0);
+        }
+        W->Finalize();
+    }
+
+    if (W)
+    {
+        mfem::HypreParMatrix pW(comm_, hD->M(), hD->RowPart(), W.get());
+        auto active_pW = GatherRows(pW, group_comm_, active_comm_);
+        if (active_pW)
+        {
+            active_W_ = make_unique<mfem::SparseMatrix>(GetDiag(*active_pW));
+        }
+    }
+
+    mfem::SparseMatrix M_proc(mgL.GetM());
+    for (int mm = 0; mm < ess_edofs_.Size(); ++mm)
+    {
+        if (ess_edofs_[mm])
+            M_proc.EliminateRowCol(mm); // assume essential data = 0
+    }
+    BuildSolver(M_proc);
+}
+
+AgglomeratedSolver::~AgglomeratedSolver()
+{
+    // hypre objects have to be destroyed before their communicator
+    active_solver_.reset();
+    active_M_.reset();
+    active_D_.reset();
+
+    if (active_comm_ != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&active_comm_);
+    }
+    MPI_Comm_free(&group_comm_);
+}
+
+void AgglomeratedSolver::BuildSolver(const mfem::SparseMatrix& M_proc)
+{
+    ScopedTimer timer("agglomerated-solver");
+
+    std::unique_ptr<mfem::HypreParMatrix> hM(mgL_.MakeParallelM(M_proc));
+
+    active_solver_.reset();
+    active_M_ = GatherRows(*hM, group_comm_, active_comm_);
+
+    int nnz = 0;
+    if (active_M_)
+    {
+        active_solver_ = make_unique<BlockSolver>(active_M_.get(), active_D_.get(),
+                                                  active_W_.get(), active_offsets_);
+        active_solver_->SetPrintLevel(print_level_);
+        active_solver_->SetMaxIter(max_num_iter_);
+        active_solver_->SetRelTol(rtol_);
+        active_solver_->SetAbsTol(atol_);
+        active_solver_->SetPipelinedKrylov(pipelined_krylov_);
+        nnz = active_solver_->GetNNZ();
+    }
+    MPI_Bcast(&nnz, 1, MPI_INT, 0, group_comm_);
+    nnz_ = nnz;
+}
+
+void AgglomeratedSolver::Gather(const mfem::BlockVector& x, mfem::BlockVector* x_active) const
+{
+    for (int b = 0; b < 2; ++b)
+    {
+        const mfem::Vector& x_b = x.GetBlock(b);
+        double* recv_buf = x_active ? x_active->GetBlock(b).GetData() : nullptr;
+        MPI_Gatherv(x_b.GetData(), x_b.Size(), MPI_DOUBLE, recv_buf, counts_[b].data(),
+                    displs_[b].data(), MPI_DOUBLE, 0, group_comm_);
+    }
+}
+
+void AgglomeratedSolver::Scatter(const mfem::BlockVector* x_active, mfem::BlockVector& x) const
+{
+    for (int b = 0; b < 2; ++b)
+    {
+        mfem::Vector& x_b = x.GetBlock(b);
+        const double* send_buf = x_active ? x_active->GetBlock(b).GetData() : nullptr;
+        MPI_Scatterv(send_buf, counts_[b].data(), displs_[b].data(), MPI_DOUBLE,
+                     x_b.GetData(), x_b.Size(), MPI_DOUBLE, 0, group_comm_);
+    }
+}
+
+void AgglomeratedSolver::Mult(const mfem::BlockVector& rhs, mfem::BlockVector& sol) const
+{
+    mfem::StopWatch chrono;
+    chrono.Start();
+
+    const auto& edof_trueedof = mgL_.GetGraphSpace().EDofToTrueEDof();
+    edof_trueedof.MultTranspose(rhs.GetBlock(0), rhs_.GetBlock(0));
+    rhs_.GetBlock(1) = rhs.GetBlock(1);
+    if (!W_is_nonzero_ && remove_one_dof_ && myid_ == 0)
+    {
+        rhs_.GetBlock(1)[0] = 0.0;
+    }
+
+    mfem::SparseMatrix edof_trueedof_diag = GetDiag(edof_trueedof);
+    edof_trueedof_diag.MultTranspose(sol.GetBlock(0), sol_.GetBlock(0));
+    sol_.GetBlock(1) = sol.GetBlock(1);
+
+    Gather(rhs_, active_rhs_.get());
+    Gather(sol_, active_sol_.get());
+
+    int num_iterations = 0;
+    if (active_solver_)
+    {
+        active_solver_->Mult(*active_rhs_, *active_sol_);
+        num_iterations = active_solver_->GetNumIterations();
+    }
+
+    Scatter(active_sol_.get(), sol_);
+    MPI_Bcast(&num_iterations, 1, MPI_INT, 0, group_comm_);
+    num_iterations_ = num_iterations;
+
+    edof_trueedof.Mult(sol_.GetBlock(0), sol.GetBlock(0));
+    sol.GetBlock(1) = sol_.GetBlock(1);
+
+    if (!W_is_nonzero_ && remove_one_dof_)
+    {
+        Orthogonalize(sol.GetBlock(1));
+    }
+
+    chrono.Stop();
+    timing_ = chrono.RealTime();
+}
+
+void AgglomeratedSolver::Mult(const mfem::Vector& rhs, mfem::Vector& sol) const
+{
+    mfem::BlockVector rhs_dof(mgL_.BlockOffsets());
+    rhs_dof.GetBlock(0) = 0.0;
+    rhs_dof.GetBlock(1) = rhs;
+    rhs_dof.GetBlock(1) *= -1.0;
+
+    mfem::BlockVector sol_dof(mgL_.BlockOffsets());
+    sol_dof = 0.0;
+
+    Mult(rhs_dof, sol_dof);
+
+    sol = sol_dof.GetBlock(1);
+}
+
+void AgglomeratedSolver::UpdateElemScaling(const mfem::Vector& elem_scaling_inverse)
+{
+    auto M_proc = mgL_.GetMBuilder().BuildAssembledM(elem_scaling_inverse);
+    for (int mm = 0; mm < ess_edofs_.Size(); ++mm)
+    {
+        if (ess_edofs_[mm])
+            M_proc.EliminateRowCol(mm); // assume essential data = 0
+    }
+    BuildSolver(M_proc);
+}
+
+void AgglomeratedSolver::SetPrintLevel(int l)
+{
+    print_level_ = l;
+    if (active_solver_)
+    {
+        active_solver_->SetPrintLevel(l);
+    }
+}
+
+void AgglomeratedSolver::SetMaxIter(int it)
+{
+    max_num_iter_ = it;
+    if (active_solver_)
+    {
+        active_solver_->SetMaxIter(it);
+    }
+}
+
+void AgglomeratedSolver::SetRelTol(double rtol)
+{
+    rtol_ = rtol;
+    if (active_solver_)
+    {
+        active_solver_->SetRelTol(rtol);
+    }
+}
+
+void AgglomeratedSolver::SetAbsTol(double atol)
+{
+    atol_ = atol;
+    if (active_solver_)
+    {
+        active_solver_->SetAbsTol(atol);
+    }
+}
+
+void AgglomeratedSolver::SetPipelinedKrylov(bool pipelined)
+{
+    pipelined_krylov_ = pipelined;
+    if (active_solver_)
+    {
+        active_solver_->SetPipelinedKrylov(pipelined);
+    }
+}
+
+} // namespace smoothg
@@ -0,0 +1,109 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file AgglomeratedSolver.hpp
+
+    @brief Solver for small (coarse) mixed systems on fewer processes.
+*/
+
+#ifndef __AGGLOMERATEDSOLVER_HPP__
+#define __AGGLOMERATEDSOLVER_HPP__
+
+#include "BlockSolver.hpp"
+
+namespace smoothg
+{
+
+/**
+   @brief Solve a mixed system on a subset of the processes.
+
+   When a mixed system has only a handful of dofs per process, the solves
+   are dominated by the latency of the communications. This solver gathers
+   the (true dof) matrices of groups of consecutive processes on the first
+   process of each group, and solves the system there with BlockSolver.
+   Right hand sides and solutions are gathered and scattered in Mult, so
+   that the interface (dof numbering on all processes of the original
+   communicator) is the same as the one of BlockSolverFalse.
+*/
+class AgglomeratedSolver : public MixedLaplacianSolver
+{
+public:
+    /**
+       @param mgL the mixed system, M has to be assembled
+       @param ess_attr indicate which boundary attributes to impose essential
+              edge condition. If not provided, will assume no boundary
+       @param min_dofs_per_proc minimal number of dofs (edge and vertex) per
+              process on which the system is solved
+    */
+    AgglomeratedSolver(const MixedMatrix& mgL, const mfem::Array<int>* ess_attr,
+                       int min_dofs_per_proc);
+
+    virtual ~AgglomeratedSolver();
+
+    virtual void Mult(const mfem::BlockVector& rhs, mfem::BlockVector& sol) const;
+
+    virtual void Mult(const mfem::Vector& rhs, mfem::Vector& sol) const;
+
+    /// The agglomerated system is rebuilt (and the preconditioner set up again)
+    virtual void UpdateElemScaling(const mfem::Vector& elem_scaling_inverse);
+
+    virtual void UpdateJacobian(const mfem::Vector& elem_scaling_inverse,
+                                const std::vector<mfem::DenseMatrix>& N_el)
+    {
+        mfem::mfem_error("not implemented!\n");
+    }
+
+    virtual void SetPrintLevel(int l);
+    virtual void SetMaxIter(int it);
+    virtual void SetRelTol(double rtol);
+    virtual void SetAbsTol(double atol);
+    virtual void SetPipelinedKrylov(bool pipelined);
+
+    /// Number of processes on which the system is solved
+    int NumActiveProcs() const { return num_active_procs_; }
+
+private:
+    /// Gather M on the active processes and set up the solver there
+    void BuildSolver(const mfem::SparseMatrix& M_proc);
+
+    /// Gather (scatter) true dof vectors to (from) the active processes,
+    /// x_active is only accessed on the active processes
+    void Gather(const mfem::BlockVector& x, mfem::BlockVector* x_active) const;
+    void Scatter(const mfem::BlockVector* x_active, mfem::BlockVector& x) const;
+
+    const MixedMatrix& mgL_;
+
+    MPI_Comm group_comm_;
+    MPI_Comm active_comm_;
+    int num_active_procs_;
+    bool pipelined_krylov_;
+
+    /// sizes and offsets of the blocks of the processes of the group
+    std::vector<int> counts_[2];
+    std::vector<int> displs_[2];
+
+    mfem::Array<int> active_offsets_;
+    std::unique_ptr<mfem::HypreParMatrix> active_M_;
+    std::unique_ptr<mfem::HypreParMatrix> active_D_;
+    std::unique_ptr<mfem::SparseMatrix> active_W_;
+    std::unique_ptr<BlockSolver> active_solver_;
+
+    std::unique_ptr<mfem::BlockVector> active_rhs_;
+    std::unique_ptr<mfem::BlockVector> active_sol_;
+};
+
+} // namespace smoothg
+
+#endif /* __AGGLOMERATEDSOLVER_HPP__ */
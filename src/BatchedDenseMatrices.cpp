@@ -0,0 +1,250 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file
+
+    @brief Implements BatchedDenseMatrices and the batched kernels
+*/
+
+#include "BatchedDenseMatrices.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace smoothg
+{
+
+BatchedDenseMatrices::BatchedDenseMatrices(int height, int width, int count)
+{
+    SetSize(height, width, count);
+}
+
+void BatchedDenseMatrices::SetSize(int height, int width, int count)
+{
+    height_ = height;
+    width_ = width;
+    count_ = count;
+    data_.assign(height * width * count, 0.0);
+}
+
+void BatchedDenseMatrices::SetMatrix(int b, const mfem::DenseMatrix& A)
+{
+    assert(A.Height() == height_ && A.Width() == width_);
+    assert(b >= 0 && b < count_);
+
+    const double* A_data = A.Data();
+    for (int i = 0; i < height_ * width_; ++i)
+    {
+        data_[i * count_ + b] = A_data[i];
+    }
+}
+
+void BatchedDenseMatrices::GetMatrix(int b, mfem::DenseMatrix& A) const
+{
+    assert(b >= 0 && b < count_);
+
+    A.SetSize(height_, width_);
+    double* A_data = A.Data();
+    for (int i = 0; i < height_ * width_; ++i)
+    {
+        A_data[i] = data_[i * count_ + b];
+    }
+}
+
+BatchedDenseMatrices& BatchedDenseMatrices::operator+=(const BatchedDenseMatrices& B)
+{
+    assert(B.height_ == height_ && B.width_ == width_ && B.count_ == count_);
+
+    for (unsigned int i = 0; i < data_.size(); ++i)
+    {
+        data_[i] += B.data_[i];
+    }
+    return *this;
+}
+
+void BatchedDenseMatrices::InvertSPD()
+{
+    assert(height_ == width_);
+
+    const int size = height_;
+    const int n = count_;
+    double min_pivot = std::numeric_limits<double>::max();
+
+    // Cholesky factorization A = L L^T, L overwrites the lower triangle
+    for (int j = 0; j < size; ++j)
+    {
+        double* L_jj = Entry(j, j);
+        for (int k = 0; k < j; ++k)
+        {
+            const double* L_jk = Entry(j, k);
+            for (int b = 0; b < n; ++b)
+            {
+                L_jj[b] -= L_jk[b] * L_jk[b];
+            }
+        }
+        for (int b = 0; b < n; ++b)
+        {
+            min_pivot = std::min(min_pivot, L_jj[b]);
+            L_jj[b] = std::sqrt(L_jj[b]);
+        }
+
+        for (int i = j + 1; i < size; ++i)
+        {
+            double* L_ij = Entry(i, j);
+            for (int k = 0; k < j; ++k)
+            {
+                const double* L_ik = Entry(i, k);
+                const double* L_jk = Entry(j, k);
+                for (int b = 0; b < n; ++b)
+                {
+                    L_ij[b] -= L_ik[b] * L_jk[b];
+                }
+            }
+            for (int b = 0; b < n; ++b)
+            {
+                L_ij[b] /= L_jj[b];
+            }
+        }
+    }
+
+    MFEM_VERIFY(size == 0 || n == 0 || min_pivot > 0.0,
+                "BatchedDenseMatrices::InvertSPD: matrix is not positive definite!");
+
+    // X = L^{-1} (lower triangular)
+    BatchedDenseMatrices X(size, size, n);
+    for (int j = 0; j < size; ++j)
+    {
+        double* X_jj = X.Entry(j, j);
+        const double* L_jj = Entry(j, j);
+        for (int b = 0; b < n; ++b)
+        {
+            X_jj[b] = 1.0 / L_jj[b];
+        }
+
+        for (int i = j + 1; i < size; ++i)
+        {
+            double* X_ij = X.Entry(i, j);
+            for (int k = j; k < i; ++k)
+            {
+                const double* L_ik = Entry(i, k);
+                const double* X_kj = X.Entry(k, j);
+                for (int b = 0; b < n; ++b)
+                {
+                    X_ij[b] -= L_ik[b] * X_kj[b];
+                }
+            }
+
+            const double* L_ii = Entry(i, i);
+            for (int b = 0; b < n; ++b)
+            {
+                X_ij[b] /= L_ii[b];
+            }
+        }
+    }
+
+    // A^{-1} = X^T X
+    for (int j = 0; j < size; ++j)
+    {
+        for (int i = j; i < size; ++i)
+        {
+            double* A_ij = Entry(i, j);
+            std::fill_n(A_ij, n, 0.0);
+            for (int k = i; k < size; ++k)
+            {
+                const double* X_ki = X.Entry(k, i);
+                const double* X_kj = X.Entry(k, j);
+                for (int b = 0; b < n; ++b)
+                {
+                    A_ij[b] += X_ki[b] * X_kj[b];
+                }
+            }
+            if (i != j)
+            {
+                std::copy_n(A_ij, n, Entry(j, i));
+            }
+        }
+    }
+}
+
+namespace
+{
+
+/// C_b (+)= a * op(A_b) * B_b, op being the identity or the transpose
+void BatchedGemm(const BatchedDenseMatrices& A, bool transpose_A,
+                 const BatchedDenseMatrices& B, BatchedDenseMatrices& C,
+                 double a, bool add)
+{
+    const int m = transpose_A ? A.Width() : A.Height();
+    const int k = transpose_A ? A.Height() : A.Width();
+    const int p = B.Width();
+    const int n = A.Count();
+
+    assert(B.Height() == k && B.Count() == n);
+    if (add)
+    {
+        assert(C.Height() == m && C.Width() == p && C.Count() == n);
+    }
+    else
+    {
+        C.SetSize(m, p, n);
+    }
+
+    for (int j = 0; j < p; ++j)
+    {
+        for (int i = 0; i < m; ++i)
+        {
+            double* C_ij = C.Entry(i, j);
+            for (int l = 0; l < k; ++l)
+            {
+                const double* A_il = transpose_A ? A.Entry(l, i) : A.Entry(i, l);
+                const double* B_lj = B.Entry(l, j);
+                for (int b = 0; b < n; ++b)
+                {
+                    C_ij[b] += a * A_il[b] * B_lj[b];
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+void Mult(const BatchedDenseMatrices& A, const BatchedDenseMatrices& B,
+          BatchedDenseMatrices& C, double a)
+{
+    BatchedGemm(A, false, B, C, a, false);
+}
+
+void AddMult(const BatchedDenseMatrices& A, const BatchedDenseMatrices& B,
+             BatchedDenseMatrices& C, double a)
+{
+    BatchedGemm(A, false, B, C, a, true);
+}
+
+void MultAtB(const BatchedDenseMatrices& A, const BatchedDenseMatrices& B,
+             BatchedDenseMatrices& C, double a)
+{
+    BatchedGemm(A, true, B, C, a, false);
+}
+
+void AddMultAtB(const BatchedDenseMatrices& A, const BatchedDenseMatrices& B,
+                BatchedDenseMatrices& C, double a)
+{
+    BatchedGemm(A, true, B, C, a, true);
+}
+
+} // namespace smoothg
@@ -0,0 +1,144 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file BatchedDenseMatrices.hpp
+
+    @brief Batched kernels for many small dense matrices of the same size.
+
+    Local computations on aggregates and faces involve thousands of tiny
+    dense matrices. Aggregates with the same numbers of local dofs are
+    grouped in batches whose matrices are stored interleaved, so that the
+    innermost loop of every kernel runs over the batch with unit stride and
+    is vectorized by the compiler.
+*/
+
+#ifndef __BATCHEDDENSEMATRICES_HPP__
+#define __BATCHEDDENSEMATRICES_HPP__
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "mfem.hpp"
+
+namespace smoothg
+{
+
+/**
+   @brief A batch of dense matrices of identical size, stored interleaved.
+
+   Entry (row, col) of the Count() matrices is stored contiguously at
+   Entry(row, col), the entries being in column-major order.
+*/
+class BatchedDenseMatrices
+{
+public:
+    BatchedDenseMatrices() = default;
+
+    /// Allocate count matrices of size height x width, initialized to zero
+    BatchedDenseMatrices(int height, int width, int count);
+
+    /// Resize to count matrices of size height x width, set to zero
+    void SetSize(int height, int width, int count);
+
+    int Height() const { return height_; }
+    int Width() const { return width_; }
+
+    /// Number of matrices in the batch
+    int Count() const { return count_; }
+
+    /// Entry (row, col) of all the matrices (Count() contiguous values)
+    double* Entry(int row, int col)
+    {
+        return data_.data() + (row + col * height_) * count_;
+    }
+    const double* Entry(int row, int col) const
+    {
+        return data_.data() + (row + col * height_) * count_;
+    }
+
+    /// Copy A (of size Height() x Width()) into matrix b of the batch
+    void SetMatrix(int b, const mfem::DenseMatrix& A);
+
+    /// Copy matrix b of the batch into A (resized if needed)
+    void GetMatrix(int b, mfem::DenseMatrix& A) const;
+
+    /// Add B (of the same sizes) to this batch
+    BatchedDenseMatrices& operator+=(const BatchedDenseMatrices& B);
+
+    /**
+       @brief Replace every matrix by its inverse.
+
+       The matrices must be symmetric positive definite, they are inverted
+       through a Cholesky factorization without pivoting.
+    */
+    void InvertSPD();
+
+private:
+    int height_ = 0;
+    int width_ = 0;
+    int count_ = 0;
+    std::vector<double> data_;
+};
+
+/// C_b = a * A_b * B_b for every matrix b of the batches
+void Mult(const BatchedDenseMatrices& A, const BatchedDenseMatrices& B,
+          BatchedDenseMatrices& C, double a = 1.0);
+
+/// C_b += a * A_b * B_b for every matrix b of the batches
+void AddMult(const BatchedDenseMatrices& A, const BatchedDenseMatrices& B,
+             BatchedDenseMatrices& C, double a = 1.0);
+
+/// C_b = a * A_b^T * B_b for every matrix b of the batches
+void MultAtB(const BatchedDenseMatrices& A, const BatchedDenseMatrices& B,
+             BatchedDenseMatrices& C, double a = 1.0);
+
+/// C_b += a * A_b^T * B_b for every matrix b of the batches
+void AddMultAtB(const BatchedDenseMatrices& A, const BatchedDenseMatrices& B,
+                BatchedDenseMatrices& C, double a = 1.0);
+
+/**
+   @brief Group the indices of items with equal keys into batches.
+
+   @param keys key of every item, typically its local sizes
+   @param max_count maximal number of items in a batch
+
+   @return batches of item indices, every batch having a single key
+*/
+template <typename Key>
+std::vector<std::vector<int>> MakeBatches(const std::vector<Key>& keys, int max_count = 64)
+{
+    std::map<Key, std::vector<int>> groups;
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        groups[keys[i]].push_back(i);
+    }
+
+    std::vector<std::vector<int>> batches;
+    for (const auto& group : groups)
+    {
+        const std::vector<int>& items = group.second;
+        for (unsigned int begin = 0; begin < items.size(); begin += max_count)
+        {
+            const unsigned int end = std::min<unsigned int>(begin + max_count, items.size());
+            batches.emplace_back(items.begin() + begin, items.begin() + end);
+        }
+    }
+    return batches;
+}
+
+} // namespace smoothg
+
+#endif /* __BATCHEDDENSEMATRICES_HPP__ */
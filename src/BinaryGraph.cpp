@@ -0,0 +1,348 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file
+
+    @brief Implements reading and writing of binary vertex_edge files.
+*/
+
+#include <climits>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BinaryGraph.hpp"
+#include "utilities.hpp"
+
+namespace smoothg
+{
+
+static_assert(sizeof(BinaryGraphHeader) == 48, "Unexpected padding in BinaryGraphHeader!");
+
+const char BinaryGraphHeader::magic_string[8] = {'S', 'M', 'G', 'G', 'R', 'A', 'P', 'H'};
+
+namespace
+{
+
+const uint64_t fnv_offset_basis = 14695981039346656037ULL;
+const uint64_t fnv_prime = 1099511628211ULL;
+
+uint64_t ChecksumUpdate(uint64_t hash, const char* data, uint64_t num_bytes)
+{
+    const uint64_t num_words = num_bytes / sizeof(uint64_t);
+    for (uint64_t i = 0; i < num_words; ++i)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i * sizeof(uint64_t), sizeof(uint64_t));
+        hash = (hash ^ word) * fnv_prime;
+    }
+    for (uint64_t i = num_words * sizeof(uint64_t); i < num_bytes; ++i)
+    {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * fnv_prime;
+    }
+    return hash;
+}
+
+template <typename T>
+void WriteSection(std::ofstream& out, const T* data, uint64_t size, uint64_t& hash)
+{
+    const char* bytes = reinterpret_cast<const char*>(data);
+    out.write(bytes, size * sizeof(T));
+    hash = ChecksumUpdate(hash, bytes, size * sizeof(T));
+}
+
+} // namespace
+
+uint64_t BinaryGraphHeader::Offset(Section section) const
+{
+    const uint64_t i_offset = sizeof(BinaryGraphHeader);
+    const uint64_t j_offset = i_offset + (num_vertices + 1) * sizeof(int);
+    const uint64_t j_end = j_offset + nnz * sizeof(int);
+    const uint64_t data_offset = (j_end + 7) / 8 * 8;
+    const uint64_t weight_offset = data_offset + nnz * sizeof(double);
+    const uint64_t weight_size = (flags & HAS_EDGE_WEIGHT) ? num_edges * sizeof(double) : 0;
+
+    switch (section)
+    {
+        case I_ARRAY:
+            return i_offset;
+        case J_ARRAY:
+            return j_offset;
+        case DATA_ARRAY:
+            return data_offset;
+        case EDGE_WEIGHT:
+            return weight_offset;
+        default:
+            return weight_offset + weight_size;
+    }
+}
+
+uint64_t BinaryGraphChecksum(const char* data, uint64_t num_bytes)
+{
+    return ChecksumUpdate(fnv_offset_basis, data, num_bytes);
+}
+
+void WriteVertexEdgeBinary(const std::string& filename,
+                           const mfem::SparseMatrix& vertex_edge,
+                           const mfem::Vector* edge_weight)
+{
+    MFEM_VERIFY(vertex_edge.Finalized(), "vertex_edge has to be finalized!");
+    MFEM_VERIFY(!edge_weight || edge_weight->Size() == vertex_edge.Width(),
+                "Size of edge_weight does not match number of edges!");
+
+    BinaryGraphHeader header;
+    std::memcpy(header.magic, BinaryGraphHeader::magic_string, sizeof(header.magic));
+    header.version = BinaryGraphHeader::current_version;
+    header.flags = edge_weight ? BinaryGraphHeader::HAS_EDGE_WEIGHT : 0;
+    header.num_vertices = vertex_edge.Height();
+    header.num_edges = vertex_edge.Width();
+    header.nnz = vertex_edge.NumNonZeroElems();
+    header.checksum = 0;
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open())
+        mfem::mfem_error(("Error in opening " + filename + " for writing").c_str());
+
+    // write a placeholder header, the checksum is known only at the end
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    uint64_t hash = fnv_offset_basis;
+    WriteSection(out, vertex_edge.GetI(), header.num_vertices + 1, hash);
+    WriteSection(out, vertex_edge.GetJ(), header.nnz, hash);
+
+    const uint64_t padding = header.Offset(BinaryGraphHeader::DATA_ARRAY) -
+                             header.Offset(BinaryGraphHeader::J_ARRAY) -
+                             header.nnz * sizeof(int);
+    const char zeros[8] = {0};
+    out.write(zeros, padding);
+
+    WriteSection(out, vertex_edge.GetData(), header.nnz, hash);
+    if (edge_weight)
+    {
+        WriteSection(out, edge_weight->GetData(), header.num_edges, hash);
+    }
+
+    header.checksum = hash;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!out.good())
+        mfem::mfem_error(("Error in writing " + filename).c_str());
+}
+
+void ConvertVertexEdgeToBinary(const std::string& text_filename,
+                               const std::string& binary_filename,
+                               const std::string& weight_filename)
+{
+    mfem::SparseMatrix vertex_edge = ReadVertexEdge(text_filename);
+
+    if (weight_filename.empty())
+    {
+        WriteVertexEdgeBinary(binary_filename, vertex_edge);
+        return;
+    }
+
+    std::ifstream weight_file(weight_filename);
+    if (!weight_file.is_open())
+        mfem::mfem_error(("Error in opening " + weight_filename).c_str());
+
+    mfem::Vector edge_weight;
+    edge_weight.Load(weight_file, vertex_edge.Width());
+    WriteVertexEdgeBinary(binary_filename, vertex_edge, &edge_weight);
+}
+
+BinaryGraphFile::BinaryGraphFile(const std::string& filename, bool verify_checksum)
+    : map_(nullptr), map_size_(0), header_(nullptr)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        mfem::mfem_error(("Error in opening the graph file " + filename).c_str());
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(BinaryGraphHeader))
+    {
+        close(fd);
+        mfem::mfem_error((filename + " is not a binary graph file").c_str());
+    }
+
+    // MAP_PRIVATE makes the mapping copy-on-write, SparseMatrix wants non-const
+    map_size_ = file_stat.st_size;
+    void* map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid after the file is closed
+    if (map == MAP_FAILED)
+        mfem::mfem_error(("Error in memory mapping " + filename).c_str());
+
+    map_ = static_cast<char*>(map);
+    header_ = reinterpret_cast<const BinaryGraphHeader*>(map_);
+
+    MFEM_VERIFY(std::memcmp(header_->magic, BinaryGraphHeader::magic_string,
+                            sizeof(header_->magic)) == 0,
+                filename << " is not a binary graph file");
+    MFEM_VERIFY(header_->version == BinaryGraphHeader::current_version,
+                filename << " has unsupported version (or byte order) "
+                << header_->version);
+    MFEM_VERIFY(header_->num_vertices < INT_MAX && header_->num_edges < INT_MAX &&
+                header_->nnz < INT_MAX, filename << " is too large for int indices");
+    MFEM_VERIFY(map_size_ >= header_->Offset(BinaryGraphHeader::END),
+                filename << " is truncated");
+
+    int* I = reinterpret_cast<int*>(map_ + header_->Offset(BinaryGraphHeader::I_ARRAY));
+    int* J = reinterpret_cast<int*>(map_ + header_->Offset(BinaryGraphHeader::J_ARRAY));
+    double* data = reinterpret_cast<double*>(
+                       map_ + header_->Offset(BinaryGraphHeader::DATA_ARRAY));
+    double* weight = reinterpret_cast<double*>(
+                         map_ + header_->Offset(BinaryGraphHeader::EDGE_WEIGHT));
+
+    const int num_vertices = header_->num_vertices;
+    const int num_edges = header_->num_edges;
+    const int nnz = header_->nnz;
+
+    if (verify_checksum)
+    {
+        uint64_t hash = fnv_offset_basis;
+        hash = ChecksumUpdate(hash, (char*)I, (num_vertices + 1) * sizeof(int));
+        hash = ChecksumUpdate(hash, (char*)J, nnz * sizeof(int));
+        hash = ChecksumUpdate(hash, (char*)data, nnz * sizeof(double));
+        if (HasEdgeWeight())
+        {
+            hash = ChecksumUpdate(hash, (char*)weight, num_edges * sizeof(double));
+        }
+        MFEM_VERIFY(hash == header_->checksum, "Checksum mismatch in " << filename);
+    }
+    MFEM_VERIFY(I[0] == 0 && I[num_vertices] == nnz,
+                filename << " has an inconsistent I array");
+
+    // the writer keeps the column order of its input, so sortedness is checked
+    bool sorted = true;
+    for (int i = 0; i < num_vertices; ++i)
+    {
+        MFEM_VERIFY(I[i] <= I[i + 1], filename << " has an inconsistent I array");
+        for (int k = I[i]; k < I[i + 1]; ++k)
+        {
+            MFEM_VERIFY(J[k] >= 0 && J[k] < num_edges, filename << " has an invalid J array");
+            sorted = sorted && (k == I[i] || J[k - 1] < J[k]);
+        }
+    }
+
+    mfem::SparseMatrix vertex_edge(I, J, data, num_vertices, num_edges,
+                                   false, false, sorted);
+    vertex_edge_.Swap(vertex_edge);
+
+    if (HasEdgeWeight())
+    {
+        edge_weight_.SetDataAndSize(weight, num_edges);
+    }
+}
+
+BinaryGraphFile::~BinaryGraphFile()
+{
+    if (map_)
+    {
+        munmap(map_, map_size_);
+    }
+}
+
+ParBinaryGraphFile::ParBinaryGraphFile(MPI_Comm comm, const std::string& filename)
+    : filename_(filename)
+{
+    int err = MPI_File_open(comm, const_cast<char*>(filename.c_str()), MPI_MODE_RDONLY,
+                            MPI_INFO_NULL, &file_);
+    if (err != MPI_SUCCESS)
+        mfem::mfem_error(("Error in opening the graph file " + filename).c_str());
+
+    MPI_File_read_at_all(file_, 0, &header_, sizeof(header_), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    MPI_Offset file_size;
+    MPI_File_get_size(file_, &file_size);
+
+    MFEM_VERIFY(std::memcmp(header_.magic, BinaryGraphHeader::magic_string,
+                            sizeof(header_.magic)) == 0,
+                filename << " is not a binary graph file");
+    MFEM_VERIFY(header_.version == BinaryGraphHeader::current_version,
+                filename << " has unsupported version (or byte order) "
+                << header_.version);
+    MFEM_VERIFY(header_.num_vertices < INT_MAX && header_.num_edges < INT_MAX &&
+                header_.nnz < INT_MAX, filename << " is too large for int indices");
+    MFEM_VERIFY((uint64_t)file_size >= header_.Offset(BinaryGraphHeader::END),
+                filename << " is truncated");
+}
+
+ParBinaryGraphFile::~ParBinaryGraphFile()
+{
+    MPI_File_close(&file_);
+}
+
+mfem::SparseMatrix ParBinaryGraphFile::ReadVertexEdgeRows(int vertex_begin, int vertex_end)
+{
+    MFEM_VERIFY(0 <= vertex_begin && vertex_begin <= vertex_end &&
+                vertex_end <= NumVertices(), "Invalid vertex range!");
+
+    const int num_rows = vertex_end - vertex_begin;
+    std::unique_ptr<int[]> I(new int[num_rows + 1]);
+    MPI_Offset offset = header_.Offset(BinaryGraphHeader::I_ARRAY) +
+                        (MPI_Offset)vertex_begin * sizeof(int);
+    MPI_File_read_at_all(file_, offset, I.get(), num_rows + 1, MPI_INT, MPI_STATUS_IGNORE);
+
+    const int nnz_begin = I[0];
+    const int nnz = I[num_rows] - nnz_begin;
+    MFEM_VERIFY(nnz >= 0, filename_ << " has an inconsistent I array");
+    for (int i = 0; i < num_rows + 1; ++i)
+    {
+        I[i] -= nnz_begin;
+    }
+
+    std::unique_ptr<int[]> J(new int[nnz]);
+    offset = header_.Offset(BinaryGraphHeader::J_ARRAY) + (MPI_Offset)nnz_begin * sizeof(int);
+    MPI_File_read_at_all(file_, offset, J.get(), nnz, MPI_INT, MPI_STATUS_IGNORE);
+
+    std::unique_ptr<double[]> data(new double[nnz]);
+    offset = header_.Offset(BinaryGraphHeader::DATA_ARRAY) +
+             (MPI_Offset)nnz_begin * sizeof(double);
+    MPI_File_read_at_all(file_, offset, data.get(), nnz, MPI_DOUBLE, MPI_STATUS_IGNORE);
+
+    for (int i = 0; i < nnz; ++i)
+    {
+        MFEM_VERIFY(J[i] >= 0 && J[i] < NumEdges(), filename_ << " has an invalid J array");
+    }
+
+    return mfem::SparseMatrix(I.release(), J.release(), data.release(),
+                              num_rows, NumEdges());
+}
+
+mfem::Vector ParBinaryGraphFile::ReadEdgeWeight(int edge_begin, int edge_end)
+{
+    MFEM_VERIFY(0 <= edge_begin && edge_begin <= edge_end && edge_end <= NumEdges(),
+                "Invalid edge range!");
+
+    mfem::Vector edge_weight(edge_end - edge_begin);
+    if (header_.flags & BinaryGraphHeader::HAS_EDGE_WEIGHT)
+    {
+        const MPI_Offset offset = header_.Offset(BinaryGraphHeader::EDGE_WEIGHT) +
+                                  (MPI_Offset)edge_begin * sizeof(double);
+        MPI_File_read_at_all(file_, offset, edge_weight.GetData(), edge_weight.Size(),
+                             MPI_DOUBLE, MPI_STATUS_IGNORE);
+    }
+    else
+    {
+        edge_weight = 1.0;
+    }
+    return edge_weight;
+}
+
+} // namespace smoothg
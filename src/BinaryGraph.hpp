@@ -0,0 +1,190 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file BinaryGraph.hpp
+
+    @brief Binary (memory-mappable) file format for vertex_edge tables.
+
+    The text format read by ReadVertexEdge() has to be parsed token by token,
+    which dominates the setup time for very large graphs. The binary format
+    here stores the same CSR arrays in native byte order so that a file can
+    be memory-mapped and used as an mfem::SparseMatrix directly.
+*/
+
+#ifndef __BINARYGRAPH_HPP__
+#define __BINARYGRAPH_HPP__
+
+#include <cstdint>
+#include <string>
+
+#include <mpi.h>
+#include "mfem.hpp"
+
+namespace smoothg
+{
+
+/**
+   @brief Header of a binary vertex_edge file (version 1).
+
+   The header is followed by the payload, with each section starting at the
+   offset returned by BinaryGraphHeader::Offset():
+
+   - I array of vertex_edge, num_vertices + 1 ints
+   - J array of vertex_edge, nnz ints
+   - zero padding to an 8-byte boundary
+   - data array of vertex_edge, nnz doubles
+   - (if flags & HAS_EDGE_WEIGHT) edge weights, num_edges doubles
+
+   The checksum is computed over the I, J, data and edge weight sections in
+   this order, the padding is not included, see BinaryGraphChecksum(). The
+   columns of a row are not required to be sorted.
+*/
+struct BinaryGraphHeader
+{
+    enum Flags { HAS_EDGE_WEIGHT = 1 };
+    enum Section { I_ARRAY, J_ARRAY, DATA_ARRAY, EDGE_WEIGHT, END };
+
+    static const char magic_string[8];
+    static const uint32_t current_version = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t num_vertices;
+    uint64_t num_edges;
+    uint64_t nnz;
+    uint64_t checksum;
+
+    /// @return byte offset (from start of file) of a section of the payload
+    uint64_t Offset(Section section) const;
+};
+
+/// 64-bit FNV-1a style hash of a byte range, processed one word at a time
+uint64_t BinaryGraphChecksum(const char* data, uint64_t num_bytes);
+
+/**
+   @brief Write vertex_edge (and optionally edge weights) in binary format.
+
+   @param filename name of the file to be written
+   @param vertex_edge vertex to edge table
+   @param edge_weight if not nullptr, edge weights stored along the graph
+*/
+void WriteVertexEdgeBinary(const std::string& filename,
+                           const mfem::SparseMatrix& vertex_edge,
+                           const mfem::Vector* edge_weight = nullptr);
+
+/**
+   @brief Convert a graph in the text format of ReadVertexEdge() to binary.
+
+   @param text_filename graph in text CSR format
+   @param binary_filename name of the binary file to be written
+   @param weight_filename if not empty, text file of edge weights (one per
+          edge) to be stored in the binary file
+*/
+void ConvertVertexEdgeToBinary(const std::string& text_filename,
+                               const std::string& binary_filename,
+                               const std::string& weight_filename = "");
+
+/**
+   @brief Read-only view of a memory-mapped binary vertex_edge file.
+
+   VertexToEdge() and EdgeWeight() refer directly to the mapped memory, so no
+   copy of the graph is made and they are only valid during the lifetime of
+   this object. The mapping is private (copy-on-write), so modifying these
+   objects never changes the file.
+*/
+class BinaryGraphFile
+{
+public:
+    /**
+       @param filename binary graph file written by WriteVertexEdgeBinary()
+       @param verify_checksum whether to verify the checksum of the payload
+    */
+    BinaryGraphFile(const std::string& filename, bool verify_checksum = true);
+
+    ~BinaryGraphFile();
+
+    BinaryGraphFile(const BinaryGraphFile&) = delete;
+    BinaryGraphFile& operator=(const BinaryGraphFile&) = delete;
+
+    const BinaryGraphHeader& Header() const { return *header_; }
+
+    const mfem::SparseMatrix& VertexToEdge() const { return vertex_edge_; }
+
+    bool HasEdgeWeight() const
+    {
+        return header_->flags & BinaryGraphHeader::HAS_EDGE_WEIGHT;
+    }
+
+    /// Edge weights stored in the file, empty if HasEdgeWeight() is false
+    const mfem::Vector& EdgeWeight() const { return edge_weight_; }
+
+private:
+    char* map_;
+    size_t map_size_;
+    const BinaryGraphHeader* header_;
+
+    mfem::SparseMatrix vertex_edge_;
+    mfem::Vector edge_weight_;
+};
+
+/**
+   @brief Collective (MPI-IO) reader of slices of a binary vertex_edge file.
+
+   Every process only reads the parts of the file it asks for, so the global
+   graph is never held by any single process. All the Read methods are
+   collective over the communicator. The checksum is not verified since no
+   process sees the whole payload.
+*/
+class ParBinaryGraphFile
+{
+public:
+    /// Open filename and read its header (collective)
+    ParBinaryGraphFile(MPI_Comm comm, const std::string& filename);
+
+    ~ParBinaryGraphFile();
+
+    ParBinaryGraphFile(const ParBinaryGraphFile&) = delete;
+    ParBinaryGraphFile& operator=(const ParBinaryGraphFile&) = delete;
+
+    const BinaryGraphHeader& Header() const { return header_; }
+
+    int NumVertices() const { return header_.num_vertices; }
+
+    int NumEdges() const { return header_.num_edges; }
+
+    /**
+       @brief Read rows vertex_begin, ..., vertex_end - 1 of vertex_edge
+
+       @return the rows of vertex_edge, columns are in global edge numbering
+    */
+    mfem::SparseMatrix ReadVertexEdgeRows(int vertex_begin, int vertex_end);
+
+    /**
+       @brief Read weights of edges edge_begin, ..., edge_end - 1
+
+       If the file has no edge weights, the returned weights are all one.
+    */
+    mfem::Vector ReadEdgeWeight(int edge_begin, int edge_end);
+
+private:
+    MPI_File file_;
+    std::string filename_;
+    BinaryGraphHeader header_;
+};
+
+} // namespace smoothg
+
+#endif /* __BINARYGRAPH_HPP__ */
@@ -21,7 +21,9 @@
 
 #include "BlockSolver.hpp"
 #include "utilities.hpp"
+#include "Timer.hpp"
 #include <assert.h>
+#include <algorithm>
 
 namespace smoothg
 {
@@ -45,6 +47,8 @@ void BlockSolver::Init(mfem::HypreParMatrix* M, mfem::HypreParMatrix* D,
 {
     assert(M && D);
 
+    ScopedTimer timer("block-init");
+
     if (!hDt_)
     {
         hDt_.reset(D->Transpose());
@@ -58,43 +62,150 @@ void BlockSolver::Init(mfem::HypreParMatrix* M, mfem::HypreParMatrix* D,
         operator_.SetBlock(1, 1, W, -1.0);
     }
 
-    mfem::Vector Md;
-    M->GetDiag(Md);
-    hDt_->InvScaleRows(Md);
-    schur_block_.reset(mfem::ParMult(D, hDt_.get()));
-    hDt_->ScaleRows(Md);
+    schur_pattern_.reset();
+    {
+        ScopedTimer schur_timer("schur-complement");
+        if (diagonal_schur_)
+        {
+            schur_block_.reset();
+            schur_diag_.reset();
+            ComputeDiagonalSchur(*M, *D, W);
+        }
+        else
+        {
+            mfem::Vector Md;
+            M->GetDiag(Md);
+            hDt_->InvScaleRows(Md);
+            schur_block_.reset(mfem::ParMult(D, hDt_.get()));
+            hDt_->ScaleRows(Md);
+        }
+    }
 
     nnz_ = M->NNZ() + D->NNZ() + hDt_->NNZ();
 
     if (W_is_nonzero_)
     {
         nnz_ += W->NumNonZeroElems();
-        GetDiag(*schur_block_).Add(1.0, *W);
+        if (!diagonal_schur_)
+        {
+            GetDiag(*schur_block_).Add(1.0, *W);
+        }
     }
     else if (remove_one_dof_)
     {
         nnz_ += 1;
     }
 
-    Mprec_.reset(new mfem::HypreDiagScale(*M));
-    Sprec_.reset(new mfem::HypreBoomerAMG(*schur_block_));
-    Sprec_->SetPrintLevel(0);
-    schur_block_->EliminateZeroRows();
+    {
+        ScopedTimer prec_timer("preconditioner");
+        Mprec_.reset(new mfem::HypreDiagScale(*M));
+        Sprec_ = MakeSchurPreconditioner();
+        schur_block_->EliminateZeroRows();
+    }
 
     prec_.SetDiagonalBlock(0, Mprec_.get());
     prec_.SetDiagonalBlock(1, Sprec_.get());
 
     solver_ = InitKrylovSolver(KrylovMethod::MINRES);
-    solver_->SetPreconditioner(prec_);
-    solver_->SetOperator(operator_);
+    SetKrylovPreconditioner(prec_);
+    SetKrylovOperator(operator_);
+    external_prec_ = false;
+}
+
+void BlockSolver::ComputeDiagonalSchur(const mfem::HypreParMatrix& M,
+                                       const mfem::HypreParMatrix& D,
+                                       const mfem::SparseMatrix* W)
+{
+    if (!hD_squared_)
+    {
+        hD_squared_ = Copy(D);
+        mfem::SparseMatrix D2_diag = GetDiag(*hD_squared_);
+        mfem::SparseMatrix D2_offd = GetOffd(*hD_squared_);
+        for (int i = 0; i < D2_diag.NumNonZeroElems(); ++i)
+        {
+            D2_diag.GetData()[i] *= D2_diag.GetData()[i];
+        }
+        for (int i = 0; i < D2_offd.NumNonZeroElems(); ++i)
+        {
+            D2_offd.GetData()[i] *= D2_offd.GetData()[i];
+        }
+    }
+
+    mfem::Vector M_inv;
+    M.GetDiag(M_inv);
+    for (int i = 0; i < M_inv.Size(); ++i)
+    {
+        M_inv[i] = 1.0 / M_inv[i];
+    }
+
+    // diag(D diag(M)^{-1} D^T)_i = sum_k D_ik^2 / M_kk
+    mfem::Vector schur_diag(hD_squared_->Height());
+    hD_squared_->Mult(M_inv, schur_diag);
+
+    if (W_is_nonzero_)
+    {
+        mfem::Vector W_diag;
+        W->GetDiag(W_diag);
+        schur_diag += W_diag;
+    }
+
+    for (int i = 0; i < schur_diag.Size(); ++i)
+    {
+        if (schur_diag[i] == 0.0)
+        {
+            schur_diag[i] = 1.0; // as EliminateZeroRows()
+        }
+    }
+
+    if (schur_diag_)
+    {
+        // schur_block_ shares the values of schur_diag_
+        std::copy_n(schur_diag.GetData(), schur_diag.Size(), schur_diag_->GetData());
+        return;
+    }
+
+    schur_diag_ = make_unique<mfem::SparseMatrix>(schur_diag.Size());
+    for (int i = 0; i < schur_diag.Size(); ++i)
+    {
+        schur_diag_->Add(i, i, schur_diag[i]);
+    }
+    schur_diag_->Finalize();
+
+    auto& D_ref = const_cast<mfem::HypreParMatrix&>(D);
+    schur_block_ = make_unique<mfem::HypreParMatrix>(comm_, D_ref.M(), D_ref.RowPart(),
+                                                     schur_diag_.get());
+}
+
+std::unique_ptr<mfem::HypreSolver> BlockSolver::MakeSchurPreconditioner() const
+{
+    if (diagonal_schur_)
+    {
+        return make_unique<mfem::HypreDiagScale>(*schur_block_);
+    }
+
+    auto amg = make_unique<mfem::HypreBoomerAMG>(*schur_block_);
+    amg->SetPrintLevel(0);
+    return std::move(amg);
+}
+
+void BlockSolver::SetPreconditioner(mfem::Solver& prec)
+{
+    const bool iterative_mode = solver_->iterative_mode;
+    solver_ = InitKrylovSolver(KrylovMethod::GMRES);
+    solver_->iterative_mode = iterative_mode;
+    SetKrylovOperator(operator_);
+    SetKrylovPreconditioner(prec);
+    external_prec_ = true;
 }
 
 BlockSolver::BlockSolver(const MixedMatrix& mgL,
-                         const mfem::Array<int>* ess_attr)
+                         const mfem::Array<int>* ess_attr,
+                         bool diagonal_schur)
     :
     MixedLaplacianSolver(mgL.GetComm(), mgL.BlockTrueOffsets(), mgL.CheckW()),
     operator_(mgL.BlockTrueOffsets()),
-    prec_(mgL.BlockTrueOffsets())
+    prec_(mgL.BlockTrueOffsets()),
+    diagonal_schur_(diagonal_schur)
 {
     MixedLaplacianSolver::Init(mgL, ess_attr);
 
@@ -163,7 +274,7 @@ void BlockSolver::Mult(const mfem::BlockVector& rhs,
 
     if (myid_ == 0 && print_level_ > 0)
     {
-        std::string solver_name = is_symmetric_ ? "Minres" : "GMRES";
+        std::string solver_name = (is_symmetric_ && !external_prec_) ? "Minres" : "GMRES";
 
         std::cout << "  Timing " + solver_name + ": Solver done in "
                   << timing_ << "s. \n";
@@ -197,9 +308,22 @@ void BlockSolverFalse::UpdateElemScaling(const mfem::Vector& elem_scaling_invers
             M_proc.EliminateRowCol(mm); // assume essential data = 0
     }
 
-    hM_.reset(mixed_matrix_.MakeParallelM(M_proc));
+    std::unique_ptr<mfem::HypreParMatrix> hM(mixed_matrix_.MakeParallelM(M_proc));
 
-    Init(hM_.get(), hD_.get(), W_.get());
+    // after UpdateJacobian, the operator no longer has the structure assumed here;
+    // an external preconditioner was set up for the old values and is replaced
+    // by the default one, so the in-place update does not apply either
+    if (is_symmetric_ && !external_prec_ && CopyValuesIfSamePattern(*hM, *hM_))
+    {
+        UpdateSchurComplement();
+    }
+    else
+    {
+        hM_ = std::move(hM);
+        Init(hM_.get(), hD_.get(), W_.get());
+        num_prec_setups_++;
+        amg_reference_iterations_ = -1;
+    }
 
     if (myid_ == 0 && print_level_ > 0)
     {
@@ -208,11 +332,95 @@ void BlockSolverFalse::UpdateElemScaling(const mfem::Vector& elem_scaling_invers
     }
 }
 
+void BlockSolverFalse::UpdateSchurComplement()
+{
+    ScopedTimer timer("schur-update");
+
+    if (diagonal_schur_)
+    {
+        // the Jacobi preconditioner reads the updated values, no setup needed
+        ComputeDiagonalSchur(*hM_, *hD_, W_.get());
+        return;
+    }
+
+    std::unique_ptr<mfem::HypreParMatrix> schur;
+    bool same_pattern = true;
+    if (reuse_schur_pattern_)
+    {
+        if (!schur_pattern_)
+        {
+            schur_pattern_ = make_unique<ScaledProductPattern>(*hD_, *schur_block_);
+        }
+
+        mfem::Vector M_inv;
+        hM_->GetDiag(M_inv);
+        for (int i = 0; i < M_inv.Size(); ++i)
+        {
+            M_inv[i] = 1.0 / M_inv[i];
+        }
+        schur_pattern_->Update(M_inv, *schur_block_);
+
+        if (W_is_nonzero_)
+        {
+            GetDiag(*schur_block_).Add(1.0, *W_);
+        }
+        schur_block_->EliminateZeroRows();
+    }
+    else
+    {
+        mfem::Vector Md;
+        hM_->GetDiag(Md);
+        hDt_->InvScaleRows(Md);
+        schur.reset(mfem::ParMult(hD_.get(), hDt_.get()));
+        hDt_->ScaleRows(Md);
+
+        if (W_is_nonzero_)
+        {
+            GetDiag(*schur).Add(1.0, *W_);
+        }
+        schur->EliminateZeroRows();
+
+        same_pattern = CopyValuesIfSamePattern(*schur, *schur_block_);
+    }
+
+    // iteration counts are global, so all processes make the same decision
+    const int reference_iterations = std::max(amg_reference_iterations_, 1);
+    const bool degraded = amg_reference_iterations_ >= 0 &&
+                          num_iterations_ > amg_reuse_ratio_ * reference_iterations;
+    const bool reuse_amg = amg_reuse_ratio_ > 0.0 && !degraded;
+
+    if (same_pattern && reuse_amg)
+    {
+        return;
+    }
+
+    Sprec_.reset();
+    if (!same_pattern)
+    {
+        schur_block_ = std::move(schur);
+    }
+
+    Sprec_ = MakeSchurPreconditioner();
+    prec_.SetDiagonalBlock(1, Sprec_.get());
+
+    num_prec_setups_++;
+    amg_reference_iterations_ = -1;
+}
+
+void BlockSolverFalse::RecordReferenceIterations() const
+{
+    if (amg_reference_iterations_ < 0)
+    {
+        amg_reference_iterations_ = num_iterations_;
+    }
+}
+
 
 BlockSolverFalse::BlockSolverFalse(const MixedMatrix& mgL,
-                                   const mfem::Array<int>* ess_attr)
+                                   const mfem::Array<int>* ess_attr,
+                                   bool diagonal_schur)
     :
-    BlockSolver(mgL, ess_attr),
+    BlockSolver(mgL, ess_attr, diagonal_schur),
     mixed_matrix_(mgL)
 {
 }
@@ -229,6 +437,7 @@ void BlockSolverFalse::Mult(const mfem::BlockVector& rhs,
     sol_.GetBlock(1) = sol.GetBlock(1);
 
     BlockSolver::Mult(rhs_, sol_);
+    RecordReferenceIterations();
 
     edof_trueedof.Mult(sol_.GetBlock(0), sol.GetBlock(0));
     sol.GetBlock(1) = sol_.GetBlock(1);
@@ -241,6 +450,7 @@ void BlockSolverFalse::Mult(const mfem::Vector& rhs, mfem::Vector& sol) const
     rhs_.GetBlock(1) *= -1.0;
 
     BlockSolver::Mult(rhs_, sol_);
+    RecordReferenceIterations();
 
     sol = sol_.GetBlock(1);
 }
@@ -311,14 +521,18 @@ void BlockSolverFalse::UpdateJacobian(const mfem::Vector& elem_scaling_inverse,
     }
 
     block_01_->ScaleRows(Md);
-    Sprec_.reset(new mfem::HypreBoomerAMG(*schur_block_));
-    Sprec_->SetPrintLevel(0);
+    schur_pattern_.reset();
+    schur_diag_.reset();
+    Sprec_ = MakeSchurPreconditioner();
     prec_.SetDiagonalBlock(1, Sprec_.get());
+    num_prec_setups_++;
+    amg_reference_iterations_ = -1;
 
     solver_ = InitKrylovSolver(KrylovMethod::GMRES);
-    solver_->SetOperator(operator_);
-    solver_->SetPreconditioner(prec_);
+    SetKrylovOperator(operator_);
+    SetKrylovPreconditioner(prec_);
     solver_->iterative_mode = false;
+    external_prec_ = false;
 
     is_symmetric_ = false;
 
@@ -71,15 +71,32 @@ public:
 
     /**
        @brief Constructor from a single MixedMatrix
+
+       @param diagonal_schur precondition the Schur complement block with
+              the diagonal of D diag(M)^{-1} D^T + W (no sparse product and
+              no AMG setup) instead of BoomerAMG on the full product
     */
     BlockSolver(const MixedMatrix& mgL,
-                const mfem::Array<int>* ess_attr = nullptr);
+                const mfem::Array<int>* ess_attr = nullptr,
+                bool diagonal_schur = false);
 
     /**
        @brief Use block-preconditioned MINRES to solve the problem.
     */
     virtual void Mult(const mfem::BlockVector& rhs, mfem::BlockVector& sol) const;
 
+    /**
+       @brief Use prec (acting on true dofs) instead of the block diagonal
+       preconditioner, with GMRES as Krylov solver.
+
+       This is meant for nonsymmetric preconditioners such as
+       HierarchyPreconditioner. prec is not owned and is not updated with the
+       system: UpdateElemScaling and UpdateJacobian discard it and restore the
+       block diagonal preconditioner (with a full setup), so SetPreconditioner
+       has to be called again with a preconditioner built for the new system.
+    */
+    void SetPreconditioner(mfem::Solver& prec);
+
     virtual void UpdateJacobian(const mfem::Vector& elem_scaling_inverse,
                                 const std::vector<mfem::DenseMatrix>& N_el)
     {
@@ -95,6 +112,13 @@ protected:
     void Init(mfem::HypreParMatrix* M, mfem::HypreParMatrix* D,
               mfem::SparseMatrix* W);
 
+    /// Set (or update in place) schur_block_ to diag(D diag(M)^{-1} D^T + W)
+    void ComputeDiagonalSchur(const mfem::HypreParMatrix& M, const mfem::HypreParMatrix& D,
+                              const mfem::SparseMatrix* W);
+
+    /// BoomerAMG, or Jacobi if diagonal_schur_, for schur_block_
+    std::unique_ptr<mfem::HypreSolver> MakeSchurPreconditioner() const;
+
     mfem::BlockOperator operator_;
     mfem::BlockDiagonalPreconditioner prec_;
 
@@ -107,7 +131,16 @@ protected:
     std::unique_ptr<mfem::HypreParMatrix> hDt_;
 
     std::unique_ptr<mfem::HypreDiagScale> Mprec_;
-    std::unique_ptr<mfem::HypreBoomerAMG> Sprec_;
+    std::unique_ptr<mfem::HypreSolver> Sprec_;
+
+    bool external_prec_ = false;
+
+    bool diagonal_schur_ = false;
+    std::unique_ptr<mfem::SparseMatrix> schur_diag_;
+    std::unique_ptr<mfem::HypreParMatrix> hD_squared_;
+
+    /// symbolic product of the Schur complement, valid for the current schur_block_
+    std::unique_ptr<ScaledProductPattern> schur_pattern_;
 };
 
 /**
@@ -117,20 +150,64 @@ class BlockSolverFalse : public BlockSolver
 {
 public:
     BlockSolverFalse(const MixedMatrix& mgL,
-                     const mfem::Array<int>* ess_attr = nullptr);
+                     const mfem::Array<int>* ess_attr = nullptr,
+                     bool diagonal_schur = false);
 
     virtual void Mult(const mfem::BlockVector& rhs, mfem::BlockVector& sol) const;
 
     virtual void Mult(const mfem::Vector& rhs, mfem::Vector& sol) const;
 
+    /**
+       @brief Update the solver for a new element scaling of M.
+
+       The values of M and of the Schur complement D diag(M)^{-1} D^T are
+       updated in place, their sparsity patterns do not change. The AMG
+       hierarchy of the Schur complement is kept (only its finest level sees
+       the new values) as long as the iteration count of the solves stays
+       within the reuse ratio of the one right after the last AMG setup, see
+       SetAMGReuseRatio().
+    */
     virtual void UpdateElemScaling(const mfem::Vector& elem_scaling_inverse);
 
     virtual void UpdateJacobian(const mfem::Vector& elem_scaling_inverse,
                                 const std::vector<mfem::DenseMatrix>& N_el) override;
 
+    /**
+       @brief Allow reusing the AMG hierarchy in UpdateElemScaling().
+
+       The AMG setup is redone when the last iteration count exceeds ratio
+       times the iteration count of the first solve after the last setup.
+       A non-positive ratio means the setup is redone at every update.
+    */
+    void SetAMGReuseRatio(double ratio) { amg_reuse_ratio_ = ratio; }
+
+    /**
+       @brief Keep the symbolic product of the Schur complement in
+       UpdateElemScaling().
+
+       The pattern of D diag(M)^{-1} D^T and the entries of D contributing to
+       every nonzero are recorded at the first update, later updates compute
+       the values in place instead of forming a new sparse product.
+    */
+    void SetSchurPatternReuse(bool reuse) { reuse_schur_pattern_ = reuse; }
+
+    /// Number of preconditioner setups, including the one in the constructor
+    int GetNumPreconditionerSetups() const { return num_prec_setups_; }
+
 private:
+    /// Recompute the values of schur_block_ from the current hM_
+    void UpdateSchurComplement();
+
+    /// Record the iteration count of the first solve after an AMG setup
+    void RecordReferenceIterations() const;
+
     const MixedMatrix& mixed_matrix_;
     std::unique_ptr<mfem::HypreParMatrix> block_01_;
+
+    double amg_reuse_ratio_ = 0.0;
+    bool reuse_schur_pattern_ = false;
+    int num_prec_setups_ = 1;
+    mutable int amg_reference_iterations_ = -1;
 };
 
 } // namespace smoothg
@@ -18,7 +18,11 @@
     @brief Implements Graph object.
 */
 
+#include <algorithm>
+
+#include "smoothG_config.h"
 #include "Graph.hpp"
+#include "BinaryGraph.hpp"
 #include "MetisGraphPartitioner.hpp"
 
 #if SMOOTHG_USE_PARMETIS
@@ -40,6 +44,14 @@ Graph::Graph(MPI_Comm comm,
     Init(*edge_trueedge_, edge_bdratt);
 }
 
+Graph::Graph(MPI_Comm comm, const std::string& filename,
+             const mfem::Array<int>& vertex_starts)
+{
+    ReadDistributed(comm, filename, vertex_starts);
+    const mfem::SparseMatrix* edge_bdratt = nullptr;
+    Init(*edge_trueedge_, edge_bdratt);
+}
+
 Graph::Graph(const mfem::SparseMatrix& vertex_edge_local,
              const mfem::HypreParMatrix& edge_trueedge,
              const mfem::Vector& edge_weight_local,
@@ -176,6 +188,122 @@ void Graph::Distribute(MPI_Comm comm,
     SplitEdgeWeight(edge_weight_local);
 }
 
+#if SMOOTHG_USE_PARMETIS
+namespace
+{
+
+/**
+   Vertex to vertex table of the vertices slice_starts[myid], ...,
+   slice_starts[myid + 1] - 1 (columns in global numbering), built from the
+   rows of the slice only: the other vertex of each edge is found through
+   a directory of edges distributed over the processes, like in
+   Graph::ReadDistributed, rather than from a transpose of vert_edge_global.
+*/
+mfem::SparseMatrix SliceVertexToVertex(MPI_Comm comm,
+                                       const mfem::SparseMatrix& vert_edge_global,
+                                       const mfem::Array<int>& slice_starts)
+{
+    int num_procs;
+    int myid;
+    MPI_Comm_size(comm, &num_procs);
+    MPI_Comm_rank(comm, &myid);
+
+    const int nedges_global = vert_edge_global.Width();
+    const int vertex_begin = slice_starts[myid];
+    const int slice_size = slice_starts[myid + 1] - vertex_begin;
+    const int* ve_i = vert_edge_global.GetI();
+    const int* ve_j = vert_edge_global.GetJ();
+
+    // Edge e is registered in the directory of processor p if
+    // dir_starts[p] <= e < dir_starts[p + 1]
+    std::vector<int> dir_starts(num_procs + 1);
+    for (int p = 0; p < num_procs + 1; p++)
+        dir_starts[p] = (long long)nedges_global * p / num_procs;
+
+    // Requests (edge, vertex) for all edges of the vertices in the slice
+    std::vector<std::vector<int>> requests(num_procs);
+    for (int i = 0; i < slice_size; i++)
+    {
+        for (int k = ve_i[vertex_begin + i]; k < ve_i[vertex_begin + i + 1]; k++)
+        {
+            const int e = ve_j[k];
+            const int p = std::upper_bound(dir_starts.begin(), dir_starts.end(), e)
+                          - dir_starts.begin() - 1;
+            requests[p].push_back(e);
+            requests[p].push_back(vertex_begin + i);
+        }
+    }
+
+    std::vector<int> send_counts(num_procs), send_displs(num_procs + 1, 0);
+    for (int p = 0; p < num_procs; p++)
+    {
+        send_counts[p] = requests[p].size();
+        send_displs[p + 1] = send_displs[p] + send_counts[p];
+    }
+    std::vector<int> send_buffer(send_displs[num_procs]);
+    for (int p = 0; p < num_procs; p++)
+    {
+        std::copy(requests[p].begin(), requests[p].end(), send_buffer.begin() + send_displs[p]);
+    }
+
+    std::vector<int> recv_counts(num_procs), recv_displs(num_procs + 1, 0);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    for (int p = 0; p < num_procs; p++)
+        recv_displs[p + 1] = recv_displs[p] + recv_counts[p];
+
+    std::vector<int> dir_requests(recv_displs[num_procs]);
+    MPI_Alltoallv(send_buffer.data(), send_counts.data(), send_displs.data(), MPI_INT,
+                  dir_requests.data(), recv_counts.data(), recv_displs.data(), MPI_INT,
+                  comm);
+
+    // Directory: record the (at most two) vertices of each edge
+    const int dir_begin = dir_starts[myid];
+    const int dir_size = dir_starts[myid + 1] - dir_begin;
+    std::vector<int> first_vertex(dir_size, -1), second_vertex(dir_size, -1);
+    for (unsigned int k = 0; k < dir_requests.size(); k += 2)
+    {
+        const int e = dir_requests[k] - dir_begin;
+        if (first_vertex[e] < 0)
+        {
+            first_vertex[e] = dir_requests[k + 1];
+        }
+        else
+        {
+            MFEM_VERIFY(second_vertex[e] < 0,
+                        "Edge " << dir_requests[k] << " has more than two vertices!");
+            second_vertex[e] = dir_requests[k + 1];
+        }
+    }
+
+    // Reply to each request with the other vertex of the edge (-1 if none)
+    for (unsigned int k = 0; k < dir_requests.size(); k += 2)
+    {
+        const int e = dir_requests[k] - dir_begin;
+        dir_requests[k] = (first_vertex[e] == dir_requests[k + 1]) ?
+                          second_vertex[e] : first_vertex[e];
+    }
+
+    MPI_Alltoallv(dir_requests.data(), recv_counts.data(), recv_displs.data(), MPI_INT,
+                  send_buffer.data(), send_counts.data(), send_displs.data(), MPI_INT,
+                  comm);
+
+    // Replies are (other vertex, vertex) pairs
+    mfem::SparseMatrix vert_vert_slice(slice_size, vert_edge_global.Height());
+    for (unsigned int k = 0; k < send_buffer.size(); k += 2)
+    {
+        if (send_buffer[k] >= 0)
+        {
+            vert_vert_slice.Add(send_buffer[k + 1] - vertex_begin, send_buffer[k], 1.0);
+        }
+    }
+    vert_vert_slice.Finalize();
+
+    return vert_vert_slice;
+}
+
+} // namespace
+#endif // SMOOTHG_USE_PARMETIS
+
 void Graph::DistributeVertexEdge(MPI_Comm comm,
                                  const mfem::SparseMatrix& vert_edge_global)
 {
@@ -187,9 +315,31 @@ void Graph::DistributeVertexEdge(MPI_Comm comm,
     MPI_Comm_size(comm, &num_procs);
     MPI_Comm_rank(comm, &myid);
 
-    mfem::SparseMatrix vert_vert = AAt(vert_edge_global);
     mfem::Array<int> partition;
+#if SMOOTHG_USE_PARMETIS
+    // Each process partitions the vertex to vertex table of a slice of vertices
+    const int nvertices_global = vert_edge_global.Height();
+    mfem::Array<int> slice_starts(num_procs + 1);
+    for (int p = 0; p < num_procs + 1; p++)
+        slice_starts[p] = (long long)nvertices_global * p / num_procs;
+
+    mfem::SparseMatrix vert_vert_slice = SliceVertexToVertex(comm, vert_edge_global,
+                                                             slice_starts);
+
+    mfem::Array<int> slice_partition;
+    ParPartition(comm, vert_vert_slice, slice_starts, slice_partition, num_procs);
+
+    mfem::Array<int> slice_sizes(num_procs);
+    for (int p = 0; p < num_procs; p++)
+        slice_sizes[p] = slice_starts[p + 1] - slice_starts[p];
+    partition.SetSize(nvertices_global);
+    MPI_Allgatherv(slice_partition.GetData(), slice_partition.Size(), MPI_INT,
+                   partition.GetData(), slice_sizes.GetData(), slice_starts.GetData(),
+                   MPI_INT, comm);
+#else
+    mfem::SparseMatrix vert_vert = AAt(vert_edge_global);
     Partition(vert_vert, partition, num_procs);
+#endif
 
     // Construct processor to vertex/edge from global partition
     mfem::SparseMatrix proc_vert = PartitionToMatrix(partition, num_procs);
@@ -229,6 +379,19 @@ void Graph::MakeEdgeTrueEdge(MPI_Comm comm, int myid, const mfem::SparseMatrix&
     for (int i = 0; i < ntedges_global; i++)
         tedge_old2new[i] = tedge_couters[edge_proc.GetRowColumns(i)[0]]++;
 
+    mfem::Array<int> edge_tedge(nedges_local);
+    for (int i = 0; i < nedges_local; i++)
+        edge_tedge[i] = tedge_old2new[edge_loc_to_glo_[i]];
+
+    const int tedge_begin = tedge_couters[myid] - ntedges_local;
+    MakeEdgeTrueEdge(comm, edge_tedge, tedge_begin, ntedges_local, ntedges_global);
+}
+
+void Graph::MakeEdgeTrueEdge(MPI_Comm comm, const mfem::Array<int>& edge_tedge,
+                             int tedge_begin, int ntedges_local, int ntedges_global)
+{
+    const int nedges_local = edge_tedge.Size();
+
     // Construct edge to true edge table
     int* e_te_diag_i = new int[nedges_local + 1];
     int* e_te_diag_j = new int[ntedges_local];
@@ -244,20 +407,15 @@ void Graph::MakeEdgeTrueEdge(MPI_Comm comm, int myid, const mfem::SparseMatrix&
     e_te_offd_i[0] = 0;
     std::fill_n(e_te_offd_data, nedges_local - ntedges_local, 1.0);
 
-    for (int i = num_procs - 1; i > 0; i--)
-        tedge_couters[i] = tedge_couters[i - 1];
-    tedge_couters[0] = 0;
-
     mfem::Array<mfem::Pair<HYPRE_Int, int> > offdmap_pair(
         nedges_local - ntedges_local);
 
     int tedge_new;
-    int tedge_begin = tedge_couters[myid];
-    int tedge_end = tedge_couters[myid + 1];
+    int tedge_end = tedge_begin + ntedges_local;
     int diag_counter(0), offd_counter(0);
     for (int i = 0; i < nedges_local; i++)
     {
-        tedge_new = tedge_old2new[edge_loc_to_glo_[i]];
+        tedge_new = edge_tedge[i];
         if ( (tedge_new >= tedge_begin) && (tedge_new < tedge_end) )
         {
             e_te_diag_j[diag_counter++] = tedge_new - tedge_begin;
@@ -295,6 +453,224 @@ void Graph::MakeEdgeTrueEdge(MPI_Comm comm, int myid, const mfem::SparseMatrix&
     edge_trueedge_->CopyColStarts();
 }
 
+void Graph::ReadDistributed(MPI_Comm comm, const std::string& filename,
+                            const mfem::Array<int>& vertex_starts)
+{
+    MFEM_VERIFY(HYPRE_AssumedPartitionCheck(),
+                "this method can not be used without assumed partition");
+
+    int num_procs;
+    int myid;
+    MPI_Comm_size(comm, &num_procs);
+    MPI_Comm_rank(comm, &myid);
+
+    ParBinaryGraphFile graph_file(comm, filename);
+    const int nvertices_global = graph_file.NumVertices();
+    const int nedges_global = graph_file.NumEdges();
+
+    int vertex_begin, vertex_end;
+    if (vertex_starts.Size() > 0)
+    {
+        MFEM_VERIFY(vertex_starts.Size() == num_procs + 1 &&
+                    vertex_starts.Last() == nvertices_global,
+                    "vertex_starts does not match the graph file!");
+        vertex_begin = vertex_starts[myid];
+        vertex_end = vertex_starts[myid + 1];
+    }
+    else
+    {
+        vertex_begin = (long long)nvertices_global * myid / num_procs;
+        vertex_end = (long long)nvertices_global * (myid + 1) / num_procs;
+    }
+
+    mfem::SparseMatrix vertex_edge_rows =
+        graph_file.ReadVertexEdgeRows(vertex_begin, vertex_end);
+    const int nvertices_local = vertex_edge_rows.Height();
+    const int nnz_local = vertex_edge_rows.NumNonZeroElems();
+    int* rows_j = vertex_edge_rows.GetJ();
+
+    // Local edges are the edges of local vertices, ordered by global number
+    std::vector<int> local_edges(rows_j, rows_j + nnz_local);
+    std::sort(local_edges.begin(), local_edges.end());
+    local_edges.erase(std::unique(local_edges.begin(), local_edges.end()),
+                      local_edges.end());
+    const int nedges_local = local_edges.size();
+
+    vert_loc_to_glo_.SetSize(nvertices_local);
+    for (int i = 0; i < nvertices_local; i++)
+        vert_loc_to_glo_[i] = vertex_begin + i;
+
+    edge_loc_to_glo_.SetSize(nedges_local);
+    std::copy(local_edges.begin(), local_edges.end(), edge_loc_to_glo_.GetData());
+
+    for (int i = 0; i < nnz_local; i++)
+    {
+        rows_j[i] = std::lower_bound(local_edges.begin(), local_edges.end(), rows_j[i])
+                    - local_edges.begin();
+    }
+    mfem::SparseMatrix vertex_edge_local(
+        vertex_edge_rows.GetI(), rows_j, vertex_edge_rows.GetData(),
+        nvertices_local, nedges_local);
+    vertex_edge_rows.LoseData();
+    vertex_edge_local_.Swap(vertex_edge_local);
+
+    // Edge e is registered in the directory of processor p if
+    // dir_starts[p] <= e < dir_starts[p + 1]. Since local_edges is sorted,
+    // the requests to each directory are contiguous in local_edges.
+    std::vector<int> dir_starts(num_procs + 1);
+    for (int p = 0; p < num_procs + 1; p++)
+        dir_starts[p] = (long long)nedges_global * p / num_procs;
+
+    std::vector<int> send_counts(num_procs, 0), send_displs(num_procs + 1, 0);
+    for (int p = 0, i = 0; p < num_procs; p++)
+    {
+        while (i < nedges_local && local_edges[i] < dir_starts[p + 1])
+        {
+            send_counts[p]++;
+            i++;
+        }
+        send_displs[p + 1] = send_displs[p] + send_counts[p];
+    }
+
+    std::vector<int> recv_counts(num_procs), recv_displs(num_procs + 1, 0);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    for (int p = 0; p < num_procs; p++)
+        recv_displs[p + 1] = recv_displs[p] + recv_counts[p];
+
+    std::vector<int> dir_requests(recv_displs[num_procs]);
+    MPI_Alltoallv(local_edges.data(), send_counts.data(), send_displs.data(), MPI_INT,
+                  dir_requests.data(), recv_counts.data(), recv_displs.data(), MPI_INT,
+                  comm);
+
+    // Directory: record the (at most two) processors having each edge.
+    // Requests are received in increasing order of processors, so the first
+    // processor is the one with the smallest rank, which owns the true edge.
+    const int dir_begin = dir_starts[myid];
+    const int dir_size = dir_starts[myid + 1] - dir_begin;
+    std::vector<int> first_proc(dir_size, -1), second_proc(dir_size, -1);
+    for (int p = 0; p < num_procs; p++)
+    {
+        for (int k = recv_displs[p]; k < recv_displs[p + 1]; k++)
+        {
+            const int e = dir_requests[k] - dir_begin;
+            if (first_proc[e] < 0)
+            {
+                first_proc[e] = p;
+            }
+            else
+            {
+                MFEM_VERIFY(second_proc[e] < 0,
+                            "Edge " << dir_requests[k] << " has more than two vertices!");
+                second_proc[e] = p;
+            }
+        }
+    }
+
+    // Reply to each request with (owner, other processor) and the edge weight
+    mfem::Vector dir_weight = graph_file.ReadEdgeWeight(dir_begin, dir_begin + dir_size);
+    std::vector<int> reply_procs(2 * dir_requests.size());
+    std::vector<double> reply_weight(dir_requests.size());
+    for (int p = 0; p < num_procs; p++)
+    {
+        for (int k = recv_displs[p]; k < recv_displs[p + 1]; k++)
+        {
+            const int e = dir_requests[k] - dir_begin;
+            reply_procs[2 * k] = first_proc[e];
+            reply_procs[2 * k + 1] = (first_proc[e] == p) ? second_proc[e] : first_proc[e];
+            reply_weight[k] = dir_weight[e];
+        }
+    }
+
+    std::vector<int> send_counts2(num_procs), send_displs2(num_procs + 1);
+    std::vector<int> recv_counts2(num_procs), recv_displs2(num_procs + 1);
+    for (int p = 0; p < num_procs + 1; p++)
+    {
+        if (p < num_procs)
+        {
+            send_counts2[p] = 2 * send_counts[p];
+            recv_counts2[p] = 2 * recv_counts[p];
+        }
+        send_displs2[p] = 2 * send_displs[p];
+        recv_displs2[p] = 2 * recv_displs[p];
+    }
+
+    std::vector<int> edge_procs(2 * nedges_local);
+    MPI_Alltoallv(reply_procs.data(), recv_counts2.data(), recv_displs2.data(), MPI_INT,
+                  edge_procs.data(), send_counts2.data(), send_displs2.data(), MPI_INT,
+                  comm);
+
+    mfem::Vector edge_weight_local(nedges_local);
+    MPI_Alltoallv(reply_weight.data(), recv_counts.data(), recv_displs.data(), MPI_DOUBLE,
+                  edge_weight_local.GetData(), send_counts.data(), send_displs.data(),
+                  MPI_DOUBLE, comm);
+
+    // Number the owned true edges contiguously, in order of global edge number
+    int ntedges_local = 0;
+    for (int i = 0; i < nedges_local; i++)
+    {
+        ntedges_local += (edge_procs[2 * i] == myid);
+    }
+
+    int tedge_end;
+    MPI_Scan(&ntedges_local, &tedge_end, 1, MPI_INT, MPI_SUM, comm);
+    const int tedge_begin = tedge_end - ntedges_local;
+
+    int ntedges_global;
+    MPI_Allreduce(&ntedges_local, &ntedges_global, 1, MPI_INT, MPI_SUM, comm);
+    MFEM_VERIFY(ntedges_global == nedges_global, "Some edge has no vertex!");
+
+    // Owners send (global edge, true edge) of shared edges to the other processor
+    mfem::Array<int> edge_tedge(nedges_local);
+    std::vector<std::vector<int>> tedge_to_send(num_procs);
+    std::vector<int> tedge_recv_counts(num_procs, 0);
+    for (int i = 0, counter = tedge_begin; i < nedges_local; i++)
+    {
+        const int owner = edge_procs[2 * i];
+        const int other = edge_procs[2 * i + 1];
+        if (owner == myid)
+        {
+            edge_tedge[i] = counter++;
+            if (other >= 0)
+            {
+                tedge_to_send[other].push_back(local_edges[i]);
+                tedge_to_send[other].push_back(edge_tedge[i]);
+            }
+        }
+        else
+        {
+            tedge_recv_counts[owner] += 2;
+        }
+    }
+
+    std::vector<int> tedge_send_buffer, tedge_send_counts(num_procs);
+    std::vector<int> tedge_send_displs(num_procs + 1, 0), tedge_recv_displs(num_procs + 1, 0);
+    for (int p = 0; p < num_procs; p++)
+    {
+        tedge_send_buffer.insert(tedge_send_buffer.end(), tedge_to_send[p].begin(),
+                                 tedge_to_send[p].end());
+        tedge_send_counts[p] = tedge_to_send[p].size();
+        tedge_send_displs[p + 1] = tedge_send_displs[p] + tedge_send_counts[p];
+        tedge_recv_displs[p + 1] = tedge_recv_displs[p] + tedge_recv_counts[p];
+    }
+
+    std::vector<int> tedge_recv_buffer(tedge_recv_displs[num_procs]);
+    MPI_Alltoallv(tedge_send_buffer.data(), tedge_send_counts.data(),
+                  tedge_send_displs.data(), MPI_INT, tedge_recv_buffer.data(),
+                  tedge_recv_counts.data(), tedge_recv_displs.data(), MPI_INT, comm);
+
+    for (unsigned int k = 0; k < tedge_recv_buffer.size(); k += 2)
+    {
+        const int edge = std::lower_bound(local_edges.begin(), local_edges.end(),
+                                          tedge_recv_buffer[k]) - local_edges.begin();
+        edge_tedge[edge] = tedge_recv_buffer[k + 1];
+    }
+
+    MakeEdgeTrueEdge(comm, edge_tedge, tedge_begin, ntedges_local, ntedges_global);
+
+    FixSharedEdgeWeight(*edge_trueedge_, edge_weight_local);
+    SplitEdgeWeight(edge_weight_local);
+}
+
 mfem::Vector Graph::DistributeEdgeWeight(const mfem::Vector& edge_weight_global)
 {
     mfem::Vector edge_weight_local(vertex_edge_local_.Width());
@@ -69,6 +69,29 @@ public:
           const mfem::SparseMatrix& vertex_edge_global,
           const mfem::Vector& edge_weight_global = mfem::Vector());
 
+    /**
+       @brief Construct a distributed graph by reading a binary graph file in
+       parallel, no process ever holds the global graph.
+
+       Process i reads rows vertex_starts[i], ..., vertex_starts[i+1] - 1 of
+       the vertex_edge table in the file (see BinaryGraph.hpp), so the file
+       should be ordered such that contiguous vertices form a good partition.
+       Processes then find out which of their edges are shared (and with
+       whom) through a directory distributed over the edges, from which
+       edge_trueedge_ is built. The directory also reads the edge weights
+       stored in the file (unit weight if there is none).
+
+       Split weights are set as in the constructor from a global graph.
+
+       @param comm the communicator over which to distribute the graph
+       @param filename binary graph file written by WriteVertexEdgeBinary()
+       @param vertex_starts global offsets of the vertices owned by each
+              process (size number of processes + 1). If not provided, the
+              vertices are distributed evenly.
+    */
+    Graph(MPI_Comm comm, const std::string& filename,
+          const mfem::Array<int>& vertex_starts = mfem::Array<int>());
+
     /**
        @brief Construct a distributed graph from local graph information
 
@@ -164,6 +187,18 @@ private:
 
     void MakeEdgeTrueEdge(MPI_Comm comm, int myid, const mfem::SparseMatrix& proc_edge);
 
+    /**
+       Build edge_trueedge_ given the true edge (global numbering) of each
+       local edge, true edges tedge_begin, ..., tedge_begin + ntedges_local - 1
+       are owned by the local processor.
+    */
+    void MakeEdgeTrueEdge(MPI_Comm comm, const mfem::Array<int>& edge_tedge,
+                          int tedge_begin, int ntedges_local, int ntedges_global);
+
+    /// read local part of the graph from a binary file, see the constructor
+    void ReadDistributed(MPI_Comm comm, const std::string& filename,
+                         const mfem::Array<int>& vertex_starts);
+
     /// distribute edge weight of global graph to local graph (of each processor)
     mfem::Vector DistributeEdgeWeight(const mfem::Vector& edge_weight_global);
 
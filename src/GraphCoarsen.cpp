@@ -19,10 +19,16 @@
    @brief Implementation of GraphCoarsen object
 */
 
+#include <array>
 #include <numeric>
 #include "GraphCoarsen.hpp"
 #include "MatrixUtilities.hpp"
 #include "GraphCoarsenBuilder.hpp"
+#include "BatchedDenseMatrices.hpp"
+
+#if SMOOTHG_USE_OPENMP
+#include <omp.h>
+#endif
 
 using std::unique_ptr;
 
@@ -292,8 +298,6 @@ mfem::SparseMatrix GraphCoarsen::BuildPEdges(bool build_coarse_components)
     const int num_coarse_vdofs = coarse_space_.VertexToVDof().NumCols();
     const int num_coarse_edofs = coarse_space_.VertexToEDof().NumCols();
 
-    mfem::SparseMatrix coarse_D(num_coarse_vdofs, num_coarse_edofs);
-
     // Modify the traces so that "1^T D PV_trace = 1", "1^T D other trace = 0"
     // this is Gelever's "ScaleEdgeTargets"
     NormalizeTraces(const_cast<std::vector<mfem::DenseMatrix>&>(edge_traces_), agg_vdof, face_edof);
@@ -308,250 +312,321 @@ mfem::SparseMatrix GraphCoarsen::BuildPEdges(bool build_coarse_components)
     }
     coarse_m_builder_->Setup(coarse_space_);
 
-    int bubble_counter = 0;
-    double entry_value;
-    mfem::Vector B_potential, F_potential;
-    mfem::DenseMatrix traces_extensions, bubbles, B_potentials, F_potentials;
-    mfem::Vector ref_vec1, ref_vec2;
-    mfem::Vector local_rhs_trace0, local_rhs_trace1, local_rhs_bubble, local_sol, trace;
-    mfem::Array<int> local_vdofs, local_edofs, faces;
-    mfem::Array<int> facecdofs, local_facecdofs;
-    mfem::Vector one, first_vert_target;
-    mfem::SparseMatrix Mbb;
+    // the bubbles of aggregate i are numbered from bubble_offsets[i] on (after
+    // the traces), so that aggregates can be processed in any order
+    std::vector<int> bubble_offsets(num_aggs + 1, 0);
     for (unsigned int i = 0; i < num_aggs; i++)
     {
-        // extract local matrices and build local solver
-        GetTableRow(agg_edof, i, local_edofs);
-        GetTableRow(agg_vdof, i, local_vdofs);
-        GetTableRow(Agg_face, i, faces);
-        auto Mloc = ExtractRowAndColumns(M_proc_, local_edofs, local_edofs, col_map_);
-        auto Dloc = ExtractRowAndColumns(D_proc_, local_vdofs, local_edofs, col_map_);
-        constant_rep_.GetSubVector(local_vdofs, one);
-
-        // next line does *not* assume M_proc_ is diagonal
-        LocalGraphEdgeSolver solver(Mloc, Dloc, one);
-
-        int num_local_vdofs = local_vdofs.Size();
-        local_rhs_trace1.SetSize(num_local_vdofs);
-
-        auto& vertex_target_i = const_cast<mfem::DenseMatrix&>(vertex_targets_[i]);
-
-        // ---
-        // solving bubble functions (vertex_target -> bubbles)
-        // ---
-        int num_bubbles_i = vertex_target_i.Width() - 1;
-        int num_local_edofs = local_edofs.Size();
-        bubbles.SetSize(num_local_edofs, num_bubbles_i);
-        B_potentials.SetSize(num_local_vdofs, num_bubbles_i);
-        for (int j = 0; j < num_bubbles_i; j++)
-        {
-            vertex_target_i.GetColumnReference(j + 1, local_rhs_bubble);
-            bubbles.GetColumnReference(j, local_sol);
-            B_potentials.GetColumnReference(j, B_potential);
-            solver.Mult(local_rhs_bubble, local_sol, B_potential);
-        }
+        bubble_offsets[i + 1] = bubble_offsets[i] + vertex_targets_[i].Width() - 1;
+    }
 
-        // ---
-        // solving trace extensions and store coarse matrices
-        // (edge_traces -> traces_extensions)
-        // ---
-        int nlocal_traces = 0;
-        for (int j = 0; j < faces.Size(); j++)
-        {
-            nlocal_traces += face_coarse_edof.RowSize(faces[j]);
-        }
-        traces_extensions.SetSize(num_local_edofs, nlocal_traces);
-        F_potentials.SetSize(num_local_vdofs, nlocal_traces);
-        local_facecdofs.SetSize(nlocal_traces);
-        local_rhs_trace0.SetSize(num_local_edofs);
+    mfem::SparseMatrix face_Agg(smoothg::Transpose(Agg_face));
 
-        std::vector<mfem::Array<int> > facefdofs(faces.Size());
-        std::vector<std::pair<int, int> > agg_trace_map(nlocal_traces);
+    auto edof_vert = smoothg::Transpose(fine_space_.VertexToEDof());
+    auto vert_agg = smoothg::Transpose(topology_.Agg_vertex_);
 
-        nlocal_traces = 0;
-        for (int j = 0; j < faces.Size(); j++)
+    // Aggregates (and faces) only write their own rows of Pedges, everything
+    // else is staged per thread (coarse M contributions and coarse D entries)
+    // and merged in thread order after the loops
+    int num_threads = 1;
+#if SMOOTHG_USE_OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    std::vector<unique_ptr<CoarseMBuilder>> staging_m_builders(num_threads);
+    std::vector<mfem::SparseMatrix> staging_coarse_D(num_threads);
+
+#if SMOOTHG_USE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        int thread = 0;
+#if SMOOTHG_USE_OPENMP
+        thread = omp_get_thread_num();
+#endif
+        unique_ptr<CoarseMBuilder> m_builder = coarse_m_builder_->MakeStaging();
+        mfem::SparseMatrix coarse_D(num_coarse_vdofs, num_coarse_edofs);
+
+        mfem::Array<int> col_map(col_map_.Size());
+        col_map = -1;
+
+        // aggregates of the same shape share the symbolic factorization
+        CholmodSymbolicCache symbolic_cache;
+
+        double entry_value;
+        mfem::Vector B_potential, F_potential;
+        mfem::DenseMatrix traces_extensions, bubbles, B_potentials, F_potentials;
+        mfem::Vector ref_vec1, ref_vec2;
+        mfem::Vector local_rhs_trace0, local_rhs_trace1, local_rhs_bubble, local_sol, trace;
+        mfem::Array<int> local_vdofs, local_edofs, faces;
+        mfem::Array<int> facecdofs, local_facecdofs;
+        mfem::Vector one, first_vert_target;
+        mfem::SparseMatrix Mbb;
+
+#if SMOOTHG_USE_OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for (int i = 0; i < (int) num_aggs; i++)
         {
-            const int face = faces[j];
-            GetTableRow(face_coarse_edof, face, facecdofs);
-            GetTableRow(face_edof, face, facefdofs[j]);
+            const int bubble_counter = bubble_offsets[i];
+
+            // extract local matrices and build local solver
+            GetTableRow(agg_edof, i, local_edofs);
+            GetTableRow(agg_vdof, i, local_vdofs);
+            GetTableRow(Agg_face, i, faces);
+            auto Mloc = ExtractRowAndColumns(M_proc_, local_edofs, local_edofs, col_map);
+            auto Dloc = ExtractRowAndColumns(D_proc_, local_vdofs, local_edofs, col_map);
+            constant_rep_.GetSubVector(local_vdofs, one);
+
+            // next line does *not* assume M_proc_ is diagonal
+            LocalGraphEdgeSolver solver(Mloc, Dloc, one, &symbolic_cache);
+
+            int num_local_vdofs = local_vdofs.Size();
+            local_rhs_trace1.SetSize(num_local_vdofs);
+
+            auto& vertex_target_i = const_cast<mfem::DenseMatrix&>(vertex_targets_[i]);
+
+            // ---
+            // solving bubble functions (vertex_target -> bubbles)
+            // ---
+            int num_bubbles_i = vertex_target_i.Width() - 1;
+            int num_local_edofs = local_edofs.Size();
+            bubbles.SetSize(num_local_edofs, num_bubbles_i);
+            B_potentials.SetSize(num_local_vdofs, num_bubbles_i);
+            for (int j = 0; j < num_bubbles_i; j++)
+            {
+                vertex_target_i.GetColumnReference(j + 1, local_rhs_bubble);
+                bubbles.GetColumnReference(j, local_sol);
+                B_potentials.GetColumnReference(j, B_potential);
+                solver.Mult(local_rhs_bubble, local_sol, B_potential);
+            }
 
-            auto Dtransfer = ExtractRowAndColumns(D_proc_, local_vdofs,
-                                                  facefdofs[j], col_map_);
-            mfem::SparseMatrix DtransferT = smoothg::Transpose(Dtransfer);
+            // ---
+            // solving trace extensions and store coarse matrices
+            // (edge_traces -> traces_extensions)
+            // ---
+            int nlocal_traces = 0;
+            for (int j = 0; j < faces.Size(); j++)
+            {
+                nlocal_traces += face_coarse_edof.RowSize(faces[j]);
+            }
+            traces_extensions.SetSize(num_local_edofs, nlocal_traces);
+            F_potentials.SetSize(num_local_vdofs, nlocal_traces);
+            local_facecdofs.SetSize(nlocal_traces);
+            local_rhs_trace0.SetSize(num_local_edofs);
 
-            auto Mtransfer = ExtractRowAndColumns(M_proc_, local_edofs,
-                                                  facefdofs[j], col_map_);
-            mfem::SparseMatrix MtransferT = smoothg::Transpose(Mtransfer);
+            std::vector<mfem::Array<int> > facefdofs(faces.Size());
+            std::vector<std::pair<int, int> > agg_trace_map(nlocal_traces);
 
-            auto& edge_traces_f = const_cast<mfem::DenseMatrix&>(edge_traces_[face]);
-            int num_traces = edge_traces_f.Width();
-            for (int k = 0; k < num_traces; k++)
+            nlocal_traces = 0;
+            for (int j = 0; j < faces.Size(); j++)
             {
-                agg_trace_map[nlocal_traces] = std::make_pair(j, k);
+                const int face = faces[j];
+                GetTableRow(face_coarse_edof, face, facecdofs);
+                GetTableRow(face_edof, face, facefdofs[j]);
 
-                const int row = local_facecdofs[nlocal_traces] = facecdofs[k];
-                const int cdof_loc = num_bubbles_i + nlocal_traces;
-                coarse_m_builder_->RegisterRow(i, row, cdof_loc, bubble_counter);
-                edge_traces_f.GetColumnReference(k, trace);
-                Dtransfer.Mult(trace, local_rhs_trace1);
-                Mtransfer.Mult(trace, local_rhs_trace0);
+                auto Dtransfer = ExtractRowAndColumns(D_proc_, local_vdofs,
+                                                      facefdofs[j], col_map);
+                mfem::SparseMatrix DtransferT = smoothg::Transpose(Dtransfer);
 
-                // compute and store local coarse D
-                if (k == 0)
-                {
-                    vertex_target_i.GetColumnReference(0, first_vert_target);
-                    coarse_D.Set(bubble_counter + i, row,
-                                 -(local_rhs_trace1 * first_vert_target));
-                }
+                auto Mtransfer = ExtractRowAndColumns(M_proc_, local_edofs,
+                                                      facefdofs[j], col_map);
+                mfem::SparseMatrix MtransferT = smoothg::Transpose(Mtransfer);
 
-                // instead of doing local_rhs *= -1, we store -trace later
-                if (num_local_edofs)
+                auto& edge_traces_f = const_cast<mfem::DenseMatrix&>(edge_traces_[face]);
+                int num_traces = edge_traces_f.Width();
+                for (int k = 0; k < num_traces; k++)
                 {
-                    orthogonalize_from_vector(local_rhs_trace1, one);
-                    // orthogonalize_from_constant(local_rhs_trace);
-                    traces_extensions.GetColumnReference(nlocal_traces, local_sol);
-                    F_potentials.GetColumnReference(nlocal_traces, F_potential);
-                    solver.Mult(local_rhs_trace0, local_rhs_trace1, local_sol, F_potential);
-
-                    // compute and store diagonal block of coarse M
-                    entry_value = DTTraceProduct(DtransferT, F_potentials, nlocal_traces, trace);
-                    entry_value -= MtransferT.InnerProduct(local_sol, trace);
-                    coarse_m_builder_->AddTraceTraceBlockDiag(entry_value);
-
-                    // compute and store off diagonal block of coarse M
-                    for (int l = 0; l < num_bubbles_i; l++)
+                    agg_trace_map[nlocal_traces] = std::make_pair(j, k);
+
+                    const int row = local_facecdofs[nlocal_traces] = facecdofs[k];
+                    const int cdof_loc = num_bubbles_i + nlocal_traces;
+                    m_builder->RegisterRow(i, row, cdof_loc, bubble_counter);
+                    edge_traces_f.GetColumnReference(k, trace);
+                    Dtransfer.Mult(trace, local_rhs_trace1);
+                    Mtransfer.Mult(trace, local_rhs_trace0);
+
+                    // compute and store local coarse D
+                    if (k == 0)
                     {
-                        entry_value = DTTraceProduct(DtransferT, B_potentials, l, trace);
-                        bubbles.GetColumnReference(l, local_sol);
-                        entry_value -= MtransferT.InnerProduct(local_sol, trace);
-                        coarse_m_builder_->SetTraceBubbleBlock(l, entry_value);
+                        vertex_target_i.GetColumnReference(0, first_vert_target);
+                        coarse_D.Set(bubble_counter + i, row,
+                                     -(local_rhs_trace1 * first_vert_target));
                     }
 
-                    int other_j = -1;
-                    for (int l = 0; l < nlocal_traces; l++)
+                    // instead of doing local_rhs *= -1, we store -trace later
+                    if (num_local_edofs)
                     {
-                        entry_value = DTTraceProduct(DtransferT, F_potentials, l, trace);
-                        entry_value -= DTTraceProduct(MtransferT, traces_extensions, l, trace);
+                        orthogonalize_from_vector(local_rhs_trace1, one);
+                        // orthogonalize_from_constant(local_rhs_trace);
+                        traces_extensions.GetColumnReference(nlocal_traces, local_sol);
+                        F_potentials.GetColumnReference(nlocal_traces, F_potential);
+                        solver.Mult(local_rhs_trace0, local_rhs_trace1, local_sol, F_potential);
+
+                        // compute and store diagonal block of coarse M
+                        entry_value = DTTraceProduct(DtransferT, F_potentials,
+                                                     nlocal_traces, trace);
+                        entry_value -= MtransferT.InnerProduct(local_sol, trace);
+                        m_builder->AddTraceTraceBlockDiag(entry_value);
 
-                        std::pair<int, int>& loc_map = agg_trace_map[l];
-                        if (loc_map.first != j)
+                        // compute and store off diagonal block of coarse M
+                        for (int l = 0; l < num_bubbles_i; l++)
                         {
-                            // note other_j increases with l, so no repeated extraction
-                            if (loc_map.first != other_j)
+                            entry_value = DTTraceProduct(DtransferT, B_potentials, l, trace);
+                            bubbles.GetColumnReference(l, local_sol);
+                            entry_value -= MtransferT.InnerProduct(local_sol, trace);
+                            m_builder->SetTraceBubbleBlock(l, entry_value);
+                        }
+
+                        int other_j = -1;
+                        for (int l = 0; l < nlocal_traces; l++)
+                        {
+                            entry_value = DTTraceProduct(DtransferT, F_potentials, l, trace);
+                            entry_value -= DTTraceProduct(MtransferT, traces_extensions, l, trace);
+
+                            std::pair<int, int>& loc_map = agg_trace_map[l];
+                            if (loc_map.first != j)
                             {
-                                other_j = loc_map.first;
-                                auto tmp = ExtractRowAndColumns(M_proc_, facefdofs[j],
-                                                                facefdofs[other_j], col_map_);
-                                Mbb.Swap(tmp);
+                                // note other_j increases with l, so no repeated extraction
+                                if (loc_map.first != other_j)
+                                {
+                                    other_j = loc_map.first;
+                                    auto tmp = ExtractRowAndColumns(M_proc_, facefdofs[j],
+                                                                    facefdofs[other_j], col_map);
+                                    Mbb.Swap(tmp);
+                                }
+                                entry_value += DTTraceProduct(Mbb, edge_traces_[faces[other_j]],
+                                                              loc_map.second, trace);
                             }
-                            entry_value += DTTraceProduct(Mbb, edge_traces_[faces[other_j]],
-                                                          loc_map.second, trace);
-                        }
 
-                        coarse_m_builder_->AddTraceTraceBlock(local_facecdofs[l], entry_value);
+                            m_builder->AddTraceTraceBlock(local_facecdofs[l], entry_value);
+                        }
                     }
+                    nlocal_traces++;
                 }
-                nlocal_traces++;
             }
-        }
-        assert(nlocal_traces == traces_extensions.Width());
+            assert(nlocal_traces == traces_extensions.Width());
 
-        // ---
-        // put trace extensions and bubbles into Pedges
-        // ---
-        for (int l = 0; l < num_local_edofs; l++)
-        {
-            int ptr = I[local_edofs[l]];
-            for (int j = 0; j < nlocal_traces; j++)
+            // ---
+            // put trace extensions and bubbles into Pedges
+            // ---
+            for (int l = 0; l < num_local_edofs; l++)
             {
-                J[ptr] = local_facecdofs[j];
-                data[ptr++] = traces_extensions(l, j);
+                int ptr = I[local_edofs[l]];
+                for (int j = 0; j < nlocal_traces; j++)
+                {
+                    J[ptr] = local_facecdofs[j];
+                    data[ptr++] = traces_extensions(l, j);
+                }
+                for (int j = 0; j < num_bubbles_i; j++)
+                {
+                    J[ptr] = num_traces + bubble_counter + j;
+                    data[ptr++] = bubbles(l, j);
+                }
+                assert(ptr == I[local_edofs[l] + 1]);
             }
-            for (int j = 0; j < num_bubbles_i; j++)
+
+            // storing local coarse D
+            for (int l = 0; l < num_bubbles_i; l++)
             {
-                J[ptr] = num_traces + bubble_counter + j;
-                data[ptr++] = bubbles(l, j);
+                coarse_D.Set(bubble_counter + i + 1 + l,
+                             num_traces + bubble_counter + l, 1.);
             }
-            assert(ptr == I[local_edofs[l] + 1]);
-        }
 
-        // storing local coarse D
-        for (int l = 0; l < num_bubbles_i; l++)
-        {
-            coarse_D.Set(bubble_counter + i + 1 + l,
-                         num_traces + bubble_counter + l, 1.);
+            // storing local coarse M (bubble part)
+            for (int l = 0; l < num_bubbles_i; l++)
+            {
+                B_potentials.GetColumnReference(l, ref_vec1);
+                vertex_target_i.GetColumnReference(l + 1, ref_vec2);
+                entry_value = smoothg::InnerProduct(ref_vec1, ref_vec2);
+                m_builder->SetBubbleBubbleBlock(i, l, l, entry_value);
+
+                for (int j = l + 1; j < num_bubbles_i; j++)
+                {
+                    vertex_target_i.GetColumnReference(j + 1, ref_vec2);
+                    entry_value = smoothg::InnerProduct(ref_vec1, ref_vec2);
+                    m_builder->SetBubbleBubbleBlock(i, l, j, entry_value);
+                }
+            }
         }
 
-        // storing local coarse M (bubble part)
-        for (int l = 0; l < num_bubbles_i; l++)
+        mfem::DenseMatrix Mloc_dm;
+        mfem::Array<int> Aggs;
+
+        // static schedule: the staged (summed) face contributions, hence the
+        // merged coarse M, do not depend on the timing of the threads
+#if SMOOTHG_USE_OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (int i = 0; i < (int) num_faces; i++)
         {
-            B_potentials.GetColumnReference(l, ref_vec1);
-            vertex_target_i.GetColumnReference(l + 1, ref_vec2);
-            entry_value = smoothg::InnerProduct(ref_vec1, ref_vec2);
-            coarse_m_builder_->SetBubbleBubbleBlock(i, l, l, entry_value);
+            // put edge_traces (original, non-extended) into Pedges
+            auto& edge_traces_i = const_cast<mfem::DenseMatrix&>(edge_traces_[i]);
+            GetTableRow(face_edof, i, local_edofs);
+            GetTableRow(face_coarse_edof, i, facecdofs);
 
-            for (int j = l + 1; j < num_bubbles_i; j++)
+            for (int j = 0; j < local_edofs.Size(); j++)
             {
-                vertex_target_i.GetColumnReference(j + 1, ref_vec2);
-                entry_value = smoothg::InnerProduct(ref_vec1, ref_vec2);
-                coarse_m_builder_->SetBubbleBubbleBlock(i, l, j, entry_value);
+                int ptr = I[local_edofs[j]];
+                for (int k = 0; k < facecdofs.Size(); k++)
+                {
+                    J[ptr] = facecdofs[k];
+                    // since we did not do local_rhs *= -1, we store -trace here
+                    data[ptr++] = -edge_traces_i(j, k);
+                }
             }
-        }
-        bubble_counter += num_bubbles_i;
-    }
 
-    coarse_D.Finalize();
-    coarse_D_.Swap(coarse_D);
+            // store element coarse M
+            m_builder->FillEdgeCdofMarkers(i, face_Agg, coarse_space_.VertexToEDof());
+            GetTableRow(face_Agg, i, Aggs);
+            for (int a = 0; a < Aggs.Size(); a++)
+            {
+                BuildAggregateFaceM(local_edofs, vert_agg, edof_vert, Aggs[a], Mloc_dm);
+                for (int l = 0; l < facecdofs.Size(); l++)
+                {
+                    const int row = facecdofs[l];
+                    edge_traces_i.GetColumnReference(l, ref_vec1);
+                    entry_value = Mloc_dm.InnerProduct(ref_vec1, ref_vec1);
+                    m_builder->AddTraceAcross(row, row, a, entry_value);
 
-    mfem::SparseMatrix face_Agg(smoothg::Transpose(Agg_face));
+                    for (int j = l + 1; j < facecdofs.Size(); j++)
+                    {
+                        const int col = facecdofs[j];
+                        edge_traces_i.GetColumnReference(j, ref_vec2);
+                        entry_value = Mloc_dm.InnerProduct(ref_vec1, ref_vec2);
+                        m_builder->AddTraceAcross(row, col, a, entry_value);
+                        m_builder->AddTraceAcross(col, row, a, entry_value);
+                    }
+                }
+            }
+        }
 
-    auto edof_vert = smoothg::Transpose(fine_space_.VertexToEDof());
-    auto vert_agg = smoothg::Transpose(topology_.Agg_vertex_);
+        coarse_D.Finalize();
+        staging_coarse_D[thread].Swap(coarse_D);
+        staging_m_builders[thread] = std::move(m_builder);
+    }
 
-    mfem::DenseMatrix Mloc_dm;
-    mfem::Array<int> Aggs;
-    for (unsigned int i = 0; i < num_faces; i++)
+    // merge the staged contributions of the threads
+    mfem::SparseMatrix coarse_D(num_coarse_vdofs, num_coarse_edofs);
+    for (int t = 0; t < num_threads; t++)
     {
-        // put edge_traces (original, non-extended) into Pedges
-        auto& edge_traces_i = const_cast<mfem::DenseMatrix&>(edge_traces_[i]);
-        GetTableRow(face_edof, i, local_edofs);
-        GetTableRow(face_coarse_edof, i, facecdofs);
-
-        for (int j = 0; j < local_edofs.Size(); j++)
+        if (!staging_m_builders[t])
         {
-            int ptr = I[local_edofs[j]];
-            for (int k = 0; k < facecdofs.Size(); k++)
-            {
-                J[ptr] = facecdofs[k];
-                // since we did not do local_rhs *= -1, we store -trace here
-                data[ptr++] = -edge_traces_i(j, k);
-            }
+            continue;
         }
+        coarse_m_builder_->Merge(*staging_m_builders[t]);
 
-        // store element coarse M
-        coarse_m_builder_->FillEdgeCdofMarkers(i, face_Agg, coarse_space_.VertexToEDof());
-        GetTableRow(face_Agg, i, Aggs);
-        for (int a = 0; a < Aggs.Size(); a++)
+        const mfem::SparseMatrix& coarse_D_t = staging_coarse_D[t];
+        for (int row = 0; row < coarse_D_t.NumRows(); row++)
         {
-            BuildAggregateFaceM(local_edofs, vert_agg, edof_vert, Aggs[a], Mloc_dm);
-            for (int l = 0; l < facecdofs.Size(); l++)
+            for (int j = coarse_D_t.GetI()[row]; j < coarse_D_t.GetI()[row + 1]; j++)
             {
-                const int row = facecdofs[l];
-                edge_traces_i.GetColumnReference(l, ref_vec1);
-                entry_value = Mloc_dm.InnerProduct(ref_vec1, ref_vec1);
-                coarse_m_builder_->AddTraceAcross(row, row, a, entry_value);
-
-                for (int j = l + 1; j < facecdofs.Size(); j++)
-                {
-                    const int col = facecdofs[j];
-                    edge_traces_i.GetColumnReference(j, ref_vec2);
-                    entry_value = Mloc_dm.InnerProduct(ref_vec1, ref_vec2);
-                    coarse_m_builder_->AddTraceAcross(row, col, a, entry_value);
-                    coarse_m_builder_->AddTraceAcross(col, row, a, entry_value);
-                }
+                coarse_D.Set(row, coarse_D_t.GetJ()[j], coarse_D_t.GetData()[j]);
             }
         }
     }
+    coarse_D.Finalize();
+    coarse_D_.Swap(coarse_D);
+
     mfem::SparseMatrix Pedges(I, J, data, num_fine_edofs, num_coarse_edofs);
 
     auto coef_mbuilder_ptr = dynamic_cast<CoefficientMBuilder*>(coarse_m_builder_.get());
@@ -652,6 +727,47 @@ mfem::SparseMatrix GraphCoarsen::BuildEdgeProjection()
         bubble_offset += Q_i.Width();
     }
 
+    // pi_f = sigma_f (sigma_f^T sigma_f)^{-1}, sigma_f being the traces of
+    // face f except the PV, computed in batches of faces of the same sizes
+    std::vector<mfem::DenseMatrix> pi_f(num_faces);
+    {
+        std::vector<std::array<int, 2>> trace_sizes(num_faces);
+        for (int face = 0; face < num_faces; ++face)
+        {
+            const mfem::DenseMatrix& traces = edge_traces_[face];
+            trace_sizes[face] = {{ traces.NumRows(), traces.NumCols() - 1 }};
+        }
+
+        BatchedDenseMatrices sigma, sigma_prod_inv, pi;
+        for (const auto& batch : MakeBatches(trace_sizes))
+        {
+            const int count = batch.size();
+            const int num_rows = trace_sizes[batch[0]][0];
+            const int num_cols = trace_sizes[batch[0]][1];
+            if (num_cols < 1)
+            {
+                continue;
+            }
+
+            sigma.SetSize(num_rows, num_cols, count);
+            for (int b = 0; b < count; ++b)
+            {
+                const mfem::DenseMatrix& traces = edge_traces_[batch[b]];
+                mfem::DenseMatrix sigma_f(traces.Data() + num_rows, num_rows, num_cols);
+                sigma.SetMatrix(b, sigma_f);
+            }
+
+            MultAtB(sigma, sigma, sigma_prod_inv);
+            sigma_prod_inv.InvertSPD();
+            Mult(sigma, sigma_prod_inv, pi);
+
+            for (int b = 0; b < count; ++b)
+            {
+                pi.GetMatrix(b, pi_f[batch[b]]);
+            }
+        }
+    }
+
     for (int face = 0; face < num_faces; ++face)
     {
         int agg = face_agg.GetRowColumns(face)[0];
@@ -679,24 +795,13 @@ mfem::SparseMatrix GraphCoarsen::BuildEdgeProjection()
 
         if (traces.NumCols() > 1)
         {
-            mfem::DenseMatrix sigma_f(traces.Data() + traces.NumRows(),
-                                      traces.NumRows(),  traces.NumCols() - 1);
-
-            mfem::DenseMatrix sigma_f_prod(sigma_f.Width());
-            mfem::MultAtB(sigma_f, sigma_f, sigma_f_prod);
-
-            sigma_f_prod.Invert();
-
-            mfem::DenseMatrix pi_f(sigma_f.Height(), sigma_f.Width());
-            mfem::Mult(sigma_f, sigma_f_prod, pi_f);
-
-            mfem::Vector pi_f_PV(pi_f.Width());
-            pi_f.MultTranspose(PV_trace, pi_f_PV);
+            mfem::Vector pi_f_PV(pi_f[face].Width());
+            pi_f[face].MultTranspose(PV_trace, pi_f_PV);
             DT_one_pi_f_PV.UseExternalData(Q_i.Data() + Q_i.NumRows(),
                                            Q_i.NumRows(), Q_i.NumCols() - 1);
             mfem::MultVWt(one_D, pi_f_PV, DT_one_pi_f_PV);
 
-            DT_one_pi_f_PV -= pi_f;
+            DT_one_pi_f_PV -= pi_f[face];
         }
 
         one_D *= -1.0;
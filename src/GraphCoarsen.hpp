@@ -96,6 +96,10 @@ public:
        interiors and contains the "bubbles". (The columns are in fact ordered as
        written above, but the rows are not.)
 
+       With OpenMP, the local problems on aggregates and the face
+       contributions are computed by several threads; the coarse M and D
+       contributions are staged per thread and merged afterwards.
+
        @param edge_trace lives on faces, not aggregates
        @param vertex_target usually eigenvectors, lives on aggregate
        @param coarse_space the coarse graph space
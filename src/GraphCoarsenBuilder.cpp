@@ -56,12 +56,50 @@ void ElementMBuilder::Setup(const GraphSpace& coarse_space)
     for (unsigned int i = 0; i < num_aggs_; i++)
     {
         M_el_[i].SetSize(elem_edgedof_.RowSize(i));
+        M_el_[i] = 0.0;
     }
 
     edge_dof_markers_.resize(2);
     ResetEdgeCdofMarkers(elem_edgedof_.NumCols());
 }
 
+std::unique_ptr<CoarseMBuilder> ElementMBuilder::MakeStaging() const
+{
+    auto staging = make_unique<ElementMBuilder>();
+    staging->elem_edgedof_.MakeRef(elem_edgedof_);
+    staging->num_aggs_ = num_aggs_;
+    staging->M_el_.resize(num_aggs_); // allocated in ElementMatrix() when touched
+    staging->edge_dof_markers_.resize(2);
+    staging->ResetEdgeCdofMarkers(elem_edgedof_.NumCols());
+    return std::move(staging);
+}
+
+void ElementMBuilder::Merge(CoarseMBuilder& staging)
+{
+    auto& element_staging = dynamic_cast<ElementMBuilder&>(staging);
+    assert(element_staging.num_aggs_ == num_aggs_);
+
+    for (unsigned int agg = 0; agg < num_aggs_; agg++)
+    {
+        const mfem::DenseMatrix& staged_M = element_staging.M_el_[agg];
+        if (staged_M.Height() > 0)
+        {
+            M_el_[agg] += staged_M;
+        }
+    }
+}
+
+mfem::DenseMatrix& ElementMBuilder::ElementMatrix(int agg)
+{
+    mfem::DenseMatrix& M_el_loc = M_el_[agg];
+    if (M_el_loc.Height() == 0)
+    {
+        M_el_loc.SetSize(elem_edgedof_.RowSize(agg));
+        M_el_loc = 0.0;
+    }
+    return M_el_loc;
+}
+
 void ElementMBuilder::RegisterRow(int agg_index, int row, int dof_loc, int bubble_counter)
 {
     agg_index_ = agg_index;
@@ -71,19 +109,19 @@ void ElementMBuilder::RegisterRow(int agg_index, int row, int dof_loc, int bubbl
 
 void ElementMBuilder::SetTraceBubbleBlock(int l, double value)
 {
-    mfem::DenseMatrix& M_el_loc(M_el_[agg_index_]);
+    mfem::DenseMatrix& M_el_loc(ElementMatrix(agg_index_));
     M_el_loc(l, dof_loc_) = value;
     M_el_loc(dof_loc_, l) = value;
 }
 
 void ElementMBuilder::AddTraceTraceBlockDiag(double value)
 {
-    M_el_[agg_index_](dof_loc_, dof_loc_) += value;
+    ElementMatrix(agg_index_)(dof_loc_, dof_loc_) += value;
 }
 
 void ElementMBuilder::AddTraceTraceBlock(int l, double value)
 {
-    mfem::DenseMatrix& M_el_loc(M_el_[agg_index_]);
+    mfem::DenseMatrix& M_el_loc(ElementMatrix(agg_index_));
     M_el_loc(edge_dof_markers_[0][l], dof_loc_) += value;
     M_el_loc(dof_loc_, edge_dof_markers_[0][l]) += value;
 }
@@ -91,7 +129,7 @@ void ElementMBuilder::AddTraceTraceBlock(int l, double value)
 void ElementMBuilder::SetBubbleBubbleBlock(int agg_index, int l,
                                            int j, double value)
 {
-    mfem::DenseMatrix& M_el_loc(M_el_[agg_index]);
+    mfem::DenseMatrix& M_el_loc(ElementMatrix(agg_index));
     M_el_loc(l, j) = value;
     M_el_loc(j, l) = value;
 }
@@ -119,7 +157,7 @@ void ElementMBuilder::FillEdgeCdofMarkers(int face_num, const mfem::SparseMatrix
 
 void ElementMBuilder::AddTraceAcross(int row, int col, int agg, double value)
 {
-    mfem::DenseMatrix& M_el_loc(M_el_[Aggs_[agg]]);
+    mfem::DenseMatrix& M_el_loc(ElementMatrix(Aggs_[agg]));
 
     int id0_in_agg = edge_dof_markers_[agg][row];
     int id1_in_agg = edge_dof_markers_[agg][col];
@@ -143,6 +181,42 @@ mfem::SparseMatrix ElementMBuilder::BuildAssembledM(
     return M;
 }
 
+void ElementMBuilder::SetCoefficient(const mfem::Vector& agg_weights_inverse)
+{
+    MFEM_VERIFY(agg_weights_inverse.Size() == (int) M_el_.size(),
+                "Coefficient should have one value per element!");
+
+    if (M_el_unscaled_.empty())
+    {
+        M_el_unscaled_ = M_el_;
+    }
+
+    for (unsigned int agg = 0; agg < M_el_.size(); ++agg)
+    {
+        M_el_[agg] = M_el_unscaled_[agg];
+        M_el_[agg] *= 1. / agg_weights_inverse(agg);
+    }
+}
+
+std::vector<const std::vector<mfem::DenseMatrix>*> ElementMBuilder::GetLocalMatrices() const
+{
+    return { &M_el_ };
+}
+
+void ElementMBuilder::SetLocalMatrices(std::vector<std::vector<mfem::DenseMatrix>> local_mats)
+{
+    MFEM_VERIFY(local_mats.size() == 1 && local_mats[0].size() == num_aggs_,
+                "Wrong number of element matrices!");
+    for (unsigned int agg = 0; agg < num_aggs_; ++agg)
+    {
+        MFEM_VERIFY(local_mats[0][agg].Height() == elem_edgedof_.RowSize(agg),
+                    "Element matrix does not match the coarse space!");
+    }
+
+    M_el_ = std::move(local_mats[0]);
+    M_el_unscaled_.clear();
+}
+
 mfem::Vector ElementMBuilder::Mult(
     const mfem::Vector& elem_scaling_inv, const mfem::Vector& x) const
 {
@@ -198,6 +272,8 @@ void CoefficientMBuilder::Setup(const GraphSpace& coarse_space)
     Agg_face_ref_.MakeRef(coarse_space.GetGraph().VertexToEdge());
     mfem::SparseMatrix tmp = smoothg::Transpose(Agg_face_ref_);
     face_Agg_.Swap(tmp);
+
+    face_cdof_ref_.MakeRef(coarse_space.EdgeToEDof());
 }
 
 void CoefficientMBuilder::GetCoarseAggDofs(int agg, mfem::Array<int>& local_coarse_dofs) const
@@ -422,5 +498,24 @@ mfem::Vector CoefficientMBuilder::Mult(
     return mfem::Vector();
 }
 
+std::vector<const std::vector<mfem::DenseMatrix>*> CoefficientMBuilder::GetLocalMatrices() const
+{
+    MFEM_VERIFY(components_built_, "Components of M are not built!");
+    return { &comp_F_F_, &comp_EF_EF_, &comp_EF_E_, &comp_E_E_ };
+}
+
+void CoefficientMBuilder::SetLocalMatrices(
+    std::vector<std::vector<mfem::DenseMatrix>> local_mats)
+{
+    MFEM_VERIFY(local_mats.size() == 4, "Wrong number of components of M!");
+    MFEM_VERIFY(local_mats[0].size() == (unsigned int) face_cdof_ref_.NumRows(),
+                "Components of M do not match the coarse space!");
+
+    comp_F_F_ = std::move(local_mats[0]);
+    comp_EF_EF_ = std::move(local_mats[1]);
+    comp_EF_E_ = std::move(local_mats[2]);
+    comp_E_E_ = std::move(local_mats[3]);
+    components_built_ = true;
+}
 
 }
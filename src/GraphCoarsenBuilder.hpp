@@ -88,6 +88,19 @@ public:
     /// do not need all these arguments
     virtual void Setup(const GraphSpace& coarse_space) = 0;
 
+    /**
+       @brief Make an empty builder staging the contributions of one thread
+
+       The staging builder accepts the RegisterRow(), Set...() and Add...()
+       calls of this one for a subset of the aggregates and faces, so that
+       GraphCoarsen::BuildPEdges() can be threaded. Merge() adds the staged
+       contributions to this builder afterwards.
+    */
+    virtual std::unique_ptr<CoarseMBuilder> MakeStaging() const = 0;
+
+    /// Add the contributions staged in a builder made by MakeStaging()
+    virtual void Merge(CoarseMBuilder& staging) {}
+
     virtual void RegisterRow(int agg_index, int row, int cdof_loc, int bubble_counter) {}
 
     virtual void SetTraceBubbleBlock(int l, double value) {}
@@ -115,6 +128,17 @@ public:
     virtual mfem::Vector Mult(const mfem::Vector& elem_scaling_inv,
                               const mfem::Vector& x) const = 0;
 
+    /**
+       @brief The local matrices M is assembled from
+
+       Together with the coarse space given to Setup(), these determine the
+       builder completely, they are what Hierarchy::Save() writes to file.
+    */
+    virtual std::vector<const std::vector<mfem::DenseMatrix>*> GetLocalMatrices() const = 0;
+
+    /// Replace the local matrices by ones from GetLocalMatrices(), after Setup()
+    virtual void SetLocalMatrices(std::vector<std::vector<mfem::DenseMatrix>> local_mats) = 0;
+
 protected:
     int total_num_traces_;
 };
@@ -137,6 +161,10 @@ public:
     /// Setting up coarse level element M builder
     void Setup(const GraphSpace& coarse_space);
 
+    std::unique_ptr<CoarseMBuilder> MakeStaging() const;
+
+    void Merge(CoarseMBuilder& staging);
+
     void RegisterRow(int agg_index, int row, int dof_loc, int bubble_counter);
 
     void SetTraceBubbleBlock(int l, double value);
@@ -162,14 +190,32 @@ public:
 
     const std::vector<mfem::DenseMatrix>& GetElementMatrices() const { return M_el_; }
 
+    /**
+       @brief Scale the element matrices by 1 / agg_weights_inverse(agg)
+
+       The scaling is relative to the element matrices at the first call, so
+       the coefficient can be set repeatedly (unlike BuildAssembledM, this
+       also changes GetElementMatrices() and Mult).
+    */
+    void SetCoefficient(const mfem::Vector& agg_weights_inverse);
+
     const mfem::SparseMatrix& GetElemEdgeDofTable() const { return elem_edgedof_; }
 
     /// @return scaled M times x
     virtual mfem::Vector Mult(const mfem::Vector& elem_scaling_inv,
                               const mfem::Vector& x) const;
 
+    /// The element matrices
+    std::vector<const std::vector<mfem::DenseMatrix>*> GetLocalMatrices() const;
+
+    void SetLocalMatrices(std::vector<std::vector<mfem::DenseMatrix>> local_mats);
+
 private:
+    /// Element matrix of agg, allocated (and zeroed) if it is still empty
+    mfem::DenseMatrix& ElementMatrix(int agg);
+
     std::vector<mfem::DenseMatrix> M_el_;
+    std::vector<mfem::DenseMatrix> M_el_unscaled_; // only kept by SetCoefficient
     mfem::SparseMatrix elem_edgedof_;
 
     std::vector<std::vector<int>> edge_dof_markers_;
@@ -199,6 +245,12 @@ public:
 
     void Setup(const GraphSpace& coarse_space);
 
+    /// The components are not built in BuildPEdges(), so nothing is staged
+    std::unique_ptr<CoarseMBuilder> MakeStaging() const
+    {
+        return make_unique<CoefficientMBuilder>();
+    }
+
     /**
        @brief Assemble local components, independent of coefficient.
 
@@ -217,6 +269,11 @@ public:
 
     virtual mfem::Vector Mult(const mfem::Vector& elem_scaling_inv,
                               const mfem::Vector& x) const;
+
+    /// The components F_F, EF_EF, EF_E and E_E, in this order
+    std::vector<const std::vector<mfem::DenseMatrix>*> GetLocalMatrices() const;
+
+    void SetLocalMatrices(std::vector<std::vector<mfem::DenseMatrix>> local_mats);
 private:
     /// @todo remove this (GetTableRowCopy is the same thing?)
     void GetCoarseFaceDofs(
@@ -28,13 +28,13 @@ namespace smoothg
 
 // Construct entities to dofs table in the case when each dof belongs to one
 // and only one entity and the enumeration of dofs solely depends on entity
-mfem::SparseMatrix BuildEntityToDof(const std::vector<mfem::DenseMatrix>& local_targets)
+mfem::SparseMatrix BuildEntityToDof(const std::vector<int>& num_local_dofs)
 {
-    const unsigned int num_entities = local_targets.size();
+    const unsigned int num_entities = num_local_dofs.size();
     int* I = new int[num_entities + 1]();
     for (unsigned int entity = 0; entity < num_entities; ++entity)
     {
-        I[entity + 1] = I[entity] + local_targets[entity].NumCols();
+        I[entity + 1] = I[entity] + num_local_dofs[entity];
     }
 
     int nnz = I[num_entities];
@@ -47,6 +47,17 @@ mfem::SparseMatrix BuildEntityToDof(const std::vector<mfem::DenseMatrix>& local_
     return mfem::SparseMatrix(I, J, Data, num_entities, nnz);
 }
 
+// Number of dofs of each entity, given by the number of local targets
+std::vector<int> NumLocalDofs(const std::vector<mfem::DenseMatrix>& local_targets)
+{
+    std::vector<int> num_local_dofs(local_targets.size());
+    for (unsigned int entity = 0; entity < local_targets.size(); ++entity)
+    {
+        num_local_dofs[entity] = local_targets[entity].NumCols();
+    }
+    return num_local_dofs;
+}
+
 GraphSpace::GraphSpace(Graph graph)
     : graph_(std::move(graph)),
       vertex_vdof_(SparseIdentity(graph_.NumVertices())),
@@ -67,9 +78,16 @@ GraphSpace::GraphSpace(Graph graph)
 GraphSpace::GraphSpace(Graph graph,
                        const std::vector<mfem::DenseMatrix>& edge_traces,
                        const std::vector<mfem::DenseMatrix>& vertex_targets)
+    : GraphSpace(std::move(graph), NumLocalDofs(edge_traces), NumLocalDofs(vertex_targets))
+{
+}
+
+GraphSpace::GraphSpace(Graph graph,
+                       const std::vector<int>& num_edge_dofs,
+                       const std::vector<int>& num_vertex_dofs)
     : graph_(std::move(graph)),
-      vertex_vdof_(BuildEntityToDof(vertex_targets)),
-      edge_edof_(BuildEntityToDof(edge_traces)),
+      vertex_vdof_(BuildEntityToDof(num_vertex_dofs)),
+      edge_edof_(BuildEntityToDof(num_edge_dofs)),
       vertex_edof_(BuildVertexToEDof()),
       edof_trueedof_(BuildEdofToTrueEdof())
 {
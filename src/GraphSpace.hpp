@@ -50,6 +50,15 @@ public:
                const std::vector<mfem::DenseMatrix>& edge_traces,
                const std::vector<mfem::DenseMatrix>& vertex_targets);
 
+    /**
+       @brief Constructor from the number of dofs on each edge and vertex
+
+       Same as above, where the numbers of traces and targets are given.
+    */
+    GraphSpace(Graph graph,
+               const std::vector<int>& num_edge_dofs,
+               const std::vector<int>& num_vertex_dofs);
+
     /// Default constructor
     GraphSpace() = default;
 
@@ -20,6 +20,8 @@
 
 #include "Hierarchy.hpp"
 #include "GraphCoarsen.hpp"
+#include "Timer.hpp"
+#include <cstring>
 #include <iostream>
 #include <fstream>
 
@@ -36,6 +38,7 @@ Hierarchy::Hierarchy(MixedMatrix mixed_system,
       ess_attr_(ess_attr),
       param_(param)
 {
+    ScopedTimer timer("hierarchy");
     mfem::StopWatch chrono;
     chrono.Start();
 
@@ -59,32 +62,431 @@ Hierarchy::Hierarchy(MixedMatrix mixed_system,
     setup_time_ = chrono.RealTime();
 }
 
+namespace
+{
+
+/// Header of the per-process files written by Hierarchy::Save()
+struct HierarchyFileHeader
+{
+    char magic[8];
+    int version;
+    int num_procs;
+    int rank;
+    int num_levels;
+};
+
+const char hierarchy_magic_string[8] = "SMGHIER";
+const int hierarchy_file_version = 2;
+
+std::string HierarchyFileName(const std::string& filename, int rank)
+{
+    return filename + "." + std::to_string(rank);
+}
+
+template <typename T>
+void WriteBinary(std::ostream& out, const T* data, int size)
+{
+    out.write(reinterpret_cast<const char*>(data), sizeof(T) * size);
+}
+
+template <typename T>
+void ReadBinary(std::istream& in, T* data, int size)
+{
+    in.read(reinterpret_cast<char*>(data), sizeof(T) * size);
+    MFEM_VERIFY(in, "Unexpected end of hierarchy file!");
+}
+
+void WriteDenseMatrices(std::ostream& out, const std::vector<mfem::DenseMatrix>& mats)
+{
+    const int num_mats = mats.size();
+    WriteBinary(out, &num_mats, 1);
+
+    for (const auto& mat : mats)
+    {
+        const int sizes[2] = { mat.Height(), mat.Width() };
+        WriteBinary(out, sizes, 2);
+        WriteBinary(out, mat.Data(), sizes[0] * sizes[1]);
+    }
+}
+
+std::vector<mfem::DenseMatrix> ReadDenseMatrices(std::istream& in)
+{
+    int num_mats;
+    ReadBinary(in, &num_mats, 1);
+
+    std::vector<mfem::DenseMatrix> mats(num_mats);
+    for (auto& mat : mats)
+    {
+        int sizes[2];
+        ReadBinary(in, sizes, 2);
+        mat.SetSize(sizes[0], sizes[1]);
+        ReadBinary(in, mat.Data(), sizes[0] * sizes[1]);
+    }
+
+    return mats;
+}
+
+void WriteVector(std::ostream& out, const mfem::Vector& vec)
+{
+    const int size = vec.Size();
+    WriteBinary(out, &size, 1);
+    WriteBinary(out, vec.GetData(), size);
+}
+
+mfem::Vector ReadVector(std::istream& in)
+{
+    int size;
+    ReadBinary(in, &size, 1);
+
+    mfem::Vector vec(size);
+    ReadBinary(in, vec.GetData(), size);
+    return vec;
+}
+
+void WriteIntVector(std::ostream& out, const std::vector<int>& vec)
+{
+    const int size = vec.size();
+    WriteBinary(out, &size, 1);
+    WriteBinary(out, vec.data(), size);
+}
+
+std::vector<int> ReadIntVector(std::istream& in)
+{
+    int size;
+    ReadBinary(in, &size, 1);
+
+    std::vector<int> vec(size);
+    ReadBinary(in, vec.data(), size);
+    return vec;
+}
+
+void WriteSparseMatrix(std::ostream& out, const mfem::SparseMatrix& mat)
+{
+    MFEM_VERIFY(mat.Finalized(), "Only finalized matrices can be written!");
+
+    const int sizes[3] = { mat.Height(), mat.Width(), mat.NumNonZeroElems() };
+    WriteBinary(out, sizes, 3);
+    WriteBinary(out, mat.GetI(), sizes[0] + 1);
+    WriteBinary(out, mat.GetJ(), sizes[2]);
+    WriteBinary(out, mat.GetData(), sizes[2]);
+}
+
+mfem::SparseMatrix ReadSparseMatrix(std::istream& in)
+{
+    int sizes[3];
+    ReadBinary(in, sizes, 3);
+
+    int* I = new int[sizes[0] + 1];
+    int* J = new int[sizes[2]];
+    double* data = new double[sizes[2]];
+    ReadBinary(in, I, sizes[0] + 1);
+    ReadBinary(in, J, sizes[2]);
+    ReadBinary(in, data, sizes[2]);
+
+    return mfem::SparseMatrix(I, J, data, sizes[0], sizes[1]);
+}
+
+/// Number of dofs of each row (entity) of an entity to dof table
+std::vector<int> NumDofs(const mfem::SparseMatrix& entity_dof)
+{
+    std::vector<int> num_dofs(entity_dof.NumRows());
+    for (int i = 0; i < entity_dof.NumRows(); ++i)
+    {
+        num_dofs[i] = entity_dof.RowSize(i);
+    }
+    return num_dofs;
+}
+
+/// Type of the coarse M builder, as written in the hierarchy files
+enum class MBuilderType : int { Element = 0, Coefficient = 1 };
+
+std::unique_ptr<CoarseMBuilder> MakeCoarseMBuilder(MBuilderType type)
+{
+    if (type == MBuilderType::Coefficient)
+    {
+        return make_unique<CoefficientMBuilder>();
+    }
+    MFEM_VERIFY(type == MBuilderType::Element, "Unknown M builder in hierarchy file!");
+    return make_unique<ElementMBuilder>();
+}
+
+} // namespace
+
+Hierarchy::Hierarchy(MixedMatrix mixed_system,
+                     const std::string& filename,
+                     const UpscaleParameters& param,
+                     const mfem::Array<int>* ess_attr)
+    : comm_(mixed_system.GetComm()),
+      setup_time_(0.0),
+      ess_attr_(ess_attr),
+      param_(param)
+{
+    ScopedTimer timer("hierarchy");
+    mfem::StopWatch chrono;
+    chrono.Start();
+
+    MPI_Comm_rank(comm_, &myid_);
+
+    int num_procs;
+    MPI_Comm_size(comm_, &num_procs);
+
+    std::ifstream in(HierarchyFileName(filename, myid_), std::ios::binary);
+    MFEM_VERIFY(in.is_open(), "Cannot open hierarchy file!");
+
+    HierarchyFileHeader header;
+    ReadBinary(in, &header, 1);
+    MFEM_VERIFY(std::strncmp(header.magic, hierarchy_magic_string, 8) == 0,
+                "Not a hierarchy file!");
+    MFEM_VERIFY(header.version == hierarchy_file_version,
+                "Unsupported hierarchy file version!");
+    MFEM_VERIFY(header.num_procs == num_procs,
+                "Hierarchy was saved on a different number of processes!");
+    MFEM_VERIFY(header.rank == myid_, "Hierarchy file belongs to another process!");
+
+    const int num_levels = header.num_levels;
+    param_.max_levels = num_levels;
+    solvers_.resize(num_levels);
+
+    mixed_systems_.reserve(num_levels);
+    mixed_systems_.push_back(std::move(mixed_system));
+    if (ess_attr) { mixed_systems_.back().SetEssDofs(*ess_attr); }
+    MakeSolver(0, param_);
+
+    agg_vert_.reserve(num_levels - 1);
+    Psigma_.reserve(num_levels - 1);
+    Pu_.reserve(num_levels - 1);
+    Proj_sigma_.reserve(num_levels - 1);
+
+    for (int level = 0; level < num_levels - 1; ++level)
+    {
+        ScopedTimer level_timer("load-level-" + std::to_string(level));
+
+        const Graph& graph = GetGraph(level);
+
+        int sizes[2];
+        ReadBinary(in, sizes, 2);
+        MFEM_VERIFY(sizes[0] == graph.NumVertices() && sizes[1] == graph.NumEdges(),
+                    "Graph does not match the one of the saved hierarchy!");
+
+        mfem::Array<int> partitioning(sizes[0]);
+        ReadBinary(in, partitioning.GetData(), sizes[0]);
+
+        GraphTopology topology;
+        Graph coarse_graph = topology.Coarsen(graph, partitioning);
+        agg_vert_.push_back(topology.Agg_vertex_);
+
+        std::vector<int> num_edge_dofs = ReadIntVector(in);
+        std::vector<int> num_vertex_dofs = ReadIntVector(in);
+        MFEM_VERIFY(num_vertex_dofs.size() == (unsigned int) coarse_graph.NumVertices() &&
+                    num_edge_dofs.size() == (unsigned int) coarse_graph.NumEdges(),
+                    "Saved coarse space does not match the coarse graph!");
+        GraphSpace coarse_space(std::move(coarse_graph), num_edge_dofs, num_vertex_dofs);
+
+        MBuilderType mbuilder_type;
+        ReadBinary(in, &mbuilder_type, 1);
+        auto mbuilder = MakeCoarseMBuilder(mbuilder_type);
+        mbuilder->Setup(coarse_space);
+
+        int num_local_mats;
+        ReadBinary(in, &num_local_mats, 1);
+        std::vector<std::vector<mfem::DenseMatrix>> local_mats(num_local_mats);
+        for (auto& mats : local_mats)
+        {
+            mats = ReadDenseMatrices(in);
+        }
+        mbuilder->SetLocalMatrices(std::move(local_mats));
+
+        Pu_.push_back(ReadSparseMatrix(in));
+        Psigma_.push_back(ReadSparseMatrix(in));
+        Proj_sigma_.push_back(ReadSparseMatrix(in));
+
+        mfem::SparseMatrix D = ReadSparseMatrix(in);
+        mfem::SparseMatrix W = ReadSparseMatrix(in);
+        mfem::Vector constant_rep = ReadVector(in);
+        mfem::Vector vertex_sizes = ReadVector(in);
+        mfem::SparseMatrix P_pwc = ReadSparseMatrix(in);
+
+        mixed_systems_.push_back(MixedMatrix(std::move(coarse_space), std::move(mbuilder),
+                                             std::move(D), std::move(W),
+                                             std::move(constant_rep), std::move(vertex_sizes),
+                                             std::move(P_pwc)));
+
+        MakeSolver(level + 1, param_);
+        if (ess_attr) { mixed_systems_.back().SetEssDofs(*ess_attr); }
+    }
+
+    chrono.Stop();
+    setup_time_ = chrono.RealTime();
+}
+
+void Hierarchy::Save(const std::string& filename) const
+{
+    int num_procs;
+    MPI_Comm_size(comm_, &num_procs);
+
+    std::ofstream out(HierarchyFileName(filename, myid_), std::ios::binary);
+    MFEM_VERIFY(out.is_open(), "Cannot open hierarchy file for writing!");
+
+    HierarchyFileHeader header;
+    std::memcpy(header.magic, hierarchy_magic_string, 8);
+    header.version = hierarchy_file_version;
+    header.num_procs = num_procs;
+    header.rank = myid_;
+    header.num_levels = NumLevels();
+    WriteBinary(out, &header, 1);
+
+    for (int level = 0; level < NumLevels() - 1; ++level)
+    {
+        const Graph& graph = GetGraph(level);
+        const int sizes[2] = { graph.NumVertices(), graph.NumEdges() };
+        WriteBinary(out, sizes, 2);
+
+        mfem::Array<int> partitioning = Partitioning(agg_vert_[level]);
+        WriteBinary(out, partitioning.GetData(), sizes[0]);
+
+        const MixedMatrix& coarse_mgL = GetMatrix(level + 1);
+        const GraphSpace& coarse_space = coarse_mgL.GetGraphSpace();
+        WriteIntVector(out, NumDofs(coarse_space.EdgeToEDof()));
+        WriteIntVector(out, NumDofs(coarse_space.VertexToVDof()));
+
+        const auto& mbuilder = dynamic_cast<const CoarseMBuilder&>(coarse_mgL.GetMBuilder());
+        const MBuilderType mbuilder_type = dynamic_cast<const CoefficientMBuilder*>(&mbuilder) ?
+                                           MBuilderType::Coefficient : MBuilderType::Element;
+        WriteBinary(out, &mbuilder_type, 1);
+
+        const auto local_mats = mbuilder.GetLocalMatrices();
+        const int num_local_mats = local_mats.size();
+        WriteBinary(out, &num_local_mats, 1);
+        for (const auto* mats : local_mats)
+        {
+            WriteDenseMatrices(out, *mats);
+        }
+
+        WriteSparseMatrix(out, Pu_[level]);
+        WriteSparseMatrix(out, Psigma_[level]);
+        WriteSparseMatrix(out, Proj_sigma_[level]);
+
+        WriteSparseMatrix(out, coarse_mgL.GetD());
+        WriteSparseMatrix(out, coarse_mgL.GetW());
+        WriteVector(out, coarse_mgL.GetConstantRep());
+        WriteVector(out, coarse_mgL.GetVertexSizes());
+        WriteSparseMatrix(out, coarse_mgL.GetPWConstProj());
+    }
+
+    MFEM_VERIFY(out, "Failed to write hierarchy file!");
+}
+
 void Hierarchy::Coarsen(int level, const UpscaleParameters& param,
                         const mfem::Array<int>* partitioning)
 {
+    ScopedTimer timer("coarsen-level-" + std::to_string(level));
+
     MixedMatrix& mgL = GetMatrix(level);
     mgL.BuildM();
 
     GraphTopology topology;
-    Graph coarse_graph = partitioning ? topology.Coarsen(mgL.GetGraph(), *partitioning) :
-                         topology.Coarsen(mgL.GetGraph(), param.coarse_factor, param.num_iso_verts);
+    Graph coarse_graph;
+    std::unique_ptr<DofAggregate> dof_agg;
+    {
+        ScopedTimer topology_timer("topology");
+        coarse_graph = partitioning ? topology.Coarsen(mgL.GetGraph(), *partitioning) :
+                       topology.Coarsen(mgL.GetGraph(), param.coarse_factor,
+                                        param.num_iso_verts);
+        dof_agg = make_unique<DofAggregate>(topology, mgL.GetGraphSpace());
+    }
 
-    agg_vert_.push_back(topology.Agg_vertex_);
+    LocalMixedGraphSpectralTargets localtargets(mgL, coarse_graph, *dof_agg, param);
+    if (param.cache_targets)
+    {
+        if (targets_cache_.size() <= (unsigned int) level)
+        {
+            targets_cache_.resize(level + 1);
+        }
+        localtargets.SetTargetsCache(targets_cache_[level], param.recoarsen_tol);
+    }
+    std::vector<mfem::DenseMatrix> vertex_targets;
+    {
+        ScopedTimer targets_timer("vertex-targets");
+        vertex_targets = localtargets.ComputeVertexTargets();
+    }
+    std::vector<mfem::DenseMatrix> edge_traces;
+    {
+        ScopedTimer targets_timer("edge-targets");
+        edge_traces = localtargets.ComputeEdgeTargets(vertex_targets);
+    }
 
-    DofAggregate dof_agg(topology, mgL.GetGraphSpace());
+    BuildCoarseLevel(level, param, *dof_agg, edge_traces, vertex_targets,
+                     std::move(coarse_graph));
+}
 
-    LocalMixedGraphSpectralTargets localtargets(mgL, coarse_graph, dof_agg, param);
-    auto vertex_targets = localtargets.ComputeVertexTargets();
+void Hierarchy::Recoarsen(const mfem::Vector& coeff)
+{
+    ScopedTimer timer("recoarsen");
 
-    auto edge_traces = localtargets.ComputeEdgeTargets(vertex_targets);
+    MFEM_VERIFY(coeff.Size() == NumVertices(0),
+                "Coefficient should have one value per fine vertex!");
 
-    GraphCoarsen graph_coarsen(mgL, dof_agg, edge_traces, vertex_targets, std::move(coarse_graph));
+    GetMatrix(0).SetCoefficient(coeff);
+    MakeSolver(0, param_);
 
-    Pu_.push_back(graph_coarsen.BuildPVertices());
-    Psigma_.push_back(graph_coarsen.BuildPEdges(param.coarse_components));
-    Proj_sigma_.push_back(graph_coarsen.BuildEdgeProjection());
+    const int num_levels = NumLevels();
+    std::vector<mfem::Array<int>> partitionings(num_levels - 1);
+    for (int level = 0; level < num_levels - 1; ++level)
+    {
+        partitionings[level] = Partitioning(agg_vert_[level]);
+    }
+
+    // coarse levels are rebuilt from scratch with the same aggregates
+    for (int level = 1; level < num_levels; ++level)
+    {
+        solvers_[level].reset();
+    }
+    while (mixed_systems_.size() > 1)
+    {
+        mixed_systems_.pop_back();
+    }
+    Psigma_.clear();
+    Pu_.clear();
+    Proj_sigma_.clear();
+    agg_vert_.clear();
 
-    mixed_systems_.push_back(graph_coarsen.BuildCoarseMatrix(mgL, Pu_[level]));
+    for (int level = 0; level < num_levels - 1; ++level)
+    {
+        Coarsen(level, param_, &partitionings[level]);
+        MakeSolver(level + 1, param_);
+        if (ess_attr_) { mixed_systems_.back().SetEssDofs(*ess_attr_); }
+    }
+}
+
+void Hierarchy::BuildCoarseLevel(int level, const UpscaleParameters& param,
+                                 const DofAggregate& dof_agg,
+                                 const std::vector<mfem::DenseMatrix>& edge_traces,
+                                 const std::vector<mfem::DenseMatrix>& vertex_targets,
+                                 Graph coarse_graph)
+{
+    MixedMatrix& mgL = GetMatrix(level);
+
+    agg_vert_.push_back(dof_agg.topology_->Agg_vertex_);
+
+    GraphCoarsen graph_coarsen(mgL, dof_agg, edge_traces, vertex_targets,
+                               std::move(coarse_graph));
+
+    {
+        ScopedTimer timer("pvertices");
+        Pu_.push_back(graph_coarsen.BuildPVertices());
+    }
+    {
+        ScopedTimer timer("pedges");
+        Psigma_.push_back(graph_coarsen.BuildPEdges(param.coarse_components));
+    }
+    {
+        ScopedTimer timer("edge-projection");
+        Proj_sigma_.push_back(graph_coarsen.BuildEdgeProjection());
+    }
+    {
+        ScopedTimer timer("coarse-matrix");
+        mixed_systems_.push_back(graph_coarsen.BuildCoarseMatrix(mgL, Pu_[level]));
+    }
 
 #ifdef SMOOTHG_DEBUG
     Debug_tests(level);
@@ -93,17 +495,39 @@ void Hierarchy::Coarsen(int level, const UpscaleParameters& param,
 
 void Hierarchy::MakeSolver(int level, const UpscaleParameters& param)
 {
-    if (param.hybridization) // Hybridization solver
+    ScopedTimer timer("solver-level-" + std::to_string(level));
+
+    int num_procs;
+    MPI_Comm_size(comm_, &num_procs);
+    const GraphSpace& graph_space = GetMatrix(level).GetGraphSpace();
+    const int global_dofs = graph_space.EDofToTrueEDof().N() + graph_space.VDofStarts().Last();
+
+    if (level > 0 && param.agglomerate_dofs > 0 && num_procs > 1 &&
+        global_dofs / num_procs < param.agglomerate_dofs) // latency-bound coarse level
+    {
+        GetMatrix(level).BuildM();
+        solvers_[level] = make_unique<AgglomeratedSolver>(GetMatrix(level), ess_attr_,
+                                                          param.agglomerate_dofs);
+    }
+    else if (param.hybridization) // Hybridization solver
     {
         SAAMGeParam* sa_param = level ? param.saamge_param : nullptr;
-        solvers_[level].reset(new HybridSolver(GetMatrix(level), ess_attr_,
-                                               param.rescale_iter, sa_param));
+        auto hybrid_solver = make_unique<HybridSolver>(GetMatrix(level), ess_attr_,
+                                                       param.rescale_iter, sa_param,
+                                                       param.matrix_free);
+        hybrid_solver->SetAMGReuseRatio(param.amg_reuse_ratio);
+        solvers_[level] = std::move(hybrid_solver);
     }
     else // L2-H1 block diagonal preconditioner
     {
         GetMatrix(level).BuildM();
-        solvers_[level].reset(new BlockSolverFalse(GetMatrix(level), ess_attr_));
+        auto block_solver = make_unique<BlockSolverFalse>(GetMatrix(level), ess_attr_,
+                                                          param.diagonal_schur);
+        block_solver->SetAMGReuseRatio(param.amg_reuse_ratio);
+        block_solver->SetSchurPatternReuse(param.schur_pattern_reuse);
+        solvers_[level] = std::move(block_solver);
     }
+    solvers_[level]->SetPipelinedKrylov(param.pipelined_krylov);
 }
 
 void Hierarchy::Solve(int level, const mfem::BlockVector& x, mfem::BlockVector& y) const
@@ -120,6 +544,27 @@ mfem::BlockVector Hierarchy::Solve(int level, const mfem::BlockVector& x) const
     return y;
 }
 
+void Hierarchy::Solve(int level, const std::vector<mfem::BlockVector>& x,
+                      std::vector<mfem::BlockVector>& y) const
+{
+    assert(level >= 0 && level < NumLevels());
+    solvers_[level]->Solve(x, y);
+}
+
+std::vector<mfem::BlockVector> Hierarchy::Solve(
+    int level, const std::vector<mfem::BlockVector>& x) const
+{
+    std::vector<mfem::BlockVector> y;
+    y.reserve(x.size());
+    for (unsigned int k = 0; k < x.size(); ++k)
+    {
+        y.emplace_back(BlockOffsets(level));
+        y.back() = 0.0;
+    }
+    Solve(level, x, y);
+    return y;
+}
+
 void Hierarchy::Solve(int level, const mfem::Vector& x, mfem::Vector& y) const
 {
     assert(level >= 0 && level < NumLevels());
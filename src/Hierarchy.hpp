@@ -21,6 +21,7 @@
 #ifndef __HIERARCHY_HPP__
 #define __HIERARCHY_HPP__
 
+#include "AgglomeratedSolver.hpp"
 #include "BlockSolver.hpp"
 #include "HybridSolver.hpp"
 #include "MixedMatrix.hpp"
@@ -62,12 +63,52 @@ public:
               const mfem::Array<int>* partitioning = nullptr,
               const mfem::Array<int>* ess_attr = nullptr);
 
+    /**
+       @brief Construct hierarchy from a coarsening saved by Save().
+
+       The coarse levels (partitions, interpolation and projection
+       operators, coarse mixed systems) are read from the files, so no
+       local eigenproblem is solved and no coarse operator is rebuilt. The
+       number of levels and the kind of coarse M builder are the ones of the
+       saved hierarchy, solver parameters (hybridization, ...) are taken
+       from param.
+
+       @param mixed_system fine level mixed system, it must be identical to
+              the one the saved hierarchy was built from
+       @param filename prefix of the files written by Save()
+       @param param upscaling parameters
+       @param ess_attr indicate which boundary attributes to impose essential
+              edge condition. If not provided, will assume no boundary
+    */
+    Hierarchy(MixedMatrix mixed_system,
+              const std::string& filename,
+              const UpscaleParameters& param = UpscaleParameters(),
+              const mfem::Array<int>* ess_attr = nullptr);
+
     Hierarchy() = default;
 
+    /**
+       @brief Save the coarsening of the hierarchy to files
+
+       Every process writes its own binary file filename.<rank>, containing
+       for each level the partition of vertices, the coarse dofs, the local
+       matrices of the coarse M builder, Pu, Psigma, Proj_sigma and the
+       other blocks of the coarse mixed system. The files can only be read
+       by Hierarchy(mixed_system, filename, ...) on the same number of
+       processes.
+    */
+    void Save(const std::string& filename) const;
+
     /// At a given level, solve mixed system for the given RHS (x)
     virtual void Solve(int level, const mfem::BlockVector& x, mfem::BlockVector& y) const;
     mfem::BlockVector Solve(int level, const mfem::BlockVector& x) const;
 
+    /// At a given level, solve mixed system for several RHS (x) at once
+    virtual void Solve(int level, const std::vector<mfem::BlockVector>& x,
+                       std::vector<mfem::BlockVector>& y) const;
+    std::vector<mfem::BlockVector> Solve(int level,
+                                         const std::vector<mfem::BlockVector>& x) const;
+
     /// At a given level, solve primal system for the given RHS (x)
     virtual void Solve(int level, const mfem::Vector& x, mfem::Vector& y) const;
     mfem::Vector Solve(int level, const mfem::Vector& x) const;
@@ -140,6 +181,22 @@ public:
     /// coeff should have the size of the number of vertices in the given level
     void RescaleCoefficient(int level, const mfem::Vector& coeff);
 
+    /**
+       @brief Rebuild the coarse levels for a new coefficient on the finest level
+
+       Unlike RescaleCoefficient, the spectral targets are recomputed, so the
+       coarse levels are adapted to the coefficient. The aggregates are kept.
+       If param.cache_targets is set, aggregates where M on the extended
+       aggregate changed by less than param.recoarsen_tol keep their targets,
+       and the other local eigenproblems are warm started from the ones of the
+       previous coarsening if they are solved by LOBPCG (see
+       LocalMixedGraphSpectralTargets::SetTargetsCache).
+
+       @param coeff coefficient on the vertices of the finest level, the
+              element matrices of M are scaled by 1 / coeff
+    */
+    void Recoarsen(const mfem::Vector& coeff);
+
     /// Show Total setup time
     void ShowSetupTime(std::ostream& out = std::cout) const;
 
@@ -150,6 +207,7 @@ public:
     MPI_Comm GetComm() const { return GetMatrix(0).GetComm(); }
     const mfem::SparseMatrix& GetPsigma(int level) const { return Psigma_[level]; }
     const mfem::SparseMatrix& GetPu(int level) const { return Pu_[level]; }
+    const mfem::SparseMatrix& GetProjSigma(int level) const { return Proj_sigma_[level]; }
     int NumLevels() const { return mixed_systems_.size(); }
     ///@}
 
@@ -168,15 +226,24 @@ public:
     void DumpDebug(const std::string& prefix) const;
 
     const mfem::SparseMatrix& GetAggVert(int level) const { return agg_vert_[level]; }
-    const std::vector<mfem::DenseMatrix>& GetTraces(int level) const
+
+    /// Local spectral data kept for Recoarsen (if param.cache_targets is set)
+    const SpectralTargetsCache& GetTargetsCache(int level) const
     {
-        return edge_traces_[level];
+        return targets_cache_[level];
     }
 
 private:
     void Coarsen(int level, const UpscaleParameters& param,
                  const mfem::Array<int>* partitioning);
 
+    /// Build level + 1 from the local spectral targets of level
+    void BuildCoarseLevel(int level, const UpscaleParameters& param,
+                          const DofAggregate& dof_agg,
+                          const std::vector<mfem::DenseMatrix>& edge_traces,
+                          const std::vector<mfem::DenseMatrix>& vertex_targets,
+                          Graph coarse_graph);
+
     /// Test if Proj_sigma_ * Psigma_ = identity
     void Debug_tests(int level) const;
 
@@ -189,7 +256,6 @@ private:
     std::vector<mfem::SparseMatrix> Psigma_;
     std::vector<mfem::SparseMatrix> Pu_;
     std::vector<mfem::SparseMatrix> Proj_sigma_;
-    std::vector<std::vector<mfem::DenseMatrix>> edge_traces_;
 
     double setup_time_;
 
@@ -197,6 +263,8 @@ private:
 
     std::vector<mfem::SparseMatrix > agg_vert_;
     UpscaleParameters param_;
+
+    std::vector<SpectralTargetsCache> targets_cache_;
 };
 
 } // namespace smoothg
@@ -0,0 +1,292 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file
+
+    @brief Implements HierarchyPreconditioner
+*/
+
+#include "HierarchyPreconditioner.hpp"
+#include "Timer.hpp"
+
+#include <cmath>
+
+namespace smoothg
+{
+
+namespace
+{
+
+/// Row sums of absolute values (diagonal and off diagonal blocks)
+mfem::Vector L1RowSums(const mfem::HypreParMatrix& mat)
+{
+    mfem::SparseMatrix diag = GetDiag(mat);
+    mfem::SparseMatrix offd = GetOffd(mat);
+
+    mfem::Vector sums(diag.NumRows());
+    for (int i = 0; i < diag.NumRows(); ++i)
+    {
+        double sum = 0.0;
+        for (int j = diag.GetI()[i]; j < diag.GetI()[i + 1]; ++j)
+        {
+            sum += std::fabs(diag.GetData()[j]);
+        }
+        for (int j = offd.GetI()[i]; j < offd.GetI()[i + 1]; ++j)
+        {
+            sum += std::fabs(offd.GetData()[j]);
+        }
+        sums[i] = sum;
+    }
+    return sums;
+}
+
+} // namespace
+
+HierarchyPreconditioner::HierarchyPreconditioner(Hierarchy& hierarchy,
+                                                 const mfem::Array<int>* ess_attr,
+                                                 int cycle_index, int num_smooth)
+    : mfem::Solver(hierarchy.GetMatrix(0).BlockTrueOffsets().Last()),
+      hierarchy_(hierarchy), ess_attr_(ess_attr), cycle_index_(cycle_index),
+      num_smooth_(num_smooth)
+{
+    MFEM_VERIFY(hierarchy.NumLevels() > 1, "HierarchyPreconditioner needs coarse levels!");
+    MFEM_VERIFY(cycle_index_ > 0 && num_smooth_ > 0, "Invalid cycle parameters!");
+
+    ScopedTimer timer("hierarchy-preconditioner-setup");
+
+    MPI_Comm_rank(hierarchy.GetComm(), &myid_);
+
+    for (int l = 0; l < hierarchy.NumLevels(); ++l)
+    {
+        MixedMatrix& mgL = hierarchy.GetMatrix(l);
+        mgL.BuildM();
+
+        levels_.push_back(make_unique<Level>(mgL));
+        BuildLevel(mgL, *levels_.back());
+    }
+
+    coarse_solver_ = make_unique<BlockSolver>(hierarchy.GetMatrix(NumLevels() - 1), ess_attr_);
+    coarse_solver_->SetRelTol(1e-10);
+    coarse_solver_->SetAbsTol(1e-16);
+}
+
+void HierarchyPreconditioner::BuildLevel(const MixedMatrix& mgL, Level& level) const
+{
+    // essential edge dofs and pinned vertex dof, as in BlockSolver
+    mfem::Array<int> ess_edofs;
+    bool remove_one_dof = true;
+    if (ess_attr_)
+    {
+        ess_edofs.SetSize(mgL.NumEDofs(), 0);
+        BooleanMult(mgL.GetGraphSpace().EDofToBdrAtt(), *ess_attr_, ess_edofs);
+        remove_one_dof = (ess_attr_->Find(0) == -1);
+    }
+    const bool pinned = !mgL.CheckW() && remove_one_dof && myid_ == 0;
+
+    mfem::SparseMatrix M_proc(mgL.GetM());
+    for (int mm = 0; mm < ess_edofs.Size(); ++mm)
+    {
+        if (ess_edofs[mm])
+            M_proc.EliminateRowCol(mm);
+    }
+    level.M.reset(mgL.MakeParallelM(M_proc));
+
+    mfem::SparseMatrix D_proc(mgL.GetD());
+    if (ess_edofs.Size())
+    {
+        D_proc.EliminateCols(ess_edofs);
+    }
+    if (pinned)
+    {
+        D_proc.EliminateRow(0);
+    }
+    level.D.reset(mgL.MakeParallelD(D_proc));
+    level.DT.reset(level.D->Transpose());
+
+    if (mgL.CheckW())
+    {
+        level.W = make_unique<mfem::SparseMatrix>(mgL.GetW());
+    }
+    else if (pinned)
+    {
+        level.W = make_unique<mfem::SparseMatrix>(mgL.NumVDofs());
+        level.W->Add(0, 0, -1.0);
+        level.W->Finalize();
+    }
+
+    level.op = make_unique<mfem::BlockOperator>(level.offsets);
+    level.op->SetBlock(0, 0, level.M.get());
+    level.op->SetBlock(0, 1, level.DT.get());
+    level.op->SetBlock(1, 0, level.D.get());
+    if (level.W)
+    {
+        level.op->SetBlock(1, 1, level.W.get(), -1.0);
+    }
+
+    // l1 smoother of M and of the Schur complement D Mhat^{-1} D^T + W
+    mfem::Vector M_l1 = L1RowSums(*level.M);
+    level.DT->InvScaleRows(M_l1);
+    std::unique_ptr<mfem::HypreParMatrix> schur(mfem::ParMult(level.D.get(), level.DT.get()));
+    level.DT->ScaleRows(M_l1);
+    mfem::Vector S_l1 = L1RowSums(*schur);
+
+    if (mgL.CheckW())
+    {
+        for (int i = 0; i < S_l1.Size(); ++i)
+        {
+            for (int j = level.W->GetI()[i]; j < level.W->GetI()[i + 1]; ++j)
+            {
+                S_l1[i] += std::fabs(level.W->GetData()[j]);
+            }
+        }
+    }
+    else if (pinned)
+    {
+        // the pinned row reads u_0 = g_0, the smoother solves it exactly
+        S_l1[0] = -1.0;
+    }
+
+    level.M_inv.SetSize(M_l1.Size());
+    for (int i = 0; i < M_l1.Size(); ++i)
+    {
+        level.M_inv[i] = M_l1[i] != 0.0 ? 1.0 / M_l1[i] : 0.0;
+    }
+    level.S_inv.SetSize(S_l1.Size());
+    for (int i = 0; i < S_l1.Size(); ++i)
+    {
+        level.S_inv[i] = S_l1[i] != 0.0 ? 1.0 / S_l1[i] : 0.0;
+    }
+
+    level.edof_trueedof = &mgL.GetGraphSpace().EDofToTrueEDof();
+    level.edof_trueedof_diag = make_unique<mfem::SparseMatrix>(GetDiag(*level.edof_trueedof));
+}
+
+void HierarchyPreconditioner::Mult(const mfem::Vector& x, mfem::Vector& y) const
+{
+    const mfem::Array<int>& offsets = levels_[0]->offsets;
+    const mfem::BlockVector x_block(x.GetData(), offsets);
+    mfem::BlockVector y_block(y.GetData(), offsets);
+
+    Cycle(0, x_block, y_block);
+}
+
+void HierarchyPreconditioner::Cycle(int l, const mfem::BlockVector& b,
+                                    mfem::BlockVector& x) const
+{
+    x = 0.0;
+
+    if (l == NumLevels() - 1)
+    {
+        coarse_solver_->Mult(b, x);
+        return;
+    }
+
+    const Level& level = *levels_[l];
+    const Level& coarse = *levels_[l + 1];
+
+    for (int i = 0; i < num_smooth_; ++i)
+    {
+        Smooth(l, b, x);
+    }
+
+    level.op->Mult(x, level.residual);
+    level.residual.Neg();
+    level.residual += b;
+
+    // coarse.rhs holds the coarse residual of the current coarse solution
+    Restrict(l, level.residual, coarse.rhs);
+    coarse.sol = 0.0;
+    for (int k = 0; k < cycle_index_; ++k)
+    {
+        Cycle(l + 1, coarse.rhs, coarse.sol_update);
+        coarse.sol += coarse.sol_update;
+
+        if (k + 1 < cycle_index_)
+        {
+            coarse.op->Mult(coarse.sol_update, coarse.residual);
+            coarse.rhs -= coarse.residual;
+        }
+    }
+    AddInterpolation(l, coarse.sol, x);
+
+    for (int i = 0; i < num_smooth_; ++i)
+    {
+        Smooth(l, b, x);
+    }
+}
+
+void HierarchyPreconditioner::Smooth(int l, const mfem::BlockVector& b,
+                                     mfem::BlockVector& x) const
+{
+    const Level& level = *levels_[l];
+
+    level.op->Mult(x, level.residual);
+    level.residual.Neg();
+    level.residual += b;
+
+    mfem::Vector& r_sigma = level.residual.GetBlock(0);
+    mfem::Vector& r_u = level.residual.GetBlock(1);
+    mfem::Vector& d_sigma = level.correction.GetBlock(0);
+    mfem::Vector& d_u = level.correction.GetBlock(1);
+
+    // forward: d_sigma = Mhat^{-1} r_sigma, d_u = Shat^{-1} (D d_sigma - r_u)
+    for (int i = 0; i < d_sigma.Size(); ++i)
+    {
+        d_sigma[i] = level.M_inv[i] * r_sigma[i];
+    }
+
+    level.D->Mult(d_sigma, d_u);
+    for (int i = 0; i < d_u.Size(); ++i)
+    {
+        d_u[i] = level.S_inv[i] * (d_u[i] - r_u[i]);
+    }
+
+    // backward: d_sigma -= Mhat^{-1} D^T d_u
+    level.DT->Mult(d_u, r_sigma);
+    for (int i = 0; i < d_sigma.Size(); ++i)
+    {
+        d_sigma[i] -= level.M_inv[i] * r_sigma[i];
+    }
+
+    x += level.correction;
+}
+
+void HierarchyPreconditioner::Restrict(int l, const mfem::BlockVector& fine,
+                                       mfem::BlockVector& coarse) const
+{
+    const Level& level = *levels_[l];
+    const Level& coarse_level = *levels_[l + 1];
+
+    level.edof_trueedof_diag->Mult(fine.GetBlock(0), level.sigma_dof);
+    hierarchy_.GetPsigma(l).MultTranspose(level.sigma_dof, coarse_level.sigma_dof);
+    coarse_level.edof_trueedof->MultTranspose(coarse_level.sigma_dof, coarse.GetBlock(0));
+
+    hierarchy_.GetPu(l).MultTranspose(fine.GetBlock(1), coarse.GetBlock(1));
+}
+
+void HierarchyPreconditioner::AddInterpolation(int l, const mfem::BlockVector& coarse,
+                                               mfem::BlockVector& fine) const
+{
+    const Level& level = *levels_[l];
+    const Level& coarse_level = *levels_[l + 1];
+
+    coarse_level.edof_trueedof->Mult(coarse.GetBlock(0), coarse_level.sigma_dof);
+    hierarchy_.GetPsigma(l).Mult(coarse_level.sigma_dof, level.sigma_dof);
+    level.edof_trueedof_diag->AddMultTranspose(level.sigma_dof, fine.GetBlock(0));
+
+    hierarchy_.GetPu(l).AddMult(coarse.GetBlock(1), fine.GetBlock(1));
+}
+
+} // namespace smoothg
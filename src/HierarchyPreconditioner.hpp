@@ -0,0 +1,142 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file HierarchyPreconditioner.hpp
+
+    @brief Multilevel preconditioner for the fine level mixed system built
+    from the interpolation and projection operators of a Hierarchy.
+*/
+
+#ifndef __HIERARCHYPRECONDITIONER_HPP__
+#define __HIERARCHYPRECONDITIONER_HPP__
+
+#include "Hierarchy.hpp"
+
+namespace smoothg
+{
+
+/**
+   @brief V- or W-cycle on the mixed system of the finest level of a Hierarchy.
+
+   Every level of the hierarchy holds the saddle point system
+   \f[
+     \mathcal{A}_l =
+     \left( \begin{array}{cc}
+       M_l & D_l^T \\
+       D_l & -W_l
+     \end{array} \right)
+   \f]
+   in true dofs, with the same treatment of essential edge dofs and of the
+   pinned vertex dof as BlockSolver. On all but the coarsest level, the
+   smoother is a symmetric inexact Uzawa sweep with the l1 diagonals
+   \f$ \hat{M}_l \f$ of \f$ M_l \f$ and \f$ \hat{S}_l \f$ of
+   \f$ D_l \hat{M}_l^{-1} D_l^T + W_l \f$. Levels are connected by the
+   interpolation operators P_sigma and P_u of the hierarchy (and their
+   transposes as restriction), the coarsest level is solved with BlockSolver
+   to a tight tolerance.
+
+   The cycle is not symmetric positive definite, so it has to be used as
+   preconditioner of GMRES, see BlockSolver::SetPreconditioner().
+
+   The hierarchy must outlive this object and must not be moved while it is
+   in use.
+*/
+class HierarchyPreconditioner : public mfem::Solver
+{
+public:
+    /**
+       @param hierarchy multilevel hierarchy, the cycle acts on its level 0
+       @param ess_attr marker of essential boundary attributes (or nullptr)
+       @param cycle_index 1 for V-cycle, 2 for W-cycle
+       @param num_smooth number of pre- and post-smoothing sweeps
+    */
+    HierarchyPreconditioner(Hierarchy& hierarchy,
+                            const mfem::Array<int>* ess_attr = nullptr,
+                            int cycle_index = 1, int num_smooth = 1);
+
+    /// Apply one cycle to x (level 0 true dofs), y does not need an initial value
+    virtual void Mult(const mfem::Vector& x, mfem::Vector& y) const;
+
+    /// The operator is defined by the hierarchy, nothing to do here
+    virtual void SetOperator(const mfem::Operator& op) { }
+
+    /// Relative tolerance of the coarsest level solver (default 1e-10)
+    void SetCoarseRelTol(double rtol) { coarse_solver_->SetRelTol(rtol); }
+
+    int NumLevels() const { return levels_.size(); }
+
+private:
+    /// True dof operators and work vectors of one level
+    struct Level
+    {
+        explicit Level(const MixedMatrix& mgL)
+            : offsets(mgL.BlockTrueOffsets()), residual(offsets), correction(offsets),
+              sigma_dof(mgL.NumEDofs()), rhs(offsets), sol(offsets), sol_update(offsets) { }
+
+        const mfem::Array<int>& offsets;
+
+        std::unique_ptr<mfem::HypreParMatrix> M;
+        std::unique_ptr<mfem::HypreParMatrix> D;
+        std::unique_ptr<mfem::HypreParMatrix> DT;
+        std::unique_ptr<mfem::SparseMatrix> W;
+        std::unique_ptr<mfem::BlockOperator> op;
+
+        /// inverse l1 diagonals of M and of the approximate Schur complement
+        mfem::Vector M_inv;
+        mfem::Vector S_inv;
+
+        /// local (dof to true dof) diagonal block of the edge dof map
+        std::unique_ptr<mfem::SparseMatrix> edof_trueedof_diag;
+        const mfem::HypreParMatrix* edof_trueedof;
+
+        /// residual and temporaries of the smoother on this level
+        mutable mfem::BlockVector residual;
+        mutable mfem::BlockVector correction;
+        mutable mfem::Vector sigma_dof;
+
+        /// right hand side and solution when visited from the level above
+        mutable mfem::BlockVector rhs;
+        mutable mfem::BlockVector sol;
+        mutable mfem::BlockVector sol_update;
+    };
+
+    void BuildLevel(const MixedMatrix& mgL, Level& level) const;
+
+    void Cycle(int l, const mfem::BlockVector& b, mfem::BlockVector& x) const;
+
+    /// One symmetric inexact Uzawa sweep on level l, x is updated in place
+    void Smooth(int l, const mfem::BlockVector& b, mfem::BlockVector& x) const;
+
+    /// Residual on level l restricted to the true dofs of level l + 1
+    void Restrict(int l, const mfem::BlockVector& fine, mfem::BlockVector& coarse) const;
+
+    /// fine += interpolation of coarse (true dofs of level l + 1 to level l)
+    void AddInterpolation(int l, const mfem::BlockVector& coarse,
+                          mfem::BlockVector& fine) const;
+
+    const Hierarchy& hierarchy_;
+    const mfem::Array<int>* ess_attr_;
+
+    int cycle_index_;
+    int num_smooth_;
+    int myid_;
+
+    std::vector<std::unique_ptr<Level>> levels_;
+    std::unique_ptr<BlockSolver> coarse_solver_;
+};
+
+} // namespace smoothg
+
+#endif /* __HIERARCHYPRECONDITIONER_HPP__ */
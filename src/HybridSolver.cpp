@@ -24,16 +24,105 @@
 #include "utilities.hpp"
 #include "MatrixUtilities.hpp"
 #include "MetisGraphPartitioner.hpp"
+#include "Timer.hpp"
+#include "BatchedDenseMatrices.hpp"
+
+#include <array>
 
 using std::unique_ptr;
 
 namespace smoothg
 {
 
+HybridOperator::HybridOperator(const mfem::SparseMatrix& Agg_multiplier,
+                               const mfem::SparseMatrix& color_Agg,
+                               const std::vector<mfem::DenseMatrix>& Hybrid_el,
+                               const mfem::HypreParMatrix& multiplier_d_td,
+                               const mfem::HypreParMatrix& multiplier_td_d,
+                               const mfem::Array<int>& ess_true_multipliers)
+    : mfem::Operator(multiplier_d_td.NumCols()),
+      Agg_multiplier_(Agg_multiplier),
+      color_Agg_(color_Agg),
+      Hybrid_el_(Hybrid_el),
+      multiplier_d_td_(multiplier_d_td),
+      multiplier_td_d_(multiplier_td_d),
+      ess_true_multipliers_(ess_true_multipliers),
+      elem_scaling_(nullptr),
+      x_true_(multiplier_d_td.NumCols()),
+      x_d_(multiplier_d_td.NumRows()),
+      y_d_(multiplier_d_td.NumRows())
+{
+}
+
+void HybridOperator::Mult(const mfem::Vector& x, mfem::Vector& y) const
+{
+    x_true_ = x;
+    for (int ess_true_mult : ess_true_multipliers_)
+    {
+        x_true_(ess_true_mult) = 0.0;
+    }
+
+    MultUnconstrained(x_true_, y);
+
+    // eliminated rows and columns have unit diagonal, as in EliminateRowsCols
+    for (int ess_true_mult : ess_true_multipliers_)
+    {
+        y(ess_true_mult) = x(ess_true_mult);
+    }
+}
+
+void HybridOperator::MultUnconstrained(const mfem::Vector& x, mfem::Vector& y) const
+{
+    multiplier_d_td_.Mult(x, x_d_);
+    MultLocal(x_d_, y_d_);
+    multiplier_td_d_.Mult(y_d_, y);
+}
+
+void HybridOperator::MultLocal(const mfem::Vector& x_d, mfem::Vector& y_d) const
+{
+    y_d = 0.0;
+
+    // Aggregates of the same color share no multiplier, so they add to
+    // disjoint entries of y_d and can be processed concurrently
+#if SMOOTHG_USE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        mfem::Array<int> local_multiplier;
+        mfem::Vector x_loc, y_loc;
+
+        for (int color = 0; color < color_Agg_.NumRows(); ++color)
+        {
+            const int num_color_aggs = color_Agg_.RowSize(color);
+            const int* color_aggs = color_Agg_.GetRowColumns(color);
+
+#if SMOOTHG_USE_OPENMP
+            #pragma omp for schedule(dynamic)
+#endif
+            for (int k = 0; k < num_color_aggs; ++k)
+            {
+                const int iAgg = color_aggs[k];
+                GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
+
+                x_d.GetSubVector(local_multiplier, x_loc);
+                y_loc.SetSize(local_multiplier.Size());
+                Hybrid_el_[iAgg].Mult(x_loc, y_loc);
+
+                if (elem_scaling_)
+                {
+                    y_loc /= (*elem_scaling_)(iAgg);
+                }
+                y_d.AddElementVector(local_multiplier, y_loc);
+            }
+        }
+    }
+}
+
 HybridSolver::HybridSolver(const MixedMatrix& mgL,
                            const mfem::Array<int>* ess_attr,
                            const int rescale_iter,
-                           const SAAMGeParam* saamge_param)
+                           const SAAMGeParam* saamge_param,
+                           bool matrix_free)
     :
     MixedLaplacianSolver(mgL.GetComm(), mgL.BlockOffsets(), mgL.CheckW()),
     mgL_(mgL),
@@ -52,7 +141,7 @@ HybridSolver::HybridSolver(const MixedMatrix& mgL,
     const GraphSpace& graph_space = mgL.GetGraphSpace();
 
     Init(graph_space.EdgeToEDof(), mbuilder->GetElementMatrices(),
-         graph_space.EDofToTrueEDof(), graph_space.EDofToBdrAtt());
+         graph_space.EDofToTrueEDof(), graph_space.EDofToBdrAtt(), matrix_free);
 }
 
 HybridSolver::~HybridSolver()
@@ -70,40 +159,53 @@ void HybridSolver::Init(
     const mfem::SparseMatrix& face_edgedof,
     const std::vector<mfem::DenseMatrix>& M_el,
     const mfem::HypreParMatrix& edgedof_d_td,
-    const mfem::SparseMatrix& edgedof_bdrattr)
+    const mfem::SparseMatrix& edgedof_bdrattr,
+    bool matrix_free)
 {
+    ScopedTimer timer("hybrid-init");
     mfem::StopWatch chrono;
     chrono.Clear();
     chrono.Start();
 
     nAggs_ = mgL_.GetGraph().NumVertices();
 
-    // Set the size of the Hybrid_el_, AinvCT, Ainv_f_, these are all local
-    // matrices and vector for each element
-    DMinv_.resize(nAggs_);
-    MinvCT_.resize(nAggs_);
-    AinvDMinvCT_.resize(nAggs_);
-    Ainv_.resize(nAggs_);
-    Minv_.resize(nAggs_);
-    Minv_ref_.resize(nAggs_);
     Hybrid_el_.resize(nAggs_);
     C_.resize(nAggs_);
-    CM_.resize(nAggs_);
     CDT_.resize(nAggs_);
-    Minv_g_.resize(nAggs_);
-    local_rhs_.resize(nAggs_);
 
     elem_scaling_.SetSize(nAggs_);
     elem_scaling_ = 1.0;
 
-    edof_needs_averaging_ = MakeAveragingIndicators();
+    {
+        ScopedTimer relations_timer("multiplier-relations");
+        CreateMultiplierRelations(face_edgedof, edgedof_d_td);
+    }
+
+    InitLocalStorage();
 
-    CreateMultiplierRelations(face_edgedof, edgedof_d_td);
+    ColorAggregates();
 
     CollectEssentialDofs(edgedof_bdrattr);
 
+    // Only worth it with several multipliers per face (the system is then
+    // preconditioned by AuxSpacePrec), SAAMGe needs the assembled system
+    const bool use_matrix_free = matrix_free && !saamge_param_ &&
+                                 multiplier_d_td_->N() != mgL_.GetGraph().EdgeToTrueEdge().N();
+    BuildSystemPattern(face_edgedof, use_matrix_free);
+    if (use_matrix_free)
+    {
+        H_op_ = make_unique<HybridOperator>(Agg_multiplier_, color_Agg_, Hybrid_el_,
+                                            *multiplier_d_td_, *multiplier_td_d_,
+                                            ess_true_multipliers_);
+    }
+
     // Assemble the hybridized system on each processor
-    mfem::SparseMatrix H_proc = AssembleHybridSystem(M_el);
+    mfem::SparseMatrix H_proc;
+    {
+        ScopedTimer assemble_timer("assemble");
+        mfem::SparseMatrix H_assembled = AssembleHybridSystem(M_el);
+        H_proc.Swap(H_assembled);
+    }
     if (myid_ == 0 && print_level_ > 0)
         std::cout << "  Timing: Hybridized system built in "
                   << chrono.RealTime() << "s. \n";
@@ -177,6 +279,59 @@ void HybridSolver::CreateMultiplierRelations(
     }
 }
 
+void HybridSolver::ColorAggregates()
+{
+    mfem::SparseMatrix multiplier_Agg = smoothg::Transpose(Agg_multiplier_);
+
+    mfem::SparseMatrix Agg_Agg = smoothg::Mult(Agg_multiplier_, multiplier_Agg);
+    mfem::Array<int> colors;
+    GetElementColoring(colors, Agg_Agg);
+
+    const int num_colors = colors.Size() > 0 ? colors.Max() + 1 : 1;
+    mfem::SparseMatrix color_Agg = PartitionToMatrix(colors, num_colors);
+    color_Agg_.Swap(color_Agg);
+}
+
+void HybridSolver::BuildSystemPattern(const mfem::SparseMatrix& face_edgedof,
+                                      bool matrix_free)
+{
+    mfem::SparseMatrix multiplier_Agg = smoothg::Transpose(Agg_multiplier_);
+
+    if (!matrix_free)
+    {
+        mfem::SparseMatrix H_pattern = smoothg::Mult(multiplier_Agg, Agg_multiplier_);
+        H_proc_pattern_.Swap(H_pattern);
+        return;
+    }
+
+    // multipliers on the same face (face edge dofs are the multipliers)
+    mfem::SparseMatrix multiplier_face = smoothg::Transpose(face_edgedof);
+    mfem::SparseMatrix face_blocks = smoothg::Mult(multiplier_face, face_edgedof);
+
+    // first (PV) multipliers of faces of the same aggregate, the PV being the
+    // first dof of a face as assumed in BuildPreconditioner
+    mfem::Vector is_first(num_multiplier_dofs_);
+    is_first = 0.0;
+    for (int face = 0; face < face_edgedof.NumRows(); ++face)
+    {
+        if (face_edgedof.RowSize(face) > 0)
+        {
+            is_first[face_edgedof.GetRowColumns(face)[0]] = 1.0;
+        }
+    }
+    mfem::SparseMatrix Agg_first_multiplier(Agg_multiplier_);
+    Agg_first_multiplier = 1.0;
+    Agg_first_multiplier.ScaleColumns(is_first);
+    Agg_first_multiplier = DropSmall(Agg_first_multiplier);
+
+    mfem::SparseMatrix first_multiplier_Agg = smoothg::Transpose(Agg_first_multiplier);
+    mfem::SparseMatrix first_blocks = smoothg::Mult(first_multiplier_Agg,
+                                                    Agg_first_multiplier);
+
+    unique_ptr<mfem::SparseMatrix> H_pattern(mfem::Add(face_blocks, first_blocks));
+    H_proc_pattern_.Swap(*H_pattern);
+}
+
 std::vector<bool> HybridSolver::MakeAveragingIndicators()
 {
     auto edof_vert = smoothg::Transpose(mgL_.GetGraphSpace().VertexToEDof());
@@ -188,189 +343,268 @@ std::vector<bool> HybridSolver::MakeAveragingIndicators()
     return out;
 }
 
+void HybridSolver::InitLocalStorage()
+{
+    const auto& Agg_vertexdof = mgL_.GetGraphSpace().VertexToVDof();
+    const auto& Agg_edgedof = mgL_.GetGraphSpace().VertexToEDof();
+
+    std::vector<int> num_vdofs(nAggs_), num_edofs(nAggs_), num_multipliers(nAggs_);
+    for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+    {
+        num_vdofs[iAgg] = Agg_vertexdof.RowSize(iAgg);
+        num_edofs[iAgg] = Agg_edgedof.RowSize(iAgg);
+        num_multipliers[iAgg] = Agg_multiplier_.RowSize(iAgg);
+    }
+
+    DMinv_ = PackedDenseMatrices(num_vdofs, num_edofs);
+    MinvCT_ = PackedDenseMatrices(num_edofs, num_multipliers);
+    AinvDMinvCT_ = PackedDenseMatrices(num_vdofs, num_multipliers);
+    Ainv_ = PackedDenseMatrices(num_vdofs, num_vdofs);
+    Minv_ref_ = PackedDenseMatrices(num_edofs, num_edofs);
+    CM_ = PackedDenseMatrices(num_multipliers, num_edofs);
+
+    Minv_g_.SetSize(Agg_edgedof.NumNonZeroElems());
+    local_rhs_.SetSize(Agg_vertexdof.NumNonZeroElems());
+
+    const std::vector<bool> edof_needs_averaging = MakeAveragingIndicators();
+    const int* edof_J = Agg_edgedof.GetJ();
+    agg_edof_weight_.SetSize(Agg_edgedof.NumNonZeroElems());
+    for (int i = 0; i < agg_edof_weight_.Size(); ++i)
+    {
+        agg_edof_weight_[i] = edof_needs_averaging[edof_J[i]] ? 0.5 : 1.0;
+    }
+}
+
 mfem::SparseMatrix HybridSolver::AssembleHybridSystem(
     const std::vector<mfem::DenseMatrix>& M_el)
 {
-    mfem::SparseMatrix H_proc(num_multiplier_dofs_);
-
     const auto& Agg_vertexdof = mgL_.GetGraphSpace().VertexToVDof();
     const auto& Agg_edgedof = mgL_.GetGraphSpace().VertexToEDof();
 
     const int map_size = std::max(Agg_edgedof.Width(), Agg_vertexdof.Width());
-    mfem::Array<int> edof_global_to_local_map(map_size);
-    edof_global_to_local_map = -1;
-    std::vector<bool> edge_marker(Agg_edgedof.Width(), true);
 
     mfem::SparseMatrix edof_IsOwned = GetDiag(*multiplier_d_td_);
 
-    const int scaling_size = rescale_iter_ < 0 ? H_proc.NumRows() : 0;
-    mfem::Vector CCT_diag(scaling_size), CDT1(scaling_size);
-    CCT_diag = 0.0;
-    CDT1 = 0.0;
-
-    mfem::DenseMatrix DlocT, ClocT, Aloc, CMinvDT, DMinvCT, CMDADMC;
-    mfem::Vector one;
-    mfem::DenseMatrixInverse Mloc_solver, Aloc_solver;
+    // The sign of C on a multiplier owned by this processor is positive in the
+    // first aggregate containing the multiplier and negative in the other one
+    mfem::Array<int> multiplier_first_Agg(num_multiplier_dofs_);
+    multiplier_first_Agg = -1;
     for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
     {
-        // Extracting the size and global numbering of local dof
-        mfem::Array<int> local_vertexdof, local_edgedof, local_multiplier;
-        GetTableRow(Agg_vertexdof, iAgg, local_vertexdof);
-        GetTableRow(Agg_edgedof, iAgg, local_edgedof);
-        GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
-
-        const int nlocal_vertexdof = local_vertexdof.Size();
-        const int nlocal_edgedof = local_edgedof.Size();
-        const int nlocal_multiplier = local_multiplier.Size();
+        const int* Agg_mult = Agg_multiplier_.GetRowColumns(iAgg);
+        for (int i = 0; i < Agg_multiplier_.RowSize(iAgg); ++i)
+        {
+            if (multiplier_first_Agg[Agg_mult[i]] < 0)
+                multiplier_first_Agg[Agg_mult[i]] = iAgg;
+        }
+    }
 
-        // Build the edge dof global to local map which will be used
-        // later for mapping local multiplier dof to local edge dof
-        for (int i = 0; i < nlocal_edgedof; ++i)
-            edof_global_to_local_map[local_edgedof[i]] = i;
+    const int scaling_size = rescale_iter_ < 0 ? num_multiplier_dofs_ : 0;
+    std::vector<mfem::Vector> CCT_diag_el(scaling_size > 0 ? nAggs_ : 0);
+    std::vector<mfem::Vector> CDT1_el(scaling_size > 0 ? nAggs_ : 0);
 
-        // Extract Dloc as a sparse submatrix of D_
-        auto Dloc = ExtractRowAndColumns(mgL_.GetD(), local_vertexdof, local_edgedof,
-                                         edof_global_to_local_map, false);
+    std::vector<mfem::DenseMatrix> DlocT_el(nAggs_), ClocT_el(nAggs_);
+    std::vector<mfem::DenseMatrix> Wloc_el(mgL_.GetW().Width() ? nAggs_ : 0);
 
-        // Fill DlocT as a dense matrix of Dloc^T
-        FullTranspose(Dloc, DlocT);
+    // The element matrices are independent of each other, so with OpenMP they
+    // are computed by several threads, each having its own workspace
+#if SMOOTHG_USE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        mfem::Array<int> edof_global_to_local_map(map_size);
+        edof_global_to_local_map = -1;
 
-        // Construct the constraint matrix C which enforces the continuity of
-        // the broken edge space
-        ClocT.SetSize(nlocal_edgedof, nlocal_multiplier);
-        ClocT = 0.;
+        mfem::Array<int> local_vertexdof, local_edgedof, local_multiplier;
+        mfem::DenseMatrix ClocT, CM_i;
+        mfem::Vector one;
 
-        int* Cloc_i = new int[nlocal_multiplier + 1];
-        std::iota(Cloc_i, Cloc_i + nlocal_multiplier + 1, 0);
-        int* Cloc_j = new int[nlocal_multiplier];
-        double* Cloc_data = new double[nlocal_multiplier];
-        for (int i = 0; i < nlocal_multiplier; ++i)
+#if SMOOTHG_USE_OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
         {
-            const int edof_global_id = multiplier_to_edof_[local_multiplier[i]];
-            const int edof_local_id = edof_global_to_local_map[edof_global_id];
-            Cloc_j[i] = edof_local_id;
-            if (edof_IsOwned.RowSize(edof_global_id) && edge_marker[edof_global_id])
-            {
-                edge_marker[edof_global_id] = false;
-                ClocT(edof_local_id, i) = 1.;
-                Cloc_data[i] = 1.;
-            }
-            else
+            // Extracting the size and global numbering of local dof
+            GetTableRow(Agg_vertexdof, iAgg, local_vertexdof);
+            GetTableRow(Agg_edgedof, iAgg, local_edgedof);
+            GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
+
+            const int nlocal_edgedof = local_edgedof.Size();
+            const int nlocal_multiplier = local_multiplier.Size();
+
+            // Build the edge dof global to local map which will be used
+            // later for mapping local multiplier dof to local edge dof
+            for (int i = 0; i < nlocal_edgedof; ++i)
+                edof_global_to_local_map[local_edgedof[i]] = i;
+
+            // Extract Dloc as a sparse submatrix of D_
+            auto Dloc = ExtractRowAndColumns(mgL_.GetD(), local_vertexdof, local_edgedof,
+                                             edof_global_to_local_map, false);
+
+            // Fill DlocT as a dense matrix of Dloc^T (used in batches below)
+            FullTranspose(Dloc, DlocT_el[iAgg]);
+
+            // Construct the constraint matrix C which enforces the continuity of
+            // the broken edge space
+            ClocT.SetSize(nlocal_edgedof, nlocal_multiplier);
+            ClocT = 0.;
+
+            int* Cloc_i = new int[nlocal_multiplier + 1];
+            std::iota(Cloc_i, Cloc_i + nlocal_multiplier + 1, 0);
+            int* Cloc_j = new int[nlocal_multiplier];
+            double* Cloc_data = new double[nlocal_multiplier];
+            for (int i = 0; i < nlocal_multiplier; ++i)
             {
-                ClocT(edof_local_id, i) = -1.;
-                Cloc_data[i] = -1.;
+                const int edof_global_id = multiplier_to_edof_[local_multiplier[i]];
+                const int edof_local_id = edof_global_to_local_map[edof_global_id];
+                Cloc_j[i] = edof_local_id;
+                if (edof_IsOwned.RowSize(edof_global_id) &&
+                    multiplier_first_Agg[local_multiplier[i]] == iAgg)
+                {
+                    ClocT(edof_local_id, i) = 1.;
+                    Cloc_data[i] = 1.;
+                }
+                else
+                {
+                    ClocT(edof_local_id, i) = -1.;
+                    Cloc_data[i] = -1.;
+                }
             }
-        }
-
-        mfem::SparseMatrix Cloc(Cloc_i, Cloc_j, Cloc_data,
-                                nlocal_multiplier, nlocal_edgedof);
-
-        for (int i = 0; i < nlocal_edgedof; ++i)
-            edof_global_to_local_map[local_edgedof[i]] = -1;
 
-        // for initial guess
-        {
-            C_[iAgg].Swap(Cloc);
-            CM_[iAgg] = smoothg::Mult(C_[iAgg], M_el[iAgg]);
-            auto DT = smoothg::Transpose(Dloc);
-            auto CDT = smoothg::Mult(C_[iAgg], DT);
-            CDT_[iAgg].Swap(CDT);
-        }
+            mfem::SparseMatrix Cloc(Cloc_i, Cloc_j, Cloc_data,
+                                    nlocal_multiplier, nlocal_edgedof);
 
-        Mloc_solver.SetOperator(M_el[iAgg]);
-        Mloc_solver.GetInverseMatrix(Minv_ref_[iAgg]);
+            for (int i = 0; i < nlocal_edgedof; ++i)
+                edof_global_to_local_map[local_edgedof[i]] = -1;
 
-        mfem::DenseMatrix& MinvCT_i(MinvCT_[iAgg]);
-        mfem::DenseMatrix& AinvDMinvCT_i(AinvDMinvCT_[iAgg]);
-        mfem::DenseMatrix& Ainv_i(Ainv_[iAgg]);
-
-        MinvCT_i.SetSize(nlocal_edgedof, nlocal_multiplier);
-        AinvDMinvCT_i.SetSize(nlocal_vertexdof, nlocal_multiplier);
+            // for initial guess
+            {
+                C_[iAgg].Swap(Cloc);
+                CM_.GetView(iAgg, CM_i);
+                CM_i = smoothg::Mult(C_[iAgg], M_el[iAgg]);
+                auto DT = smoothg::Transpose(Dloc);
+                auto CDT = smoothg::Mult(C_[iAgg], DT);
+                CDT_[iAgg].Swap(CDT);
+            }
 
-        mfem::DenseMatrix MinvDT_i(nlocal_edgedof, nlocal_vertexdof);
-        mfem::Mult(Minv_ref_[iAgg], DlocT, MinvDT_i);
-        mfem::Mult(Minv_ref_[iAgg], ClocT, MinvCT_i);
+            ClocT_el[iAgg] = ClocT;
 
-        DMinv_[iAgg].Transpose(MinvDT_i);
+            if (mgL_.GetW().Width())
+            {
+                auto Wloc_sparse = ExtractRowAndColumns(mgL_.GetW(), local_vertexdof,
+                                                        local_vertexdof,
+                                                        edof_global_to_local_map);
+                Full(Wloc_sparse, Wloc_el[iAgg]);
+            }
 
-        // Compute CMinvCT = Cloc * MinvCT
-        Hybrid_el_[iAgg] = smoothg::Mult(C_[iAgg], MinvCT_i);
+            // Save local CCT and CDT1
+            if (scaling_size > 0)
+            {
+                mfem::DenseMatrix CCT(nlocal_multiplier);
+                CCT = smoothg::Mult(C_[iAgg], ClocT);
+                CCT.GetDiag(CCT_diag_el[iAgg]);
 
-        // Compute Aloc = DMinvDT = Dloc * MinvDT
-        Aloc = smoothg::Mult(Dloc, MinvDT_i);
+                const_rep_->GetSubVector(local_vertexdof, one);
+                mfem::Vector DTone(nlocal_edgedof);
+                Dloc.MultTranspose(one, DTone);
 
-        if (mgL_.GetW().Width())
-        {
-            mfem::DenseMatrix Wloc(nlocal_vertexdof, nlocal_vertexdof);
-            auto& W_ref = const_cast<mfem::SparseMatrix&>(mgL_.GetW());
-            W_ref.GetSubMatrix(local_vertexdof, local_vertexdof, Wloc);
-            Aloc += Wloc;
+                CDT1_el[iAgg].SetSize(nlocal_multiplier);
+                C_[iAgg].Mult(DTone, CDT1_el[iAgg]);
+            }
         }
+    }
 
-        // Compute DMinvCT = Dloc * MinvCT
-        DMinvCT = smoothg::Mult(Dloc, MinvCT_i);
-
-        // Compute the LU factorization of Aloc and Ainv_ * DMinvCT
-        Aloc_solver.SetOperator(Aloc);
-        Aloc_solver.GetInverseMatrix(Ainv_i);
-        mfem::Mult(Ainv_i, DMinvCT, AinvDMinvCT_i);
+    // Aggregates with the same numbers of local dofs are processed in batches
+    std::vector<std::array<int, 3>> local_sizes(nAggs_);
+    for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+    {
+        local_sizes[iAgg] = {{ DlocT_el[iAgg].Width(), DlocT_el[iAgg].Height(),
+                               ClocT_el[iAgg].Width() }};
+    }
+    const std::vector<std::vector<int>> batches = MakeBatches(local_sizes);
 
-        // Compute CMinvDTAinvDMinvCT = CMinvDT * AinvDMinvCT_
-        CMinvDT.Transpose(DMinvCT);
-        CMDADMC.SetSize(nlocal_multiplier, nlocal_multiplier);
+#if SMOOTHG_USE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        BatchedDenseMatrices Minv, DT, CT, W, MinvDT, MinvCT;
+        BatchedDenseMatrices Ainv, DMinvCT, AinvDMinvCT, Hybrid;
+        mfem::DenseMatrix view, MinvDT_i;
 
-        if (CMinvDT.Height() > 0 && CMinvDT.Width() > 0)
-        {
-            mfem::Mult(CMinvDT, AinvDMinvCT_i, CMDADMC);
-        }
-        else
+#if SMOOTHG_USE_OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for (int i = 0; i < (int) batches.size(); ++i)
         {
-            CMDADMC = 0.0;
-        }
-
-        // Hybrid_el_ = CMinvCT - CMinvDTAinvDMinvCT
-        Hybrid_el_[iAgg] -= CMDADMC;
+            const std::vector<int>& aggs = batches[i];
+            const int count = aggs.size();
+            const int nlocal_vertexdof = DlocT_el[aggs[0]].Width();
+            const int nlocal_edgedof = DlocT_el[aggs[0]].Height();
+            const int nlocal_multiplier = ClocT_el[aggs[0]].Width();
+
+            Minv.SetSize(nlocal_edgedof, nlocal_edgedof, count);
+            DT.SetSize(nlocal_edgedof, nlocal_vertexdof, count);
+            CT.SetSize(nlocal_edgedof, nlocal_multiplier, count);
+            for (int b = 0; b < count; ++b)
+            {
+                Minv.SetMatrix(b, M_el[aggs[b]]);
+                DT.SetMatrix(b, DlocT_el[aggs[b]]);
+                CT.SetMatrix(b, ClocT_el[aggs[b]]);
+            }
 
-        // Add contribution of the element matrix to the global system
-        H_proc.AddSubMatrix(local_multiplier, local_multiplier, Hybrid_el_[iAgg]);
+            Minv.InvertSPD();
+            Mult(Minv, DT, MinvDT);
+            Mult(Minv, CT, MinvCT);
 
-        // Save CCT and CDT1
-        if (scaling_size > 0)
-        {
-            mfem::DenseMatrix CCT(nlocal_multiplier);
-            CCT = smoothg::Mult(C_[iAgg], ClocT);
-            mfem::Vector CCT_diag_local;
-            CCT.GetDiag(CCT_diag_local);
+            // Ainv = (D M^{-1} D^T + W)^{-1}
+            MultAtB(DT, MinvDT, Ainv);
+            if (Wloc_el.size())
+            {
+                W.SetSize(nlocal_vertexdof, nlocal_vertexdof, count);
+                for (int b = 0; b < count; ++b)
+                {
+                    W.SetMatrix(b, Wloc_el[aggs[b]]);
+                }
+                Ainv += W;
+            }
+            Ainv.InvertSPD();
 
-            const_rep_->GetSubVector(local_vertexdof, one);
-            mfem::Vector DTone(nlocal_edgedof);
-            Dloc.MultTranspose(one, DTone);
+            MultAtB(DT, MinvCT, DMinvCT);
+            Mult(Ainv, DMinvCT, AinvDMinvCT);
 
-            mfem::Vector CDT1_local(nlocal_multiplier);
-            C_[iAgg].Mult(DTone, CDT1_local);
+            // Hybrid_el_ = C M^{-1} C^T - C M^{-1} D^T A^{-1} D M^{-1} C^T
+            MultAtB(CT, MinvCT, Hybrid);
+            AddMultAtB(DMinvCT, AinvDMinvCT, Hybrid, -1.0);
 
-            for (int i = 0; i < nlocal_multiplier; ++i)
+            // The local matrices are written directly to the packed storage
+            for (int b = 0; b < count; ++b)
             {
-                CCT_diag[local_multiplier[i]] += CCT_diag_local[i];
-                CDT1[local_multiplier[i]] += CDT1_local[i];
+                const int iAgg = aggs[b];
+
+                Minv_ref_.GetView(iAgg, view);
+                Minv.GetMatrix(b, view);
+                MinvCT_.GetView(iAgg, view);
+                MinvCT.GetMatrix(b, view);
+                AinvDMinvCT_.GetView(iAgg, view);
+                AinvDMinvCT.GetMatrix(b, view);
+                Ainv_.GetView(iAgg, view);
+                Ainv.GetMatrix(b, view);
+
+                MinvDT.GetMatrix(b, MinvDT_i);
+                DMinv_.GetView(iAgg, view);
+                view.Transpose(MinvDT_i);
+
+                Hybrid.GetMatrix(b, Hybrid_el_[iAgg]);
             }
         }
     }
 
-    // Assemble global rescaling vector (CC^T)^{-1}CD^T 1
-    if (scaling_size)
-    {
-        mfem::Vector CCT_diag_global(multiplier_d_td_->NumCols());
-        multiplier_td_d_->Mult(CCT_diag, CCT_diag_global);
+    // Add contribution of the element matrices to the global system
+    mfem::SparseMatrix H_proc = AssembleElementMatrices(false);
 
-        mfem::Vector CDT1_global(multiplier_d_td_->NumCols());
-        multiplier_td_d_->Mult(CDT1, CDT1_global);
-
-        diagonal_scaling_.SetSize(multiplier_d_td_->NumCols());
-        for (int i = 0; i < diagonal_scaling_.Size(); ++i)
-        {
-            diagonal_scaling_[i] = CDT1_global[i] / CCT_diag_global[i];
-        }
+    if (scaling_size > 0)
+    {
+        ComputeDiagonalScaling(CCT_diag_el, CDT1_el);
     }
 
     return H_proc;
@@ -383,147 +617,241 @@ mfem::SparseMatrix HybridSolver::AssembleHybridSystem(
     const auto& Agg_vertexdof = mgL_.GetGraphSpace().VertexToVDof();
     const auto& Agg_edgedof = mgL_.GetGraphSpace().VertexToEDof();
 
-    mfem::SparseMatrix H_proc(num_multiplier_dofs_);
-
-    MinvN_.resize(Minv_.size());
-    CMinvNAinv_.resize(Minv_.size());
+    if (Minv_.Size() == 0)
+    {
+        std::vector<int> num_vdofs(nAggs_), num_edofs(nAggs_), num_multipliers(nAggs_);
+        for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+        {
+            num_vdofs[iAgg] = Agg_vertexdof.RowSize(iAgg);
+            num_edofs[iAgg] = Agg_edgedof.RowSize(iAgg);
+            num_multipliers[iAgg] = Agg_multiplier_.RowSize(iAgg);
+        }
 
-    mfem::Array<int> col_marker(mgL_.GetD().NumCols());
-    col_marker = -1;
+        Minv_ = PackedDenseMatrices(num_edofs, num_edofs);
+        MinvN_ = PackedDenseMatrices(num_edofs, num_vdofs);
+        CMinvNAinv_ = PackedDenseMatrices(num_multipliers, num_vdofs);
+    }
 
-    const int scaling_size = rescale_iter_ < 0 ? H_proc.NumRows() : 0;
-    mfem::Vector CCT_diag(scaling_size), CDT1(scaling_size);
-    CCT_diag = 0.0;
-    CDT1 = 0.0;
+    const int map_size = std::max(Agg_edgedof.Width(), Agg_vertexdof.Width());
 
-    mfem::DenseMatrix DlocT, Aloc, CMinv, CMinvN, DMinvCT, CMDADMC;
-    mfem::Array<int> local_vertexdof, local_edgedof, local_multiplier;
-    mfem::Vector one;
+    const int scaling_size = rescale_iter_ < 0 ? num_multiplier_dofs_ : 0;
+    std::vector<mfem::Vector> CCT_diag_el(scaling_size > 0 ? nAggs_ : 0);
+    std::vector<mfem::Vector> CDT1_el(scaling_size > 0 ? nAggs_ : 0);
 
-    mfem::DenseMatrixInverse Aloc_solver;
-    for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+#if SMOOTHG_USE_OPENMP
+    #pragma omp parallel
+#endif
     {
-        // Extracting the size and global numbering of local dof
-        GetTableRow(Agg_vertexdof, iAgg, local_vertexdof);
-        GetTableRow(Agg_edgedof, iAgg, local_edgedof);
-        GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
+        mfem::Array<int> col_marker(map_size);
+        col_marker = -1;
+
+        mfem::DenseMatrix DlocT, Aloc, CMinv, CMinvN, DMinvCT, CMDADMC, Wloc;
+        mfem::DenseMatrix Minv_ref_i, Minv_i, MinvCT_i, MinvN_i, AinvDMinvCT_i;
+        mfem::DenseMatrix CMinvNAinv_i, Ainv_i, DMinv_i;
+        mfem::Array<int> local_vertexdof, local_edgedof, local_multiplier;
+        mfem::Vector one;
 
-        const int nlocal_vertexdof = local_vertexdof.Size();
-        const int nlocal_edgedof = local_edgedof.Size();
-        const int nlocal_multiplier = local_multiplier.Size();
+        mfem::DenseMatrixInverse Aloc_solver;
 
-        // Extract Dloc as a sparse submatrix of D_
-        auto Dloc = ExtractRowAndColumns(mgL_.GetD(), local_vertexdof,
-                                         local_edgedof, col_marker);
+#if SMOOTHG_USE_OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+        {
+            // Extracting the size and global numbering of local dof
+            GetTableRow(Agg_vertexdof, iAgg, local_vertexdof);
+            GetTableRow(Agg_edgedof, iAgg, local_edgedof);
+            GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
+
+            const int nlocal_vertexdof = local_vertexdof.Size();
+            const int nlocal_edgedof = local_edgedof.Size();
+            const int nlocal_multiplier = local_multiplier.Size();
+
+            // Extract Dloc as a sparse submatrix of D_
+            auto Dloc = ExtractRowAndColumns(mgL_.GetD(), local_vertexdof,
+                                             local_edgedof, col_marker);
+
+            // Fill DlocT as a dense matrix of Dloc^T
+            FullTranspose(Dloc, DlocT);
+            DlocT += N_el[iAgg];
+
+            // The local matrices are written directly to the packed storage
+            Minv_ref_.GetView(iAgg, Minv_ref_i);
+            Minv_.GetView(iAgg, Minv_i);
+            MinvCT_.GetView(iAgg, MinvCT_i);
+            MinvN_.GetView(iAgg, MinvN_i);
+            AinvDMinvCT_.GetView(iAgg, AinvDMinvCT_i);
+            CMinvNAinv_.GetView(iAgg, CMinvNAinv_i);
+            Ainv_.GetView(iAgg, Ainv_i);
+            DMinv_.GetView(iAgg, DMinv_i);
+
+            Minv_i = Minv_ref_i;
+            Minv_i *= elem_scaling_inverse[iAgg];
+
+            mfem::Mult(Minv_i, DlocT, MinvN_i);
+            MultSparseDenseTranspose(C_[iAgg], Minv_i, MinvCT_i);
+            DMinv_i = smoothg::Mult(Dloc, Minv_i);
+
+            // Compute CMinvCT = Cloc * MinvCT
+            Hybrid_el_[iAgg] = smoothg::Mult(C_[iAgg], MinvCT_i);
+
+            // Compute Aloc = DMinvN = Dloc * Minv * N
+            Aloc = smoothg::Mult(Dloc, MinvN_i);
+
+            if (mgL_.GetW().Width())
+            {
+                auto Wloc_sparse = ExtractRowAndColumns(mgL_.GetW(), local_vertexdof,
+                                                        local_vertexdof, col_marker);
+                Full(Wloc_sparse, Wloc);
+                Aloc += Wloc;
+            }
 
-        // Fill DlocT as a dense matrix of Dloc^T
-        FullTranspose(Dloc, DlocT);
-        DlocT += N_el[iAgg];
+            // Compute DMinvCT = Dloc * MinvCT
+            DMinvCT = smoothg::Mult(Dloc, MinvCT_i);
 
-        Minv_[iAgg] = Minv_ref_[iAgg];
-        Minv_[iAgg] *= elem_scaling_inverse[iAgg];
+            // Compute the LU factorization of Aloc and Ainv_ * DMinvCT
+            Aloc_solver.SetOperator(Aloc);
+            Aloc_solver.GetInverseMatrix(Ainv_i);
+            mfem::Mult(Ainv_i, DMinvCT, AinvDMinvCT_i);
 
-        mfem::DenseMatrix& MinvCT_i(MinvCT_[iAgg]);
-        mfem::DenseMatrix& MinvN_i(MinvN_[iAgg]);
-        mfem::DenseMatrix& AinvDMinvCT_i(AinvDMinvCT_[iAgg]);
-        mfem::DenseMatrix& CMinvNAinv_i(CMinvNAinv_[iAgg]);
-        mfem::DenseMatrix& Ainv_i(Ainv_[iAgg]);
+            // Compute CMinvNAinvDMinvCT = CMinvN * AinvDMinvCT_
+            CMinv.Transpose(MinvCT_i);
+            CMinvN.SetSize(nlocal_multiplier, nlocal_vertexdof);
+            mfem::Mult(CMinv, DlocT, CMinvN);
 
-        MinvCT_i.SetSize(nlocal_edgedof, nlocal_multiplier);
-        MinvN_i.SetSize(nlocal_edgedof, nlocal_vertexdof);
-        AinvDMinvCT_i.SetSize(nlocal_vertexdof, nlocal_multiplier);
-        CMinvNAinv_i.SetSize(nlocal_multiplier, nlocal_vertexdof);
+            mfem::Mult(CMinvN, Ainv_i, CMinvNAinv_i);
 
-        mfem::Mult(Minv_[iAgg], DlocT, MinvN_i);
-        MultSparseDenseTranspose(C_[iAgg], Minv_[iAgg], MinvCT_i);
-        DMinv_[iAgg] = smoothg::Mult(Dloc, Minv_[iAgg]);
+            CMDADMC.SetSize(nlocal_multiplier, nlocal_multiplier);
 
-        // Compute CMinvCT = Cloc * MinvCT
-        Hybrid_el_[iAgg] = smoothg::Mult(C_[iAgg], MinvCT_i);
+            if (CMinvN.Height() > 0 && CMinvN.Width() > 0)
+            {
+                mfem::Mult(CMinvN, AinvDMinvCT_i, CMDADMC);
+            }
+            else
+            {
+                CMDADMC = 0.0;
+            }
 
-        // Compute Aloc = DMinvN = Dloc * Minv * N
-        Aloc = smoothg::Mult(Dloc, MinvN_i);
+            // Hybrid_el_ = CMinvCT - CMinvDTAinvDMinvCT
+            Hybrid_el_[iAgg] -= CMDADMC;
 
-        if (mgL_.GetW().Width())
-        {
-            mfem::DenseMatrix Wloc(nlocal_vertexdof, nlocal_vertexdof);
-            auto& W_ref = const_cast<mfem::SparseMatrix&>(mgL_.GetW());
-            W_ref.GetSubMatrix(local_vertexdof, local_vertexdof, Wloc);
-            Aloc += Wloc;
-        }
+            // Save local CCT and CDT1
+            if (scaling_size > 0)
+            {
+                mfem::SparseMatrix ClocT = smoothg::Transpose(C_[iAgg]);
+                mfem::SparseMatrix CCT = smoothg::Mult(C_[iAgg], ClocT);
+                CCT.GetDiag(CCT_diag_el[iAgg]);
 
-        // Compute DMinvCT = Dloc * MinvCT
-        DMinvCT = smoothg::Mult(Dloc, MinvCT_i);
+                const_rep_->GetSubVector(local_vertexdof, one);
+                mfem::Vector DTone(nlocal_edgedof);
+                Dloc.MultTranspose(one, DTone);
 
-        // Compute the LU factorization of Aloc and Ainv_ * DMinvCT
-        Aloc_solver.SetOperator(Aloc);
-        Aloc_solver.GetInverseMatrix(Ainv_i);
-        mfem::Mult(Ainv_i, DMinvCT, AinvDMinvCT_i);
+                CDT1_el[iAgg].SetSize(nlocal_multiplier);
+                C_[iAgg].Mult(DTone, CDT1_el[iAgg]);
+            }
+        }
+    }
 
-        // Compute CMinvNAinvDMinvCT = CMinvN * AinvDMinvCT_
-        CMinv.Transpose(MinvCT_i);
-        CMinvN.SetSize(nlocal_multiplier, nlocal_vertexdof);
-        mfem::Mult(CMinv, DlocT, CMinvN);
+    // Add contribution of the element matrices to the global system
+    mfem::SparseMatrix H_proc = AssembleElementMatrices(false);
 
-        mfem::Mult(CMinvN, Ainv_i, CMinvNAinv_i);
+    if (scaling_size > 0)
+    {
+        ComputeDiagonalScaling(CCT_diag_el, CDT1_el);
+    }
 
-        CMDADMC.SetSize(nlocal_multiplier, nlocal_multiplier);
+    return H_proc;
+}
 
-        if (CMinvN.Height() > 0 && CMinvN.Width() > 0)
-        {
-            mfem::Mult(CMinvN, AinvDMinvCT_i, CMDADMC);
-        }
-        else
-        {
-            CMDADMC = 0.0;
-        }
+mfem::SparseMatrix HybridSolver::AssembleElementMatrices(bool scaled) const
+{
+    mfem::SparseMatrix H_proc(H_proc_pattern_);
+    H_proc = 0.0;
 
-        // Hybrid_el_ = CMinvCT - CMinvDTAinvDMinvCT
-        Hybrid_el_[iAgg] -= CMDADMC;
+    const int* H_i = H_proc.GetI();
+    const int* H_j = H_proc.GetJ();
+    double* H_data = H_proc.GetData();
 
-        // Add contribution of the element matrix to the global system
-        H_proc.AddSubMatrix(local_multiplier, local_multiplier, Hybrid_el_[iAgg]);
+    // Aggregates of the same color share no multiplier, so they add to
+    // disjoint rows of H_proc and can be processed concurrently
+#if SMOOTHG_USE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        mfem::Array<int> multiplier_map(num_multiplier_dofs_);
+        multiplier_map = -1;
 
-        // Save CCT and CDT1
-        if (scaling_size > 0)
+        for (int color = 0; color < color_Agg_.NumRows(); ++color)
         {
-            mfem::SparseMatrix ClocT = smoothg::Transpose(C_[iAgg]);
-            mfem::SparseMatrix CCT = smoothg::Mult(C_[iAgg], ClocT);
-            mfem::Vector CCT_diag_local;
-            CCT.GetDiag(CCT_diag_local);
+            const int num_color_aggs = color_Agg_.RowSize(color);
+            const int* color_aggs = color_Agg_.GetRowColumns(color);
 
-            const_rep_->GetSubVector(local_vertexdof, one);
-            mfem::Vector DTone(nlocal_edgedof);
-            Dloc.MultTranspose(one, DTone);
+#if SMOOTHG_USE_OPENMP
+            #pragma omp for schedule(dynamic)
+#endif
+            for (int k = 0; k < num_color_aggs; ++k)
+            {
+                const int iAgg = color_aggs[k];
+                const int nlocal_multiplier = Agg_multiplier_.RowSize(iAgg);
+                const int* local_multiplier = Agg_multiplier_.GetRowColumns(iAgg);
+                const mfem::DenseMatrix& H_el = Hybrid_el_[iAgg];
+                const double scale = scaled ? (1.0 / elem_scaling_(iAgg)) : 1.0;
 
-            mfem::Vector CDT1_local(nlocal_multiplier);
-            C_[iAgg].Mult(DTone, CDT1_local);
+                for (int i = 0; i < nlocal_multiplier; ++i)
+                    multiplier_map[local_multiplier[i]] = i;
 
-            for (int i = 0; i < nlocal_multiplier; ++i)
-            {
-                CCT_diag[local_multiplier[i]] += CCT_diag_local[i];
-                CDT1[local_multiplier[i]] += CDT1_local[i];
+                for (int i = 0; i < nlocal_multiplier; ++i)
+                {
+                    const int row = local_multiplier[i];
+                    for (int j = H_i[row]; j < H_i[row + 1]; ++j)
+                    {
+                        const int local_col = multiplier_map[H_j[j]];
+                        if (local_col >= 0)
+                        {
+                            H_data[j] += scale * H_el(i, local_col);
+                        }
+                    }
+                }
+
+                for (int i = 0; i < nlocal_multiplier; ++i)
+                    multiplier_map[local_multiplier[i]] = -1;
             }
         }
     }
 
-    // Assemble global rescaling vector (CC^T)^{-1}CD^T 1
-    if (scaling_size)
-    {
-        mfem::Vector CCT_diag_global(multiplier_d_td_->NumCols());
-        multiplier_td_d_->Mult(CCT_diag, CCT_diag_global);
+    return H_proc;
+}
 
-        mfem::Vector CDT1_global(multiplier_d_td_->NumCols());
-        multiplier_td_d_->Mult(CDT1, CDT1_global);
+void HybridSolver::ComputeDiagonalScaling(const std::vector<mfem::Vector>& CCT_diag_el,
+                                          const std::vector<mfem::Vector>& CDT1_el)
+{
+    mfem::Vector CCT_diag(num_multiplier_dofs_), CDT1(num_multiplier_dofs_);
+    CCT_diag = 0.0;
+    CDT1 = 0.0;
 
-        diagonal_scaling_.SetSize(multiplier_d_td_->NumCols());
-        for (int i = 0; i < diagonal_scaling_.Size(); ++i)
+    mfem::Array<int> local_multiplier;
+    for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+    {
+        GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
+        for (int i = 0; i < local_multiplier.Size(); ++i)
         {
-            diagonal_scaling_[i] = CDT1_global[i] / CCT_diag_global[i];
+            CCT_diag[local_multiplier[i]] += CCT_diag_el[iAgg][i];
+            CDT1[local_multiplier[i]] += CDT1_el[iAgg][i];
         }
     }
 
-    return H_proc;
+    // Assemble global rescaling vector (CC^T)^{-1}CD^T 1
+    mfem::Vector CCT_diag_global(multiplier_d_td_->NumCols());
+    multiplier_td_d_->Mult(CCT_diag, CCT_diag_global);
+
+    mfem::Vector CDT1_global(multiplier_d_td_->NumCols());
+    multiplier_td_d_->Mult(CDT1, CDT1_global);
+
+    diagonal_scaling_.SetSize(multiplier_d_td_->NumCols());
+    for (int i = 0; i < diagonal_scaling_.Size(); ++i)
+    {
+        diagonal_scaling_[i] = CDT1_global[i] / CCT_diag_global[i];
+    }
 }
 
 /// @todo nonzero Neumann BC (edge unknown), solve on true dof (original system)
@@ -553,7 +881,7 @@ void HybridSolver::Mult(const mfem::BlockVector& Rhs, mfem::BlockVector& Sol) co
     // assemble true right hand side
     multiplier_d_td_->MultTranspose(Hrhs_, trueHrhs_);
 
-    H_elim_->Mult(-1.0, trueMu_, 1.0, trueHrhs_);
+    EliminateEssentialMultipliers(trueMu_, trueHrhs_);
     for (int ess_true_mult : ess_true_multipliers_)
     {
         trueHrhs_(ess_true_mult) = trueMu_(ess_true_mult);
@@ -585,6 +913,7 @@ void HybridSolver::Mult(const mfem::BlockVector& Rhs, mfem::BlockVector& Sol) co
 
     // TODO: decide to use = or += here and in timing_ update (MinresBlockSolver uses +=)
     num_iterations_ = solver_->GetNumIterations();
+    RecordReferenceIterations();
 
     if (myid_ == 0 && print_level_ > 0)
     {
@@ -632,11 +961,109 @@ void HybridSolver::Mult(const mfem::BlockVector& Rhs, mfem::BlockVector& Sol) co
     }
 }
 
+void HybridSolver::Mult(const std::vector<mfem::BlockVector>& Rhs,
+                        std::vector<mfem::BlockVector>& Sol) const
+{
+    const int num_rhs = Rhs.size();
+
+    std::vector<mfem::BlockVector> rhs(Rhs);
+    std::vector<mfem::Vector> trueMu(num_rhs);
+    for (int k = 0; k < num_rhs; ++k)
+    {
+        trueMu[k].SetSize(trueMu_.Size());
+        if (is_symmetric_)
+        {
+            trueMu[k] = MakeInitialGuess(Sol[k], Rhs[k]);
+        }
+        else
+        {
+            trueMu[k] = 0.0;
+        }
+
+        // correct right hand side due to boundary condition
+        for (int m = 0; m < ess_true_multipliers_.Size(); ++m)
+        {
+            trueMu[k](ess_true_multipliers_[m]) = -Rhs[k](ess_true_mult_to_edof_[m]);
+            rhs[k](ess_true_mult_to_edof_[m]) = 0.0;
+        }
+    }
+
+    std::vector<mfem::Vector> Hrhs(num_rhs);
+    RHSTransform(rhs, Hrhs);
+
+    std::string solver_name = is_symmetric_ ? "CG" : "GMRES";
+
+    // solve the parallel global hybridized systems one by one
+    mfem::StopWatch chrono;
+    std::vector<mfem::Vector> Mu(num_rhs);
+    num_iterations_ = 0;
+    timing_ = 0.0;
+    for (int k = 0; k < num_rhs; ++k)
+    {
+        multiplier_d_td_->MultTranspose(Hrhs[k], trueHrhs_);
+
+        EliminateEssentialMultipliers(trueMu[k], trueHrhs_);
+        for (int ess_true_mult : ess_true_multipliers_)
+        {
+            trueHrhs_(ess_true_mult) = trueMu[k](ess_true_mult);
+        }
+
+        if (diagonal_scaling_.Size() > 0)
+        {
+            RescaleVector(diagonal_scaling_, trueHrhs_);
+            InvRescaleVector(diagonal_scaling_, trueMu[k]);
+        }
+
+        chrono.Clear();
+        chrono.Start();
+
+        solver_->Mult(trueHrhs_, trueMu[k]);
+
+        chrono.Stop();
+        timing_ += chrono.RealTime();
+        num_iterations_ = std::max(num_iterations_, solver_->GetNumIterations());
+
+        if (myid_ == 0 && print_level_ > 0 && !solver_->GetConverged())
+        {
+            std::cout << "  " + solver_name + " did not converge for rhs " << k
+                      << ". Final residual norm is " << solver_->GetFinalNorm() << "\n";
+        }
+
+        if (diagonal_scaling_.Size() > 0)
+            RescaleVector(diagonal_scaling_, trueMu[k]);
+
+        Mu[k].SetSize(num_multiplier_dofs_);
+        multiplier_d_td_->Mult(trueMu[k], Mu[k]);
+    }
+
+    RecordReferenceIterations();
+
+    if (myid_ == 0 && print_level_ > 0)
+    {
+        std::cout << "  Timing: " << num_rhs << " " + solver_name + " solves done in "
+                  << timing_ << "s (at most " << num_iterations_ << " iterations). \n";
+    }
+
+    // recover solutions of the original system
+    RecoverOriginalSolution(Mu, Sol);
+
+    mfem::Vector mean_correction(edof_shared_mean_->NumRows());
+    for (int k = 0; k < num_rhs; ++k)
+    {
+        edof_shared_mean_->Mult(Sol[k].GetBlock(0), mean_correction);
+        mgL_.GetGraphSpace().EDofToTrueEDof().Mult(mean_correction, Sol[k].GetBlock(0));
+
+        if (!W_is_nonzero_ && remove_one_dof_)
+        {
+            Orthogonalize(Sol[k].GetBlock(1));
+        }
+    }
+}
+
 /// @todo impose nonzero boundary condition for u.n
 void HybridSolver::RHSTransform(const mfem::BlockVector& OriginalRHS,
                                 mfem::Vector& HybridRHS) const
 {
-    const mfem::Vector& OriginalRHS_block1(OriginalRHS.GetBlock(1));
     const auto& Agg_vertexdof = mgL_.GetGraphSpace().VertexToVDof();
     const auto& Agg_edgedof = mgL_.GetGraphSpace().VertexToEDof();
 
@@ -648,162 +1075,347 @@ void HybridSolver::RHSTransform(const mfem::BlockVector& OriginalRHS,
 
     HybridRHS = 0.;
 
-    mfem::Vector f_loc, g_loc, CMinv_g_loc, DMinv_g_loc, rhs_loc_help;
-    mfem::Array<int> local_vertexdof, local_edgedof, local_multiplier;
+    const int* vdof_I = Agg_vertexdof.GetI();
+    const int* vdof_J = Agg_vertexdof.GetJ();
+    const int* edof_I = Agg_edgedof.GetI();
+    const int* edof_J = Agg_edgedof.GetJ();
+    const int* mult_I = Agg_multiplier_.GetI();
+    const int* mult_J = Agg_multiplier_.GetJ();
+
+    const double* f = OriginalRHS.GetBlock(1).GetData();
+    const double* g = CorrectedRHS_block0.GetData();
+    double* Hrhs = HybridRHS.GetData();
+
+    mfem::Vector g_loc, DMinv_g_loc, CMinv_g_loc;
     for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
     {
-        // Extracting the size and global numbering of local dof
-        GetTableRow(Agg_vertexdof, iAgg, local_vertexdof);
-        GetTableRow(Agg_edgedof, iAgg, local_edgedof);
-        GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
+        const int nlocal_vertexdof = vdof_I[iAgg + 1] - vdof_I[iAgg];
+        const int nlocal_edgedof = edof_I[iAgg + 1] - edof_I[iAgg];
+        const int nlocal_multiplier = mult_I[iAgg + 1] - mult_I[iAgg];
 
-        int nlocal_vertexdof = local_vertexdof.Size();
-        int nlocal_edgedof = local_edgedof.Size();
-        int nlocal_multiplier = local_multiplier.Size();
+        const int* local_vertexdof = vdof_J + vdof_I[iAgg];
+        const int* local_edgedof = edof_J + edof_I[iAgg];
+        const int* local_multiplier = mult_J + mult_I[iAgg];
+        const double* edof_weight = agg_edof_weight_.GetData() + edof_I[iAgg];
 
-        // Compute local contribution to the RHS of the hybrid system
-        // CM^{-1} g - CM^{-1}D^T A^{-1} (DM^{-1} g - f)
-        OriginalRHS_block1.GetSubVector(local_vertexdof, f_loc);
-        CorrectedRHS_block0.GetSubVector(local_edgedof, g_loc);
+        const double scale = is_symmetric_ ? 1.0 / elem_scaling_[iAgg] : 1.0;
+
+        g_loc.SetSize(nlocal_edgedof);
         for (int i = 0; i < nlocal_edgedof; ++i)
         {
-            if (edof_needs_averaging_[local_edgedof[i]])
-            {
-                g_loc[i] /= 2.0;
-            }
+            g_loc[i] = edof_weight[i] * g[local_edgedof[i]];
         }
 
+        // Compute local contribution to the RHS of the hybrid system
+        // CM^{-1} g - CM^{-1}D^T A^{-1} (DM^{-1} g - f)
         DMinv_g_loc.SetSize(nlocal_vertexdof);
-        DMinv_[iAgg].Mult(g_loc, DMinv_g_loc);
+        DMinv_.Mult(iAgg, g_loc.GetData(), DMinv_g_loc.GetData(), scale);
+        for (int i = 0; i < nlocal_vertexdof; ++i)
+        {
+            DMinv_g_loc[i] -= f[local_vertexdof[i]];
+        }
 
+        CMinv_g_loc.SetSize(nlocal_multiplier);
+        MinvCT_.MultTranspose(iAgg, g_loc.GetData(), CMinv_g_loc.GetData(), scale);
         if (is_symmetric_)
         {
-            DMinv_g_loc /= elem_scaling_[iAgg];
+            AinvDMinvCT_.AddMultTranspose(iAgg, DMinv_g_loc.GetData(),
+                                          CMinv_g_loc.GetData(), -1.0);
+        }
+        else
+        {
+            CMinvNAinv_.AddMult(iAgg, DMinv_g_loc.GetData(), CMinv_g_loc.GetData(), -1.0);
+        }
+
+        for (int i = 0; i < nlocal_multiplier; ++i)
+        {
+            Hrhs[local_multiplier[i]] += CMinv_g_loc[i];
         }
 
-        DMinv_g_loc -= f_loc;
+        // Save M^{-1}g, A^{-1} (DM^{-1} g - f) for solution recovery
+        const PackedDenseMatrices& Minv = is_symmetric_ ? Minv_ref_ : Minv_;
+        Minv.Mult(iAgg, g_loc.GetData(), Minv_g_.GetData() + edof_I[iAgg]);
 
-        rhs_loc_help.SetSize(nlocal_multiplier);
+        Ainv_.Mult(iAgg, DMinv_g_loc.GetData(), local_rhs_.GetData() + vdof_I[iAgg],
+                   is_symmetric_ ? elem_scaling_[iAgg] : 1.0);
+    }
+}
 
-        if (is_symmetric_)
+void HybridSolver::RecoverOriginalSolution(const mfem::Vector& HybridSol,
+                                           mfem::BlockVector& RecoveredSol) const
+{
+    const auto& Agg_vertexdof = mgL_.GetGraphSpace().VertexToVDof();
+    const auto& Agg_edgedof = mgL_.GetGraphSpace().VertexToEDof();
+
+    RecoveredSol = 0.;
+
+    const int* vdof_I = Agg_vertexdof.GetI();
+    const int* vdof_J = Agg_vertexdof.GetJ();
+    const int* edof_I = Agg_edgedof.GetI();
+    const int* edof_J = Agg_edgedof.GetJ();
+    const int* mult_I = Agg_multiplier_.GetI();
+    const int* mult_J = Agg_multiplier_.GetJ();
+
+    const double* mu = HybridSol.GetData();
+    double* sigma = RecoveredSol.GetBlock(0).GetData();
+    double* u = RecoveredSol.GetBlock(1).GetData();
+
+    mfem::Vector mu_loc;
+    for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+    {
+        const int nlocal_vertexdof = vdof_I[iAgg + 1] - vdof_I[iAgg];
+        const int nlocal_edgedof = edof_I[iAgg + 1] - edof_I[iAgg];
+        const int nlocal_multiplier = mult_I[iAgg + 1] - mult_I[iAgg];
+
+        const int* local_vertexdof = vdof_J + vdof_I[iAgg];
+        const int* local_edgedof = edof_J + edof_I[iAgg];
+        const int* local_multiplier = mult_J + mult_I[iAgg];
+        const double* edof_weight = agg_edof_weight_.GetData() + edof_I[iAgg];
+
+        // Local contribution of Hdiv and L2 space, computed in place
+        double* u_loc = local_rhs_.GetData() + vdof_I[iAgg];
+        double* sigma_loc = Minv_g_.GetData() + edof_I[iAgg];
+
+        // This check is just for the case when there is only one element for
+        // the global problem, then there will be no Lagrange multipliers
+        if (nlocal_multiplier > 0)
         {
-            AinvDMinvCT_[iAgg].MultTranspose(DMinv_g_loc, rhs_loc_help);
+            // Extract the local portion of the Lagrange multiplier solution
+            mu_loc.SetSize(nlocal_multiplier);
+            for (int i = 0; i < nlocal_multiplier; ++i)
+            {
+                mu_loc[i] = mu[local_multiplier[i]];
+            }
+
+            // Compute u = A^{-1} (DM^{-1} (g - C^T mu) - f)
+            AinvDMinvCT_.AddMult(iAgg, mu_loc.GetData(), u_loc, -1.0);
+
+            // Compute sigma = M^{-1} (g - D^T u - C^T mu)
+            if (is_symmetric_)
+            {
+                DMinv_.AddMultTranspose(iAgg, u_loc, sigma_loc, -1.0);
+            }
+            else
+            {
+                MinvN_.AddMult(iAgg, u_loc, sigma_loc, -1.0);
+            }
+            MinvCT_.AddMult(iAgg, mu_loc.GetData(), sigma_loc, -1.0);
+
+            if (is_symmetric_)
+            {
+                const double scale = 1.0 / elem_scaling_[iAgg];
+                for (int i = 0; i < nlocal_edgedof; ++i)
+                {
+                    sigma_loc[i] *= scale;
+                }
+            }
         }
-        else
+
+        // Save local solution to the global solution vector, shared edge dofs
+        // get the average of the two aggregates
+        for (int i = 0; i < nlocal_vertexdof; ++i)
         {
-            CMinvNAinv_[iAgg].Mult(DMinv_g_loc, rhs_loc_help);
+            u[local_vertexdof[i]] = u_loc[i];
         }
 
-        CMinv_g_loc.SetSize(nlocal_multiplier);
-        MinvCT_[iAgg].MultTranspose(g_loc, CMinv_g_loc);
-
-        if (is_symmetric_)
+        for (int i = 0; i < nlocal_edgedof; ++i)
         {
-            CMinv_g_loc /= elem_scaling_[iAgg];
+            sigma[local_edgedof[i]] += edof_weight[i] * sigma_loc[i];
         }
+    }
+}
 
-        CMinv_g_loc -= rhs_loc_help;
+void HybridSolver::RHSTransform(const std::vector<mfem::BlockVector>& OriginalRHS,
+                                std::vector<mfem::Vector>& HybridRHS) const
+{
+    const int num_rhs = OriginalRHS.size();
+    const auto& Agg_vertexdof = mgL_.GetGraphSpace().VertexToVDof();
+    const auto& Agg_edgedof = mgL_.GetGraphSpace().VertexToEDof();
 
-        for (int i = 0; i < nlocal_multiplier; ++i)
+    mfem::Vector mean_correction(edof_shared_mean_->NumRows());
+    std::vector<mfem::Vector> CorrectedRHS_block0(num_rhs);
+    for (int k = 0; k < num_rhs; ++k)
+    {
+        edof_shared_mean_->Mult(OriginalRHS[k].GetBlock(0), mean_correction);
+        CorrectedRHS_block0[k].SetSize(edof_shared_mean_->NumCols());
+        mgL_.GetGraphSpace().EDofToTrueEDof().Mult(mean_correction, CorrectedRHS_block0[k]);
+
+        HybridRHS[k].SetSize(num_multiplier_dofs_);
+        HybridRHS[k] = 0.;
+    }
+
+    Minv_G_.SetSize(Agg_edgedof.NumNonZeroElems() * num_rhs);
+    local_RHS_.SetSize(Agg_vertexdof.NumNonZeroElems() * num_rhs);
+
+    const int* vdof_I = Agg_vertexdof.GetI();
+    const int* vdof_J = Agg_vertexdof.GetJ();
+    const int* edof_I = Agg_edgedof.GetI();
+    const int* edof_J = Agg_edgedof.GetJ();
+    const int* mult_I = Agg_multiplier_.GetI();
+    const int* mult_J = Agg_multiplier_.GetJ();
+
+    // Local right hand sides are stored as columns
+    mfem::Vector G_loc, DMinv_G_loc, CMinv_G_loc;
+    for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+    {
+        const int nlocal_vertexdof = vdof_I[iAgg + 1] - vdof_I[iAgg];
+        const int nlocal_edgedof = edof_I[iAgg + 1] - edof_I[iAgg];
+        const int nlocal_multiplier = mult_I[iAgg + 1] - mult_I[iAgg];
+
+        const int* local_vertexdof = vdof_J + vdof_I[iAgg];
+        const int* local_edgedof = edof_J + edof_I[iAgg];
+        const int* local_multiplier = mult_J + mult_I[iAgg];
+        const double* edof_weight = agg_edof_weight_.GetData() + edof_I[iAgg];
+
+        const double scale = is_symmetric_ ? 1.0 / elem_scaling_[iAgg] : 1.0;
+
+        G_loc.SetSize(nlocal_edgedof * num_rhs);
+        for (int k = 0; k < num_rhs; ++k)
         {
-            HybridRHS[local_multiplier[i]] += CMinv_g_loc[i];
+            const double* g = CorrectedRHS_block0[k].GetData();
+            double* g_loc = G_loc.GetData() + k * nlocal_edgedof;
+            for (int i = 0; i < nlocal_edgedof; ++i)
+            {
+                g_loc[i] = edof_weight[i] * g[local_edgedof[i]];
+            }
         }
 
-        // Save M^{-1}g, A^{-1} (DM^{-1} g - f) for solution recovery
-        Minv_g_[iAgg].SetSize(nlocal_edgedof);
+        // Compute local contribution to the RHS of the hybrid system
+        // CM^{-1} g - CM^{-1}D^T A^{-1} (DM^{-1} g - f)
+        DMinv_G_loc.SetSize(nlocal_vertexdof * num_rhs);
+        DMinv_.Mult(iAgg, G_loc.GetData(), DMinv_G_loc.GetData(), scale, num_rhs);
+        for (int k = 0; k < num_rhs; ++k)
+        {
+            const double* f = OriginalRHS[k].GetBlock(1).GetData();
+            double* DMinv_g_loc = DMinv_G_loc.GetData() + k * nlocal_vertexdof;
+            for (int i = 0; i < nlocal_vertexdof; ++i)
+            {
+                DMinv_g_loc[i] -= f[local_vertexdof[i]];
+            }
+        }
+
+        CMinv_G_loc.SetSize(nlocal_multiplier * num_rhs);
+        MinvCT_.MultTranspose(iAgg, G_loc.GetData(), CMinv_G_loc.GetData(), scale, num_rhs);
         if (is_symmetric_)
         {
-            Minv_ref_[iAgg].Mult(g_loc, Minv_g_[iAgg]);
+            AinvDMinvCT_.AddMultTranspose(iAgg, DMinv_G_loc.GetData(),
+                                          CMinv_G_loc.GetData(), -1.0, num_rhs);
         }
         else
         {
-            Minv_[iAgg].Mult(g_loc, Minv_g_[iAgg]);
+            CMinvNAinv_.AddMult(iAgg, DMinv_G_loc.GetData(), CMinv_G_loc.GetData(),
+                                -1.0, num_rhs);
         }
 
-        local_rhs_[iAgg].SetSize(nlocal_vertexdof);
-        Ainv_[iAgg].Mult(DMinv_g_loc, local_rhs_[iAgg]);
-        if (is_symmetric_)
+        for (int k = 0; k < num_rhs; ++k)
         {
-            local_rhs_[iAgg] *= elem_scaling_[iAgg];
+            const double* CMinv_g_loc = CMinv_G_loc.GetData() + k * nlocal_multiplier;
+            for (int i = 0; i < nlocal_multiplier; ++i)
+            {
+                HybridRHS[k][local_multiplier[i]] += CMinv_g_loc[i];
+            }
         }
+
+        // Save M^{-1}g, A^{-1} (DM^{-1} g - f) for solution recovery
+        const PackedDenseMatrices& Minv = is_symmetric_ ? Minv_ref_ : Minv_;
+        Minv.Mult(iAgg, G_loc.GetData(), Minv_G_.GetData() + edof_I[iAgg] * num_rhs,
+                  1.0, num_rhs);
+
+        Ainv_.Mult(iAgg, DMinv_G_loc.GetData(), local_RHS_.GetData() + vdof_I[iAgg] * num_rhs,
+                   is_symmetric_ ? elem_scaling_[iAgg] : 1.0, num_rhs);
     }
 }
 
-void HybridSolver::RecoverOriginalSolution(const mfem::Vector& HybridSol,
-                                           mfem::BlockVector& RecoveredSol) const
+void HybridSolver::RecoverOriginalSolution(
+    const std::vector<mfem::Vector>& HybridSol,
+    std::vector<mfem::BlockVector>& RecoveredSol) const
 {
+    const int num_rhs = HybridSol.size();
     const auto& Agg_vertexdof = mgL_.GetGraphSpace().VertexToVDof();
     const auto& Agg_edgedof = mgL_.GetGraphSpace().VertexToEDof();
 
-    RecoveredSol = 0.;
+    for (int k = 0; k < num_rhs; ++k)
+    {
+        RecoveredSol[k] = 0.;
+    }
 
-    mfem::Vector& RecoveredSol_block2(RecoveredSol.GetBlock(1));
+    const int* vdof_I = Agg_vertexdof.GetI();
+    const int* vdof_J = Agg_vertexdof.GetJ();
+    const int* edof_I = Agg_edgedof.GetI();
+    const int* edof_J = Agg_edgedof.GetJ();
+    const int* mult_I = Agg_multiplier_.GetI();
+    const int* mult_J = Agg_multiplier_.GetJ();
 
-    mfem::Array<int> local_vertexdof, local_edgedof, local_multiplier;
-    mfem::Vector mu_loc, tmp;
+    mfem::Vector Mu_loc;
     for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
     {
-        // Extracting the size and global numbering of local dof
-        GetTableRow(Agg_vertexdof, iAgg, local_vertexdof);
-        GetTableRow(Agg_edgedof, iAgg, local_edgedof);
-        GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
+        const int nlocal_vertexdof = vdof_I[iAgg + 1] - vdof_I[iAgg];
+        const int nlocal_edgedof = edof_I[iAgg + 1] - edof_I[iAgg];
+        const int nlocal_multiplier = mult_I[iAgg + 1] - mult_I[iAgg];
 
-        int nlocal_vertexdof = local_vertexdof.Size();
-        int nlocal_edgedof = local_edgedof.Size();
-        int nlocal_multiplier = local_multiplier.Size();
+        const int* local_vertexdof = vdof_J + vdof_I[iAgg];
+        const int* local_edgedof = edof_J + edof_I[iAgg];
+        const int* local_multiplier = mult_J + mult_I[iAgg];
+        const double* edof_weight = agg_edof_weight_.GetData() + edof_I[iAgg];
 
-        // Initialize a vector which will store the local contribution of Hdiv
-        // and L2 space
-        mfem::Vector& u_loc(local_rhs_[iAgg]);
-        mfem::Vector& sigma_loc(Minv_g_[iAgg]);
+        // Local contributions of Hdiv and L2 space, one column for each rhs
+        double* U_loc = local_RHS_.GetData() + vdof_I[iAgg] * num_rhs;
+        double* Sigma_loc = Minv_G_.GetData() + edof_I[iAgg] * num_rhs;
 
-        // This check is just for the case when there is only one element for
-        // the global problem, then there will be no Lagrange multipliers
+        // There are no Lagrange multipliers if there is only one element
         if (nlocal_multiplier > 0)
         {
-            // Extract the local portion of the Lagrange multiplier solution
-            HybridSol.GetSubVector(local_multiplier, mu_loc);
+            // Extract the local portion of the Lagrange multiplier solutions
+            Mu_loc.SetSize(nlocal_multiplier * num_rhs);
+            for (int k = 0; k < num_rhs; ++k)
+            {
+                double* mu_loc = Mu_loc.GetData() + k * nlocal_multiplier;
+                for (int i = 0; i < nlocal_multiplier; ++i)
+                {
+                    mu_loc[i] = HybridSol[k][local_multiplier[i]];
+                }
+            }
 
             // Compute u = A^{-1} (DM^{-1} (g - C^T mu) - f)
-            tmp.SetSize(u_loc.Size());
-            AinvDMinvCT_[iAgg].Mult(mu_loc, tmp);
-            u_loc -= tmp;
+            AinvDMinvCT_.AddMult(iAgg, Mu_loc.GetData(), U_loc, -1.0, num_rhs);
 
             // Compute sigma = M^{-1} (g - D^T u - C^T mu)
-            tmp.SetSize(nlocal_edgedof);
             if (is_symmetric_)
             {
-                DMinv_[iAgg].MultTranspose(u_loc, tmp);
+                DMinv_.AddMultTranspose(iAgg, U_loc, Sigma_loc, -1.0, num_rhs);
             }
             else
             {
-                MinvN_[iAgg].Mult(u_loc, tmp);
+                MinvN_.AddMult(iAgg, U_loc, Sigma_loc, -1.0, num_rhs);
             }
-
-            sigma_loc -= tmp;
-            tmp.SetSize(nlocal_edgedof);
-            MinvCT_[iAgg].Mult(mu_loc, tmp);
-            sigma_loc -= tmp;
+            MinvCT_.AddMult(iAgg, Mu_loc.GetData(), Sigma_loc, -1.0, num_rhs);
 
             if (is_symmetric_)
             {
-                sigma_loc /= elem_scaling_[iAgg];
+                const double scale = 1.0 / elem_scaling_[iAgg];
+                for (int i = 0; i < nlocal_edgedof * num_rhs; ++i)
+                {
+                    Sigma_loc[i] *= scale;
+                }
             }
         }
 
-        // Save local solution to the global solution vector
-        for (int i = 0; i < nlocal_vertexdof; ++i)
-            RecoveredSol_block2(local_vertexdof[i]) = u_loc(i);
-
-        for (int i = 0; i < nlocal_edgedof; ++i)
+        // Save local solutions to the global solution vectors
+        for (int k = 0; k < num_rhs; ++k)
         {
-            if (edof_needs_averaging_[local_edgedof[i]])
+            const double* u_loc = U_loc + k * nlocal_vertexdof;
+            const double* sigma_loc = Sigma_loc + k * nlocal_edgedof;
+            double* sigma = RecoveredSol[k].GetBlock(0).GetData();
+            double* u = RecoveredSol[k].GetBlock(1).GetData();
+
+            for (int i = 0; i < nlocal_vertexdof; ++i)
             {
-                RecoveredSol(local_edgedof[i]) += sigma_loc(i) * 0.5;
+                u[local_vertexdof[i]] = u_loc[i];
             }
-            else
+
+            for (int i = 0; i < nlocal_edgedof; ++i)
             {
-                RecoveredSol(local_edgedof[i]) = sigma_loc(i);
+                sigma[local_edgedof[i]] += edof_weight[i] * sigma_loc[i];
             }
         }
     }
@@ -903,9 +1515,19 @@ void HybridSolver::BuildSpectralAMGePreconditioner()
 }
 
 void HybridSolver::BuildParallelSystemAndSolver(mfem::SparseMatrix& H_proc)
+{
+    ScopedTimer timer("parallel-system");
+
+    AssembleParallelSystem(H_proc);
+    SetKrylovOperator(SystemOperator());
+    BuildPreconditioner();
+}
+
+void HybridSolver::AssembleParallelSystem(mfem::SparseMatrix& H_proc)
 {
     H_proc.Finalize();
     {
+        ScopedTimer rap_timer("rap");
         auto tmp = ParMult(*multiplier_td_d_, H_proc, multiplier_start_);
         H_.reset(mfem::ParMult(tmp.get(), multiplier_d_td_.get()));
     }
@@ -917,13 +1539,17 @@ void HybridSolver::BuildParallelSystemAndSolver(mfem::SparseMatrix& H_proc)
         ComputeScaledHybridSystem(*H_);
     }
     nnz_ = H_->NNZ();
+}
 
-    solver_->SetOperator(*H_);
-
+void HybridSolver::BuildPreconditioner()
+{
     mfem::StopWatch chrono;
     chrono.Clear();
     chrono.Start();
 
+    num_prec_setups_++;
+    prec_reference_iterations_ = -1;
+
     // HypreBoomerAMG is broken if local size is zero
     int local_size = H_->Height();
     int min_size;
@@ -932,6 +1558,8 @@ void HybridSolver::BuildParallelSystemAndSolver(mfem::SparseMatrix& H_proc)
     const bool use_prec = min_size > 0;
     if (use_prec)
     {
+        ScopedTimer prec_timer("preconditioner");
+
         if (saamge_param_)
         {
             BuildSpectralAMGePreconditioner();
@@ -974,16 +1602,77 @@ void HybridSolver::BuildParallelSystemAndSolver(mfem::SparseMatrix& H_proc)
                 diagonal_scaling_.SetSize(0);
             }
 
-            prec_ = make_unique<AuxSpacePrec>(*H_, std::move(PV_map), local_dofs);
+            if (H_op_)
+            {
+                prec_ = make_unique<AuxSpacePrec>(*H_op_, *H_, std::move(PV_map), local_dofs);
+            }
+            else
+            {
+                prec_ = make_unique<AuxSpacePrec>(*H_, std::move(PV_map), local_dofs);
+            }
         }
 
-        solver_->SetPreconditioner(*prec_);
+        SetKrylovPreconditioner(*prec_);
     }
     if (myid_ == 0 && print_level_ > 0)
         std::cout << "  Timing: Preconditioner for hybridized system"
                   " constructed in " << chrono.RealTime() << "s. \n";
 }
 
+const mfem::Operator& HybridSolver::SystemOperator() const
+{
+    if (H_op_)
+    {
+        return *H_op_;
+    }
+    return *H_;
+}
+
+void HybridSolver::EliminateEssentialMultipliers(const mfem::Vector& mu,
+                                                 mfem::Vector& rhs) const
+{
+    if (!H_op_)
+    {
+        H_elim_->Mult(-1.0, mu, 1.0, rhs);
+        return;
+    }
+
+    mfem::Vector mu_ess(mu.Size());
+    mu_ess = 0.0;
+    for (int ess_true_mult : ess_true_multipliers_)
+    {
+        mu_ess(ess_true_mult) = mu(ess_true_mult);
+    }
+
+    mfem::Vector H_mu_ess(rhs.Size());
+    H_op_->MultUnconstrained(mu_ess, H_mu_ess);
+    rhs -= H_mu_ess;
+}
+
+bool HybridSolver::ReusePreconditioner() const
+{
+    // SAAMGe and AuxSpacePrec keep local data computed from the old system
+    // (the latter also consumes diagonal_scaling_), only BoomerAMG is kept
+    if (amg_reuse_ratio_ <= 0.0 || saamge_param_ ||
+        H_->N() != mgL_.GetGraph().EdgeToTrueEdge().N())
+    {
+        return false;
+    }
+
+    // iteration counts are global, so all processes make the same decision
+    const int reference_iterations = std::max(prec_reference_iterations_, 1);
+    return prec_reference_iterations_ < 0 ||
+           num_iterations_ <= amg_reuse_ratio_ * reference_iterations;
+}
+
+void HybridSolver::RecordReferenceIterations() const
+{
+    if (prec_reference_iterations_ < 0)
+    {
+        prec_reference_iterations_ = num_iterations_;
+    }
+}
+
 void HybridSolver::CollectEssentialDofs(const mfem::SparseMatrix& edof_bdrattr)
 {
     mfem::SparseMatrix mult_truemult = GetDiag(*multiplier_d_td_);
@@ -1043,17 +1732,34 @@ void HybridSolver::UpdateElemScaling(const mfem::Vector& elem_scaling_inverse)
     // TODO: this is not valid when W is nonzero
     assert(W_is_nonzero_ == false);
 
-    mfem::SparseMatrix H_proc(num_multiplier_dofs_);
-    mfem::Array<int> local_multiplier;
-    for (int iAgg = 0; iAgg < nAggs_; ++iAgg)
+    mfem::SparseMatrix H_proc = AssembleElementMatrices(true);
+    if (H_op_)
     {
-        GetTableRow(Agg_multiplier_, iAgg, local_multiplier);
-        mfem::DenseMatrix H_el = Hybrid_el_[iAgg]; // deep copy
-        H_el *= (1.0 / elem_scaling_(iAgg));
-        H_proc.AddSubMatrix(local_multiplier, local_multiplier, H_el);
+        H_op_->SetElemScaling(&elem_scaling_);
+    }
 
+    if (ReusePreconditioner())
+    {
+        ScopedTimer timer("parallel-system");
+
+        std::unique_ptr<mfem::HypreParMatrix> H_old = std::move(H_);
+        AssembleParallelSystem(H_proc);
+
+        // solver_ and prec_ refer to H_old, so they see the new values
+        if (CopyValuesIfSamePattern(*H_, *H_old))
+        {
+            H_ = std::move(H_old);
+        }
+        else
+        {
+            SetKrylovOperator(SystemOperator());
+            BuildPreconditioner();
+        }
+    }
+    else
+    {
+        BuildParallelSystemAndSolver(H_proc);
     }
-    BuildParallelSystemAndSolver(H_proc);
 
     if (myid_ == 0 && print_level_ > 0)
     {
@@ -1074,6 +1780,10 @@ void HybridSolver::UpdateJacobian(const mfem::Vector& elem_scaling_inverse,
     solver_->iterative_mode = false;
 
     auto H_proc = AssembleHybridSystem(elem_scaling_inverse, N_el);
+    if (H_op_)
+    {
+        H_op_->SetElemScaling(nullptr);
+    }
     BuildParallelSystemAndSolver(H_proc);
 
     if (myid_ == 0 && print_level_ > 0)
@@ -1092,33 +1802,49 @@ mfem::Vector HybridSolver::MakeInitialGuess(const mfem::BlockVector& sol,
     mfem::Vector mu(num_multiplier_dofs_);
     mu = 0.0;
 
-    mfem::Array<int> local_vertexdof, local_edgedof, local_multiplier;
+    const int* vdof_I = Agg_vertexdof.GetI();
+    const int* vdof_J = Agg_vertexdof.GetJ();
+    const int* edof_I = Agg_edgedof.GetI();
+    const int* edof_J = Agg_edgedof.GetJ();
+    const int* mult_I = Agg_multiplier_.GetI();
+    const int* mult_J = Agg_multiplier_.GetJ();
+
+    const double* g = rhs.GetBlock(0).GetData();
+    const double* sigma = sol.GetBlock(0).GetData();
+    const double* u = sol.GetBlock(1).GetData();
+
     mfem::Vector sigma_loc, u_loc, mu_loc, g_loc;
     for (int i = 0; i < nAggs_; ++i)
     {
-        // Extracting the size and global numbering of local dof
-        GetTableRow(Agg_vertexdof, i, local_vertexdof);
-        GetTableRow(Agg_edgedof, i, local_edgedof);
-        GetTableRow(Agg_multiplier_, i, local_multiplier);
-
-        rhs.GetSubVector(local_edgedof, g_loc);
-        for (int i = 0; i < local_edgedof.Size(); ++i)
+        const int nlocal_vertexdof = vdof_I[i + 1] - vdof_I[i];
+        const int nlocal_edgedof = edof_I[i + 1] - edof_I[i];
+        const int nlocal_multiplier = mult_I[i + 1] - mult_I[i];
+
+        const int* local_vertexdof = vdof_J + vdof_I[i];
+        const int* local_edgedof = edof_J + edof_I[i];
+        const int* local_multiplier = mult_J + mult_I[i];
+        const double* edof_weight = agg_edof_weight_.GetData() + edof_I[i];
+
+        g_loc.SetSize(nlocal_edgedof);
+        sigma_loc.SetSize(nlocal_edgedof);
+        for (int j = 0; j < nlocal_edgedof; ++j)
         {
-            if (edof_needs_averaging_[local_edgedof[i]])
-            {
-                g_loc[i] /= 2.0;
-            }
+            g_loc[j] = edof_weight[j] * g[local_edgedof[j]];
+            sigma_loc[j] = sigma[local_edgedof[j]];
         }
-        mu_loc.SetSize(local_multiplier.Size());
-        C_[i].Mult(g_loc, mu_loc);
 
-        sol.GetSubVector(local_edgedof, sigma_loc);
-        CM_[i].AddMult_a(-elem_scaling_[i], sigma_loc, mu_loc);
+        u_loc.SetSize(nlocal_vertexdof);
+        for (int j = 0; j < nlocal_vertexdof; ++j)
+        {
+            u_loc[j] = u[local_vertexdof[j]];
+        }
 
-        sol.GetBlock(1).GetSubVector(local_vertexdof, u_loc);
+        mu_loc.SetSize(nlocal_multiplier);
+        C_[i].Mult(g_loc, mu_loc);
+        CM_.AddMult(i, sigma_loc.GetData(), mu_loc.GetData(), -elem_scaling_[i]);
         CDT_[i].AddMult(u_loc, mu_loc, -1.0);
 
-        for (int j = 0; j < mu_loc.Size(); ++j)
+        for (int j = 0; j < nlocal_multiplier; ++j)
         {
             int local_mult = local_multiplier[j];
             double CCT_i = mult_on_bdr_[local_mult] ? 1.0 : 2.0;
@@ -1133,6 +1859,13 @@ mfem::Vector HybridSolver::MakeInitialGuess(const mfem::BlockVector& sol,
 
 AuxSpacePrec::AuxSpacePrec(mfem::HypreParMatrix& op, mfem::SparseMatrix aux_map,
                            const std::vector<mfem::Array<int>>& loc_dofs)
+    : AuxSpacePrec(op, op, std::move(aux_map), loc_dofs)
+{
+}
+
+AuxSpacePrec::AuxSpacePrec(const mfem::Operator& op, mfem::HypreParMatrix& op_part,
+                           mfem::SparseMatrix aux_map,
+                           const std::vector<mfem::Array<int>>& loc_dofs)
     : mfem::Solver(op.NumRows(), false),
       local_dofs_(loc_dofs.size()),
       local_ops_(local_dofs_.size()),
@@ -1140,7 +1873,9 @@ AuxSpacePrec::AuxSpacePrec(mfem::HypreParMatrix& op, mfem::SparseMatrix aux_map,
       op_(op),
       aux_map_(std::move(aux_map))
 {
-    op.GetDiag(op_diag_);
+    assert(op.NumRows() == op_part.NumRows());
+
+    op_part.GetDiag(op_diag_);
     for (unsigned int i = 0; i < local_dofs_.size(); ++i)
     {
         loc_dofs[i].Copy(local_dofs_[i]);
@@ -1152,11 +1887,11 @@ AuxSpacePrec::AuxSpacePrec(mfem::HypreParMatrix& op, mfem::SparseMatrix aux_map,
 
     // Set up auxilary space solver
     mfem::Array<int> adof_starts;
-    GenerateOffsets(op.GetComm(), aux_map_.NumCols(), adof_starts);
+    GenerateOffsets(op_part.GetComm(), aux_map_.NumCols(), adof_starts);
     int num_global_adofs = adof_starts.Last();
-    mfem::HypreParMatrix par_aux_map(op.GetComm(), op.N(), num_global_adofs,
-                                     op.ColPart(), adof_starts, &aux_map_);
-    aux_op_.reset(smoothg::RAP(op, par_aux_map));
+    mfem::HypreParMatrix par_aux_map(op_part.GetComm(), op_part.N(), num_global_adofs,
+                                     op_part.ColPart(), adof_starts, &aux_map_);
+    aux_op_.reset(smoothg::RAP(op_part, par_aux_map));
     aux_op_->CopyRowStarts();
     aux_op_->CopyColStarts();
 
@@ -1168,12 +1903,13 @@ void AuxSpacePrec::Mult(const mfem::Vector& x, mfem::Vector& y) const
 {
     y = 0.0;
 
-    mfem::Vector x_aux, y_aux, residual(x), correction(y.Size());
+    mfem::Vector x_aux, y_aux, residual(x), correction(y.Size()), op_y(y.Size());
     correction = 0.0;
 
     Smoothing(x, y);
 
-    op_.Mult(-1.0, y, 1.0, residual);
+    op_.Mult(y, op_y);
+    residual -= op_y;
 
     x_aux.SetSize(aux_map_.NumCols());
     y_aux.SetSize(aux_map_.NumCols());
@@ -1183,7 +1919,8 @@ void AuxSpacePrec::Mult(const mfem::Vector& x, mfem::Vector& y) const
     aux_solver_->Mult(x_aux, y_aux);
     aux_map_.Mult(y_aux, correction);
 
-    op_.Mult(-1.0, correction, 1.0, residual);
+    op_.Mult(correction, op_y);
+    residual -= op_y;
     y += correction;
 
     Smoothing(residual, correction);
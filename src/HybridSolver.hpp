@@ -43,6 +43,62 @@
 namespace smoothg
 {
 
+/**
+   @brief Matrix-free application of the hybridized system in true dofs.
+
+   Applies \f$ P^T (\sum_i C_i H_i C_i^T) P \f$ element by element, where
+   \f$ H_i \f$ are the element hybridized matrices, \f$ C_i \f$ the
+   aggregate to multiplier restrictions and \f$ P \f$ the multiplier dof
+   to true dof map. Essential multipliers are eliminated like in
+   mfem::HypreParMatrix::EliminateRowsCols (unit diagonal).
+
+   The operator refers to (does not copy) the data given to the constructor.
+*/
+class HybridOperator : public mfem::Operator
+{
+public:
+    /**
+       @param Agg_multiplier aggregate to multiplier dof table
+       @param color_Agg color to aggregate table, aggregates of the same
+              color share no multiplier (they are processed concurrently)
+       @param Hybrid_el element hybridized matrices
+       @param multiplier_d_td multiplier dof to true dof map
+       @param multiplier_td_d transpose of multiplier_d_td
+       @param ess_true_multipliers eliminated true multipliers
+    */
+    HybridOperator(const mfem::SparseMatrix& Agg_multiplier,
+                   const mfem::SparseMatrix& color_Agg,
+                   const std::vector<mfem::DenseMatrix>& Hybrid_el,
+                   const mfem::HypreParMatrix& multiplier_d_td,
+                   const mfem::HypreParMatrix& multiplier_td_d,
+                   const mfem::Array<int>& ess_true_multipliers);
+
+    /// Divide Hybrid_el[i] by (*elem_scaling)(i), no scaling if nullptr
+    void SetElemScaling(const mfem::Vector* elem_scaling) { elem_scaling_ = elem_scaling; }
+
+    /// y = H x, with the essential multipliers eliminated
+    virtual void Mult(const mfem::Vector& x, mfem::Vector& y) const;
+
+    /// y = H x, without elimination
+    void MultUnconstrained(const mfem::Vector& x, mfem::Vector& y) const;
+
+private:
+    /// y_d = sum_i C_i H_i C_i^T x_d in (processor-local) multiplier dofs
+    void MultLocal(const mfem::Vector& x_d, mfem::Vector& y_d) const;
+
+    const mfem::SparseMatrix& Agg_multiplier_;
+    const mfem::SparseMatrix& color_Agg_;
+    const std::vector<mfem::DenseMatrix>& Hybrid_el_;
+    const mfem::HypreParMatrix& multiplier_d_td_;
+    const mfem::HypreParMatrix& multiplier_td_d_;
+    const mfem::Array<int>& ess_true_multipliers_;
+    const mfem::Vector* elem_scaling_;
+
+    mutable mfem::Vector x_true_;
+    mutable mfem::Vector x_d_;
+    mutable mfem::Vector y_d_;
+};
+
 /**
    @brief Hybridization solver for saddle point problems
 
@@ -77,6 +133,11 @@ namespace smoothg
 
    Each constraint in turn creates a dual variable (Lagrange multiplier).
    The construction is done locally in each element.
+
+   On levels with several multipliers per face, H can optionally be applied
+   matrix-free (see HybridOperator). Then only the face diagonal blocks and
+   the couplings between the first (PV) multipliers of the faces are
+   assembled, which is all the auxiliary space preconditioner needs.
 */
 class HybridSolver : public MixedLaplacianSolver
 {
@@ -95,17 +156,32 @@ public:
        @param saamge_param SAAMGe parameters. Use SAAMGe as preconditioner for
               hybridized system if saamge_param is not nullptr, otherwise
               BoomerAMG is used instead.
+       @param matrix_free apply the hybridized system matrix-free if there are
+              several multipliers per face and SAAMGe is not used (the
+              system is assembled otherwise)
     */
     HybridSolver(const MixedMatrix& mgL,
                  const mfem::Array<int>* ess_attr = nullptr,
                  const int rescale_iter = -1,
-                 const SAAMGeParam* saamge_param = nullptr);
+                 const SAAMGeParam* saamge_param = nullptr,
+                 bool matrix_free = false);
 
     virtual ~HybridSolver();
 
     /// Wrapper for solving the saddle point system through hybridization
     void Mult(const mfem::BlockVector& Rhs, mfem::BlockVector& Sol) const;
 
+    /**
+       @brief Solve for several right hand sides
+
+       The element-local transformations of the right hand sides and the
+       recovery of the solutions are done for all right hand sides together
+       (dense matrix-matrix products), then the hybridized systems are solved
+       one after another with the same solver and preconditioner.
+    */
+    void Mult(const std::vector<mfem::BlockVector>& Rhs,
+              std::vector<mfem::BlockVector>& Sol) const;
+
     /**
        @brief Update weights of local M matrices on "elements"
 
@@ -113,17 +189,39 @@ public:
        a finite volume problem, elem_scaling is the weights on the mass matrix
        in the mixed form, which is the reciprocal of that.
 
+       If the BoomerAMG preconditioner may be reused (see SetAMGReuseRatio())
+       and the sparsity pattern of the hybridized system is unchanged, the
+       new values are copied into the existing system and the preconditioner
+       is kept, so the update costs an assembly only.
+
        @todo when W is non-zero, Aloc and Hybrid_el need to be recomputed
     */
     virtual void UpdateElemScaling(const mfem::Vector& elem_scaling_inverse);
 
     virtual void UpdateJacobian(const mfem::Vector& elem_scaling_inverse,
                                 const std::vector<mfem::DenseMatrix>& N_el);
+
+    /**
+       @brief Allow reusing the BoomerAMG preconditioner in UpdateElemScaling().
+
+       The preconditioner is rebuilt when the last iteration count exceeds
+       ratio times the iteration count of the first solve after the last
+       setup. A non-positive ratio means it is rebuilt at every update.
+       SAAMGe and the auxiliary space preconditioner are always rebuilt.
+    */
+    void SetAMGReuseRatio(double ratio) { amg_reuse_ratio_ = ratio; }
+
+    /// Number of preconditioner setups, including the one in the constructor
+    int GetNumPreconditionerSetups() const { return num_prec_setups_; }
+
+    /// Whether the hybridized system is applied matrix-free
+    bool IsMatrixFree() const { return (bool) H_op_; }
 private:
     void Init(const mfem::SparseMatrix& face_edgedof,
               const std::vector<mfem::DenseMatrix>& M_el,
               const mfem::HypreParMatrix& edgedof_d_td,
-              const mfem::SparseMatrix& face_bdrattr);
+              const mfem::SparseMatrix& face_bdrattr,
+              bool matrix_free);
 
     void CreateMultiplierRelations(const mfem::SparseMatrix& face_edgedof,
                                    const mfem::HypreParMatrix& edgedof_d_td);
@@ -135,6 +233,30 @@ private:
         const mfem::Vector& elem_scaling_inverse,
         const std::vector<mfem::DenseMatrix>& N_el);
 
+    /// Color aggregates sharing multipliers
+    void ColorAggregates();
+
+    /**
+       @brief Build the sparsity pattern of H_proc.
+
+       If the system is applied matrix-free, only the face diagonal blocks
+       and the couplings between the first multipliers of faces are kept.
+    */
+    void BuildSystemPattern(const mfem::SparseMatrix& face_edgedof, bool matrix_free);
+
+    /**
+       @brief Add Hybrid_el_ to the processor-local hybridized system
+
+       Aggregates of the same color are added concurrently (with OpenMP).
+
+       @param scaled whether to divide Hybrid_el_ by elem_scaling_
+    */
+    mfem::SparseMatrix AssembleElementMatrices(bool scaled) const;
+
+    /// Assemble global rescaling vector (CC^T)^{-1}CD^T 1 from local parts
+    void ComputeDiagonalScaling(const std::vector<mfem::Vector>& CCT_diag_el,
+                                const std::vector<mfem::Vector>& CDT1_el);
+
     // Compute scaling vector and the scaled hybridized system
     void ComputeScaledHybridSystem(const mfem::HypreParMatrix& H_d);
 
@@ -144,14 +266,39 @@ private:
     // Assemble parallel hybridized system and build a solver for it
     void BuildParallelSystemAndSolver(mfem::SparseMatrix& H_proc);
 
+    // Assemble parallel hybridized system H_ (with elimination and scaling)
+    void AssembleParallelSystem(mfem::SparseMatrix& H_proc);
+
+    // Build the preconditioner for H_ and set it in solver_
+    void BuildPreconditioner();
+
+    /// The operator of the iterative solver (H_, or H_op_ if matrix-free)
+    const mfem::Operator& SystemOperator() const;
+
+    /// rhs -= H mu_E, mu_E being the essential part of mu
+    void EliminateEssentialMultipliers(const mfem::Vector& mu, mfem::Vector& rhs) const;
+
+    /// Whether the staleness rule allows keeping the current preconditioner
+    bool ReusePreconditioner() const;
+
+    /// Record the iteration count of the first solve after a setup
+    void RecordReferenceIterations() const;
+
     void CollectEssentialDofs(const mfem::SparseMatrix& edof_bdrattr);
 
     std::vector<bool> MakeAveragingIndicators();
 
+    /// Allocate the packed local matrices and set up agg_edof_weight_
+    void InitLocalStorage();
+
     /// Transform original RHS to the RHS of the hybridized system
     void RHSTransform(const mfem::BlockVector& OriginalRHS,
                       mfem::Vector& HybridRHS) const;
 
+    /// Transform several original RHS to RHS of the hybridized system
+    void RHSTransform(const std::vector<mfem::BlockVector>& OriginalRHS,
+                      std::vector<mfem::Vector>& HybridRHS) const;
+
     /**
        @brief Recover the solution of the original system from multiplier \f$ \mu \f$.
 
@@ -171,6 +318,10 @@ private:
     void RecoverOriginalSolution(const mfem::Vector& HybridSol,
                                  mfem::BlockVector& RecoveredSol) const;
 
+    /// Recover several solutions of the original system at once
+    void RecoverOriginalSolution(const std::vector<mfem::Vector>& HybridSol,
+                                 std::vector<mfem::BlockVector>& RecoveredSol) const;
+
     mfem::Vector MakeInitialGuess(const mfem::BlockVector& sol,
                                   const mfem::BlockVector& rhs) const;
 
@@ -178,30 +329,49 @@ private:
 
     mfem::SparseMatrix Agg_multiplier_;
 
-    std::vector<bool> edof_needs_averaging_;
+    /// sparsity pattern of processor-local (partially if matrix-free) hybridized system
+    mfem::SparseMatrix H_proc_pattern_;
+
+    /// color to aggregate table, aggregates of the same color share no multiplier
+    mfem::SparseMatrix color_Agg_;
 
     std::unique_ptr<mfem::HypreParMatrix> H_;
     std::unique_ptr<mfem::Solver> prec_;
 
+    // matrix-free hybridized system (H_ is then partially assembled)
+    std::unique_ptr<HybridOperator> H_op_;
+
     // eliminated part of H_ (for applying elimination in repeated solves)
     std::unique_ptr<mfem::HypreParMatrix> H_elim_;
 
     std::vector<mfem::DenseMatrix> Hybrid_el_;
 
-    std::vector<mfem::DenseMatrix> MinvN_;
-    std::vector<mfem::DenseMatrix> DMinv_;
-    std::vector<mfem::DenseMatrix> MinvCT_;
-    std::vector<mfem::DenseMatrix> AinvDMinvCT_;
-    std::vector<mfem::DenseMatrix> CMinvNAinv_;
-    std::vector<mfem::DenseMatrix> Ainv_;
-    std::vector<mfem::DenseMatrix> Minv_;
-    std::vector<mfem::DenseMatrix> Minv_ref_;
+    // Local matrices used in every solve, matrix i belongs to aggregate i
+    PackedDenseMatrices MinvN_;
+    PackedDenseMatrices DMinv_;
+    PackedDenseMatrices MinvCT_;
+    PackedDenseMatrices AinvDMinvCT_;
+    PackedDenseMatrices CMinvNAinv_;
+    PackedDenseMatrices Ainv_;
+    PackedDenseMatrices Minv_;
+    PackedDenseMatrices Minv_ref_;
     std::vector<mfem::SparseMatrix> C_;
-    std::vector<mfem::DenseMatrix> CM_;
+    PackedDenseMatrices CM_;
     std::vector<mfem::SparseMatrix> CDT_;
 
-    mutable std::vector<mfem::Vector> Minv_g_;
-    mutable std::vector<mfem::Vector> local_rhs_;
+    // 0.5 for edge dofs shared by two aggregates, 1.0 otherwise, stored in
+    // the order of the column indices of Agg_edgedof
+    mfem::Vector agg_edof_weight_;
+
+    // M^{-1}g and A^{-1} (DM^{-1} g - f) of all aggregates, stored in the
+    // order of the column indices of Agg_edgedof and Agg_vertexdof
+    mutable mfem::Vector Minv_g_;
+    mutable mfem::Vector local_rhs_;
+
+    // counterparts of Minv_g_, local_rhs_ for several right hand sides, the
+    // part of an aggregate is a column-major matrix with one column per rhs
+    mutable mfem::Vector Minv_G_;
+    mutable mfem::Vector local_RHS_;
 
     mfem::Array<int> ess_true_multipliers_;
     mfem::Array<int> multiplier_to_edof_;
@@ -224,6 +394,10 @@ private:
     int rescale_iter_;
     mfem::Vector diagonal_scaling_;
 
+    double amg_reuse_ratio_ = 0.0;
+    int num_prec_setups_ = 0;
+    mutable int prec_reference_iterations_ = -1;
+
     const SAAMGeParam* saamge_param_;
 #if SMOOTHG_USE_SAAMGE
     std::vector<int> sa_nparts_;
@@ -241,6 +415,17 @@ public:
     AuxSpacePrec(mfem::HypreParMatrix& op, mfem::SparseMatrix aux_map,
                  const std::vector<mfem::Array<int>>& loc_dofs);
 
+    /**
+       @brief Preconditioner for an operator which is not assembled.
+
+       @param op the operator, used for residuals only
+       @param op_part assembled matrix which coincides with op on the blocks
+              of loc_dofs and on the span of aux_map
+    */
+    AuxSpacePrec(const mfem::Operator& op, mfem::HypreParMatrix& op_part,
+                 mfem::SparseMatrix aux_map,
+                 const std::vector<mfem::Array<int>>& loc_dofs);
+
     virtual void Mult(const mfem::Vector& x, mfem::Vector& y) const;
     virtual void SetOperator(const mfem::Operator& op) { }
 private:
@@ -250,7 +435,7 @@ private:
     std::vector<mfem::DenseMatrix> local_ops_;
     std::vector<mfem::DenseMatrix> local_solvers_;
 
-    mfem::HypreParMatrix& op_;
+    const mfem::Operator& op_;
     mfem::SparseMatrix op_diag_;
     mfem::SparseMatrix aux_map_;
     std::unique_ptr<mfem::HypreParMatrix> aux_op_;
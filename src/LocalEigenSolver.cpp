@@ -23,6 +23,7 @@
 #include "MatrixUtilities.hpp"
 #include "utilities.hpp"
 #include <cassert>
+#include <random>
 
 #if SMOOTHG_USE_ARPACK
 // arpackpp include
@@ -82,10 +83,21 @@ LocalEigenSolver::LocalEigenSolver(
     num_arnoldi_vectors_(-1),
     tolerance_(1e-10),
     max_iterations_(1000),
-    shift_(-1e-2)  // shift_ may need to be adjusted
+    shift_(-1e-2),  // shift_ may need to be adjusted
+    lobpcg_threshold_(0),
+    lobpcg_tolerance_(1e-8),
+    print_level_(0)
 {
 }
 
+bool LocalEigenSolver::UsesLOBPCG(int size) const
+{
+    // the projected problems have up to three times as many unknowns
+    // as the number of wanted eigenpairs
+    return lobpcg_threshold_ > 0 && size > lobpcg_threshold_ &&
+           max_num_evects_ > 0 && size > 3 * max_num_evects_;
+}
+
 void LocalEigenSolver::AllocateWorkspace(int n, bool is_gev)
 {
     A_.resize(n * n, 0.0);
@@ -261,6 +273,278 @@ void LocalEigenSolver::BlockCompute(
     Compute(DMinvDt, evals, evects);
 }
 
+// Evaluate y = D M^{-1} D^T x
+class DMinvDt_operator : public mfem::Operator
+{
+public:
+    DMinvDt_operator(const mfem::SparseMatrix& M, const mfem::SparseMatrix& D)
+        :
+        mfem::Operator(D.Height()),
+        D_(D),
+        M_is_diag_(IsDiag(M)),
+        sigma_(D.Width()),
+        Minv_sigma_(D.Width())
+    {
+        if (M_is_diag_)
+        {
+            M.GetDiag(M_diag_);
+        }
+        else
+        {
+            M_inv_.SetOperator(M);
+        }
+    }
+
+    void Mult(const mfem::Vector& x, mfem::Vector& y) const override
+    {
+        D_.MultTranspose(x, sigma_);
+        if (M_is_diag_)
+        {
+            for (int i = 0; i < sigma_.Size(); ++i)
+            {
+                Minv_sigma_(i) = sigma_(i) / M_diag_(i);
+            }
+        }
+        else
+        {
+            M_inv_.Mult(sigma_, Minv_sigma_);
+        }
+        D_.Mult(Minv_sigma_, y);
+    }
+
+private:
+    const mfem::SparseMatrix& D_;
+    bool M_is_diag_;
+    mfem::Vector M_diag_;
+    mfem::UMFPackSolver M_inv_;
+    mutable mfem::Vector sigma_;
+    mutable mfem::Vector Minv_sigma_;
+};
+
+// Evaluate y = diag(A)^{-1} x (rows with nonpositive diagonal are not scaled)
+class Jacobi_operator : public mfem::Solver
+{
+public:
+    Jacobi_operator(const mfem::SparseMatrix& A)
+        :
+        mfem::Solver(A.Height())
+    {
+        A.GetDiag(diag_);
+    }
+
+    void Mult(const mfem::Vector& x, mfem::Vector& y) const override
+    {
+        for (int i = 0; i < x.Size(); ++i)
+        {
+            y(i) = diag_(i) > 0.0 ? x(i) / diag_(i) : x(i);
+        }
+    }
+
+    void SetOperator(const mfem::Operator& op) override { }
+
+private:
+    mfem::Vector diag_;
+};
+
+namespace
+{
+
+// AX = A X, column by column
+void MultColumns(const mfem::Operator& A, const mfem::DenseMatrix& X, mfem::DenseMatrix& AX)
+{
+    const int n = X.Height();
+    AX.SetSize(A.Height(), X.Width());
+
+    mfem::Vector x, Ax;
+    for (int j = 0; j < X.Width(); ++j)
+    {
+        x.SetDataAndSize(X.Data() + j * n, n);
+        Ax.SetDataAndSize(AX.Data() + j * A.Height(), A.Height());
+        A.Mult(x, Ax);
+    }
+}
+
+// Orthonormalize the columns of S by (twice applied) modified Gram-Schmidt,
+// (numerically) linearly dependent columns are dropped
+void Orthonormalize(const mfem::DenseMatrix& S, mfem::DenseMatrix& Q)
+{
+    const int n = S.Height();
+    Q.SetSize(n, S.Width());
+
+    int num_kept = 0;
+    mfem::Vector v, q;
+    for (int j = 0; j < S.Width(); ++j)
+    {
+        v.SetDataAndSize(Q.Data() + num_kept * n, n);
+        S.GetColumn(j, v);
+
+        const double norm_before = v.Norml2();
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (int k = 0; k < num_kept; ++k)
+            {
+                q.SetDataAndSize(Q.Data() + k * n, n);
+                v.Add(-(q * v), q);
+            }
+        }
+
+        const double norm = v.Norml2();
+        if (norm > 1e-10 * norm_before)
+        {
+            v /= norm;
+            num_kept++;
+        }
+    }
+    Q.SetSize(n, num_kept);
+}
+
+// Fill v with uniform random numbers in [0, 1) from a generator seeded by seed.
+// Unlike mfem::Vector::Randomize, this does not use the global state of rand(),
+// so concurrent local solves (OpenMP) are safe and reproducible
+void Randomize(mfem::Vector& v, int seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (int i = 0; i < v.Size(); ++i)
+    {
+        v(i) = uniform(generator);
+    }
+}
+
+} // namespace
+
+void LocalEigenSolver::LOBPCG(const mfem::Operator& A, const mfem::Solver& T,
+                              mfem::Vector& evals, mfem::DenseMatrix& evects)
+{
+    const int n = A.Height();
+    const int block_size = std::min(n, max_num_evects_);
+
+    // solver of the (dense) projected problems, computes all eigenpairs
+    LocalEigenSolver rayleigh_ritz(-1, 1.0);
+
+    // Initial guess: the columns of initial_guess_ if it is set, completed
+    // by the constant vector (kernel of graph Laplacians) and deterministic
+    // random vectors
+    const int num_guess = initial_guess_.Height() == n ?
+                          std::min(initial_guess_.Width(), block_size) : 0;
+    mfem::DenseMatrix S(n, block_size), AS, X, AX, P, G, C;
+    mfem::Vector column, theta, residual, precond_residual;
+    for (int j = 0; j < block_size; ++j)
+    {
+        column.SetDataAndSize(S.Data() + j * n, n);
+        if (j < num_guess)
+        {
+            std::copy_n(initial_guess_.Data() + j * n, n, column.GetData());
+        }
+        else if (j == 0)
+        {
+            column = 1.0;
+        }
+        else
+        {
+            Randomize(column, j);
+        }
+    }
+    initial_guess_.Clear();
+    X = S;
+    Orthonormalize(X, S);
+    MFEM_VERIFY(S.Width() == block_size, "LOBPCG initial guess is degenerate!");
+
+    double norm_A = 0.0;
+    bool converged = false;
+    for (int iter = 0; iter < max_iterations_ && !converged; ++iter)
+    {
+        // Rayleigh-Ritz on the span of S = [X, preconditioned residuals, P]
+        MultColumns(A, S, AS);
+        G.SetSize(S.Width());
+        mfem::MultAtB(S, AS, G);
+        G.Symmetrize();
+        rayleigh_ritz.Compute(G, theta, C);
+        norm_A = std::max(norm_A, std::max(std::fabs(theta(0)),
+                                           std::fabs(theta(theta.Size() - 1))));
+
+        // Ritz vectors of the block_size smallest Ritz values
+        C.SetSize(S.Width(), block_size);
+        X.SetSize(n, block_size);
+        AX.SetSize(n, block_size);
+        mfem::Mult(S, C, X);
+        mfem::Mult(AS, C, AX);
+
+        // P is the component of the new X in the span of the
+        // preconditioned residuals and the previous P
+        const int num_p_rows = S.Width() - block_size;
+        P.SetSize(n, block_size);
+        P = 0.0;
+        if (iter > 0 && num_p_rows > 0)
+        {
+            for (int j = 0; j < block_size; ++j)
+            {
+                for (int k = 0; k < block_size; ++k)
+                {
+                    C(k, j) = 0.0;
+                }
+            }
+            mfem::Mult(S, C, P);
+        }
+
+        // Residuals and convergence check
+        mfem::DenseMatrix W(n, block_size);
+        converged = true;
+        for (int j = 0; j < block_size; ++j)
+        {
+            residual.SetDataAndSize(AX.Data() + j * n, n);
+            column.SetDataAndSize(X.Data() + j * n, n);
+            residual.Add(-theta(j), column);
+            if (residual.Norml2() > lobpcg_tolerance_ * norm_A)
+            {
+                converged = false;
+            }
+            precond_residual.SetDataAndSize(W.Data() + j * n, n);
+            T.Mult(residual, precond_residual);
+        }
+
+        if (!converged)
+        {
+            mfem::DenseMatrix XWP(n, 3 * block_size);
+            std::copy_n(X.Data(), n * block_size, XWP.Data());
+            std::copy_n(W.Data(), n * block_size, XWP.Data() + n * block_size);
+            std::copy_n(P.Data(), n * block_size, XWP.Data() + 2 * n * block_size);
+            if (iter == 0)
+            {
+                XWP.SetSize(n, 2 * block_size);
+            }
+            Orthonormalize(XWP, S);
+        }
+    }
+
+    if (!converged && print_level_ > 0)
+    {
+        std::cout << "LOBPCG warning: eigenvectors did not converge!\n";
+    }
+
+    auto data_ptr = EigenPairsSetSizeAndData(n, block_size, evals, evects);
+    std::copy_n(X.Data(), n * block_size, data_ptr[0]);
+    std::copy_n(theta.GetData(), block_size, data_ptr[1]);
+
+    if (rel_tol_ < 1.0)
+    {
+        // Estimate the largest eigenvalue by power iterations
+        mfem::Vector v(n), Av(n);
+        Randomize(v, block_size);
+        v /= v.Norml2();
+        for (int i = 0; i < 20; ++i)
+        {
+            A.Mult(v, Av);
+            eig_max_ = v * Av;
+            v = Av;
+            v /= v.Norml2();
+        }
+
+        int num_evects = FindNumberOfEigenPairs(evals, block_size, eig_max_);
+        EigenPairsSetSizeAndData(n, num_evects, evals, evects);
+    }
+}
+
 #if SMOOTHG_USE_ARPACK
 /// Adapter for applying the action of a certain operator in ARPACK
 class ARPACK_operator_adapter
@@ -574,11 +858,30 @@ void LocalEigenSolver::BlockCompute(
 }
 #endif // SMOOTHG_USE_ARPACK
 
-double LocalEigenSolver::Compute(mfem::SparseMatrix& A, mfem::DenseMatrix& evects)
+double LocalEigenSolver::Compute(mfem::SparseMatrix& A, mfem::DenseMatrix& evects,
+                                 const mfem::Solver* prec)
 {
+    if (UsesLOBPCG(A.Height()))
+    {
+        if (prec)
+        {
+            LOBPCG(A, *prec, evals_, evects);
+        }
+        else
+        {
+            Jacobi_operator jacobi(A);
+            LOBPCG(A, jacobi, evals_, evects);
+        }
+        return evals_(0);
+    }
+
 #if SMOOTHG_USE_ARPACK
     if (A.Size() > size_offset_)
     {
+        // ARPACK keeps its state in static variables, it is not reentrant
+#if SMOOTHG_USE_OPENMP
+        #pragma omp critical(arpack)
+#endif
         Compute(A, evals_, evects);
     }
     else
@@ -587,6 +890,7 @@ double LocalEigenSolver::Compute(mfem::SparseMatrix& A, mfem::DenseMatrix& evect
         Full(A, dense_A_);
         Compute(dense_A_, evals_, evects);
     }
+    initial_guess_.Clear();
     return evals_(0);
 }
 
@@ -596,6 +900,10 @@ double LocalEigenSolver::Compute(
 #if SMOOTHG_USE_ARPACK
     if (A.Size() > size_offset_)
     {
+        // ARPACK is not reentrant
+#if SMOOTHG_USE_OPENMP
+        #pragma omp critical(arpack)
+#endif
         Compute(A, B, evals_, evects);
     }
     else
@@ -625,9 +933,21 @@ double LocalEigenSolver::Compute(
 double LocalEigenSolver::BlockCompute(
     mfem::SparseMatrix& M, mfem::SparseMatrix& D, mfem::DenseMatrix& evects)
 {
+    if (UsesLOBPCG(D.NumRows()))
+    {
+        DMinvDt_operator DMinvDt(M, D);
+        LocalGraphLaplacianInverse DMinvDt_inv(M, D);
+        LOBPCG(DMinvDt, DMinvDt_inv, evals_, evects);
+        return evals_(0);
+    }
+
 #if SMOOTHG_USE_ARPACK
     if (D.NumRows() > size_offset_)
     {
+        // ARPACK is not reentrant
+#if SMOOTHG_USE_OPENMP
+        #pragma omp critical(arpack)
+#endif
         BlockCompute(M, D, evals_, evects);
     }
     else
@@ -637,6 +957,7 @@ double LocalEigenSolver::BlockCompute(
         Full(D, dense_B_);
         BlockCompute(dense_A_, dense_B_, evals_, evects);
     }
+    initial_guess_.Clear();
     return evals_(0);
 }
 
@@ -16,7 +16,8 @@
 /** @file LocalEigenSolver.hpp
 
     @brief Wrapper for LAPACK and ARPACK (via arpackpp), solving (generalized)
-    eigenproblem of symmetric matrices.
+    eigenproblem of symmetric matrices. Also contains a built-in LOBPCG
+    solver for the few smallest eigenpairs of large graph Laplacians.
 
    ARPACK implementation is based on
    https://perso.univ-rennes1.fr/yvon.lafranche/mintera/index.html
@@ -48,6 +49,28 @@ public:
     */
     LocalEigenSolver(int max_num_evects, double rel_tol, int size_offset = 20);
 
+    /**
+       Solve eigen problems of size larger than threshold with the built-in
+       LOBPCG solver instead of LAPACK or ARPACK (0: never). Only the
+       max_num_evects smallest eigenpairs are computed, so the cost is about
+       linear in the size of the problem (plus one sparse factorization).
+    */
+    void SetLOBPCGThreshold(int threshold) { lobpcg_threshold_ = threshold; }
+
+    /// Print a warning when LOBPCG does not converge if print_level > 0
+    void SetPrintLevel(int print_level) { print_level_ = print_level; }
+
+    /**
+       Use the columns of guess (e.g. eigenvectors of a nearby problem) as
+       initial guess of the next computation, if it is done by LOBPCG (see
+       UsesLOBPCG), which then converges in a few iterations if guess is
+       accurate. The other solvers ignore it. The guess is used only once.
+    */
+    void SetInitialGuess(const mfem::DenseMatrix& guess) { initial_guess_ = guess; }
+
+    /// Whether a problem of given size is solved with LOBPCG
+    bool UsesLOBPCG(int size) const;
+
     /**
        Given a symmetric matrix \f$ A \f$, find the eigenpairs
        corresponding to the smallest few eigenvalues.
@@ -94,13 +117,18 @@ public:
        corresponding to the smallest few eigenvalues.
 
        If size of A > size_offset_ and SMOOTHG_USE_ARPACK is on, ARPACK-based
-       solver will be used, otherwise LAPACK-based solver is used.
+       solver will be used, otherwise LAPACK-based solver is used. Large
+       problems are solved by LOBPCG if UsesLOBPCG(size of A).
 
        @param A (in) the matrix
        @param evects (out) eigenvectors
+       @param prec (in) symmetric positive definite approximate inverse of A
+              preconditioning LOBPCG, e.g. LocalGraphLaplacianInverse if A
+              is a graph Laplacian (Jacobi is used if not given)
        @return smallest eigenvalue
     */
-    double Compute(mfem::SparseMatrix& A, mfem::DenseMatrix& evects);
+    double Compute(mfem::SparseMatrix& A, mfem::DenseMatrix& evects,
+                   const mfem::Solver* prec = nullptr);
 
     /**
        Given symmetric matrices \f$ A, B \f$, find the eigenvectors
@@ -138,7 +166,9 @@ public:
        \f$ (DM^{-1}D^T)x = \lambda x \f$.
 
        If size of A > size_offset_ and SMOOTHG_USE_ARPACK is on, ARPACK-based
-       solver will be used, otherwise LAPACK-based solver is used.
+       solver will be used, otherwise LAPACK-based solver is used. Large
+       problems are solved by LOBPCG (preconditioned by a
+       LocalGraphLaplacianInverse) if UsesLOBPCG(number of rows of D).
 
        @param M (in) the matrix M
        @param D (in) the matrix D
@@ -167,6 +197,16 @@ private:
     */
     int Compute(int n, double* a, mfem::Vector& evals, mfem::DenseMatrix& evects);
 
+    /**
+       Calculate the smallest eigenpairs of the symmetric operator A with
+       LOBPCG, T is a symmetric positive definite approximation of the
+       (pseudo-)inverse of A.
+
+       Returns eigenvalues < rel_tol_ * eig_max_, up to max_num_evects_ total.
+    */
+    void LOBPCG(const mfem::Operator& A, const mfem::Solver& T,
+                mfem::Vector& evals, mfem::DenseMatrix& evects);
+
     int max_num_evects_;
     double rel_tol_;
     int size_offset_;
@@ -214,6 +254,14 @@ private:
     const int max_iterations_;
     const double shift_;
     ///@}
+
+    ///@name LOBPCG parameters
+    ///@{
+    int lobpcg_threshold_;
+    mfem::DenseMatrix initial_guess_;
+    const double lobpcg_tolerance_;
+    int print_level_;
+    ///@}
 };
 
 } // namespace smoothg
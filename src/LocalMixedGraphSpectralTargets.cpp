@@ -19,9 +19,11 @@
    @brief Implements LocalMixedGraphSpectralTargets
 */
 
+#include "smoothG_config.h"
 #include "GraphCoarsen.hpp"
 #include "utilities.hpp"
 #include "sharedentitycommunication.hpp"
+#include <algorithm>
 
 using std::unique_ptr;
 
@@ -70,15 +72,45 @@ LocalMixedGraphSpectralTargets::LocalMixedGraphSpectralTargets(
     dual_target_(param.dual_target),
     scaled_dual_(param.scaled_dual),
     energy_dual_(param.energy_dual),
+    lobpcg_threshold_(param.lobpcg_threshold),
     mgL_(mgL),
     constant_rep_(mgL.GetConstantRep()),
     coarse_graph_(coarse_graph),
     dof_agg_(dof_agg),
     zero_eigenvalue_threshold_(1.e-8), // note we also use this for singular values
-    col_map_(0)
+    col_map_(0),
+    targets_cache_(nullptr),
+    skip_tol_(-1.0)
 {
 }
 
+void LocalMixedGraphSpectralTargets::SetTargetsCache(SpectralTargetsCache& cache,
+                                                     double skip_tol)
+{
+    targets_cache_ = &cache;
+    skip_tol_ = skip_tol;
+}
+
+bool LocalMixedGraphSpectralTargets::LocalMatrixUnchanged(
+    int agg, const mfem::SparseMatrix& Mloc) const
+{
+    const mfem::Vector& cached = targets_cache_->M_ext_data[agg];
+    if (skip_tol_ < 0.0 || cached.Size() != Mloc.NumNonZeroElems())
+    {
+        return false;
+    }
+
+    const double* data = Mloc.GetData();
+    for (int i = 0; i < cached.Size(); ++i)
+    {
+        if (std::fabs(data[i] - cached(i)) > skip_tol_ * std::fabs(cached(i)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 void LocalMixedGraphSpectralTargets::BuildExtendedAggregates(const GraphSpace& space)
 {
     const mfem::Array<int>& Agg_starts = coarse_graph_.VertexStarts();
@@ -142,7 +174,13 @@ class MixedBlockEigensystem
 {
 public:
     MixedBlockEigensystem(int max_evects, int max_traces, double spec_tol,
-                          bool scaled_dual, bool energy_dual);
+                          bool scaled_dual, bool energy_dual, int lobpcg_threshold = 0);
+
+    /// initial guess of the next ComputeEigenvectors(), see LocalEigenSolver
+    void SetInitialGuess(const mfem::DenseMatrix& guess) { vertex_eigs_.SetInitialGuess(guess); }
+
+    /// whether the vertex eigenproblem on num_vdofs vertex dofs uses LOBPCG
+    bool UsesLOBPCG(int num_vdofs) const { return vertex_eigs_.UsesLOBPCG(num_vdofs); }
 
     /// compute eigenvectors of the matrix DM^{-1}D^T + W
     void ComputeEigenvectors(
@@ -192,7 +230,8 @@ void MixedBlockEigensystem::CheckMinimalEigenvalue(
 }
 
 MixedBlockEigensystem::MixedBlockEigensystem(
-    int max_evects, int max_traces, double spec_tol, bool scaled_dual, bool energy_dual)
+    int max_evects, int max_traces, double spec_tol, bool scaled_dual, bool energy_dual,
+    int lobpcg_threshold)
     :
     vertex_eigs_(max_evects, spec_tol),
     edge_eigs_(max_traces, spec_tol),
@@ -200,6 +239,7 @@ MixedBlockEigensystem::MixedBlockEigensystem(
     energy_dual_(energy_dual),
     zero_eigenvalue_threshold_(1.e-8)
 {
+    vertex_eigs_.SetLOBPCGThreshold(lobpcg_threshold);
 }
 
 void MixedBlockEigensystem::ComputeEigenvectors(
@@ -226,7 +266,13 @@ void MixedBlockEigensystem::ComputeEigenvectors(
         {
             DMinvDt_.Add(-1.0, Wloc);
         }
-        eval_min_ = vertex_eigs_.Compute(DMinvDt_, evects);
+
+        std::unique_ptr<LocalGraphLaplacianInverse> DMinvDt_inv;
+        if (vertex_eigs_.UsesLOBPCG(DMinvDt_.Height()))
+        {
+            DMinvDt_inv = make_unique<LocalGraphLaplacianInverse>(Mloc, Dloc);
+        }
+        eval_min_ = vertex_eigs_.Compute(DMinvDt_, evects, DMinvDt_inv.get());
     }
     else // general M
     {
@@ -436,74 +482,135 @@ std::vector<mfem::DenseMatrix> LocalMixedGraphSpectralTargets::ComputeVertexTarg
     // Column map for submatrix extraction
     col_map_.SetSize(std::max(permute_e->Height(), permute_v->Height()), -1);
 
-    mfem::Array<int> ext_loc_edofs, ext_loc_vdofs, loc_vdofs;
-    mfem::Vector first_evect;
-    mfem::DenseMatrix evects, evects_restricted;
-    mfem::DenseMatrix evects_T, evects_restricted_T;
-
     // ---
     // solve eigenvalue problem on each extended aggregate, our (3.1)
     // ---
     const bool edge_eigensystem = (dual_target_ && !use_w && max_loc_edofs_ > 1);
     const int max_evects = std::max(max_loc_vdofs_, edge_eigensystem ? 1 : max_loc_edofs_);
 
-    MixedBlockEigensystem mbe(max_evects, max_loc_edofs_, rel_tol_, scaled_dual_, energy_dual_);
-    for (int agg = 0; agg < num_aggs; ++agg)
+    // Cached data can be reused if it comes from the same aggregates
+    const bool use_cache = targets_cache_ &&
+                           targets_cache_->evects.size() == (unsigned int) num_aggs;
+    std::vector<int> skipped(num_aggs, 0);
+    std::vector<int> warm_started(num_aggs, 0);
+    if (targets_cache_)
     {
-        // Extract local dofs for extended aggregates that is shared
-        GetExtAggDofs(DofType::EDOF, agg, ext_loc_edofs);
-        GetExtAggDofs(DofType::VDOF, agg, ext_loc_vdofs);
+        targets_cache_->evects.resize(num_aggs);
+        targets_cache_->M_ext_data.resize(num_aggs);
+    }
 
-        // Single vertex aggregate
-        if (ext_loc_edofs.Size() == 0 || ext_loc_vdofs.Size() == 1)
+    // The local problems are independent, so with OpenMP they are distributed
+    // among threads. Every thread owns its workspace (column map, eigensolvers)
+    // and results go to the preallocated slots out[agg] and ExtAgg_sigmaT_[agg],
+    // so the output does not depend on the number of threads.
+#if SMOOTHG_USE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        mfem::Array<int> col_map;
+        col_map_.Copy(col_map);
+
+        mfem::Array<int> ext_loc_edofs, ext_loc_vdofs, loc_vdofs;
+        mfem::Vector first_evect;
+        mfem::DenseMatrix evects, evects_restricted;
+        mfem::DenseMatrix evects_T, evects_restricted_T;
+
+        MixedBlockEigensystem mbe(max_evects, max_loc_edofs_, rel_tol_,
+                                  scaled_dual_, energy_dual_, lobpcg_threshold_);
+#if SMOOTHG_USE_OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for (int agg = 0; agg < num_aggs; ++agg)
         {
-            out[agg] = mfem::DenseMatrix(1, 1);
-            out[agg] = 1.0;
-            continue;
-        }
+            // Extract local dofs for extended aggregates that is shared
+            GetExtAggDofs(DofType::EDOF, agg, ext_loc_edofs);
+            GetExtAggDofs(DofType::VDOF, agg, ext_loc_vdofs);
 
-        // Extract local matrices
-        auto Mloc = ExtractRowAndColumns(M_ext, ext_loc_edofs,
-                                         ext_loc_edofs, col_map_);
-        auto Dloc = ExtractRowAndColumns(D_ext, ext_loc_vdofs,
-                                         ext_loc_edofs, col_map_);
-        mfem::SparseMatrix Wloc;
-        if (use_w)
-        {
-            auto Wloc_tmp = ExtractRowAndColumns(W_ext, ext_loc_vdofs,
-                                                 ext_loc_vdofs, col_map_) ;
-            Wloc.Swap(Wloc_tmp);
-        }
+            // Single vertex aggregate
+            if (ext_loc_edofs.Size() == 0 || ext_loc_vdofs.Size() == 1)
+            {
+                out[agg] = mfem::DenseMatrix(1, 1);
+                out[agg] = 1.0;
+                continue;
+            }
 
-        mbe.ComputeEigenvectors(Mloc, Dloc, Wloc, evects);
+            // Extract local matrices
+            auto Mloc = ExtractRowAndColumns(M_ext, ext_loc_edofs,
+                                             ext_loc_edofs, col_map);
+            auto Dloc = ExtractRowAndColumns(D_ext, ext_loc_vdofs,
+                                             ext_loc_edofs, col_map);
+            mfem::SparseMatrix Wloc;
+            if (use_w)
+            {
+                auto Wloc_tmp = ExtractRowAndColumns(W_ext, ext_loc_vdofs,
+                                                     ext_loc_vdofs, col_map) ;
+                Wloc.Swap(Wloc_tmp);
+            }
 
-        if (use_w)
-        {
-            // Explicitly add constant vector
-            mfem::DenseMatrix with_const(evects.Height(), evects.Width() + 1);
+            if (use_cache && !use_w && LocalMatrixUnchanged(agg, Mloc))
+            {
+                out[agg] = targets_cache_->vertex_targets[agg];
+                ExtAgg_sigmaT_[agg] = targets_cache_->sigmaT[agg];
+                skipped[agg] = 1;
+                continue;
+            }
 
-            mfem::Vector constant(evects.Height());
-            constant = 1.0 / std::sqrt(evects.Height());
+            if (use_cache && mbe.UsesLOBPCG(ext_loc_vdofs.Size()) &&
+                targets_cache_->evects[agg].Height() == ext_loc_vdofs.Size())
+            {
+                mbe.SetInitialGuess(targets_cache_->evects[agg]);
+                warm_started[agg] = 1;
+            }
 
-            Concatenate(constant, evects, with_const);
-            evects = with_const;
-        }
+            mbe.ComputeEigenvectors(Mloc, Dloc, Wloc, evects);
 
-        int nevects = evects.Width();
+            if (targets_cache_)
+            {
+                // the cached matrix is only updated where the data is
+                // recomputed, so that small changes cannot accumulate unnoticed
+                targets_cache_->evects[agg] = evects;
+                targets_cache_->M_ext_data[agg].SetSize(Mloc.NumNonZeroElems());
+                std::copy_n(Mloc.GetData(), Mloc.NumNonZeroElems(),
+                            targets_cache_->M_ext_data[agg].GetData());
+            }
+
+            if (use_w)
+            {
+                // Explicitly add constant vector
+                mfem::DenseMatrix with_const(evects.Height(), evects.Width() + 1);
+
+                mfem::Vector constant(evects.Height());
+                constant = 1.0 / std::sqrt(evects.Height());
+
+                Concatenate(constant, evects, with_const);
+                evects = with_const;
+            }
+
+            int nevects = evects.Width();
+
+            // restricting vertex dofs on extended region to the original aggregate
+            GetTableRow(dof_agg_.agg_vdof_, agg, loc_vdofs);
+            evects_T.Transpose(evects);
+            evects_restricted_T.SetSize(nevects, loc_vdofs.Size());
+            ExtractColumns(evects_T, ext_loc_vdofs, loc_vdofs, col_map, evects_restricted_T);
+            evects_restricted.Transpose(evects_restricted_T);
 
-        // restricting vertex dofs on extended region to the original aggregate
-        GetTableRow(dof_agg_.agg_vdof_, agg, loc_vdofs);
-        evects_T.Transpose(evects);
-        evects_restricted_T.SetSize(nevects, loc_vdofs.Size());
-        ExtractColumns(evects_T, ext_loc_vdofs, loc_vdofs, col_map_, evects_restricted_T);
-        evects_restricted.Transpose(evects_restricted_T);
+            // Apply SVD to the restricted vectors (first vector is always kept)
+            evects_restricted.GetColumn(0, first_evect);
+            Orthogonalize(evects_restricted, first_evect, 1, out[agg]);
 
-        // Apply SVD to the restricted vectors (first vector is always kept)
-        evects_restricted.GetColumn(0, first_evect);
-        Orthogonalize(evects_restricted, first_evect, 1, out[agg]);
+            // Compute edge trace samples (before restriction and SVD)
+            ExtAgg_sigmaT_[agg] = mbe.ComputeEdgeTraces(evects, edge_eigensystem);
+        }
+    }
 
-        // Compute edge trace samples (before restriction and SVD)
-        ExtAgg_sigmaT_[agg] = mbe.ComputeEdgeTraces(evects, edge_eigensystem);
+    if (targets_cache_)
+    {
+        targets_cache_->vertex_targets = out;
+        targets_cache_->sigmaT = ExtAgg_sigmaT_;
+        targets_cache_->num_skipped = std::count(skipped.begin(), skipped.end(), 1);
+        targets_cache_->num_warm_started = std::count(warm_started.begin(),
+                                                      warm_started.end(), 1);
     }
 
     return out;
@@ -548,10 +655,10 @@ mfem::Vector LocalMixedGraphSpectralTargets::MakeOneNegOne(
 
 /// implementation copied from Stephan Gelever's GraphCoarsen::CollectConstant
 mfem::Vector** LocalMixedGraphSpectralTargets::CollectConstant(
-    const mfem::Vector& constant_vect, const mfem::SparseMatrix& agg_vdof)
+    const mfem::Vector& constant_vect, const mfem::SparseMatrix& agg_vdof,
+    std::shared_ptr<const SharedEntityCommPlan> face_plan)
 {
-    SharedEntityCommunication<mfem::Vector> sec_constant(
-        comm_, coarse_graph_.EdgeToTrueEdge());
+    SharedEntityCommunication<mfem::Vector> sec_constant(face_plan);
     sec_constant.ReducePrepare();
 
     const unsigned int num_faces = coarse_graph_.NumEdges();
@@ -659,9 +766,10 @@ std::vector<mfem::DenseMatrix> LocalMixedGraphSpectralTargets::ComputeEdgeTarget
     mfem::SparseMatrix face_ext_edof_diag = GetDiag(*face_ext_edof_);
     mfem::SparseMatrix face_IsShared = GetOffd(coarse_graph_.EdgeToTrueEdgeToEdge());
 
-    // Send and receive traces
+    // Send and receive traces, all exchanges over faces share one plan
     const auto& face_trueface = coarse_graph_.EdgeToTrueEdge();
-    SharedEntityCommunication<mfem::DenseMatrix> sec_trace(comm_, face_trueface);
+    auto face_plan = std::make_shared<const SharedEntityCommPlan>(comm_, face_trueface);
+    SharedEntityCommunication<mfem::DenseMatrix> sec_trace(face_plan);
     sec_trace.ReducePrepare();
     for (int iface = 0; iface < nfaces; ++iface)
     {
@@ -718,7 +826,7 @@ std::vector<mfem::DenseMatrix> LocalMixedGraphSpectralTargets::ComputeEdgeTarget
     // Send and receive Dloc
     mfem::Array<int> local_dof, face_nbh_dofs, vertex_local_dof;
     int dof_counter;
-    SharedEntityCommunication<mfem::SparseMatrix> sec_D(comm_, face_trueface);
+    SharedEntityCommunication<mfem::SparseMatrix> sec_D(face_plan);
     sec_D.ReducePrepare();
     for (int iface = 0; iface < nfaces; ++iface)
     {
@@ -774,7 +882,7 @@ std::vector<mfem::DenseMatrix> LocalMixedGraphSpectralTargets::ComputeEdgeTarget
     mfem::SparseMatrix** shared_Dloc = sec_D.Collect();
 
     // Send and receive Mloc
-    SharedEntityCommunication<mfem::SparseMatrix> sec_M(comm_, face_trueface);
+    SharedEntityCommunication<mfem::SparseMatrix> sec_M(face_plan);
     sec_M.ReducePrepare();
     for (int iface = 0; iface < nfaces; ++iface)
     {
@@ -822,7 +930,8 @@ std::vector<mfem::DenseMatrix> LocalMixedGraphSpectralTargets::ComputeEdgeTarget
     // Perform SVD on the collected traces sigma for shared faces
     int capacity;
     mfem::Vector PV_sigma;
-    mfem::Vector** shared_constant = CollectConstant(constant_rep_, agg_vdof);
+    mfem::Vector** shared_constant = CollectConstant(constant_rep_, agg_vdof, face_plan);
+    CholmodSymbolicCache symbolic_cache;
     for (int iface = 0; iface < nfaces; ++iface)
     {
         int num_iface_edofs = face_edof.RowSize(iface);
@@ -915,7 +1024,8 @@ std::vector<mfem::DenseMatrix> LocalMixedGraphSpectralTargets::ComputeEdgeTarget
 
                 // solve saddle point problem for PV and restrict to face
                 PV_sigma.SetSize(Mloc_neighbor.Height());
-                LocalGraphEdgeSolver solver(Mloc_neighbor, Dloc_neighbor);
+                LocalGraphEdgeSolver solver(Mloc_neighbor, Dloc_neighbor, mfem::Vector(),
+                                            &symbolic_cache);
                 solver.Mult(OneNegOne, PV_sigma);
                 PV_sigma_on_face.SetDataAndSize(PV_sigma.GetData(), num_iface_edofs);
             }
@@ -932,7 +1042,7 @@ std::vector<mfem::DenseMatrix> LocalMixedGraphSpectralTargets::ComputeEdgeTarget
 
                 // solve saddle point problem for PV and restrict to face
                 PV_sigma.SetSize(Mloc_0.Height());
-                LocalGraphEdgeSolver solver(Mloc_0, Dloc_0);
+                LocalGraphEdgeSolver solver(Mloc_0, Dloc_0, mfem::Vector(), &symbolic_cache);
                 solver.Mult(OneNegOne, PV_sigma);
 
                 PV_sigma_on_face.SetDataAndSize(PV_sigma.GetData(), num_iface_edofs);
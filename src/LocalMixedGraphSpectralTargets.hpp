@@ -36,6 +36,8 @@
 namespace smoothg
 {
 
+class SharedEntityCommPlan;
+
 /// Container for SAAMGe parameters
 struct SAAMGeParam
 {
@@ -71,6 +73,26 @@ struct SAAMGeParam
    @param rescale_iter number of iteration to compute scaling in hybridization
    @param saamge_param SAAMGe paramters, use SAAMGe as preconditioner for
           coarse hybridized system if saamge_param is not nullptr
+   @param amg_reuse_ratio when the coefficient is rescaled, keep the AMG
+          hierarchy unless the iteration count grew by more than this factor
+          since the last AMG setup (non-positive: always redo the setup)
+   @param matrix_free apply the hybridized system element by element on levels
+          with several multipliers per face (only its preconditioner is assembled)
+   @param pipelined_krylov use pipelined CG/MINRES, which hide the latency of
+          global reductions behind local work
+   @param agglomerate_dofs coarse levels with fewer dofs per process than
+          this are solved on fewer processes (0: never)
+   @param diagonal_schur precondition the Schur complement of the block
+          solver with its diagonal instead of BoomerAMG
+   @param schur_pattern_reuse when the coefficient is rescaled, recompute the
+          Schur complement of the block solver in its cached sparsity pattern
+   @param lobpcg_threshold local vertex eigenproblems larger than this are
+          solved by the built-in LOBPCG solver (0: never)
+   @param cache_targets keep the local spectral data, so that
+          Hierarchy::Recoarsen reuses it (warm starts need LOBPCG, see
+          lobpcg_threshold)
+   @param recoarsen_tol in Hierarchy::Recoarsen, aggregates where the relative
+          change of M on the extended aggregate is below this keep their targets
 */
 class UpscaleParameters
 {
@@ -88,6 +110,15 @@ public:
     int num_iso_verts;
     int rescale_iter;
     SAAMGeParam* saamge_param;
+    double amg_reuse_ratio;
+    bool matrix_free;
+    bool pipelined_krylov;
+    int agglomerate_dofs;
+    bool diagonal_schur;
+    bool schur_pattern_reuse;
+    int lobpcg_threshold;
+    bool cache_targets;
+    double recoarsen_tol;
     // possibly also boundary condition information?
 
     UpscaleParameters() : max_levels(2),
@@ -102,7 +133,16 @@ public:
         coarse_factor(64),
         num_iso_verts(0),
         rescale_iter(-1),
-        saamge_param(NULL)
+        saamge_param(NULL),
+        amg_reuse_ratio(0.0),
+        matrix_free(false),
+        pipelined_krylov(false),
+        agglomerate_dofs(0),
+        diagonal_schur(false),
+        schur_pattern_reuse(false),
+        lobpcg_threshold(0),
+        cache_targets(false),
+        recoarsen_tol(0.0)
     {}
 
     void RegisterInOptionsParser(mfem::OptionsParser& args)
@@ -131,6 +171,24 @@ public:
                        "Number of isolated vertices.");
         args.AddOption(&rescale_iter, "--rescale-iter", "--rescale-iter",
                        "Number of iteration to compute rescale vector in hybridization.");
+        args.AddOption(&amg_reuse_ratio, "--amg-reuse-ratio", "--amg-reuse-ratio",
+                       "Iteration growth factor triggering AMG setup after rescaling (0: always).");
+        args.AddOption(&matrix_free, "-mf", "--matrix-free", "-no-mf", "--no-matrix-free",
+                       "Apply the hybridized system without assembling it.");
+        args.AddOption(&pipelined_krylov, "-pk", "--pipelined-krylov", "-no-pk",
+                       "--no-pipelined-krylov", "Use pipelined CG/MINRES solvers.");
+        args.AddOption(&agglomerate_dofs, "--agglomerate-dofs", "--agglomerate-dofs",
+                       "Solve coarse levels with fewer dofs per process on fewer processes.");
+        args.AddOption(&diagonal_schur, "-ds", "--diagonal-schur", "-no-ds",
+                       "--no-diagonal-schur", "Use diagonal Schur complement preconditioner.");
+        args.AddOption(&schur_pattern_reuse, "-spr", "--schur-pattern-reuse", "-no-spr",
+                       "--no-schur-pattern-reuse", "Update Schur complement in cached pattern.");
+        args.AddOption(&lobpcg_threshold, "--lobpcg-threshold", "--lobpcg-threshold",
+                       "Solve larger local eigenproblems with LOBPCG (0: never).");
+        args.AddOption(&cache_targets, "-ct", "--cache-targets", "-no-ct",
+                       "--no-cache-targets", "Keep local eigenvectors for recoarsening.");
+        args.AddOption(&recoarsen_tol, "--recoarsen-tol", "--recoarsen-tol",
+                       "Coefficient change below which recoarsening keeps targets.");
     }
 };
 
@@ -158,6 +216,30 @@ struct DofAggregate
     }
 };
 
+/**
+   @brief Local spectral data of a coarsening, reused by a later coarsening
+   of the same aggregates (typically with another coefficient).
+
+   @param M_ext_data entries of M on each extended aggregate the data was last
+          computed with
+   @param evects eigenvectors on each extended aggregate
+   @param vertex_targets vertex targets of each aggregate
+   @param sigmaT edge trace samples of each extended aggregate
+   @param num_skipped number of aggregates that kept their cached data in the
+          last coarsening
+   @param num_warm_started number of eigenproblems warm started from the
+          cached eigenvectors in the last coarsening
+*/
+struct SpectralTargetsCache
+{
+    std::vector<mfem::Vector> M_ext_data;
+    std::vector<mfem::DenseMatrix> evects;
+    std::vector<mfem::DenseMatrix> vertex_targets;
+    std::vector<mfem::DenseMatrix> sigmaT;
+    int num_skipped = 0;
+    int num_warm_started = 0;
+};
+
 /**
    @brief Take a mixed form graph Laplacian, do local eigenvalue problems, and
    generate targets in parallel.
@@ -188,6 +270,24 @@ public:
 
     ~LocalMixedGraphSpectralTargets() {}
 
+    /**
+       @brief Reuse (and update) the local spectral data of a previous
+       coarsening of the same aggregates in ComputeVertexTargets().
+
+       The coefficient enters the local problems only through M, so
+       aggregates where every entry of M on the extended aggregate (including
+       the edges and vertices owned by other processes) differs from the
+       cached one by at most skip_tol (relative) keep their cached targets and
+       traces. If the local eigenproblems of the other aggregates are solved
+       by LOBPCG (see UpscaleParameters::lobpcg_threshold), they are warm
+       started from the cached eigenvectors (see
+       LocalEigenSolver::SetInitialGuess). An empty cache is just filled.
+
+       @param cache local spectral data, kept by the caller between coarsenings
+       @param skip_tol tolerance on the change of M (negative: never skip)
+    */
+    void SetTargetsCache(SpectralTargetsCache& cache, double skip_tol);
+
     /**
        @brief Compute spectral vectex targets for each aggregate
 
@@ -225,6 +325,9 @@ private:
 
     void GetExtAggDofs(DofType dof_type, int iAgg, mfem::Array<int>& dofs);
 
+    /// Whether Mloc (M on the extended aggregate agg) is within skip_tol_ of the cached one
+    bool LocalMatrixUnchanged(int agg, const mfem::SparseMatrix& Mloc) const;
+
     void Orthogonalize(mfem::DenseMatrix& vectors, mfem::Vector& single_vec,
                        int offset, mfem::DenseMatrix& out);
 
@@ -238,7 +341,8 @@ private:
 
     /// given an assembled vector on vertices, return extracted value on (possibly shared) faces
     mfem::Vector** CollectConstant(const mfem::Vector& constant_vect,
-                                   const mfem::SparseMatrix& agg_vdof);
+                                   const mfem::SparseMatrix& agg_vdof,
+                                   std::shared_ptr<const SharedEntityCommPlan> face_plan);
 
     /// shared_constant expected to be an array of legth 2, just returns them
     /// stacked on top of each other
@@ -252,6 +356,7 @@ private:
     const bool dual_target_;
     const bool scaled_dual_;
     const bool energy_dual_;
+    const int lobpcg_threshold_;
 
     const MixedMatrix& mgL_;
     const mfem::Vector& constant_rep_;
@@ -277,6 +382,9 @@ private:
     std::vector<mfem::DenseMatrix> ExtAgg_sigmaT_;
 
     mfem::Array<int> col_map_;
+
+    SpectralTargetsCache* targets_cache_;
+    double skip_tol_;
 };
 
 } // namespace smoothg
@@ -15,9 +15,58 @@
 
 #include "MLMCManager.hpp"
 
+#include <algorithm>
+#include <limits>
+
 namespace smoothg
 {
 
+namespace
+{
+
+/// Statistics of a level: sample count, mean, varsum and (mean) cost
+const int num_level_statistics = 4;
+
+/**
+   Add the statistics b of some samples to the statistics a of other
+   samples (the parallel update of Chan, Golub and LeVeque to Welford's
+   algorithm, exact for any split of the samples).
+*/
+void CombineStatistics(const double* b, double* a)
+{
+    const double count = a[0] + b[0];
+    if (count == 0.0)
+    {
+        return;
+    }
+    const double delta = b[1] - a[1];
+    a[1] += delta * b[0] / count;
+    a[2] += b[2] + delta * delta * a[0] * b[0] / count;
+    a[3] += (b[3] - a[3]) * b[0] / count;
+    a[0] = count;
+}
+
+} // namespace
+
+MLMCGroups::MLMCGroups(MPI_Comm comm, int num_groups)
+    : comm_(comm), num_groups_(num_groups)
+{
+    int myid, num_procs;
+    MPI_Comm_rank(comm, &myid);
+    MPI_Comm_size(comm, &num_procs);
+    MFEM_VERIFY(num_groups > 0 && num_groups <= num_procs,
+                "Number of sampling groups should be between 1 and number of processes!");
+
+    group_id_ = myid * num_groups / num_procs;
+    MPI_Comm_split(comm, group_id_, myid, &group_comm_);
+    MPI_Comm_rank(group_comm_, &group_rank_);
+}
+
+MLMCGroups::~MLMCGroups()
+{
+    MPI_Comm_free(&group_comm_);
+}
+
 PressureFunctionalQoI::PressureFunctionalQoI(const Hierarchy& hierarchy,
                                              const mfem::Vector& functional)
     :
@@ -111,7 +160,8 @@ MLMCManager::MLMCManager(MultilevelSampler& sampler,
     qoi_(qoi),
     hierarchy_(hierarchy),
     dump_number_(dump_number),
-    choose_samples_(0)
+    choose_samples_(0),
+    merge_request_(MPI_REQUEST_NULL)
 {
     num_levels_ = (num_levels < 0) ? hierarchy.NumLevels() : num_levels;
 
@@ -120,6 +170,8 @@ MLMCManager::MLMCManager(MultilevelSampler& sampler,
     varsum_.resize(num_levels_);
     cost_.resize(num_levels_);
     initial_samples_.resize(num_levels_);
+    merged_statistics_.resize(num_level_statistics * num_levels_, 0.0);
+    pending_statistics_.resize(num_level_statistics * num_levels_, 0.0);
 
     rhs_.push_back(rhs_fine);
     for (int k = 0; k < num_levels_ - 1; ++k)
@@ -151,6 +203,239 @@ void MLMCManager::Simulate(bool verbose)
     }
 }
 
+void MLMCManager::InitialSamples(const MLMCGroups& groups, bool verbose)
+{
+    const int num_groups = groups.NumGroups();
+    const int group = groups.GroupId();
+
+    int turn = 0;
+    for (int level = 0; level < num_levels_; ++level)
+    {
+        for (int sample = 0; sample < initial_samples_[level]; ++sample, ++turn)
+        {
+            if (turn % num_groups != group)
+            {
+                continue;
+            }
+            if (verbose)
+            {
+                std::cout << "---\nLevel " << level << " sample " << sample
+                          << " (group " << group << ")\n---" << std::endl;
+            }
+            Sample(level, verbose);
+        }
+    }
+    MergeStatistics(groups);
+}
+
+void MLMCManager::Simulate(const MLMCGroups& groups, bool verbose)
+{
+    const int num_groups = groups.NumGroups();
+    const int group = groups.GroupId();
+
+    InitialSamples(groups, verbose);
+
+    for (int first = 0; first < choose_samples_; first += num_groups)
+    {
+        // all processes have the same merged statistics, so every group can
+        // play the choices of the groups before it
+        std::vector<int> count(sample_count_);
+        int level = -1;
+        for (int g = 0; g <= group && first + g < choose_samples_; ++g)
+        {
+            level = UnderSampledLevel(count, false);
+            if (level >= 0)
+            {
+                count[level]++;
+            }
+        }
+
+        if (first + group < choose_samples_ && level >= 0)
+        {
+            if (verbose)
+            {
+                std::cout << "---\nChoose sample " << first + group << " on level "
+                          << level << " (group " << group << ")\n---" << std::endl;
+            }
+            Sample(level, verbose);
+        }
+        MergeStatistics(groups);
+    }
+}
+
+double MLMCManager::SimulateToTolerance(const MLMCGroups& groups, double target_rmse,
+                                        int batch_size, bool verbose)
+{
+    MFEM_VERIFY(target_rmse > 0.0 && batch_size > 0, "Invalid target or batch size!");
+
+    const int num_groups = groups.NumGroups();
+    const int group = groups.GroupId();
+
+    InitialSamples(groups, verbose);
+    for (int level = 0; level < num_levels_; ++level)
+    {
+        MFEM_VERIFY(sample_count_[level] > 1,
+                    "At least 2 initial samples per level are needed to estimate variances!");
+    }
+
+    // samples dispatched to the groups whose statistics are not merged yet
+    std::vector<int> in_flight(num_levels_, 0);
+    for (int batch = 0; ; ++batch)
+    {
+        // the allocation only depends on the merged statistics, so all
+        // processes deal the same batches
+        std::vector<int> wanted = OptimalSamples(target_rmse);
+
+        int merged_total = 0;
+        std::vector<int> dispatched(num_levels_, 0);
+        std::vector<int> my_samples(num_levels_, 0);
+        int turn = 0;
+        for (int level = num_levels_ - 1; level >= 0; --level)
+        {
+            const int merged_count = merged_statistics_[num_level_statistics * level] + 0.5;
+            merged_total += merged_count;
+
+            const int missing = wanted[level] - merged_count - in_flight[level];
+            for (int k = 0; k < missing && turn < num_groups * batch_size; ++k, ++turn)
+            {
+                dispatched[level]++;
+                if (turn % num_groups == group)
+                {
+                    my_samples[level]++;
+                }
+            }
+        }
+
+        const bool merging = merge_request_ != MPI_REQUEST_NULL;
+        if (turn == 0 && !merging)
+        {
+            break;
+        }
+
+        if (verbose)
+        {
+            std::cout << "---\nBatch " << batch << ": " << merged_total << " merged samples, "
+                      << "estimated RMSE " << EstimatedRMSE() << "\n---" << std::endl;
+        }
+
+        // coarse samples first, they improve the estimates of the next batch fastest
+        for (int level = num_levels_ - 1; level >= 0; --level)
+        {
+            for (int k = 0; k < my_samples[level]; ++k)
+            {
+                Sample(level, verbose);
+            }
+        }
+
+        if (merging)
+        {
+            FinishMerge();
+            std::fill(in_flight.begin(), in_flight.end(), 0);
+        }
+        if (turn > 0)
+        {
+            StartMerge(groups);
+            in_flight = dispatched;
+        }
+    }
+
+    const double rmse = EstimatedRMSE();
+    if (verbose)
+    {
+        std::cout << "MLMC target RMSE " << target_rmse << " reached with estimated RMSE "
+                  << rmse << std::endl;
+    }
+    return rmse;
+}
+
+std::vector<int> MLMCManager::OptimalSamples(double target_rmse) const
+{
+    std::vector<double> variance(num_levels_);
+    std::vector<double> cost(num_levels_);
+    double sum_sqrt_variance_cost = 0.0;
+    for (int level = 0; level < num_levels_; ++level)
+    {
+        const double* statistics = &merged_statistics_[num_level_statistics * level];
+        variance[level] = statistics[2] / (statistics[0] - 1.0);
+        cost[level] = std::max(statistics[3], std::numeric_limits<double>::min());
+        sum_sqrt_variance_cost += std::sqrt(variance[level] * cost[level]);
+    }
+
+    std::vector<int> wanted(num_levels_);
+    for (int level = 0; level < num_levels_; ++level)
+    {
+        wanted[level] = std::ceil(std::sqrt(variance[level] / cost[level]) *
+                                  sum_sqrt_variance_cost / (target_rmse * target_rmse));
+    }
+    return wanted;
+}
+
+double MLMCManager::EstimatedRMSE() const
+{
+    double mse = 0.0;
+    for (int level = 0; level < num_levels_; ++level)
+    {
+        mse += GetVariance(level) / sample_count_[level];
+    }
+    return std::sqrt(mse);
+}
+
+void MLMCManager::MergeStatistics(const MLMCGroups& groups)
+{
+    StartMerge(groups);
+    FinishMerge();
+}
+
+void MLMCManager::StartMerge(const MLMCGroups& groups)
+{
+    MFEM_VERIFY(merge_request_ == MPI_REQUEST_NULL, "A merge is already in progress!");
+
+    int num_procs;
+    MPI_Comm_size(groups.GetComm(), &num_procs);
+    const int size = num_level_statistics * num_levels_;
+
+    // the samples of a group are counted once, through its leader
+    merge_send_.assign(size, 0.0);
+    if (groups.IsLeader())
+    {
+        merge_send_ = pending_statistics_;
+    }
+    std::fill(pending_statistics_.begin(), pending_statistics_.end(), 0.0);
+
+    // contributions are gathered rather than reduced, so that all processes
+    // combine them in the same order and get bitwise identical statistics
+    // (the sample allocation must not differ between processes)
+    merge_recv_.resize(num_procs * size);
+    MPI_Iallgather(merge_send_.data(), size, MPI_DOUBLE, merge_recv_.data(), size,
+                   MPI_DOUBLE, groups.GetComm(), &merge_request_);
+}
+
+void MLMCManager::FinishMerge()
+{
+    MPI_Wait(&merge_request_, MPI_STATUS_IGNORE);
+
+    const int size = num_level_statistics * num_levels_;
+    const int num_contributions = merge_recv_.size() / size;
+    for (int level = 0; level < num_levels_; ++level)
+    {
+        double* merged = &merged_statistics_[num_level_statistics * level];
+        for (int p = 0; p < num_contributions; ++p)
+        {
+            CombineStatistics(&merge_recv_[p * size + num_level_statistics * level], merged);
+        }
+
+        // samples taken during the merge stay pending
+        double statistics[num_level_statistics];
+        std::copy_n(merged, num_level_statistics, statistics);
+        CombineStatistics(&pending_statistics_[num_level_statistics * level], statistics);
+
+        sample_count_[level] = (int) (statistics[0] + 0.5);
+        mean_[level] = statistics[1];
+        varsum_[level] = statistics[2];
+        cost_[level] = statistics[3];
+    }
+}
+
 /// if you have to use this, you should probably vary kappa or cell_volume instead
 void MLMCManager::FloorCoefficient(mfem::Vector& coef, double floor)
 {
@@ -204,6 +489,9 @@ void MLMCManager::UpdateStatistics(int level, double l_qoi, double current_cost)
                       (l_qoi - mean_[level]) * (l_qoi - mean_[level]);
     mean_[level] += scale * (l_qoi  - mean_[level]);
     cost_[level] += scale * (current_cost - cost_[level]);
+
+    const double sample[num_level_statistics] = { 1.0, l_qoi, 0.0, current_cost };
+    CombineStatistics(sample, &pending_statistics_[num_level_statistics * level]);
 }
 
 void MLMCManager::FixedLevelSample(int level, bool verbose)
@@ -309,47 +597,45 @@ void MLMCManager::CorrectionSample(int level,
     sample_count_[fine_level]++;
 }
 
-void MLMCManager::BestSample(bool verbose)
+int MLMCManager::UnderSampledLevel(const std::vector<int>& count, bool verbose) const
 {
-    std::vector<double> variance(num_levels_);
-    for (int level = 0; level < num_levels_; ++level)
-    {
-        variance[level] = varsum_[level] / ((double) sample_count_[level] - 1.0);
-    }
-
     // see OVV (27) and following
     double total_sample_prop = 0.0;
     double current_total_samples = 0.0;
     std::vector<double> sample_prop(num_levels_);
     for (int level = 0; level < num_levels_; ++level)
     {
-        sample_prop[level] = std::sqrt(variance[level] / cost_[level]);
+        sample_prop[level] = std::sqrt(GetVariance(level) / cost_[level]);
         total_sample_prop += sample_prop[level];
-        current_total_samples += (double) sample_count_[level];
-    }
-    std::vector<double> best_sample_frac(num_levels_);
-    std::vector<double> current_sample_frac(num_levels_);
-    for (int level = 0; level < num_levels_; ++level)
-    {
-        best_sample_frac[level] = sample_prop[level] / total_sample_prop;
-        current_sample_frac[level] = (double) sample_count_[level] / current_total_samples;
+        current_total_samples += (double) count[level];
     }
 
     // our rule is to sample on the coarsest level that is currently under-sampled
     for (int level = num_levels_ - 1; level >= 0; level--)
     {
-        std::cout << "  level " << level << " current_frac: " << current_sample_frac[level]
-                  << ", wanted_sample_frac: " << best_sample_frac[level] << std::endl;
-        if (current_sample_frac[level] < best_sample_frac[level])
+        const double best_sample_frac = sample_prop[level] / total_sample_prop;
+        const double current_sample_frac = (double) count[level] / current_total_samples;
+        if (verbose)
         {
-            if (verbose)
-                std::cout << "  Choosing to sample on level " << level << std::endl;
-            if (level == num_levels_ - 1)
-                FixedLevelSample(level, verbose);
-            else
-                CorrectionSample(level, verbose);
-            break;
+            std::cout << "  level " << level << " current_frac: " << current_sample_frac
+                      << ", wanted_sample_frac: " << best_sample_frac << std::endl;
         }
+        if (current_sample_frac < best_sample_frac)
+        {
+            return level;
+        }
+    }
+    return -1;
+}
+
+void MLMCManager::BestSample(bool verbose)
+{
+    const int level = UnderSampledLevel(sample_count_, verbose);
+    if (level >= 0)
+    {
+        if (verbose)
+            std::cout << "  Choosing to sample on level " << level << std::endl;
+        Sample(level, verbose);
     }
 }
 
@@ -189,6 +189,45 @@ public:
     }
 };
 
+/**
+   @brief Split a communicator into groups of processes sampling concurrently,
+   see MLMCManager::Simulate(const MLMCGroups&, bool).
+
+   Every group needs its own replica of the Hierarchy, sampler and quantity
+   of interest, built on GetGroupComm(), and the samplers of different groups
+   must be seeded differently. With small groups, the throughput of cheap
+   (coarse level) samples scales with the total number of processes.
+*/
+class MLMCGroups
+{
+public:
+    /// Split comm into num_groups groups of consecutive ranks (of balanced sizes)
+    MLMCGroups(MPI_Comm comm, int num_groups);
+    ~MLMCGroups();
+
+    MLMCGroups(const MLMCGroups&) = delete;
+    MLMCGroups& operator=(const MLMCGroups&) = delete;
+
+    /// communicator of all groups
+    MPI_Comm GetComm() const { return comm_; }
+
+    /// communicator of the group of this process
+    MPI_Comm GetGroupComm() const { return group_comm_; }
+
+    int NumGroups() const { return num_groups_; }
+    int GroupId() const { return group_id_; }
+
+    /// Whether this process is rank 0 of its group
+    bool IsLeader() const { return group_rank_ == 0; }
+
+private:
+    MPI_Comm comm_;
+    MPI_Comm group_comm_;
+    int num_groups_;
+    int group_id_;
+    int group_rank_;
+};
+
 /**
    @brief Class to manage multilevel sampling of quantities of interest.
 */
@@ -226,6 +265,45 @@ public:
     */
     void Simulate(bool verbose = false);
 
+    /**
+       @brief Run sampling concurrently in groups of processes.
+
+       Every process of groups.GetComm() calls this on the MLMCManager of its
+       group. The initial samples are dealt to the groups in turn, then the
+       chosen samples are taken in rounds where every group takes one sample
+       on the level it would be given if the groups chose one after another.
+       Statistics are merged over the groups (parallel Welford) after the
+       initial samples and after every round, so at return every process has
+       the statistics of all samples.
+    */
+    void Simulate(const MLMCGroups& groups, bool verbose = false);
+
+    /**
+       @brief Sample until the estimated root mean square error of the
+       estimate is below target_rmse.
+
+       After the initial samples (at least 2 per level, dealt to the groups
+       as in Simulate()), the numbers of samples minimizing the cost for the
+       target are given by the formula of Giles,
+       \f[
+          N_l = \left\lceil \sqrt{V_l / C_l} \sum_k \sqrt{V_k C_k}
+                / \epsilon^2 \right\rceil,
+       \f]
+       with the variances \f$ V_l \f$ and costs \f$ C_l \f$ of the samples
+       so far. The missing samples are dealt to the groups in batches (at
+       most batch_size per group). The statistics of a batch are merged by a
+       nonblocking reduction overlapping the next batch, and the numbers of
+       samples are updated when it is done. Sampling stops when no sample is
+       missing, which means the error is within target.
+
+       Only the statistical error is controlled, the discretization error of
+       the coarsest level is not estimated.
+
+       @return estimated root mean square error, see EstimatedRMSE()
+    */
+    double SimulateToTolerance(const MLMCGroups& groups, double target_rmse,
+                               int batch_size = 10, bool verbose = false);
+
     /// For a real multilevel Monte Carlo algorithm, you only use this
     /// on the coarsest level, but it is enabled on other levels for
     /// debugging and comparison purposes.
@@ -253,10 +331,43 @@ public:
 
     double GetEstimate() const;
 
+    /// Number of samples taken on level (correction samples except on the coarsest)
+    int GetNumSamples(int level) const { return sample_count_[level]; }
+
+    /// Sample variance on level
+    double GetVariance(int level) const
+    {
+        return varsum_[level] / ((double) sample_count_[level] - 1.0);
+    }
+
+    /// Statistical root mean square error of GetEstimate(), sqrt(sum_l V_l / N_l)
+    double EstimatedRMSE() const;
+
 private:
     /// Incremental updates of mean_, varsum_, and cost_
     void UpdateStatistics(int level, double l_qoi, double current_cost);
 
+    /**
+       Coarsest level that is under-sampled, compared to the fractions of
+       samples minimizing variance per cost, if the levels had count samples
+       (-1 if there is none).
+    */
+    int UnderSampledLevel(const std::vector<int>& count, bool verbose) const;
+
+    /// Deal the initial samples of all levels to the groups in turn
+    void InitialSamples(const MLMCGroups& groups, bool verbose);
+
+    /// Numbers of samples on each level for target_rmse (Giles), from the
+    /// merged statistics
+    std::vector<int> OptimalSamples(double target_rmse) const;
+
+    /// Add the samples taken by all groups since the last merge (collective)
+    void MergeStatistics(const MLMCGroups& groups);
+
+    /// Nonblocking MergeStatistics(), completed by FinishMerge()
+    void StartMerge(const MLMCGroups& groups);
+    void FinishMerge();
+
     /// remove super-small values from a coefficient
     /// (not recommended)
     void FloorCoefficient(mfem::Vector& coef, double floor = 1.e-8);
@@ -276,6 +387,16 @@ private:
     std::vector<double> cost_;
     std::vector<int> initial_samples_;
     int choose_samples_;
+
+    /// count, mean, varsum and cost of each level, as of the last merge and
+    /// of the samples of this group since then (mean_, ... combine both)
+    std::vector<double> merged_statistics_;
+    std::vector<double> pending_statistics_;
+
+    /// state of a merge in progress
+    std::vector<double> merge_send_;
+    std::vector<double> merge_recv_;
+    MPI_Request merge_request_;
 };
 
 
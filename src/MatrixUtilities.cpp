@@ -22,10 +22,19 @@
 
 #include "MatrixUtilities.hpp"
 #include <assert.h>
+#include <algorithm>
 #include "utilities.hpp"
 
 using std::unique_ptr;
 
+extern "C"
+{
+    void dpotrf_(char* uplo, const int* n, double* a, const int* lda, int* info);
+
+    void dpotrs_(char* uplo, const int* n, const int* nrhs, const double* a,
+                 const int* lda, double* b, const int* ldb, int* info);
+}
+
 namespace smoothg
 {
 
@@ -1044,25 +1053,266 @@ bool IsDiag(const mfem::SparseMatrix& A)
     return true;
 }
 
+CholmodSymbolicCache::CholmodSymbolicCache()
+    : num_hits_(0)
+{
+    cholmod_start(&common_);
+    common_.supernodal = CHOLMOD_SUPERNODAL;
+}
+
+CholmodSymbolicCache::~CholmodSymbolicCache()
+{
+    for (auto& pattern_factor : factors_)
+    {
+        cholmod_free_factor(&pattern_factor.second, &common_);
+    }
+    cholmod_finish(&common_);
+}
+
+const cholmod_factor* CholmodSymbolicCache::Get(cholmod_sparse& A)
+{
+    const int* A_p = static_cast<int*>(A.p);
+    const int* A_i = static_cast<int*>(A.i);
+    const int nnz = A_p[A.ncol];
+
+    std::vector<int> pattern;
+    pattern.reserve(A.ncol + nnz + 2);
+    pattern.push_back(A.ncol);
+    pattern.insert(pattern.end(), A_p, A_p + A.ncol + 1);
+    pattern.insert(pattern.end(), A_i, A_i + nnz);
+
+    auto it = factors_.find(pattern);
+    if (it != factors_.end())
+    {
+        num_hits_++;
+        return it->second;
+    }
+
+    cholmod_factor* symbolic = cholmod_analyze(&A, &common_);
+    MFEM_VERIFY(symbolic, "CHOLMOD symbolic analysis failed!");
+    factors_[pattern] = symbolic;
+    return symbolic;
+}
+
+namespace
+{
+
+/// View a symmetric CSR matrix as a CHOLMOD matrix (upper part is used)
+cholmod_sparse CholmodView(const mfem::SparseMatrix& A)
+{
+    cholmod_sparse A_view;
+    A_view.nrow = A.Height();
+    A_view.ncol = A.Width();
+    A_view.nzmax = A.NumNonZeroElems();
+    A_view.p = const_cast<int*>(A.GetI());
+    A_view.i = const_cast<int*>(A.GetJ());
+    A_view.nz = nullptr;
+    A_view.x = const_cast<double*>(A.GetData());
+    A_view.z = nullptr;
+    A_view.stype = 1;
+    A_view.itype = CHOLMOD_INT;
+    A_view.xtype = CHOLMOD_REAL;
+    A_view.dtype = CHOLMOD_DOUBLE;
+    A_view.sorted = false;
+    A_view.packed = true;
+    return A_view;
+}
+
+/// Dense Cholesky factorization (lower triangle) in place, false if A is not SPD
+bool DenseCholesky(mfem::DenseMatrix& A)
+{
+    char uplo = 'L';
+    int n = A.Height();
+    int info = 0;
+    if (n > 0)
+    {
+        dpotrf_(&uplo, &n, A.Data(), &n, &info);
+    }
+    return info == 0;
+}
+
+/// Solve with the columns of B given the factor computed by DenseCholesky
+void DenseCholeskySolve(const mfem::DenseMatrix& L, double* B, int num_rhs)
+{
+    char uplo = 'L';
+    int n = L.Height();
+    int info = 0;
+    if (n > 0 && num_rhs > 0)
+    {
+        dpotrs_(&uplo, &n, &num_rhs, L.Data(), &n, B, &n, &info);
+    }
+    assert(info == 0);
+}
+
+} // namespace
+
+CholmodSolver::CholmodSolver(const mfem::SparseMatrix& A, CholmodSymbolicCache* cache)
+    : mfem::Solver(A.Height()), cache_(cache), L_(nullptr), success_(false)
+{
+    cholmod_start(&common_);
+    common_.supernodal = CHOLMOD_SUPERNODAL;
+    // a matrix which is not positive definite is reported by Success()
+    common_.print = 1;
+
+    Factorize(A);
+}
+
+CholmodSolver::~CholmodSolver()
+{
+    cholmod_free_factor(&L_, &common_);
+    cholmod_finish(&common_);
+}
+
+void CholmodSolver::SetOperator(const mfem::Operator& op)
+{
+    auto A = dynamic_cast<const mfem::SparseMatrix*>(&op);
+    MFEM_VERIFY(A, "CholmodSolver requires a mfem::SparseMatrix!");
+
+    height = width = A->Height();
+    cholmod_free_factor(&L_, &common_);
+    Factorize(*A);
+}
+
+void CholmodSolver::Factorize(const mfem::SparseMatrix& A)
+{
+    assert(A.Height() == A.Width());
+
+    cholmod_sparse A_view = CholmodView(A);
+    if (cache_)
+    {
+        L_ = cholmod_copy_factor(const_cast<cholmod_factor*>(cache_->Get(A_view)), &common_);
+    }
+    else
+    {
+        L_ = cholmod_analyze(&A_view, &common_);
+    }
+    MFEM_VERIFY(L_, "CHOLMOD symbolic analysis failed!");
+
+    cholmod_factorize(&A_view, L_, &common_);
+    success_ = (common_.status == CHOLMOD_OK);
+}
+
+void CholmodSolver::Mult(const mfem::Vector& x, mfem::Vector& y) const
+{
+    assert(success_);
+    assert(x.Size() == height && y.Size() == height);
+
+    cholmod_dense b;
+    b.nrow = b.nzmax = b.d = height;
+    b.ncol = 1;
+    b.x = x.GetData();
+    b.z = nullptr;
+    b.xtype = CHOLMOD_REAL;
+    b.dtype = CHOLMOD_DOUBLE;
+
+    cholmod_dense* sol = cholmod_solve(CHOLMOD_A, L_, &b, &common_);
+    MFEM_VERIFY(sol, "CHOLMOD solve failed!");
+
+    std::copy_n(static_cast<double*>(sol->x), height, y.GetData());
+    cholmod_free_dense(&sol, &common_);
+}
+
 LocalGraphEdgeSolver::LocalGraphEdgeSolver(const mfem::SparseMatrix& M,
                                            const mfem::SparseMatrix& D,
-                                           const mfem::Vector& const_rep)
+                                           const mfem::Vector& const_rep,
+                                           CholmodSymbolicCache* cache,
+                                           int dense_threshold)
 {
     M_is_diag_ = IsDiag(M);
     if (M_is_diag_)
     {
-        const mfem::Vector M_diag(const_cast<double*>(M.GetData()), M.Height());
-        Init(M_diag, D);
+        Minv_.SetSize(M.Height());
+        for (int i = 0; i < M.Height(); ++i)
+        {
+            Minv_[i] = 1.0 / M.GetData()[i];
+        }
     }
-    else
+
+    // LAPACK beats the symbolic and numeric overhead of sparse direct
+    // solvers on small aggregates; fall back to those if A is singular
+    const bool small = D.Height() <= dense_threshold &&
+                       (M_is_diag_ || M.Height() <= dense_threshold);
+    use_dense_ = small && InitDense(M, D);
+
+    if (!use_dense_)
     {
-        Init(M, D);
+        MinvDT_dense_.Clear();
+        M_factor_.Clear();
+        A_factor_.Clear();
+
+        if (M_is_diag_)
+        {
+            InitSparse(D, cache);
+        }
+        else
+        {
+            InitSaddlePoint(M, D);
+        }
     }
 
     const_rep_.SetDataAndSize(const_rep.GetData(), const_rep.Size());
 }
 
-void LocalGraphEdgeSolver::Init(const mfem::Vector& M_diag, const mfem::SparseMatrix& D)
+bool LocalGraphEdgeSolver::InitDense(const mfem::SparseMatrix& M, const mfem::SparseMatrix& D)
+{
+    const int num_vdofs = D.Height();
+    const int num_edofs = D.Width();
+    const int* D_i = D.GetI();
+    const int* D_j = D.GetJ();
+    const double* D_data = D.GetData();
+
+    // Compute M^{-1}D^T
+    MinvDT_dense_.SetSize(num_edofs, num_vdofs);
+    MinvDT_dense_ = 0.0;
+    for (int i = 0; i < num_vdofs; ++i)
+    {
+        for (int k = D_i[i]; k < D_i[i + 1]; ++k)
+        {
+            MinvDT_dense_(D_j[k], i) += D_data[k];
+        }
+    }
+
+    if (M_is_diag_)
+    {
+        MinvDT_dense_.LeftScaling(Minv_);
+    }
+    else
+    {
+        M_factor_.SetSize(num_edofs);
+        M_factor_ = 0.0;
+        for (int i = 0; i < num_edofs; ++i)
+        {
+            for (int k = M.GetI()[i]; k < M.GetI()[i + 1]; ++k)
+            {
+                M_factor_(i, M.GetJ()[k]) += M.GetData()[k];
+            }
+        }
+
+        if (!DenseCholesky(M_factor_))
+        {
+            return false;
+        }
+        DenseCholeskySolve(M_factor_, MinvDT_dense_.Data(), num_vdofs);
+    }
+
+    // A = D M^{-1} D^T with the zeroth row and column removed
+    A_factor_.SetSize(num_vdofs - 1);
+    A_factor_ = 0.0;
+    for (int i = 1; i < num_vdofs; ++i)
+    {
+        for (int k = D_i[i]; k < D_i[i + 1]; ++k)
+        {
+            for (int j = 1; j < num_vdofs; ++j)
+            {
+                A_factor_(i - 1, j - 1) += D_data[k] * MinvDT_dense_(D_j[k], j);
+            }
+        }
+    }
+
+    return DenseCholesky(A_factor_);
+}
+
+void LocalGraphEdgeSolver::InitSparse(const mfem::SparseMatrix& D, CholmodSymbolicCache* cache)
 {
     assert(M_is_diag_);
 
@@ -1070,21 +1320,27 @@ void LocalGraphEdgeSolver::Init(const mfem::Vector& M_diag, const mfem::SparseMa
     MinvDT_.Swap(DT);
 
     // Compute M^{-1}D^T
-    Minv_.SetSize(M_diag.Size());
-    for (int i = 0; i < M_diag.Size(); ++i)
-    {
-        Minv_[i] = 1.0 / M_diag[i];
-    }
     MinvDT_.ScaleRows(Minv_);
 
     A_ = smoothg::Mult(D, MinvDT_);
 
     // Eliminate the first unknown so that A_ is invertible
     A_.EliminateRowCol(0);
-    solver_.SetOperator(A_);
+    A_.SortColumnIndices();
+
+    auto cholesky = make_unique<CholmodSolver>(A_, cache);
+    if (cholesky->Success())
+    {
+        solver_ = std::move(cholesky);
+    }
+    else
+    {
+        solver_ = make_unique<mfem::UMFPackSolver>(A_);
+    }
 }
 
-void LocalGraphEdgeSolver::Init(const mfem::SparseMatrix& M, const mfem::SparseMatrix& D)
+void LocalGraphEdgeSolver::InitSaddlePoint(const mfem::SparseMatrix& M,
+                                           const mfem::SparseMatrix& D)
 {
     offsets_.SetSize(3);
     offsets_[0] = 0;
@@ -1108,15 +1364,46 @@ void LocalGraphEdgeSolver::Init(const mfem::SparseMatrix& M, const mfem::SparseM
     unique_ptr<mfem::SparseMatrix> tmp_A(block_A.CreateMonolithic());
     A_.Swap(*tmp_A);
 
-    solver_.SetOperator(A_);
+    solver_ = make_unique<mfem::UMFPackSolver>(A_);
 
     rhs_ = make_unique<mfem::BlockVector>(offsets_);
     sol_ = make_unique<mfem::BlockVector>(offsets_);
     rhs_->GetBlock(0) = 0.0;
 }
 
+void LocalGraphEdgeSolver::DenseSolve(const mfem::Vector& rhs, mfem::Vector& sol_u) const
+{
+    assert(use_dense_);
+
+    sol_u = rhs;
+    sol_u(0) = 0.0;
+    DenseCholeskySolve(A_factor_, sol_u.GetData() + 1, 1);
+}
+
+void LocalGraphEdgeSolver::AddMinv(const mfem::Vector& rhs_sigma, mfem::Vector& sol_sigma) const
+{
+    mfem::Vector Minv_rhs_sigma(rhs_sigma);
+    if (M_is_diag_)
+    {
+        RescaleVector(Minv_, Minv_rhs_sigma);
+    }
+    else
+    {
+        DenseCholeskySolve(M_factor_, Minv_rhs_sigma.GetData(), 1);
+    }
+    sol_sigma += Minv_rhs_sigma;
+}
+
 void LocalGraphEdgeSolver::Mult(const mfem::Vector& rhs_u, mfem::Vector& sol_sigma) const
 {
+    if (use_dense_)
+    {
+        mfem::Vector sol_u(rhs_u.Size());
+        DenseSolve(rhs_u, sol_u);
+        MinvDT_dense_.Mult(sol_u, sol_sigma);
+        return;
+    }
+
     // Set rhs_u(0) = 0 so that the modified system after
     // the elimination is consistent with the original one
     mfem::Vector& rhs_u_copy = const_cast<mfem::Vector&>(rhs_u);
@@ -1126,13 +1413,14 @@ void LocalGraphEdgeSolver::Mult(const mfem::Vector& rhs_u, mfem::Vector& sol_sig
     if (M_is_diag_)
     {
         mfem::Vector sol_u(rhs_u.Size());
-        solver_.Mult(rhs_u_copy, sol_u);
+        solver_->Mult(rhs_u_copy, sol_u);
         MinvDT_.Mult(sol_u, sol_sigma);
     }
     else
     {
+        rhs_->GetBlock(0) = 0.0;
         rhs_->GetBlock(1) = rhs_u_copy;
-        solver_.Mult(*rhs_, *sol_);
+        solver_->Mult(*rhs_, *sol_);
         sol_sigma = sol_->GetBlock(0);
     }
 
@@ -1143,19 +1431,28 @@ void LocalGraphEdgeSolver::Mult(const mfem::Vector& rhs_u, mfem::Vector& sol_sig
 void LocalGraphEdgeSolver::Mult(const mfem::Vector& rhs_sigma, const mfem::Vector& rhs_u,
                                 mfem::Vector& sol_sigma, mfem::Vector& sol_u) const
 {
-    if (M_is_diag_)
+    if (use_dense_)
+    {
+        mfem::Vector rhs(rhs_u.Size());
+        MinvDT_dense_.MultTranspose(rhs_sigma, rhs);
+        add(-1.0, rhs, 1.0, rhs_u, rhs);
+
+        DenseSolve(rhs, sol_u);
+
+        MinvDT_dense_.Mult(sol_u, sol_sigma);
+        AddMinv(rhs_sigma, sol_sigma);
+    }
+    else if (M_is_diag_)
     {
         mfem::Vector rhs(rhs_u.Size());
         MinvDT_.MultTranspose(rhs_sigma, rhs);
         add(-1.0, rhs, 1.0, rhs_u, rhs);
         rhs(0) = 0.0;
 
-        solver_.Mult(rhs, sol_u);
+        solver_->Mult(rhs, sol_u);
 
         MinvDT_.Mult(sol_u, sol_sigma);
-        mfem::Vector Minv_rhs_sigma(rhs_sigma);
-        RescaleVector(Minv_, Minv_rhs_sigma);
-        sol_sigma += Minv_rhs_sigma;
+        AddMinv(rhs_sigma, sol_sigma);
     }
     else
     {
@@ -1163,7 +1460,7 @@ void LocalGraphEdgeSolver::Mult(const mfem::Vector& rhs_sigma, const mfem::Vecto
         rhs_->GetBlock(1) = rhs_u;
         rhs_->GetBlock(1)[0] = 0.0;
 
-        solver_.Mult(*rhs_, *sol_);
+        solver_->Mult(*rhs_, *sol_);
 
         sol_sigma = sol_->GetBlock(0);
         sol_u = sol_->GetBlock(1);
@@ -1184,6 +1481,101 @@ void LocalGraphEdgeSolver::Mult(const mfem::Vector& rhs_u,
     Mult(rhs_sigma, rhs_u, sol_sigma, sol_u);
 }
 
+LocalGraphLaplacianInverse::LocalGraphLaplacianInverse(const mfem::SparseMatrix& M,
+                                                       const mfem::SparseMatrix& D,
+                                                       CholmodSymbolicCache* cache)
+    : mfem::Solver(D.Height()), solver_(M, D, mfem::Vector(), cache),
+      rhs_(D.Height()), sigma_(D.Width())
+{
+}
+
+void LocalGraphLaplacianInverse::Mult(const mfem::Vector& x, mfem::Vector& y) const
+{
+    const double mean = x.Sum() / x.Size();
+
+    rhs_ = x;
+    rhs_ -= mean;
+    solver_.Mult(rhs_, sigma_, y);
+
+    y -= y.Sum() / y.Size();
+    y += mean;
+}
+
+PackedDenseMatrices::PackedDenseMatrices(const std::vector<int>& heights,
+                                         const std::vector<int>& widths)
+    : heights_(heights), widths_(widths), offsets_(heights.size() + 1, 0)
+{
+    assert(heights.size() == widths.size());
+
+    for (unsigned int i = 0; i < heights.size(); ++i)
+    {
+        offsets_[i + 1] = offsets_[i] + heights[i] * widths[i];
+    }
+    data_.resize(offsets_.back(), 0.0);
+}
+
+void PackedDenseMatrices::GetView(int i, mfem::DenseMatrix& view)
+{
+    view.UseExternalData(Data(i), heights_[i], widths_[i]);
+}
+
+void PackedDenseMatrices::Mult(int i, const double* x, double* y, double a,
+                               int num_vecs) const
+{
+    std::fill_n(y, heights_[i] * num_vecs, 0.0);
+    AddMult(i, x, y, a, num_vecs);
+}
+
+void PackedDenseMatrices::AddMult(int i, const double* x, double* y, double a,
+                                  int num_vecs) const
+{
+    const int height = heights_[i];
+    const int width = widths_[i];
+    const double* A = Data(i);
+
+    for (int k = 0; k < num_vecs; ++k, x += width, y += height)
+    {
+        for (int col = 0; col < width; ++col)
+        {
+            const double* A_col = A + col * height;
+            const double ax = a * x[col];
+            for (int row = 0; row < height; ++row)
+            {
+                y[row] += A_col[row] * ax;
+            }
+        }
+    }
+}
+
+void PackedDenseMatrices::MultTranspose(int i, const double* x, double* y, double a,
+                                        int num_vecs) const
+{
+    std::fill_n(y, widths_[i] * num_vecs, 0.0);
+    AddMultTranspose(i, x, y, a, num_vecs);
+}
+
+void PackedDenseMatrices::AddMultTranspose(int i, const double* x, double* y, double a,
+                                           int num_vecs) const
+{
+    const int height = heights_[i];
+    const int width = widths_[i];
+    const double* A = Data(i);
+
+    for (int k = 0; k < num_vecs; ++k, x += height, y += width)
+    {
+        for (int col = 0; col < width; ++col)
+        {
+            const double* A_col = A + col * height;
+            double dot = 0.0;
+            for (int row = 0; row < height; ++row)
+            {
+                dot += A_col[row] * x[row];
+            }
+            y[col] += a * dot;
+        }
+    }
+}
+
 double InnerProduct(const mfem::Vector& weight, const mfem::Vector& u,
                     const mfem::Vector& v)
 {
@@ -1294,6 +1686,318 @@ mfem::SparseMatrix GetOffd(const mfem::HypreParMatrix& mat)
     return offd;
 }
 
+namespace
+{
+
+bool SamePattern(const mfem::SparseMatrix& A, const mfem::SparseMatrix& B)
+{
+    return A.NumRows() == B.NumRows() && A.NumCols() == B.NumCols() &&
+           A.NumNonZeroElems() == B.NumNonZeroElems() &&
+           std::equal(A.GetI(), A.GetI() + A.NumRows() + 1, B.GetI()) &&
+           std::equal(A.GetJ(), A.GetJ() + A.NumNonZeroElems(), B.GetJ());
+}
+
+} // namespace
+
+bool CopyValuesIfSamePattern(const mfem::HypreParMatrix& src, mfem::HypreParMatrix& dst)
+{
+    mfem::SparseMatrix src_diag = GetDiag(src);
+    mfem::SparseMatrix dst_diag = GetDiag(dst);
+
+    HYPRE_Int* src_col_map;
+    HYPRE_Int* dst_col_map;
+    mfem::SparseMatrix src_offd;
+    mfem::SparseMatrix dst_offd;
+    src.GetOffd(src_offd, src_col_map);
+    dst.GetOffd(dst_offd, dst_col_map);
+
+    int same_loc = src.M() == dst.M() && src.N() == dst.N() &&
+                   SamePattern(src_diag, dst_diag) && SamePattern(src_offd, dst_offd) &&
+                   std::equal(src_col_map, src_col_map + src_offd.NumCols(), dst_col_map);
+
+    int same;
+    MPI_Allreduce(&same_loc, &same, 1, MPI_INT, MPI_MIN, src.GetComm());
+
+    if (same)
+    {
+        std::copy_n(src_diag.GetData(), src_diag.NumNonZeroElems(), dst_diag.GetData());
+        std::copy_n(src_offd.GetData(), src_offd.NumNonZeroElems(), dst_offd.GetData());
+    }
+
+    return same;
+}
+
+std::unique_ptr<mfem::HypreParMatrix> GatherRows(const mfem::HypreParMatrix& mat,
+                                                 MPI_Comm group_comm, MPI_Comm sub_comm)
+{
+    int group_rank, group_size;
+    MPI_Comm_rank(group_comm, &group_rank);
+    MPI_Comm_size(group_comm, &group_size);
+    assert((group_rank == 0) == (sub_comm != MPI_COMM_NULL));
+
+    // local rows in global column numbering
+    mfem::SparseMatrix diag = GetDiag(mat);
+    HYPRE_Int* col_map;
+    mfem::SparseMatrix offd;
+    mat.GetOffd(offd, col_map);
+    hypre_ParCSRMatrix* mat_ptr = const_cast<mfem::HypreParMatrix&>(mat);
+    const HYPRE_Int first_col = hypre_ParCSRMatrixFirstColDiag(mat_ptr);
+
+    int local_sizes[3] = { diag.NumRows(), diag.NumCols(),
+                           diag.NumNonZeroElems() + offd.NumNonZeroElems()
+                         };
+    std::vector<int> row_sizes(local_sizes[0]);
+    std::vector<HYPRE_Int> cols;
+    std::vector<double> values;
+    cols.reserve(local_sizes[2]);
+    values.reserve(local_sizes[2]);
+    for (int i = 0; i < local_sizes[0]; ++i)
+    {
+        row_sizes[i] = diag.RowSize(i) + offd.RowSize(i);
+        for (int j = diag.GetI()[i]; j < diag.GetI()[i + 1]; ++j)
+        {
+            cols.push_back(first_col + diag.GetJ()[j]);
+            values.push_back(diag.GetData()[j]);
+        }
+        for (int j = offd.GetI()[i]; j < offd.GetI()[i + 1]; ++j)
+        {
+            cols.push_back(col_map[offd.GetJ()[j]]);
+            values.push_back(offd.GetData()[j]);
+        }
+    }
+
+    std::vector<int> all_sizes(group_rank == 0 ? 3 * group_size : 0);
+    MPI_Gather(local_sizes, 3, MPI_INT, all_sizes.data(), 3, MPI_INT, 0, group_comm);
+
+    std::vector<int> row_counts, row_displs, nnz_counts, nnz_displs;
+    int num_rows = 0, num_cols = 0, nnz = 0;
+    if (group_rank == 0)
+    {
+        row_counts.resize(group_size);
+        row_displs.resize(group_size);
+        nnz_counts.resize(group_size);
+        nnz_displs.resize(group_size);
+        for (int p = 0; p < group_size; ++p)
+        {
+            row_counts[p] = all_sizes[3 * p];
+            nnz_counts[p] = all_sizes[3 * p + 2];
+            row_displs[p] = num_rows;
+            nnz_displs[p] = nnz;
+            num_rows += row_counts[p];
+            num_cols += all_sizes[3 * p + 1];
+            nnz += nnz_counts[p];
+        }
+    }
+
+    mfem::Array<int> I(num_rows + 1);
+    mfem::Array<HYPRE_Int> J(nnz);
+    mfem::Array<double> data(nnz);
+    MPI_Gatherv(row_sizes.data(), local_sizes[0], MPI_INT, I.GetData() + 1,
+                row_counts.data(), row_displs.data(), MPI_INT, 0, group_comm);
+    MPI_Gatherv(cols.data(), local_sizes[2], HYPRE_MPI_INT, J.GetData(),
+                nnz_counts.data(), nnz_displs.data(), HYPRE_MPI_INT, 0, group_comm);
+    MPI_Gatherv(values.data(), local_sizes[2], MPI_DOUBLE, data.GetData(),
+                nnz_counts.data(), nnz_displs.data(), MPI_DOUBLE, 0, group_comm);
+
+    if (sub_comm == MPI_COMM_NULL)
+    {
+        return nullptr;
+    }
+
+    I[0] = 0;
+    for (int i = 0; i < num_rows; ++i)
+    {
+        I[i + 1] += I[i];
+    }
+
+    mfem::Array<HYPRE_Int> row_starts, col_starts;
+    GenerateOffsets(sub_comm, num_rows, row_starts);
+    GenerateOffsets(sub_comm, num_cols, col_starts);
+
+    auto out = make_unique<mfem::HypreParMatrix>(
+                   sub_comm, num_rows, mat.M(), mat.N(), I.GetData(), J.GetData(),
+                   data.GetData(), row_starts.GetData(), col_starts.GetData());
+    out->CopyRowStarts();
+    out->CopyColStarts();
+    return out;
+}
+
+ScaledProductPattern::ScaledProductPattern(const mfem::HypreParMatrix& D,
+                                           const mfem::HypreParMatrix& product)
+{
+    MPI_Comm comm = D.GetComm();
+
+    mfem::SparseMatrix D_diag = GetDiag(D);
+    HYPRE_Int* D_col_map;
+    mfem::SparseMatrix D_offd;
+    D.GetOffd(D_offd, D_col_map);
+
+    num_local_cols_ = D_diag.NumCols();
+    const int num_ext = D_offd.NumCols();
+
+    // rows of D^T of the off-process columns of D
+    mfem::Array<int> I(num_ext + 1);
+    mfem::Array<HYPRE_Int> J(num_ext);
+    mfem::Array<double> data(num_ext);
+    for (int r = 0; r < num_ext; ++r)
+    {
+        I[r] = r;
+        J[r] = D_col_map[r];
+        data[r] = 1.0;
+    }
+    I[num_ext] = num_ext;
+
+    mfem::Array<HYPRE_Int> row_starts;
+    GenerateOffsets(comm, num_ext, row_starts);
+
+    select_ext_ = make_unique<mfem::HypreParMatrix>(
+                      comm, num_ext, row_starts.Last(), D.N(), I.GetData(), J.GetData(),
+                      data.GetData(), row_starts.GetData(), const_cast<HYPRE_Int*>(D.ColPart()));
+    select_ext_->CopyRowStarts();
+    select_ext_->CopyColStarts();
+    w_ext_.SetSize(num_ext);
+
+    std::unique_ptr<mfem::HypreParMatrix> Dt(const_cast<mfem::HypreParMatrix&>(D).Transpose());
+    std::unique_ptr<mfem::HypreParMatrix> Dt_ext(mfem::ParMult(select_ext_.get(), Dt.get()));
+
+    mfem::SparseMatrix Dt_diag = GetDiag(*Dt);
+    HYPRE_Int* Dt_col_map;
+    mfem::SparseMatrix Dt_offd;
+    Dt->GetOffd(Dt_offd, Dt_col_map);
+
+    mfem::SparseMatrix Dt_ext_diag = GetDiag(*Dt_ext);
+    HYPRE_Int* Dt_ext_col_map;
+    mfem::SparseMatrix Dt_ext_offd;
+    Dt_ext->GetOffd(Dt_ext_offd, Dt_ext_col_map);
+
+    mfem::SparseMatrix P_diag = GetDiag(product);
+    HYPRE_Int* P_col_map;
+    mfem::SparseMatrix P_offd;
+    product.GetOffd(P_offd, P_col_map);
+    const int P_diag_nnz = P_diag.NumNonZeroElems();
+    const int P_nnz = P_diag_nnz + P_offd.NumNonZeroElems();
+
+    struct Contribution
+    {
+        int position;
+        int source;
+        double coef;
+    };
+    std::vector<Contribution> contribs;
+
+    std::vector<int> diag_position(P_diag.NumCols(), -1);
+    auto offd_position = [&](int i, HYPRE_Int global_col)
+    {
+        const HYPRE_Int* end = P_col_map + P_offd.NumCols();
+        const HYPRE_Int* it = std::lower_bound(P_col_map, end, global_col);
+        MFEM_VERIFY(it != end && *it == global_col, "Product misses an entry of D D^T!");
+        const int col = it - P_col_map;
+        for (int p = P_offd.GetI()[i]; p < P_offd.GetI()[i + 1]; ++p)
+        {
+            if (P_offd.GetJ()[p] == col)
+            {
+                return P_diag_nnz + p;
+            }
+        }
+        mfem::mfem_error("Product misses an entry of D D^T!");
+        return -1;
+    };
+
+    // entry (i, k) of D times row k of D^T (local or off-process)
+    auto add_row = [&](int i, double D_ik, int source, const mfem::SparseMatrix& Dt_d,
+                       const mfem::SparseMatrix& Dt_o, const HYPRE_Int* Dt_map, int k)
+    {
+        for (int q = Dt_d.GetI()[k]; q < Dt_d.GetI()[k + 1]; ++q)
+        {
+            const int position = diag_position[Dt_d.GetJ()[q]];
+            MFEM_VERIFY(position >= 0, "Product misses an entry of D D^T!");
+            contribs.push_back({position, source, D_ik * Dt_d.GetData()[q]});
+        }
+        for (int q = Dt_o.GetI()[k]; q < Dt_o.GetI()[k + 1]; ++q)
+        {
+            const int position = offd_position(i, Dt_map[Dt_o.GetJ()[q]]);
+            contribs.push_back({position, source, D_ik * Dt_o.GetData()[q]});
+        }
+    };
+
+    for (int i = 0; i < D_diag.NumRows(); ++i)
+    {
+        for (int p = P_diag.GetI()[i]; p < P_diag.GetI()[i + 1]; ++p)
+        {
+            diag_position[P_diag.GetJ()[p]] = p;
+        }
+
+        for (int p = D_diag.GetI()[i]; p < D_diag.GetI()[i + 1]; ++p)
+        {
+            const int k = D_diag.GetJ()[p];
+            add_row(i, D_diag.GetData()[p], k, Dt_diag, Dt_offd, Dt_col_map, k);
+        }
+        for (int p = D_offd.GetI()[i]; p < D_offd.GetI()[i + 1]; ++p)
+        {
+            const int r = D_offd.GetJ()[p];
+            add_row(i, D_offd.GetData()[p], num_local_cols_ + r,
+                    Dt_ext_diag, Dt_ext_offd, Dt_ext_col_map, r);
+        }
+
+        for (int p = P_diag.GetI()[i]; p < P_diag.GetI()[i + 1]; ++p)
+        {
+            diag_position[P_diag.GetJ()[p]] = -1;
+        }
+    }
+
+    std::stable_sort(contribs.begin(), contribs.end(),
+                     [](const Contribution & a, const Contribution & b)
+    {
+        return a.position < b.position;
+    });
+
+    contrib_I_.assign(P_nnz + 1, 0);
+    source_.resize(contribs.size());
+    coef_.resize(contribs.size());
+    for (unsigned int q = 0; q < contribs.size(); ++q)
+    {
+        contrib_I_[contribs[q].position + 1]++;
+        source_[q] = contribs[q].source;
+        coef_[q] = contribs[q].coef;
+    }
+    for (int p = 0; p < P_nnz; ++p)
+    {
+        contrib_I_[p + 1] += contrib_I_[p];
+    }
+}
+
+void ScaledProductPattern::Update(const mfem::Vector& w, mfem::HypreParMatrix& product) const
+{
+    MFEM_VERIFY(w.Size() == num_local_cols_, "Invalid size of the scaling vector!");
+
+    select_ext_->Mult(w, w_ext_);
+
+    mfem::SparseMatrix P_diag = GetDiag(product);
+    mfem::SparseMatrix P_offd = GetOffd(product);
+    const int P_diag_nnz = P_diag.NumNonZeroElems();
+    MFEM_VERIFY(P_diag_nnz + P_offd.NumNonZeroElems() + 1 == (int) contrib_I_.size(),
+                "The pattern of the product has changed!");
+
+    for (unsigned int p = 0; p + 1 < contrib_I_.size(); ++p)
+    {
+        double value = 0.0;
+        for (int q = contrib_I_[p]; q < contrib_I_[p + 1]; ++q)
+        {
+            const int src = source_[q];
+            value += coef_[q] * (src < num_local_cols_ ? w[src] : w_ext_[src - num_local_cols_]);
+        }
+
+        if ((int) p < P_diag_nnz)
+        {
+            P_diag.GetData()[p] = value;
+        }
+        else
+        {
+            P_offd.GetData()[p - P_diag_nnz] = value;
+        }
+    }
+}
+
 double FrobeniusNorm(const mfem::SparseMatrix& mat)
 {
     double norm = 0.0;
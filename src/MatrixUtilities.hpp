@@ -22,6 +22,8 @@
 #define __MATRIXUTILITIES_HPP__
 
 #include "mfem.hpp"
+#include "cholmod.h"
+#include <map>
 #include <memory>
 #include <iomanip>
 
@@ -355,6 +357,79 @@ void GenerateOffsets(MPI_Comm comm, int local_size, mfem::Array<HYPRE_Int>& offs
 
 bool IsDiag(const mfem::SparseMatrix& A);
 
+/**
+   @brief Symbolic Cholesky factorizations (CHOLMOD) stored by sparsity pattern.
+
+   Local problems on aggregates of the same shape, e.g. from a Cartesian
+   partition of a structured mesh, have identical sparsity patterns. Solvers
+   sharing a cache compute the fill-reducing ordering and the symbolic
+   analysis only once per pattern.
+
+   The cache is not thread safe, every thread should have its own.
+*/
+class CholmodSymbolicCache
+{
+public:
+    CholmodSymbolicCache();
+    ~CholmodSymbolicCache();
+
+    CholmodSymbolicCache(const CholmodSymbolicCache&) = delete;
+    CholmodSymbolicCache& operator=(const CholmodSymbolicCache&) = delete;
+
+    /**
+       @brief Symbolic factorization of A, owned by the cache.
+
+       The analysis is computed on the first request for a pattern. Patterns
+       are compared as stored, so column indices should be sorted.
+    */
+    const cholmod_factor* Get(cholmod_sparse& A);
+
+    /// Number of distinct patterns analyzed
+    int NumAnalyses() const { return factors_.size(); }
+
+    /// Number of requests answered without a new analysis
+    int NumHits() const { return num_hits_; }
+
+private:
+    cholmod_common common_;
+    std::map<std::vector<int>, cholmod_factor*> factors_;
+    int num_hits_;
+};
+
+/**
+   @brief Supernodal sparse Cholesky solver (CHOLMOD) for symmetric positive
+   definite matrices.
+
+   Check Success() after construction: if the matrix turns out not to be
+   positive definite, the solver must not be used.
+*/
+class CholmodSolver : public mfem::Solver
+{
+public:
+    /// Factorize A, taking the symbolic analysis from cache if provided
+    CholmodSolver(const mfem::SparseMatrix& A, CholmodSymbolicCache* cache = nullptr);
+    ~CholmodSolver();
+
+    CholmodSolver(const CholmodSolver&) = delete;
+    CholmodSolver& operator=(const CholmodSolver&) = delete;
+
+    /// Whether the numerical factorization succeeded
+    bool Success() const { return success_; }
+
+    virtual void Mult(const mfem::Vector& x, mfem::Vector& y) const;
+
+    /// Factorize a new operator, which must be a mfem::SparseMatrix
+    virtual void SetOperator(const mfem::Operator& op);
+
+private:
+    void Factorize(const mfem::SparseMatrix& A);
+
+    CholmodSymbolicCache* cache_;
+    mutable cholmod_common common_;
+    cholmod_factor* L_;
+    bool success_;
+};
+
 /**
    @brief Solver for local saddle point problems, see the formula below.
 
@@ -375,6 +450,12 @@ bool IsDiag(const mfem::SparseMatrix& A);
 
    This local solver is called when computing PV vectors, bubbles, and trace
    extensions.
+
+   The factorization is chosen by size: small problems are solved with a
+   dense (LAPACK) Cholesky factorization of \f$ A = D M^{-1} D^T \f$, large
+   ones with a sparse Cholesky factorization (CHOLMOD) of \f$ A \f$ if
+   \f$ M \f$ is diagonal, or a sparse LU factorization (UMFPACK) of the
+   saddle point matrix otherwise.
 */
 class LocalGraphEdgeSolver
 {
@@ -387,14 +468,27 @@ public:
        @param const_rep a vector which solution u is set to be orthogonal to.
        If not provided, there will be NO orthogonalization step in solving stage
 
+       @param cache symbolic factorizations shared with other local solvers
+       (used by the sparse Cholesky factorization only)
+       @param dense_threshold the dense factorization is used if the number of
+       rows of D (and of M, if M is not diagonal) does not exceed it
+
        We construct the matrix \f$ A = D M^{-1} D^T \f$, eliminate the zeroth
-       degree of freedom to ensure it is solvable. LU factorization of \f$ A \f$
-       is computed and stored (until the object is deleted) for potential
-       multiple solves.
+       degree of freedom to ensure it is solvable. The factorization of
+       \f$ A \f$ is computed and stored (until the object is deleted) for
+       potential multiple solves.
     */
     LocalGraphEdgeSolver(const mfem::SparseMatrix& M,
                          const mfem::SparseMatrix& D,
-                         const mfem::Vector& const_rep = mfem::Vector());
+                         const mfem::Vector& const_rep = mfem::Vector(),
+                         CholmodSymbolicCache* cache = nullptr,
+                         int dense_threshold = default_dense_threshold);
+
+    /// Default size up to which the dense factorization is used
+    static const int default_dense_threshold = 128;
+
+    /// Whether the dense factorization is used
+    bool UsesDenseFactorization() const { return use_dense_; }
 
     /**
        @brief Solves \f$ (D M^{-1} D^T) u = f\f$, \f$ \sigma = M^{-1} D^T u \f$.
@@ -428,23 +522,114 @@ public:
 
 
 private:
-    /// Setup matrix and solver when M is diagonal
-    void Init(const mfem::Vector& M_diag, const mfem::SparseMatrix& D);
+    /// Setup dense factorizations, return false if one of them fails
+    bool InitDense(const mfem::SparseMatrix& M, const mfem::SparseMatrix& D);
+
+    /// Setup sparse matrix and solver when M is diagonal
+    void InitSparse(const mfem::SparseMatrix& D, CholmodSymbolicCache* cache);
 
-    /// Setup matrix and solver when M is not diagonal
-    void Init(const mfem::SparseMatrix& M, const mfem::SparseMatrix& D);
+    /// Setup sparse matrix and solver when M is not diagonal
+    void InitSaddlePoint(const mfem::SparseMatrix& M, const mfem::SparseMatrix& D);
 
-    mfem::UMFPackSolver solver_;
+    /// Solve A u = rhs with the dense factorization, u(0) = 0 (rhs(0) is ignored)
+    void DenseSolve(const mfem::Vector& rhs, mfem::Vector& sol_u) const;
+
+    /// Compute M^{-1} rhs_sigma and add it to sol_sigma (dense or diagonal M)
+    void AddMinv(const mfem::Vector& rhs_sigma, mfem::Vector& sol_sigma) const;
+
+    std::unique_ptr<mfem::Solver> solver_;
     mfem::SparseMatrix A_;
     mfem::SparseMatrix MinvDT_;
     bool M_is_diag_;
+    bool use_dense_;
     mfem::Vector Minv_;
+    mfem::DenseMatrix MinvDT_dense_;
+    mfem::DenseMatrix M_factor_;
+    mfem::DenseMatrix A_factor_;
     mfem::Array<int> offsets_;
     mutable std::unique_ptr<mfem::BlockVector> rhs_;
     mutable std::unique_ptr<mfem::BlockVector> sol_;
     mfem::Vector const_rep_;
 };
 
+/**
+   @brief Pseudo-inverse of a local graph Laplacian \f$ A = D M^{-1} D^T \f$,
+   extended by the identity on constant vectors.
+
+   The pseudo-inverse is applied through a LocalGraphEdgeSolver. The
+   extension makes the operator positive definite, so that it can be used
+   to precondition eigen solvers of \f$ A \f$ (whose kernel is constant).
+*/
+class LocalGraphLaplacianInverse : public mfem::Solver
+{
+public:
+    LocalGraphLaplacianInverse(const mfem::SparseMatrix& M,
+                               const mfem::SparseMatrix& D,
+                               CholmodSymbolicCache* cache = nullptr);
+
+    void Mult(const mfem::Vector& x, mfem::Vector& y) const override;
+
+    /// The operator is given in the constructor
+    void SetOperator(const mfem::Operator& op) override { }
+
+private:
+    LocalGraphEdgeSolver solver_;
+    mutable mfem::Vector rhs_;
+    mutable mfem::Vector sigma_;
+};
+
+/**
+   @brief A collection of small dense matrices stored in one contiguous buffer.
+
+   Matrix i is stored column-major starting at Data(i), and the matrices are
+   stored one after another in the order of their index. Compared to a
+   std::vector<mfem::DenseMatrix>, there is a single allocation and a loop
+   over the matrices runs through memory in order.
+
+   The Mult methods apply matrix i to num_vecs vectors at once, the vectors
+   being the (contiguous) columns of x and y.
+*/
+class PackedDenseMatrices
+{
+public:
+    PackedDenseMatrices() = default;
+
+    /// Allocate matrices of size heights[i] x widths[i], initialized to zero
+    PackedDenseMatrices(const std::vector<int>& heights, const std::vector<int>& widths);
+
+    /// Number of matrices
+    int Size() const { return heights_.size(); }
+
+    int Height(int i) const { return heights_[i]; }
+    int Width(int i) const { return widths_[i]; }
+
+    double* Data(int i) { return data_.data() + offsets_[i]; }
+    const double* Data(int i) const { return data_.data() + offsets_[i]; }
+
+    /// Make view an mfem::DenseMatrix referring to (not owning) matrix i
+    void GetView(int i, mfem::DenseMatrix& view);
+
+    /// y = a * A_i * x
+    void Mult(int i, const double* x, double* y, double a = 1.0, int num_vecs = 1) const;
+
+    /// y += a * A_i * x
+    void AddMult(int i, const double* x, double* y, double a = 1.0, int num_vecs = 1) const;
+
+    /// y = a * A_i^T * x
+    void MultTranspose(int i, const double* x, double* y, double a = 1.0,
+                       int num_vecs = 1) const;
+
+    /// y += a * A_i^T * x
+    void AddMultTranspose(int i, const double* x, double* y, double a = 1.0,
+                          int num_vecs = 1) const;
+
+private:
+    std::vector<int> heights_;
+    std::vector<int> widths_;
+    std::vector<int> offsets_;
+    std::vector<double> data_;
+};
+
 /**
    @brief Compute the weighted l2 inner product between u and v
 */
@@ -484,6 +669,69 @@ mfem::SparseMatrix GetDiag(const mfem::HypreParMatrix& mat);
 /// @return "off diagonal block" of a HypreParMatrix
 mfem::SparseMatrix GetOffd(const mfem::HypreParMatrix& mat);
 
+/**
+   @brief Copy the entries of src into dst if they have the same sparsity pattern
+
+   This is collective over the communicator of the matrices: the patterns are
+   compared on every process and the values are only copied if they match
+   everywhere. Objects referring to dst (e.g. solvers) see the new values.
+
+   @return whether the values were copied
+*/
+bool CopyValuesIfSamePattern(const mfem::HypreParMatrix& src, mfem::HypreParMatrix& dst);
+
+/**
+   @brief Gather the rows of a parallel matrix on fewer processes
+
+   The processes of the communicator of mat are split in groups of
+   consecutive ranks (group_comm), the first process of every group belongs
+   to sub_comm (the others have sub_comm == MPI_COMM_NULL). The matrix
+   returned on the processes of sub_comm holds the local rows and columns of
+   the whole group, the global numbering of rows and columns is unchanged.
+   Collective over group_comm.
+
+   @return the gathered matrix, nullptr on processes not in sub_comm
+*/
+std::unique_ptr<mfem::HypreParMatrix> GatherRows(const mfem::HypreParMatrix& mat,
+                                                 MPI_Comm group_comm, MPI_Comm sub_comm);
+
+/**
+   @brief Cached symbolic product D diag(w) D^T for a fixed parallel matrix D
+
+   The constructor records, for every nonzero of a given product matrix (with
+   the sparsity pattern of D D^T, e.g. computed once with ParMult), the
+   entries of D contributing to it. Update() then recomputes the values of
+   the product in place for any w, without sparse matrix-matrix products:
+   only the entries of w coupled to off-process columns of D are exchanged.
+*/
+class ScaledProductPattern
+{
+public:
+    /**
+       @param D parallel matrix
+       @param product matrix with (a superset of) the pattern of D D^T
+    */
+    ScaledProductPattern(const mfem::HypreParMatrix& D, const mfem::HypreParMatrix& product);
+
+    /// Overwrite the values of product (same as in constructor) with D diag(w) D^T
+    void Update(const mfem::Vector& w, mfem::HypreParMatrix& product) const;
+
+private:
+    int num_local_cols_;
+
+    /// selects the entries of w of the off-process columns of D
+    std::unique_ptr<mfem::HypreParMatrix> select_ext_;
+
+    /// contributions to nonzero p (diag then offd entries of the product):
+    /// source_[q] is an index of w (local, then off-process), for q in
+    /// [contrib_I_[p], contrib_I_[p + 1])
+    std::vector<int> contrib_I_;
+    std::vector<int> source_;
+    std::vector<double> coef_;
+
+    mutable mfem::Vector w_ext_;
+};
+
 /// @return Frobenius Norm of a matrix
 double FrobeniusNorm(const mfem::SparseMatrix& mat);
 
@@ -21,6 +21,7 @@
 #include "MixedLaplacianSolver.hpp"
 #include "MixedMatrix.hpp"
 #include "utilities.hpp"
+#include "PipelinedKrylov.hpp"
 
 namespace smoothg
 {
@@ -48,6 +49,28 @@ mfem::BlockVector MixedLaplacianSolver::Solve(const mfem::BlockVector& rhs) cons
     return sol;
 }
 
+void MixedLaplacianSolver::Solve(const std::vector<mfem::BlockVector>& rhs,
+                                 std::vector<mfem::BlockVector>& sol) const
+{
+    MFEM_VERIFY(rhs.size() == sol.size(), "Numbers of rhs and sol do not match!");
+    Mult(rhs, sol);
+}
+
+void MixedLaplacianSolver::Mult(const std::vector<mfem::BlockVector>& rhs,
+                                std::vector<mfem::BlockVector>& sol) const
+{
+    int max_iterations = 0;
+    double total_timing = 0.0;
+    for (unsigned int k = 0; k < rhs.size(); ++k)
+    {
+        Mult(rhs[k], sol[k]);
+        max_iterations = std::max(max_iterations, num_iterations_);
+        total_timing += timing_;
+    }
+    num_iterations_ = max_iterations;
+    timing_ = total_timing;
+}
+
 void MixedLaplacianSolver::Solve(const mfem::Vector& rhs, mfem::Vector& sol) const
 {
     Mult(rhs, sol);
@@ -97,6 +120,19 @@ void MixedLaplacianSolver::Orthogonalize(mfem::Vector& vec) const
 std::unique_ptr<mfem::IterativeSolver>
 MixedLaplacianSolver::InitKrylovSolver(KrylovMethod method)
 {
+    krylov_method_ = method;
+    krylov_op_ = nullptr;
+    krylov_prec_ = nullptr;
+
+    if (pipelined_krylov_ && method == KrylovMethod::CG)
+    {
+        method = KrylovMethod::PIPELINED_CG;
+    }
+    else if (pipelined_krylov_ && method == KrylovMethod::MINRES)
+    {
+        method = KrylovMethod::PIPELINED_MINRES;
+    }
+
     mfem::IterativeSolver* out;
     if (method == KrylovMethod::CG)
     {
@@ -106,6 +142,14 @@ MixedLaplacianSolver::InitKrylovSolver(KrylovMethod method)
     {
         out = new mfem::MINRESSolver(comm_);
     }
+    else if (method == KrylovMethod::PIPELINED_CG)
+    {
+        out = new PipelinedCGSolver(comm_);
+    }
+    else if (method == KrylovMethod::PIPELINED_MINRES)
+    {
+        out = new PipelinedMINRESSolver(comm_);
+    }
     else
     {
         out = new mfem::GMRESSolver(comm_);
@@ -117,4 +161,46 @@ MixedLaplacianSolver::InitKrylovSolver(KrylovMethod method)
     return std::unique_ptr<mfem::IterativeSolver>(out);
 }
 
+void MixedLaplacianSolver::SetKrylovOperator(const mfem::Operator& op)
+{
+    krylov_op_ = &op;
+    solver_->SetOperator(op);
+}
+
+void MixedLaplacianSolver::SetKrylovPreconditioner(mfem::Solver& prec)
+{
+    krylov_prec_ = &prec;
+    solver_->SetPreconditioner(prec);
+}
+
+void MixedLaplacianSolver::SetPipelinedKrylov(bool pipelined)
+{
+    if (pipelined == pipelined_krylov_)
+    {
+        return;
+    }
+    pipelined_krylov_ = pipelined;
+
+    if (!solver_ || krylov_method_ == KrylovMethod::GMRES)
+    {
+        return;
+    }
+
+    // set up the solver again with the same operator and preconditioner
+    const mfem::Operator* op = krylov_op_;
+    mfem::Solver* prec = krylov_prec_;
+    const bool iterative_mode = solver_->iterative_mode;
+
+    solver_ = InitKrylovSolver(krylov_method_);
+    solver_->iterative_mode = iterative_mode;
+    if (op)
+    {
+        SetKrylovOperator(*op);
+    }
+    if (prec)
+    {
+        SetKrylovPreconditioner(*prec);
+    }
+}
+
 } // namespace smoothg
@@ -26,7 +26,8 @@
 namespace smoothg
 {
 
-enum class KrylovMethod { CG, MINRES, GMRES };
+/// PIPELINED_CG and PIPELINED_MINRES overlap their reductions with local work
+enum class KrylovMethod { CG, MINRES, GMRES, PIPELINED_CG, PIPELINED_MINRES };
 
 /**
    @brief Abstract base class for solvers of graph Laplacian problems
@@ -51,6 +52,21 @@ public:
     mfem::BlockVector Solve(const mfem::BlockVector& rhs) const;
     virtual void Mult(const mfem::BlockVector& rhs, mfem::BlockVector& sol) const = 0;
 
+    /**
+       Solve the mixed form of the graph Laplacian problem for several right
+       hand sides with the same operator
+
+       sol has to contain as many (properly sized) BlockVectors as rhs. The
+       default Mult solves the problems one after another, derived classes may
+       share the work that does not depend on the right hand side. Afterwards,
+       GetNumIterations() is the maximum over all solves and GetTiming() the
+       total time of the solves.
+    */
+    void Solve(const std::vector<mfem::BlockVector>& rhs,
+               std::vector<mfem::BlockVector>& sol) const;
+    virtual void Mult(const std::vector<mfem::BlockVector>& rhs,
+                      std::vector<mfem::BlockVector>& sol) const;
+
     /// Solve the primal form of the graph Laplacian problem (DM^{-1}D^T) sol = rhs
     void Solve(const mfem::Vector& rhs, mfem::Vector& sol) const;
     virtual void Mult(const mfem::Vector& rhs, mfem::Vector& sol) const;
@@ -64,10 +80,17 @@ public:
 
     ///@name Set solver parameters
     ///@{
-    void SetPrintLevel(int l) { print_level_ = l; solver_->SetPrintLevel(l); }
-    void SetMaxIter(int it) { max_num_iter_ = it; solver_->SetMaxIter(it); }
-    void SetRelTol(double rtol) { rtol_ = rtol; solver_->SetRelTol(rtol); }
-    void SetAbsTol(double atol) { atol_ = atol; solver_->SetAbsTol(atol); }
+    virtual void SetPrintLevel(int l) { print_level_ = l; solver_->SetPrintLevel(l); }
+    virtual void SetMaxIter(int it) { max_num_iter_ = it; solver_->SetMaxIter(it); }
+    virtual void SetRelTol(double rtol) { rtol_ = rtol; solver_->SetRelTol(rtol); }
+    virtual void SetAbsTol(double atol) { atol_ = atol; solver_->SetAbsTol(atol); }
+
+    /**
+       Use the pipelined variants of CG and MINRES (see PipelinedKrylov.hpp)
+       for the symmetric systems, now and whenever the Krylov solver is set
+       up again. GMRES (nonsymmetric systems) is not affected.
+    */
+    virtual void SetPipelinedKrylov(bool pipelined);
     ///@}
 
     ///@name Get results of iterative solve
@@ -81,6 +104,10 @@ protected:
     void Init(const MixedMatrix& mgL, const mfem::Array<int>* ess_attr);
     void Orthogonalize(mfem::Vector& vec) const;
     std::unique_ptr<mfem::IterativeSolver> InitKrylovSolver(KrylovMethod method);
+
+    /// Set the operator (preconditioner) of solver_, kept for SetPipelinedKrylov
+    void SetKrylovOperator(const mfem::Operator& op);
+    void SetKrylovPreconditioner(mfem::Solver& prec);
     MPI_Comm comm_;
     int myid_;
 
@@ -107,6 +134,12 @@ protected:
 
     std::unique_ptr<mfem::IterativeSolver> solver_;
     bool is_symmetric_;
+
+private:
+    bool pipelined_krylov_ = false;
+    KrylovMethod krylov_method_ = KrylovMethod::CG;
+    const mfem::Operator* krylov_op_ = nullptr;
+    mfem::Solver* krylov_prec_ = nullptr;
 };
 
 } // namespace smoothg
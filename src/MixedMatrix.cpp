@@ -89,6 +89,15 @@ void MixedMatrix::Init()
     block_true_offsets_[2] = block_true_offsets_[1] + NumVDofs();
 }
 
+void MixedMatrix::SetCoefficient(const mfem::Vector& coeff)
+{
+    auto elem_mbuilder = dynamic_cast<ElementMBuilder*>(mbuilder_.get());
+    MFEM_VERIFY(elem_mbuilder, "M is not assembled from element matrices!");
+
+    elem_mbuilder->SetCoefficient(coeff);
+    BuildM();
+}
+
 mfem::HypreParMatrix* MixedMatrix::MakeParallelM(const mfem::SparseMatrix& M) const
 {
     auto tmp = ParMult(M, graph_space_.EDofToTrueEDof(), graph_space_.EDofStarts());
@@ -85,6 +85,15 @@ public:
         M_.Swap(M_tmp);
     }
 
+    /**
+       @brief Set the coefficient of the system and reassemble M
+
+       The element matrices of M are scaled by 1 / coeff (one value per
+       vertex) relative to the ones the system was constructed with. M has to
+       be assembled element by element (ElementMBuilder).
+    */
+    void SetCoefficient(const mfem::Vector& coeff);
+
     /// assemble the parallel edge mass matrix
     mfem::HypreParMatrix* MakeParallelM(const mfem::SparseMatrix& M) const;
 
@@ -0,0 +1,362 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file
+
+   @brief Implements ParMetisGraphPartitioner object.
+*/
+
+#include "smoothG_config.h"
+
+#if SMOOTHG_USE_PARMETIS
+
+#include "ParMetisGraphPartitioner.hpp"
+#include <algorithm>
+
+namespace smoothg
+{
+
+ParMetisGraphPartitioner::ParMetisGraphPartitioner(MPI_Comm comm)
+    : comm_(comm), unbalance_tol_(1.05), seed_(0)
+{
+    MPI_Comm_rank(comm_, &myid_);
+    MPI_Comm_size(comm_, &num_procs_);
+}
+
+void ParMetisGraphPartitioner::doPartition(const mfem::SparseMatrix& wtable,
+                                           const mfem::Array<int>& vertex_starts,
+                                           int& num_partitions,
+                                           mfem::Array<int>& partitioning,
+                                           bool use_edge_weight)
+{
+    const int nvertices = wtable.Height();
+    MFEM_VERIFY(vertex_starts.Size() == num_procs_ + 1 &&
+                vertex_starts[myid_ + 1] - vertex_starts[myid_] == nvertices,
+                "vertex_starts does not match the local table!");
+
+    partitioning.SetSize(nvertices);
+
+    mfem::Array<int> sub_vertex_starts;
+    mfem::Array<int> sub_to_local;
+    mfem::SparseMatrix adjacency = IsolatePreProcess(wtable, vertex_starts,
+                                                     sub_vertex_starts, sub_to_local);
+    const int sub_nvertices = adjacency.Height();
+
+    int min_sub_nvertices;
+    MPI_Allreduce(&sub_nvertices, &min_sub_nvertices, 1, MPI_INT, MPI_MIN, comm_);
+    MFEM_VERIFY(min_sub_nvertices > 0,
+                "ParMetis needs at least one (non-isolated) vertex on every process!");
+
+    int* edge_weight_ptr = nullptr;
+    mfem::Array<int> adj_weight_int;
+    if (use_edge_weight)
+    {
+        adj_weight_int.SetSize(adjacency.NumNonZeroElems());
+        mfem::Vector adj_weight(adjacency.GetData(), adj_weight_int.Size());
+
+        for (int i = 0; i < adj_weight.Size(); ++i)
+        {
+            adj_weight[i] = std::fabs(adj_weight[i]);
+        }
+
+        // the scaling has to be consistent across processes
+        double adj_wt_min = adj_weight.Size() ? adj_weight.Min() : 1e300;
+        MPI_Allreduce(MPI_IN_PLACE, &adj_wt_min, 1, MPI_DOUBLE, MPI_MIN, comm_);
+        for (int i = 0; i < adj_weight.Size(); i++)
+            adj_weight_int[i] = floor(log2(adj_weight[i] / adj_wt_min)) + 1;
+        edge_weight_ptr = adj_weight_int.GetData();
+    }
+
+    mfem::Array<int> sub_part(sub_nvertices);
+    if (num_partitions > 1)
+    {
+        int wgtflag = use_edge_weight ? 1 : 0;
+        int numflag = 0;
+        int ncon = 1;
+        int edgecut;
+        std::vector<real_t> tpwgts(num_partitions, 1.0 / num_partitions);
+        real_t ubvec = unbalance_tol_;
+        int options[3] = {1, 0, seed_};
+
+        int err = ParMETIS_V3_PartKway(sub_vertex_starts.GetData(), adjacency.GetI(),
+                                       adjacency.GetJ(), nullptr, edge_weight_ptr,
+                                       &wgtflag, &numflag, &ncon, &num_partitions,
+                                       tpwgts.data(), &ubvec, options, &edgecut,
+                                       sub_part.GetData(), &comm_);
+
+        MFEM_VERIFY(err == METIS_OK, "ParMetis failed!");
+    }
+    else
+    {
+        sub_part = 0;
+    }
+
+    for (int i = 0; i < sub_part.Size(); ++i)
+    {
+        partitioning[sub_to_local[i]] = sub_part[i];
+    }
+
+    if (pre_isolated_vertices_.size() > 0)
+    {
+        AddAggregates(pre_isolated_vertices_, vertex_starts, num_partitions, partitioning);
+    }
+
+    if (post_isolated_vertices_.size() > 0)
+    {
+        IsolatePostProcess(wtable, vertex_starts, num_partitions, partitioning);
+    }
+
+    removeEmptyParts(partitioning, num_partitions);
+}
+
+void ParMetisGraphPartitioner::SetPreIsolateVertices(int index)
+{
+    pre_isolated_vertices_.push_back(std::vector<int>(1, index));
+}
+
+void ParMetisGraphPartitioner::SetPreIsolateVertices(const std::vector<int>& indices)
+{
+    for (auto& index : indices)
+    {
+        pre_isolated_vertices_.push_back(std::vector<int>(1, index));
+    }
+}
+
+void ParMetisGraphPartitioner::SetPreIsolateVertices(std::vector<std::vector<int>> sets)
+{
+    for (auto&& indices : sets)
+    {
+        pre_isolated_vertices_.push_back(indices);
+    }
+}
+
+void ParMetisGraphPartitioner::SetPostIsolateVertices(int index)
+{
+    post_isolated_vertices_.push_back(std::vector<int>(1, index));
+}
+
+void ParMetisGraphPartitioner::SetPostIsolateVertices(const std::vector<int>& indices)
+{
+    for (auto& index : indices)
+    {
+        post_isolated_vertices_.push_back(std::vector<int>(1, index));
+    }
+}
+
+mfem::SparseMatrix ParMetisGraphPartitioner::IsolatePreProcess(
+    const mfem::SparseMatrix& wtable,
+    const mfem::Array<int>& vertex_starts,
+    mfem::Array<int>& sub_vertex_starts,
+    mfem::Array<int>& sub_to_local) const
+{
+    std::vector<int> iso_verts;
+    for (auto& partition : pre_isolated_vertices_)
+    {
+        iso_verts.insert(iso_verts.end(), partition.begin(), partition.end());
+    }
+    std::sort(iso_verts.begin(), iso_verts.end());
+
+    // number of isolated vertices with global index smaller than vertex
+    auto num_iso_before = [&iso_verts](int vertex)
+    {
+        return std::lower_bound(iso_verts.begin(), iso_verts.end(), vertex) - iso_verts.begin();
+    };
+    auto is_iso = [&iso_verts](int vertex)
+    {
+        return std::binary_search(iso_verts.begin(), iso_verts.end(), vertex);
+    };
+
+    sub_vertex_starts.SetSize(num_procs_ + 1);
+    for (int p = 0; p < num_procs_ + 1; ++p)
+    {
+        sub_vertex_starts[p] = vertex_starts[p] - num_iso_before(vertex_starts[p]);
+    }
+
+    const int vertex_begin = vertex_starts[myid_];
+    const int* w_i = wtable.GetI();
+    const int* w_j = wtable.GetJ();
+    const double* w_data = wtable.GetData();
+
+    std::vector<int> adj_i(1, 0);
+    std::vector<int> adj_j;
+    std::vector<double> adj_weight;
+    sub_to_local.SetSize(0);
+
+    for (int i = 0; i < wtable.Height(); ++i)
+    {
+        if (is_iso(vertex_begin + i))
+            continue;
+
+        sub_to_local.Append(i);
+        for (int j = w_i[i]; j < w_i[i + 1]; ++j)
+        {
+            if (w_j[j] != vertex_begin + i && !is_iso(w_j[j]))
+            {
+                adj_j.push_back(w_j[j] - num_iso_before(w_j[j]));
+                adj_weight.push_back(w_data[j]);
+            }
+        }
+        adj_i.push_back(adj_j.size());
+    }
+
+    const int sub_nvertices = sub_to_local.Size();
+    const int nnz = adj_j.size();
+    int* i_ptr = new int[sub_nvertices + 1];
+    int* j_ptr = new int[nnz];
+    double* data_ptr = new double[nnz];
+    std::copy(adj_i.begin(), adj_i.end(), i_ptr);
+    std::copy(adj_j.begin(), adj_j.end(), j_ptr);
+    std::copy(adj_weight.begin(), adj_weight.end(), data_ptr);
+
+    return mfem::SparseMatrix(i_ptr, j_ptr, data_ptr, sub_nvertices,
+                              sub_vertex_starts.Last());
+}
+
+void ParMetisGraphPartitioner::IsolatePostProcess(const mfem::SparseMatrix& wtable,
+                                                  const mfem::Array<int>& vertex_starts,
+                                                  int& num_partitions,
+                                                  mfem::Array<int>& partitioning) const
+{
+    // do a post-processing of partitioning to put critical vertices in their own partitions
+    AddAggregates(post_isolated_vertices_, vertex_starts, num_partitions, partitioning);
+
+    // removing vertices may have made some partitions disconnected. Partitions
+    // that live on one process are split into their connected components,
+    // partitions spanning several processes are left as they are.
+    std::vector<int> num_procs_in_part(num_partitions, 0);
+    for (int part : partitioning)
+        num_procs_in_part[part] = 1;
+    MPI_Allreduce(MPI_IN_PLACE, num_procs_in_part.data(), num_partitions,
+                  MPI_INT, MPI_SUM, comm_);
+
+    const int vertex_begin = vertex_starts[myid_];
+    const int nvertices = wtable.Height();
+    const int* w_i = wtable.GetI();
+    const int* w_j = wtable.GetJ();
+
+    mfem::Array<int> component(nvertices);
+    component = -1;
+    std::vector<int> num_comp(num_partitions, 0);
+    std::vector<int> vertex_stack;
+    for (int node = 0; node < nvertices; ++node)
+    {
+        const int part = partitioning[node];
+        if (component[node] >= 0 || num_procs_in_part[part] > 1)
+            continue;
+
+        component[node] = num_comp[part]++;
+        vertex_stack.assign(1, node);
+        while (!vertex_stack.empty())
+        {
+            const int i = vertex_stack.back();
+            vertex_stack.pop_back();
+            for (int j = w_i[i]; j < w_i[i + 1]; ++j)
+            {
+                const int k = w_j[j] - vertex_begin;
+                if (k >= 0 && k < nvertices && partitioning[k] == part && component[k] < 0)
+                {
+                    component[k] = component[i];
+                    vertex_stack.push_back(k);
+                }
+            }
+        }
+    }
+
+    // the first component keeps the partition number, others get new numbers
+    std::vector<int> new_part_offset(num_partitions, 0);
+    int num_new_parts = 0;
+    for (int part = 0; part < num_partitions; ++part)
+    {
+        new_part_offset[part] = num_new_parts - 1;
+        num_new_parts += std::max(num_comp[part] - 1, 0);
+    }
+
+    int first_new_part;
+    MPI_Scan(&num_new_parts, &first_new_part, 1, MPI_INT, MPI_SUM, comm_);
+    first_new_part += num_partitions - num_new_parts;
+
+    for (int i = 0; i < nvertices; ++i)
+    {
+        if (component[i] > 0)
+        {
+            partitioning[i] = first_new_part + new_part_offset[partitioning[i]] + component[i];
+        }
+    }
+
+    int total_new_parts;
+    MPI_Allreduce(&num_new_parts, &total_new_parts, 1, MPI_INT, MPI_SUM, comm_);
+    num_partitions += total_new_parts;
+}
+
+void ParMetisGraphPartitioner::AddAggregates(const std::vector<std::vector<int>>& aggs,
+                                             const mfem::Array<int>& vertex_starts,
+                                             int& current_num_aggs,
+                                             mfem::Array<int>& partitioning) const
+{
+    const int vertex_begin = vertex_starts[myid_];
+    const int vertex_end = vertex_starts[myid_ + 1];
+    for (auto& vertices : aggs)
+    {
+        for (auto vertex : vertices)
+        {
+            if (vertex >= vertex_begin && vertex < vertex_end)
+            {
+                partitioning[vertex - vertex_begin] = current_num_aggs;
+            }
+        }
+        current_num_aggs++;
+    }
+}
+
+void ParMetisGraphPartitioner::removeEmptyParts(mfem::Array<int>& partitioning,
+                                                int& num_partitions) const
+{
+    int shift = 0;
+    std::vector<int> count(num_partitions, 0);
+    std::vector<int> shifter(num_partitions, 0);
+
+    for (const int& part : partitioning)
+        ++count[part];
+
+    MPI_Allreduce(MPI_IN_PLACE, count.data(), num_partitions, MPI_INT, MPI_SUM, comm_);
+
+    for (int i = 0; i < num_partitions; ++i)
+    {
+        if (!count[i])
+            ++shift;
+        shifter[i] = shift;
+    }
+
+    for (int& part : partitioning)
+        part -= shifter[part];
+
+    num_partitions -= shift;
+}
+
+void ParPartition(MPI_Comm comm, const mfem::SparseMatrix& w_table,
+                  const mfem::Array<int>& vertex_starts,
+                  mfem::Array<int>& partitioning, int num_parts,
+                  bool use_edge_weight, std::vector<std::vector<int>> iso_verts)
+{
+    ParMetisGraphPartitioner partitioner(comm);
+    partitioner.setUnbalanceTol(2);
+    partitioner.SetPreIsolateVertices(std::move(iso_verts));
+    partitioner.doPartition(w_table, vertex_starts, num_parts, partitioning, use_edge_weight);
+}
+
+} // namespace smoothg
+
+#endif // SMOOTHG_USE_PARMETIS
@@ -0,0 +1,142 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file
+
+    @brief Defines object for partitioning distributed graphs with ParMetis.
+*/
+
+#ifndef __PARMETISGRAPHPARTITIONER_HPP__
+#define __PARMETISGRAPHPARTITIONER_HPP__
+
+#include <mpi.h>
+#include <parmetis.h>
+#include "MatrixUtilities.hpp"
+
+namespace smoothg
+{
+
+/**
+   @brief Wrap ParMetis in a C++ class for partitioning a distributed graph.
+
+   The graph is distributed by rows: process p owns the vertices
+   vertex_starts[p], ..., vertex_starts[p+1] - 1, and its local table has
+   one row per owned vertex, with columns in global vertex numbering.
+   Partitions may span several processes.
+
+   The interface mirrors MetisGraphPartitioner. Isolated vertices are given
+   in global numbering and must be set identically on all processes.
+*/
+class ParMetisGraphPartitioner
+{
+public:
+    //! Constructor: initialize default options for the partitioner.
+    explicit ParMetisGraphPartitioner(MPI_Comm comm);
+
+    //! Destructor
+    virtual ~ParMetisGraphPartitioner() { }
+
+    //! Allow some imbalance in the size of the partitions
+    void setUnbalanceTol(double utol)
+    {
+        unbalance_tol_ = utol;
+    }
+
+    //! Seed of the random number generator of ParMetis
+    void setSeed(int seed)
+    {
+        seed_ = seed;
+    }
+
+    //! Partition a distributed graph with weighted edges in num_partitions
+    /*!
+     * @param wtable local rows of the connectivity of the graph, columns in
+     *               global numbering. The weight of the edge is the value of
+     *               the matrix.
+     *
+     * @param vertex_starts vertex offsets of processes (size num procs + 1)
+     *
+     * @param num_partitions number of partitions in which we want to divide
+     *                       the graph, at return the actual number (global)
+     *
+     * @param partitioning vector of size number of local vertices.
+     *                     partitioning[v] = p if local vertex v belongs to
+     *                     (global) partition p. (OUT).
+     */
+    void doPartition(const mfem::SparseMatrix& wtable,
+                     const mfem::Array<int>& vertex_starts,
+                     int& num_partitions,
+                     mfem::Array<int>& partitioning,
+                     bool use_edge_weight = false);
+
+    /**
+       Isolate some critical vertices (global numbering) of the graph into
+       their own partition, see MetisGraphPartitioner.
+    */
+    void SetPreIsolateVertices(int index);
+    void SetPreIsolateVertices(const std::vector<int>& indices);
+    void SetPreIsolateVertices(std::vector<std::vector<int>> sets_of_indices);
+
+    void SetPostIsolateVertices(int index);
+    void SetPostIsolateVertices(const std::vector<int>& indices);
+
+private:
+    MPI_Comm comm_;
+    int myid_;
+    int num_procs_;
+
+    real_t unbalance_tol_;
+    int seed_;
+    std::vector<std::vector<int>> pre_isolated_vertices_;
+    std::vector<std::vector<int>> post_isolated_vertices_;
+
+    /// local rows without isolated vertices and diagonal, renumbered columns
+    mfem::SparseMatrix IsolatePreProcess(const mfem::SparseMatrix& wtable,
+                                         const mfem::Array<int>& vertex_starts,
+                                         mfem::Array<int>& sub_vertex_starts,
+                                         mfem::Array<int>& sub_to_local) const;
+
+    void IsolatePostProcess(const mfem::SparseMatrix& wtable,
+                            const mfem::Array<int>& vertex_starts,
+                            int& num_partitions,
+                            mfem::Array<int>& partitioning) const;
+
+    void AddAggregates(const std::vector<std::vector<int>>& aggs,
+                       const mfem::Array<int>& vertex_starts,
+                       int& current_num_aggs,
+                       mfem::Array<int>& partitioning) const;
+
+    void removeEmptyParts(mfem::Array<int>& partitioning,
+                          int& num_partitions) const;
+};
+
+/**
+   @brief Partition a distributed graph into num_parts with ParMetis.
+
+   @param comm communicator over which the graph is distributed
+   @param w_table local rows of the vertex to vertex table (global columns)
+   @param vertex_starts vertex offsets of processes (size num procs + 1)
+   @param partitioning partition of the local vertices (OUT)
+   @param num_parts number of partitions (global)
+*/
+void ParPartition(MPI_Comm comm, const mfem::SparseMatrix& w_table,
+                  const mfem::Array<int>& vertex_starts,
+                  mfem::Array<int>& partitioning, int num_parts,
+                  bool use_edge_weight = false,
+                  std::vector<std::vector<int>> iso_verts = std::vector<std::vector<int>>());
+
+} // namespace smoothg
+
+#endif
@@ -0,0 +1,371 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file
+
+    @brief Implements PipelinedCGSolver and PipelinedMINRESSolver
+*/
+
+#include "PipelinedKrylov.hpp"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+namespace smoothg
+{
+
+namespace
+{
+
+/// Start the global sum of local[0], ..., local[n-1] into global
+void StartSum(MPI_Comm comm, const double* local, double* global, int n,
+              MPI_Request& request)
+{
+    MPI_Iallreduce(local, global, n, MPI_DOUBLE, MPI_SUM, comm, &request);
+}
+
+void FinishSum(MPI_Request& request)
+{
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+}
+
+} // anonymous namespace
+
+PipelinedCGSolver::PipelinedCGSolver(MPI_Comm comm)
+    : mfem::IterativeSolver(comm), comm_(comm)
+{
+}
+
+void PipelinedCGSolver::SetOperator(const mfem::Operator& op)
+{
+    mfem::IterativeSolver::SetOperator(op);
+
+    const int size = op.Width();
+    for (mfem::Vector* v : { &r_, &u_, &w_, &m_, &n_, &z_, &q_, &s_, &p_ })
+    {
+        v->SetSize(size);
+    }
+}
+
+void PipelinedCGSolver::Mult(const mfem::Vector& b, mfem::Vector& x) const
+{
+    assert(oper);
+
+    if (iterative_mode)
+    {
+        oper->Mult(x, r_);
+        subtract(b, r_, r_);
+    }
+    else
+    {
+        r_ = b;
+        x = 0.0;
+    }
+
+    if (prec)
+    {
+        prec->Mult(r_, u_);
+    }
+    else
+    {
+        u_ = r_;
+    }
+    oper->Mult(u_, w_);
+
+    double gamma_old = 0.0;
+    double alpha_old = 0.0;
+    double goal = 0.0;
+
+    converged = 0;
+    for (int i = 0; true; ++i)
+    {
+        double local[2] = { r_ * u_, w_ * u_ };
+        double global[2];
+        MPI_Request request;
+        StartSum(comm_, local, global, 2, request);
+
+        // does not depend on the reduction, overlaps with it
+        if (i < max_iter)
+        {
+            if (prec)
+            {
+                prec->Mult(w_, m_);
+            }
+            else
+            {
+                m_ = w_;
+            }
+            oper->Mult(m_, n_);
+        }
+
+        FinishSum(request);
+        const double gamma = global[0];
+        const double delta = global[1];
+
+        if (i == 0)
+        {
+            goal = std::max(gamma * rel_tol * rel_tol, abs_tol * abs_tol);
+        }
+        if (print_level == 1)
+        {
+            std::cout << "   Iteration : " << std::setw(3) << i << "  (B r, r) = "
+                      << gamma << '\n';
+        }
+
+        final_iter = i;
+        final_norm = std::sqrt(std::fabs(gamma));
+
+        if (gamma <= goal)
+        {
+            converged = 1;
+            break;
+        }
+        if (i == max_iter)
+        {
+            break;
+        }
+
+        const double beta = (i > 0) ? gamma / gamma_old : 0.0;
+        const double den = (i > 0) ? delta - beta * gamma / alpha_old : delta;
+        if (gamma < 0.0 || den <= 0.0)
+        {
+            if (print_level >= 0)
+            {
+                std::cout << "PipelinedCG: The operator or the preconditioner is not "
+                          << "positive definite. (B r, r) = " << gamma
+                          << ", (A p, p) = " << den << '\n';
+            }
+            break;
+        }
+        const double alpha = gamma / den;
+
+        if (i == 0)
+        {
+            z_ = n_;
+            q_ = m_;
+            s_ = w_;
+            p_ = u_;
+        }
+        else
+        {
+            add(n_, beta, z_, z_);
+            add(m_, beta, q_, q_);
+            add(w_, beta, s_, s_);
+            add(u_, beta, p_, p_);
+        }
+
+        x.Add(alpha, p_);
+        r_.Add(-alpha, s_);
+        u_.Add(-alpha, q_);
+        w_.Add(-alpha, z_);
+
+        gamma_old = gamma;
+        alpha_old = alpha;
+    }
+
+    if (print_level == 2)
+    {
+        std::cout << "PipelinedCG: Number of iterations: " << final_iter << '\n';
+    }
+    if (!converged && print_level >= 0)
+    {
+        std::cout << "PipelinedCG: No convergence!\n";
+    }
+}
+
+PipelinedMINRESSolver::PipelinedMINRESSolver(MPI_Comm comm)
+    : mfem::IterativeSolver(comm), comm_(comm)
+{
+}
+
+void PipelinedMINRESSolver::SetOperator(const mfem::Operator& op)
+{
+    mfem::IterativeSolver::SetOperator(op);
+
+    const int size = op.Width();
+    for (mfem::Vector* v : { &u0_, &u1_, &v0_, &v1_, &q0_, &q1_, &p_, &t_, &w0_, &w1_ })
+    {
+        v->SetSize(size);
+    }
+}
+
+void PipelinedMINRESSolver::Mult(const mfem::Vector& b, mfem::Vector& x) const
+{
+    assert(oper);
+
+    // v: Lanczos vectors, u = B v, q = A u
+    if (iterative_mode)
+    {
+        oper->Mult(x, v1_);
+        subtract(b, v1_, v1_);
+    }
+    else
+    {
+        v1_ = b;
+        x = 0.0;
+    }
+
+    if (prec)
+    {
+        prec->Mult(v1_, u1_);
+    }
+    else
+    {
+        u1_ = v1_;
+    }
+
+    double beta = std::sqrt(Dot(v1_, u1_));
+    double eta = beta;
+    const double norm_goal = std::max(rel_tol * eta, abs_tol);
+
+    if (print_level == 1)
+    {
+        std::cout << "MINRES: iteration " << std::setw(3) << 0 << ": ||r||_B = "
+                  << eta << '\n';
+    }
+
+    converged = 0;
+    final_iter = 0;
+    final_norm = eta;
+    if (eta <= norm_goal)
+    {
+        converged = 1;
+        return;
+    }
+
+    v1_ /= beta;
+    u1_ /= beta;
+    oper->Mult(u1_, q1_);
+    v0_ = 0.0;
+    u0_ = 0.0;
+    q0_ = 0.0;
+
+    double gamma0 = 1.0, gamma1 = 1.0;
+    double sigma0 = 0.0, sigma1 = 0.0;
+
+    for (int it = 1; it <= max_iter; ++it)
+    {
+        if (prec)
+        {
+            prec->Mult(q1_, p_);
+        }
+        else
+        {
+            p_ = q1_;
+        }
+
+        double local[2] = { u1_ * q1_, q1_ * p_ };
+        double global[2];
+        MPI_Request request;
+        StartSum(comm_, local, global, 2, request);
+
+        // A B A u, from which A u of the next Lanczos vector is recovered
+        oper->Mult(p_, t_);
+
+        FinishSum(request);
+        const double alpha = global[0];
+
+        // the previous Lanczos vector is zero in the first iteration
+        const double beta_lanczos = (it > 1) ? beta : 0.0;
+
+        // next (unnormalized) Lanczos vector, B v0 and A B v0
+        v0_ *= -beta_lanczos;
+        v0_.Add(-alpha, v1_);
+        v0_ += q1_;
+        u0_ *= -beta_lanczos;
+        u0_.Add(-alpha, u1_);
+        u0_ += p_;
+        q0_ *= -beta_lanczos;
+        q0_.Add(-alpha, q1_);
+        q0_ += t_;
+
+        // the fused formula suffers from cancellation when the Krylov space is
+        // (nearly) invariant, the inner product is then computed explicitly
+        double beta_new2 = global[1] - alpha * alpha - beta_lanczos * beta_lanczos;
+        if (beta_new2 < 1e-8 * global[1])
+        {
+            beta_new2 = std::max(Dot(v0_, u0_), 0.0);
+        }
+        const double beta_new = std::sqrt(beta_new2);
+
+        // Givens rotations, as in mfem::MINRESSolver
+        const double delta = gamma1 * alpha - gamma0 * sigma1 * beta;
+        const double rho3 = sigma0 * beta;
+        const double rho2 = sigma1 * alpha + gamma0 * gamma1 * beta;
+        const double rho1 = std::hypot(delta, beta_new);
+
+        if (it == 1)
+        {
+            w0_.Set(1.0 / rho1, u1_);
+        }
+        else if (it == 2)
+        {
+            add(1.0 / rho1, u1_, -rho2 / rho1, w1_, w0_);
+        }
+        else
+        {
+            add(-rho3 / rho1, w0_, -rho2 / rho1, w1_, w0_);
+            w0_.Add(1.0 / rho1, u1_);
+        }
+
+        gamma0 = gamma1;
+        gamma1 = delta / rho1;
+
+        x.Add(gamma1 * eta, w0_);
+
+        sigma0 = sigma1;
+        sigma1 = beta_new / rho1;
+
+        eta = -sigma1 * eta;
+
+        if (print_level == 1)
+        {
+            std::cout << "MINRES: iteration " << std::setw(3) << it << ": ||r||_B = "
+                      << std::fabs(eta) << '\n';
+        }
+
+        final_iter = it;
+        final_norm = std::fabs(eta);
+
+        if (std::fabs(eta) <= norm_goal || beta_new == 0.0)
+        {
+            converged = (std::fabs(eta) <= norm_goal);
+            break;
+        }
+
+        v0_ /= beta_new;
+        u0_ /= beta_new;
+        q0_ /= beta_new;
+
+        v0_.Swap(v1_);
+        u0_.Swap(u1_);
+        q0_.Swap(q1_);
+        w0_.Swap(w1_);
+
+        beta = beta_new;
+    }
+
+    if (print_level == 2)
+    {
+        std::cout << "MINRES: number of iterations: " << final_iter << '\n';
+    }
+    if (!converged && print_level >= 0)
+    {
+        std::cout << "MINRES: No convergence!\n";
+    }
+}
+
+} // namespace smoothg
@@ -0,0 +1,89 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file PipelinedKrylov.hpp
+
+    @brief Pipelined variants of preconditioned CG and MINRES.
+
+    Each iteration of these solvers needs a single global reduction, which
+    is started with MPI_Iallreduce and completed after a matrix-vector
+    product (and for CG also a preconditioner application) that does not
+    depend on its result. On coarse levels, where the local work is small,
+    the latency of the reductions is then hidden behind the local work.
+
+    The recurrences carry more vectors and are slightly less stable than the
+    standard ones, the attainable accuracy may be a bit worse.
+*/
+
+#ifndef __PIPELINEDKRYLOV_HPP__
+#define __PIPELINEDKRYLOV_HPP__
+
+#include "mfem.hpp"
+
+namespace smoothg
+{
+
+/**
+   @brief Pipelined preconditioned conjugate gradient.
+
+   Algorithm 4 of Ghysels and Vanroose, Parallel Computing 40 (2014). The
+   stopping criterion is the one of mfem::CGSolver, i.e., on the
+   preconditioned residual norm \f$ (r, Br) \f$.
+*/
+class PipelinedCGSolver : public mfem::IterativeSolver
+{
+public:
+    explicit PipelinedCGSolver(MPI_Comm comm);
+
+    virtual void SetOperator(const mfem::Operator& op);
+
+    virtual void Mult(const mfem::Vector& b, mfem::Vector& x) const;
+
+private:
+    MPI_Comm comm_;
+
+    mutable mfem::Vector r_, u_, w_, m_, n_, z_, q_, s_, p_;
+};
+
+/**
+   @brief Preconditioned MINRES with one overlapped reduction per iteration.
+
+   The two inner products of the preconditioned Lanczos step are fused into
+   one by the Lanczos relations, \f$ \beta_{k+1}^2 = (Au_k, BAu_k) -
+   \alpha_k^2 - \beta_k^2 \f$, and the product of the operator with the
+   next Lanczos vector is obtained by recurrence from \f$ ABAu_k \f$, which
+   is computed while the reduction is in flight. When the fused formula
+   suffers from cancellation, the inner product is computed explicitly from
+   the Lanczos vectors (a blocking reduction). The Givens rotations and the
+   stopping criterion are the ones of mfem::MINRESSolver.
+*/
+class PipelinedMINRESSolver : public mfem::IterativeSolver
+{
+public:
+    explicit PipelinedMINRESSolver(MPI_Comm comm);
+
+    virtual void SetOperator(const mfem::Operator& op);
+
+    virtual void Mult(const mfem::Vector& b, mfem::Vector& x) const;
+
+private:
+    MPI_Comm comm_;
+
+    mutable mfem::Vector v0_, v1_, u0_, u1_, q0_, q1_, p_, t_, w0_, w1_;
+};
+
+} // namespace smoothg
+
+#endif /* __PIPELINEDKRYLOV_HPP__ */
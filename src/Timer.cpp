@@ -0,0 +1,151 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file
+
+    @brief Implements TimerRegistry
+*/
+
+#include "Timer.hpp"
+
+#include <set>
+#include <sstream>
+
+namespace smoothg
+{
+
+TimerRegistry& TimerRegistry::Get()
+{
+    static TimerRegistry registry;
+    return registry;
+}
+
+void TimerRegistry::Start(const std::string& name)
+{
+    assert(name.find('/') == std::string::npos);
+
+    open_paths_.push_back(open_paths_.empty() ? name : open_paths_.back() + "/" + name);
+    open_watches_.push_back(make_unique<mfem::StopWatch>());
+    open_watches_.back()->Start();
+}
+
+void TimerRegistry::Stop()
+{
+    MFEM_VERIFY(!open_paths_.empty(), "No timer region is open!");
+
+    open_watches_.back()->Stop();
+
+    Entry& entry = entries_[open_paths_.back()];
+    entry.time += open_watches_.back()->RealTime();
+    entry.count++;
+
+    open_paths_.pop_back();
+    open_watches_.pop_back();
+}
+
+void TimerRegistry::Clear()
+{
+    MFEM_VERIFY(open_paths_.empty(), "Cannot clear timers while a region is open!");
+    entries_.clear();
+}
+
+double TimerRegistry::Time(const std::string& path) const
+{
+    auto it = entries_.find(path);
+    return it == entries_.end() ? 0.0 : it->second.time;
+}
+
+picojson::object TimerRegistry::Serialize(MPI_Comm comm) const
+{
+    int num_procs;
+    MPI_Comm_size(comm, &num_procs);
+
+    // gather the region paths of every process, one per line
+    std::string local_paths;
+    for (const auto& entry : entries_)
+    {
+        local_paths += entry.first + "\n";
+    }
+
+    int local_length = local_paths.size();
+    std::vector<int> lengths(num_procs);
+    MPI_Allgather(&local_length, 1, MPI_INT, lengths.data(), 1, MPI_INT, comm);
+
+    std::vector<int> displs(num_procs + 1, 0);
+    for (int i = 0; i < num_procs; ++i)
+    {
+        displs[i + 1] = displs[i] + lengths[i];
+    }
+
+    std::vector<char> all_paths(displs[num_procs]);
+    MPI_Allgatherv(&local_paths[0], local_length, MPI_CHAR, all_paths.data(),
+                   lengths.data(), displs.data(), MPI_CHAR, comm);
+
+    std::set<std::string> paths;
+    std::istringstream path_stream(std::string(all_paths.begin(), all_paths.end()));
+    for (std::string path; std::getline(path_stream, path); )
+    {
+        paths.insert(path);
+    }
+
+    // reduce in the (sorted, identical on all processes) order of paths
+    const int num_paths = paths.size();
+    std::vector<double> time(num_paths), min_time(num_paths);
+    std::vector<double> max_time(num_paths), sum_time(num_paths);
+    std::vector<int> count(num_paths), max_count(num_paths);
+
+    int k = 0;
+    for (const auto& path : paths)
+    {
+        auto it = entries_.find(path);
+        time[k] = it == entries_.end() ? 0.0 : it->second.time;
+        count[k] = it == entries_.end() ? 0 : it->second.count;
+        k++;
+    }
+
+    MPI_Allreduce(time.data(), min_time.data(), num_paths, MPI_DOUBLE, MPI_MIN, comm);
+    MPI_Allreduce(time.data(), max_time.data(), num_paths, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(time.data(), sum_time.data(), num_paths, MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Allreduce(count.data(), max_count.data(), num_paths, MPI_INT, MPI_MAX, comm);
+
+    picojson::object serialize;
+    k = 0;
+    for (const auto& path : paths)
+    {
+        picojson::object timing;
+        timing["min"] = picojson::value(min_time[k]);
+        timing["max"] = picojson::value(max_time[k]);
+        timing["avg"] = picojson::value(sum_time[k] / num_procs);
+        timing["count"] = picojson::value((double) max_count[k]);
+        serialize[path] = picojson::value(timing);
+        k++;
+    }
+
+    return serialize;
+}
+
+void TimerRegistry::Print(MPI_Comm comm, std::ostream& out, bool pretty) const
+{
+    picojson::object serialize = Serialize(comm);
+
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+    if (myid == 0)
+    {
+        out << picojson::value(serialize).serialize(pretty) << std::endl;
+    }
+}
+
+} // namespace smoothg
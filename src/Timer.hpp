@@ -0,0 +1,118 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/** @file Timer.hpp
+
+    @brief Hierarchical phase timers for setup and solve.
+
+    Timed regions nest: a region opened while another one is running is
+    recorded under the path "outer/inner". Timings are accumulated per path
+    in a process-wide registry and can be reduced over a communicator.
+*/
+
+#ifndef __TIMER_HPP__
+#define __TIMER_HPP__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utilities.hpp"
+
+namespace smoothg
+{
+
+/**
+   @brief Process-wide registry of accumulated timings of named regions.
+
+   Regions are opened with Start() and closed with Stop() in LIFO order,
+   usually through ScopedTimer. The registry is not thread safe, regions
+   must be opened and closed outside of OpenMP parallel regions.
+*/
+class TimerRegistry
+{
+public:
+    /// @return the registry shared by the whole process
+    static TimerRegistry& Get();
+
+    /// Open a region named name nested in the currently open region
+    void Start(const std::string& name);
+
+    /// Close the most recently opened region
+    void Stop();
+
+    /// Remove all recorded timings (no region may be open)
+    void Clear();
+
+    /// Accumulated time (local to this process) of a region path, 0 if absent
+    double Time(const std::string& path) const;
+
+    /**
+       @brief Reduce timings over comm (collective).
+
+       Regions recorded on some processes only are counted as 0 seconds on
+       the others. Every entry has keys "min", "max", "avg" (seconds over
+       processes) and "count" (largest number of calls on any process).
+    */
+    picojson::object Serialize(MPI_Comm comm) const;
+
+    /// Print Serialize(comm) on rank 0 of comm (collective)
+    void Print(MPI_Comm comm, std::ostream& out = std::cout, bool pretty = true) const;
+
+private:
+    TimerRegistry() = default;
+
+    struct Entry
+    {
+        double time = 0.0;
+        int count = 0;
+    };
+
+    std::map<std::string, Entry> entries_;
+    std::vector<std::string> open_paths_;
+    std::vector<std::unique_ptr<mfem::StopWatch>> open_watches_;
+};
+
+/**
+   @brief Time the enclosing scope in TimerRegistry::Get().
+
+   @code
+   {
+       ScopedTimer timer("coarse-matrix");
+       ...
+   }
+   @endcode
+*/
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const std::string& name)
+    {
+        TimerRegistry::Get().Start(name);
+    }
+
+    ~ScopedTimer()
+    {
+        TimerRegistry::Get().Stop();
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+} // namespace smoothg
+
+#endif /* __TIMER_HPP__ */
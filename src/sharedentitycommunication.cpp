@@ -18,16 +18,267 @@
 
    \brief A class to manage shared entity communication
 
-   This particular file contains specific instantiations for data types.
-   You need to reimplement each of these routines for each datatype
-   you want to communicate.
+   This particular file contains the communication plan and specific
+   instantiations for data types. You need to reimplement each of these
+   routines for each datatype you want to communicate.
 */
 
 #include "sharedentitycommunication.hpp"
 
+#include <algorithm>
+
 namespace smoothg
 {
 
+SharedEntityCommPlan::SharedEntityCommPlan(
+    MPI_Comm comm,
+    hypre_ParCSRMatrix* entity_trueentity,
+    mfem::Table* entity_proc,
+    int* entity_master)
+    :
+    comm_(comm),
+    entity_proc_(entity_proc),
+    owns_entity_proc_(false),
+    entity_master_(entity_master),
+    owns_entity_master_(false)
+{
+    MPI_Comm_size(comm_, &comm_size_);
+    MPI_Comm_rank(comm_, &comm_rank_);
+
+    BuildLists(entity_trueentity);
+}
+
+// this construction might be simpler if we used SharingMap instead of
+// hypre_ParCSRMatrix
+SharedEntityCommPlan::SharedEntityCommPlan(
+    MPI_Comm comm,
+    hypre_ParCSRMatrix* entity_trueentity)
+    :
+    comm_(comm),
+    owns_entity_proc_(true),
+    owns_entity_master_(true)
+{
+    MPI_Comm_size(comm_, &comm_size_);
+    MPI_Comm_rank(comm_, &comm_rank_);
+
+    BuildEntityProc(entity_trueentity);
+    BuildLists(entity_trueentity);
+}
+
+SharedEntityCommPlan::~SharedEntityCommPlan()
+{
+    if (owns_entity_proc_)
+        delete entity_proc_;
+    if (owns_entity_master_)
+        delete [] entity_master_;
+}
+
+void SharedEntityCommPlan::BuildEntityProc(hypre_ParCSRMatrix* entity_trueentity)
+{
+    const int* ete_diag_I = entity_trueentity->diag->i;
+    const int* ete_diag_J = entity_trueentity->diag->j;
+    const int* ete_offd_I = entity_trueentity->offd->i;
+    const int* ete_offd_J = entity_trueentity->offd->j;
+
+    hypre_ParCSRCommPkg* comm_pkg = entity_trueentity->comm_pkg;
+    // we need to directly access the comm_pkg, so insure it has been built
+    if (!comm_pkg)
+    {
+        hypre_MatvecCommPkgCreate(entity_trueentity);
+        comm_pkg = entity_trueentity->comm_pkg;
+    }
+
+    entity_proc_ = new mfem::Table;
+    int num_entities =
+        entity_trueentity->row_starts[1] - entity_trueentity->row_starts[0];
+    entity_master_ = new int[num_entities];
+    entity_proc_->MakeI(num_entities);
+    std::vector<std::pair<int, int> > trueentity_proc;
+    for (int send = 0; send < comm_pkg->num_sends; ++send)
+    {
+        int proc = comm_pkg->send_procs[send];
+        for (int j = comm_pkg->send_map_starts[send];
+             j < comm_pkg->send_map_starts[send + 1];
+             ++j)
+        {
+            int trueentity = comm_pkg->send_map_elmts[j];
+            trueentity_proc.push_back(std::make_pair(trueentity, proc));
+        }
+    }
+    for (int entity = 0; entity < num_entities; ++entity)
+    {
+        MFEM_ASSERT((ete_offd_I[entity + 1] - ete_offd_I[entity] == 1) ||
+                    (ete_offd_I[entity + 1] - ete_offd_I[entity] == 0),
+                    "entity_trueentity has more than one column per row!");
+        entity_master_[entity] = comm_rank_;
+        entity_proc_->AddAColumnInRow(entity);
+        if (ete_offd_I[entity + 1] - ete_offd_I[entity] == 0) // local
+        {
+            int trueentity = ete_diag_J[ete_diag_I[entity]];
+            for (unsigned int i = 0; i < trueentity_proc.size(); ++i)
+            {
+                if (trueentity == trueentity_proc[i].first)
+                {
+                    entity_proc_->AddAColumnInRow(entity);
+                }
+            }
+        }
+        if (ete_offd_I[entity + 1] - ete_offd_I[entity] == 1)
+        {
+            int col = ete_offd_J[ete_offd_I[entity]];
+            for (int recv = 0; recv < comm_pkg->num_recvs; ++recv)
+            {
+                int proc = comm_pkg->recv_procs[recv];
+                for (int k = comm_pkg->recv_vec_starts[recv];
+                     k < comm_pkg->recv_vec_starts[recv + 1];
+                     ++k)
+                {
+                    if (k == col)
+                    {
+                        // next line is really unnecessary, we never touch the
+                        // unowned rows of entity_proc_
+                        entity_proc_->AddAColumnInRow(entity);
+                        entity_master_[entity] =
+                            (proc < entity_master_[entity]) ? proc : entity_master_[entity];
+                    }
+                }
+            }
+        }
+    }
+    entity_proc_->MakeJ();
+    for (int entity = 0; entity < num_entities; ++entity)
+    {
+        entity_proc_->AddConnection(entity, comm_rank_);
+        if (ete_offd_I[entity + 1] - ete_offd_I[entity] == 0)
+        {
+            int trueentity = ete_diag_J[ete_diag_I[entity]];
+            for (unsigned int i = 0; i < trueentity_proc.size(); ++i)
+            {
+                if (trueentity == trueentity_proc[i].first)
+                {
+                    int proc = trueentity_proc[i].second;
+                    entity_proc_->AddConnection(entity, proc);
+                }
+            }
+        }
+        if (ete_offd_I[entity + 1] - ete_offd_I[entity] == 1)
+        {
+            int col = ete_offd_J[ete_offd_I[entity]];
+            for (int recv = 0; recv < comm_pkg->num_recvs; ++recv)
+            {
+                int proc = comm_pkg->recv_procs[recv];
+                for (int k = comm_pkg->recv_vec_starts[recv];
+                     k < comm_pkg->recv_vec_starts[recv + 1];
+                     ++k)
+                {
+                    if (k == col)
+                    {
+                        entity_proc_->AddConnection(entity, proc);
+                    }
+                }
+            }
+        }
+    }
+    entity_proc_->ShiftUpI();
+    entity_proc_->Finalize();
+}
+
+/**
+   Master and slave lists of every neighbor are sorted by (global) true
+   entity, so both sides of a message agree on its layout.
+
+   We assume Hypre is doing assumed_partition, and that entity_trueentity
+   has exactly one entry per row.
+*/
+void SharedEntityCommPlan::BuildLists(hypre_ParCSRMatrix* entity_trueentity)
+{
+    const int* ete_diag_I = entity_trueentity->diag->i;
+    const int* ete_diag_J = entity_trueentity->diag->j;
+    const int* ete_offd_I = entity_trueentity->offd->i;
+    const int* ete_offd_J = entity_trueentity->offd->j;
+    const HYPRE_Int* ete_colmap = entity_trueentity->col_map_offd;
+    const HYPRE_Int first_trueentity = entity_trueentity->col_starts[0];
+
+    num_entities_ = entity_proc_->Size();
+
+    // (neighbor proc, true entity, entity, column) for every message entry
+    std::vector<std::vector<int>> master_entries;
+    std::vector<std::vector<int>> slave_entries;
+
+    for (int entity = 0; entity < num_entities_; ++entity)
+    {
+        const int trueentity = (ete_offd_I[entity + 1] > ete_offd_I[entity]) ?
+                               ete_colmap[ete_offd_J[ete_offd_I[entity]]] :
+                               first_trueentity + ete_diag_J[ete_diag_I[entity]];
+        if (OwnedByMe(entity))
+        {
+            const int* neighbor_row = entity_proc_->GetRow(entity);
+            int column = 0;
+            for (int neighbor = 0; neighbor < NumNeighbors(entity); ++neighbor)
+            {
+                if (neighbor_row[neighbor] != comm_rank_)
+                {
+                    master_entries.push_back({ neighbor_row[neighbor], trueentity,
+                                               entity, column++ });
+                }
+            }
+        }
+        else
+        {
+            slave_entries.push_back({ Owner(entity), trueentity, entity, 0 });
+        }
+    }
+    std::sort(master_entries.begin(), master_entries.end());
+    std::sort(slave_entries.begin(), slave_entries.end());
+
+    for (const auto& entry : master_entries)
+    {
+        neighbor_procs_.push_back(entry[0]);
+    }
+    for (const auto& entry : slave_entries)
+    {
+        neighbor_procs_.push_back(entry[0]);
+    }
+    std::sort(neighbor_procs_.begin(), neighbor_procs_.end());
+    neighbor_procs_.erase(std::unique(neighbor_procs_.begin(), neighbor_procs_.end()),
+                          neighbor_procs_.end());
+
+    const int num_neighbors = neighbor_procs_.size();
+    master_offsets_.assign(num_neighbors + 1, 0);
+    slave_offsets_.assign(num_neighbors + 1, 0);
+    slave_index_.assign(num_entities_, -1);
+
+    int n = 0;
+    for (const auto& entry : master_entries)
+    {
+        while (neighbor_procs_[n] != entry[0])
+        {
+            master_offsets_[++n] = master_entities_.size();
+        }
+        master_entities_.push_back(entry[2]);
+        master_columns_.push_back(entry[3]);
+    }
+    while (n < num_neighbors)
+    {
+        master_offsets_[++n] = master_entities_.size();
+    }
+
+    n = 0;
+    for (const auto& entry : slave_entries)
+    {
+        while (neighbor_procs_[n] != entry[0])
+        {
+            slave_offsets_[++n] = slave_entities_.size();
+        }
+        slave_index_[entry[2]] = slave_entities_.size();
+        slave_entities_.push_back(entry[2]);
+    }
+    while (n < num_neighbors)
+    {
+        slave_offsets_[++n] = slave_entities_.size();
+    }
+}
+
 template <>
 void SharedEntityCommunication<mfem::DenseMatrix>::SetSizeSpecifier()
 {
@@ -53,28 +304,26 @@ void SharedEntityCommunication<mfem::DenseMatrix>::CopyData(
 }
 
 template <>
-void SharedEntityCommunication<mfem::DenseMatrix>::SendData(
-    const mfem::DenseMatrix& mat, int recipient, int tag, MPI_Request* request)
+int SharedEntityCommunication<mfem::DenseMatrix>::PackedBytes(const int* sizes)
 {
-    MPI_Isend(mat.Data(), mat.Height() * mat.Width(), MPI_DOUBLE,
-              recipient, tag, comm_, request);
+    return sizes[0] * sizes[1] * sizeof(double);
 }
 
 template <>
-void SharedEntityCommunication<mfem::DenseMatrix>::ReceiveData(
-    mfem::DenseMatrix& mat, int* sizes, int sender, int tag,
-    MPI_Request* request)
+void SharedEntityCommunication<mfem::DenseMatrix>::PackData(
+    const mfem::DenseMatrix& mat, char* buffer)
+{
+    memcpy(buffer, mat.Data(), mat.Height() * mat.Width() * sizeof(double));
+}
+
+template <>
+void SharedEntityCommunication<mfem::DenseMatrix>::UnpackData(
+    mfem::DenseMatrix& mat, const int* sizes, const char* buffer)
 {
     const int rows = sizes[0];
     const int columns = sizes[1];
     mat.SetSize(rows, columns);
-    MPI_Irecv(mat.Data(),
-              rows * columns,
-              MPI_DOUBLE,
-              sender,
-              tag,
-              comm_,
-              request);
+    memcpy(mat.Data(), buffer, rows * columns * sizeof(double));
 }
 
 template class SharedEntityCommunication<mfem::DenseMatrix>;
@@ -103,21 +352,29 @@ void SharedEntityCommunication<mfem::SparseMatrix>::CopyData(
 }
 
 template <>
-void SharedEntityCommunication<mfem::SparseMatrix>::SendData(
-    const mfem::SparseMatrix& mat, int recipient, int tag, MPI_Request* request)
+int SharedEntityCommunication<mfem::SparseMatrix>::PackedBytes(const int* sizes)
+{
+    return (sizes[0] + 1 + sizes[2]) * sizeof(int) + sizes[2] * sizeof(double);
+}
+
+/// the values come first, so that they are aligned in the message
+template <>
+void SharedEntityCommunication<mfem::SparseMatrix>::PackData(
+    const mfem::SparseMatrix& mat, char* buffer)
 {
-    MPI_Isend(mat.GetI(), mat.Height() + 1, MPI_INT,
-              recipient, tag, comm_, request);
-    MPI_Isend(mat.GetJ(), mat.NumNonZeroElems(), MPI_INT,
-              recipient, tag + 1, comm_, request);
-    MPI_Isend(mat.GetData(), mat.NumNonZeroElems(), MPI_DOUBLE,
-              recipient, tag + 2, comm_, request);
+    const int rows = mat.Height();
+    const int nnz = mat.NumNonZeroElems();
+
+    memcpy(buffer, mat.GetData(), nnz * sizeof(double));
+    buffer += nnz * sizeof(double);
+    memcpy(buffer, mat.GetI(), (rows + 1) * sizeof(int));
+    buffer += (rows + 1) * sizeof(int);
+    memcpy(buffer, mat.GetJ(), nnz * sizeof(int));
 }
 
 template <>
-void SharedEntityCommunication<mfem::SparseMatrix>::ReceiveData(
-    mfem::SparseMatrix& mat, int* sizes, int sender, int tag,
-    MPI_Request* request)
+void SharedEntityCommunication<mfem::SparseMatrix>::UnpackData(
+    mfem::SparseMatrix& mat, const int* sizes, const char* buffer)
 {
     const int rows = sizes[0];
     const int columns = sizes[1];
@@ -127,9 +384,11 @@ void SharedEntityCommunication<mfem::SparseMatrix>::ReceiveData(
     int* mat_j = new int[nnz];
     double* mat_data = new double[nnz];
 
-    MPI_Irecv(mat_i, rows + 1, MPI_INT, sender, tag, comm_, request);
-    MPI_Irecv(mat_j, nnz, MPI_INT, sender, tag + 1, comm_, request);
-    MPI_Irecv(mat_data, nnz, MPI_DOUBLE, sender, tag + 2, comm_, request);
+    memcpy(mat_data, buffer, nnz * sizeof(double));
+    buffer += nnz * sizeof(double);
+    memcpy(mat_i, buffer, (rows + 1) * sizeof(int));
+    buffer += (rows + 1) * sizeof(int);
+    memcpy(mat_j, buffer, nnz * sizeof(int));
 
     mfem::SparseMatrix mat_tmp(mat_i, mat_j, mat_data, rows, columns);
     mat.Swap(mat_tmp);
@@ -159,26 +418,24 @@ void SharedEntityCommunication<mfem::Vector>::CopyData(
 }
 
 template <>
-void SharedEntityCommunication<mfem::Vector>::SendData(
-    const mfem::Vector& vec, int recipient, int tag, MPI_Request* request)
+int SharedEntityCommunication<mfem::Vector>::PackedBytes(const int* sizes)
+{
+    return sizes[0] * sizeof(double);
+}
+
+template <>
+void SharedEntityCommunication<mfem::Vector>::PackData(
+    const mfem::Vector& vec, char* buffer)
 {
-    MPI_Isend(vec.GetData(), vec.Size(), MPI_DOUBLE,
-              recipient, tag, comm_, request);
+    memcpy(buffer, vec.GetData(), vec.Size() * sizeof(double));
 }
 
 template <>
-void SharedEntityCommunication<mfem::Vector>::ReceiveData(
-    mfem::Vector& vec, int* sizes, int sender, int tag, MPI_Request* request)
+void SharedEntityCommunication<mfem::Vector>::UnpackData(
+    mfem::Vector& vec, const int* sizes, const char* buffer)
 {
-    const int size = sizes[0];
-    vec.SetSize(size);
-    MPI_Irecv(vec.GetData(),
-              size,
-              MPI_DOUBLE,
-              sender,
-              tag,
-              comm_,
-              request);
+    vec.SetSize(sizes[0]);
+    memcpy(vec.GetData(), buffer, sizes[0] * sizeof(double));
 }
 
 template class SharedEntityCommunication<mfem::Vector>;
@@ -35,3 +35,9 @@
 #include "MLMCManager.hpp"
 #include "Hierarchy.hpp"
 #include "NonlinearSolver.hpp"
+#include "BinaryGraph.hpp"
+#include "Timer.hpp"
+#include "BatchedDenseMatrices.hpp"
+#include "PipelinedKrylov.hpp"
+#include "AgglomeratedSolver.hpp"
+#include "HierarchyPreconditioner.hpp"
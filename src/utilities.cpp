@@ -18,6 +18,8 @@
     @brief Implements some shared code and utility functions.
 */
 
+#include <algorithm>
+
 #include <mfem.hpp>
 
 #include "utilities.hpp"
@@ -228,19 +230,32 @@ void ReadVertexEdge(std::ifstream& graphFile, mfem::SparseMatrix& out)
         mfem::mfem_error("Error in opening the graph file");
     graphFile >> nvertices;
     graphFile >> nedges;
+    MFEM_VERIFY(graphFile && nvertices >= 0 && nedges >= 0,
+                "Error in reading the size of the graph");
 
-    int* vertex_edge_i = new int[nvertices + 1];
-    int* vertex_edge_j = new int[nedges * 2];
-    double* vertex_edge_data = new double[nedges * 2];
+    // held in unique_ptr until ownership is handed to SparseMatrix
+    std::unique_ptr<int[]> vertex_edge_i(new int[nvertices + 1]);
     for (int i = 0; i < nvertices + 1; i++)
         graphFile >> vertex_edge_i[i];
-    for (int i = 0; i < nedges * 2; i++)
+    MFEM_VERIFY(graphFile && vertex_edge_i[0] == 0,
+                "Error in reading the I array of the graph");
+
+    const int nnz = vertex_edge_i[nvertices];
+    std::unique_ptr<int[]> vertex_edge_j(new int[nnz]);
+    for (int i = 0; i < nnz; i++)
         graphFile >> vertex_edge_j[i];
-    for (int i = 0; i < nedges * 2; i++)
-        vertex_edge_data[i] = 1.0;
-    //graphFile >> vertex_edge_data[i];
-    mfem::SparseMatrix vertex_edge(vertex_edge_i, vertex_edge_j,
-                                   vertex_edge_data, nvertices, nedges);
+    MFEM_VERIFY(graphFile, "Error in reading the J array of the graph");
+
+    // the data array is optional, it is all ones if not in the file
+    std::unique_ptr<double[]> vertex_edge_data(new double[nnz]);
+    int ndata = 0;
+    while (ndata < nnz && graphFile >> vertex_edge_data[ndata])
+        ndata++;
+    MFEM_VERIFY(ndata == 0 || ndata == nnz, "Incomplete data array in the graph file");
+    std::fill_n(vertex_edge_data.get() + ndata, nnz - ndata, 1.0);
+
+    mfem::SparseMatrix vertex_edge(vertex_edge_i.release(), vertex_edge_j.release(),
+                                   vertex_edge_data.release(), nvertices, nedges);
     out.Swap(vertex_edge);
 }
 
@@ -479,6 +494,19 @@ void GetElementColoring(mfem::Array<int>& colors, const mfem::SparseMatrix& el_e
     }
 }
 
+mfem::Array<int> Partitioning(const mfem::SparseMatrix& agg_vert)
+{
+    mfem::Array<int> partitioning(agg_vert.Width());
+    for (int agg = 0; agg < agg_vert.NumRows(); ++agg)
+    {
+        for (int j = agg_vert.GetI()[agg]; j < agg_vert.GetI()[agg + 1]; ++j)
+        {
+            partitioning[agg_vert.GetJ()[j]] = agg;
+        }
+    }
+    return partitioning;
+}
+
 std::set<unsigned> FindNonZeroColumns(const mfem::SparseMatrix& mat)
 {
     std::set<unsigned> cols;
@@ -182,7 +182,9 @@ private:
    - number of edges
    - I array
    - J array
-   - data array
+   - data array (optional, all ones if absent)
+
+   For large graphs, see the binary format in BinaryGraph.hpp.
 
    @param graphFile the (open) stream to read
    @param out a reference to the returned matrix
@@ -232,6 +234,9 @@ void InvRescaleVector(const mfem::Vector& scaling, mfem::Vector& vec);
 */
 void GetElementColoring(mfem::Array<int>& colors, const mfem::SparseMatrix& el_el);
 
+/// @return partition of the vertices (columns) given by the aggregates (rows) of agg_vert
+mfem::Array<int> Partitioning(const mfem::SparseMatrix& agg_vert);
+
 /// @return columns of mat that contains nonzeros
 std::set<unsigned> FindNonZeroColumns(const mfem::SparseMatrix& mat);
 
@@ -0,0 +1,82 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file TestUtilities.hpp
+   @brief Helpers and fixtures shared by the tests in testcode.
+*/
+
+#ifndef __TESTUTILITIES_HPP__
+#define __TESTUTILITIES_HPP__
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "mfem.hpp"
+#include "../src/smoothG.hpp"
+
+namespace smoothg
+{
+
+/// Relative difference ||x - y|| / ||x|| of two distributed vectors
+inline double RelativeDiff(MPI_Comm comm, const mfem::Vector& x, const mfem::Vector& y)
+{
+    mfem::Vector diff(x);
+    diff -= y;
+    return std::sqrt(mfem::InnerProduct(comm, diff, diff) / mfem::InnerProduct(comm, x, x));
+}
+
+/**
+   @brief Compare the sigma and u blocks of two mixed solutions.
+
+   @param ref reference solution
+   @param sol solution to be checked
+   @param tol tolerance on the relative difference of each block
+   @param name test name used in the error message (printed on rank 0)
+
+   @return 1 if the solutions differ by more than tol, 0 otherwise
+*/
+inline int CompareSolutions(MPI_Comm comm, const mfem::BlockVector& ref,
+                            const mfem::BlockVector& sol, double tol,
+                            const std::string& name)
+{
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    const double sigma_diff = RelativeDiff(comm, ref.GetBlock(0), sol.GetBlock(0));
+    const double u_diff = RelativeDiff(comm, ref.GetBlock(1), sol.GetBlock(1));
+    if (sigma_diff > tol || u_diff > tol)
+    {
+        if (myid == 0)
+        {
+            std::cerr << name << ": solutions differ by " << sigma_diff << " (sigma) and "
+                      << u_diff << " (u)!\n";
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/// Watts-Strogatz graph (mean degree 6, rewiring probability 0.1, fixed seed)
+inline Graph TestGraph(MPI_Comm comm, int num_vertices)
+{
+    mfem::SparseMatrix vertex_edge = GenerateGraph(comm, num_vertices, 6, 0.1, 0.0);
+    return Graph(comm, vertex_edge);
+}
+
+} // namespace smoothg
+
+#endif /* __TESTUTILITIES_HPP__ */
@@ -280,6 +280,196 @@ int test_fe_dense()
         return 1;
 }
 
+// edge to vertex (signed) incidence of a structured nx by ny grid graph, transposed
+mfem::SparseMatrix build_grid_graph_D(int nx, int ny)
+{
+    const int num_edges = (nx - 1) * ny + nx * (ny - 1);
+    mfem::SparseMatrix D(nx * ny, num_edges);
+
+    int edge = 0;
+    for (int j = 0; j < ny; ++j)
+    {
+        for (int i = 0; i < nx; ++i)
+        {
+            const int vertex = j * nx + i;
+            if (i + 1 < nx)
+            {
+                D.Add(vertex, edge, 1.0);
+                D.Add(vertex + 1, edge++, -1.0);
+            }
+            if (j + 1 < ny)
+            {
+                D.Add(vertex, edge, 1.0);
+                D.Add(vertex + nx, edge++, -1.0);
+            }
+        }
+    }
+    D.Finalize();
+    return D;
+}
+
+/// Matrix M on the edges of a graph, diagonal or tridiagonal
+mfem::SparseMatrix build_edge_mass_matrix(int num_edges, bool diagonal_M)
+{
+    mfem::SparseMatrix M(num_edges, num_edges);
+    for (int i = 0; i < num_edges; ++i)
+    {
+        M.Add(i, i, 1.0 + (i % 7) / 3.0);
+        if (!diagonal_M && i + 1 < num_edges)
+        {
+            M.Add(i, i + 1, 0.25);
+            M.Add(i + 1, i, 0.25);
+        }
+    }
+    M.Finalize();
+    return M;
+}
+
+/**
+   Largest error of the Rayleigh quotients of evects (as eigenvectors of
+   D M^{-1} D^T) compared to evals, and of the relative residuals.
+*/
+double eigenpair_error(const mfem::SparseMatrix& M, const mfem::SparseMatrix& D,
+                       mfem::DenseMatrix& evects, const mfem::Vector& evals)
+{
+    mfem::UMFPackSolver M_inv(M);
+    mfem::Vector evect, sigma(D.Width()), Minv_sigma(D.Width()), A_evect(D.Height());
+    double max_error = 0.0;
+    for (int i = 0; i < evects.Width(); ++i)
+    {
+        evects.GetColumnReference(i, evect);
+        D.MultTranspose(evect, sigma);
+        M_inv.Mult(sigma, Minv_sigma);
+        D.Mult(Minv_sigma, A_evect);
+
+        const double eval = (evect * A_evect) / (evect * evect);
+        A_evect.Add(-eval, evect);
+        max_error = std::max(max_error, std::fabs(eval - evals[i]));
+        max_error = std::max(max_error, A_evect.Norml2() / evect.Norml2());
+        std::cout << i << ": " << eval << " (LAPACK: " << evals[i] << ")\n";
+    }
+    return max_error;
+}
+
+int report_lobpcg(const std::string& name, double max_error)
+{
+    std::cout << "LOBPCG max eigenpair error: " << max_error << std::endl;
+    if (max_error < 1.e-6)
+    {
+        std::cout << "LOBPCG test (" << name << ") passes." << std::endl;
+        return 0;
+    }
+    std::cout << "LOBPCG test (" << name << ") FAILS!" << std::endl;
+    return 1;
+}
+
+/**
+   Compare LOBPCG eigenpairs of D M^{-1} D^T on a grid graph with the
+   eigenvalues computed by LAPACK, for a diagonal and a non-diagonal M.
+   With a diagonal M, the assembled D M^{-1} D^T is also given to LOBPCG,
+   preconditioned by LocalGraphLaplacianInverse.
+*/
+int test_lobpcg(bool diagonal_M)
+{
+    const int num_ev = 5;
+    const int lobpcg_threshold = 50;
+    const std::string name = std::string(diagonal_M ? "" : "non-") + "diagonal M";
+
+    mfem::SparseMatrix D = build_grid_graph_D(12, 10);
+    mfem::SparseMatrix M = build_edge_mass_matrix(D.Width(), diagonal_M);
+
+    mfem::Vector dense_evals;
+    mfem::DenseMatrix dense_evects, dense_M, dense_D;
+    Full(M, dense_M);
+    Full(D, dense_D);
+    LocalEigenSolver dense_eigensolver(num_ev, 1.0);
+    dense_eigensolver.BlockCompute(dense_M, dense_D, dense_evals, dense_evects);
+
+    LocalEigenSolver eigensolver(num_ev, 1.0);
+    eigensolver.SetLOBPCGThreshold(lobpcg_threshold);
+    eigensolver.SetPrintLevel(1);
+    if (!eigensolver.UsesLOBPCG(D.Height()))
+    {
+        std::cout << "LOBPCG test (" << name << ") FAILS: LOBPCG is not used!" << std::endl;
+        return 1;
+    }
+
+    mfem::DenseMatrix evects;
+    eigensolver.BlockCompute(M, D, evects);
+    int out = report_lobpcg(name, eigenpair_error(M, D, evects, dense_evals));
+
+    if (diagonal_M)
+    {
+        mfem::Vector M_diag_inv;
+        M.GetDiag(M_diag_inv);
+        for (int i = 0; i < M_diag_inv.Size(); ++i)
+        {
+            M_diag_inv[i] = 1.0 / M_diag_inv[i];
+        }
+        mfem::SparseMatrix Minv_Dt = smoothg::Transpose(D);
+        Minv_Dt.ScaleRows(M_diag_inv);
+        mfem::SparseMatrix A = smoothg::Mult(D, Minv_Dt);
+
+        LocalGraphLaplacianInverse A_inv(M, D);
+        eigensolver.Compute(A, evects, &A_inv);
+        out += report_lobpcg("assembled " + name,
+                             eigenpair_error(M, D, evects, dense_evals));
+    }
+
+    return out;
+}
+
+/**
+   With rel_tol < 1, LOBPCG only keeps the eigenpairs with eigenvalue below
+   rel_tol times an estimate (from below) of the largest eigenvalue.
+*/
+int test_lobpcg_rel_tol()
+{
+    const int max_num_ev = 12;
+    const double rel_tol = 0.02;
+
+    mfem::SparseMatrix D = build_grid_graph_D(12, 10);
+    mfem::SparseMatrix M = build_edge_mass_matrix(D.Width(), true);
+
+    // all eigenvalues
+    mfem::Vector dense_evals;
+    mfem::DenseMatrix dense_evects, dense_M, dense_D;
+    Full(M, dense_M);
+    Full(D, dense_D);
+    LocalEigenSolver dense_eigensolver(D.Height(), 1.0);
+    dense_eigensolver.BlockCompute(dense_M, dense_D, dense_evals, dense_evects);
+    const double eig_max = dense_evals.Max();
+
+    LocalEigenSolver eigensolver(max_num_ev, rel_tol);
+    eigensolver.SetLOBPCGThreshold(50);
+    eigensolver.SetPrintLevel(1);
+    mfem::DenseMatrix evects;
+    eigensolver.BlockCompute(M, D, evects);
+    const int num_ev = evects.Width();
+
+    // the estimate of the largest eigenvalue is a lower bound, and is off
+    // by at most a factor 2 after the power iterations
+    int num_below_tol = 0, num_below_half_tol = 0;
+    for (int i = 0; i < dense_evals.Size(); ++i)
+    {
+        num_below_tol += dense_evals[i] < rel_tol * eig_max;
+        num_below_half_tol += dense_evals[i] < 0.5 * rel_tol * eig_max;
+    }
+    std::cout << "LOBPCG kept " << num_ev << " eigenpairs, " << num_below_tol
+              << " eigenvalues are below the cut-off." << std::endl;
+
+    int out = 0;
+    if (num_ev > num_below_tol || num_ev < num_below_half_tol || num_ev >= max_num_ev)
+    {
+        std::cout << "LOBPCG rel_tol test FAILS: wrong number of eigenpairs!" << std::endl;
+        out++;
+    }
+
+    mfem::Vector evals(dense_evals.GetData(), num_ev);
+    out += report_lobpcg("rel_tol", eigenpair_error(M, D, evects, evals));
+    return out;
+}
+
 int main(int argc, char* argv[])
 {
     int out = 0;
@@ -289,5 +479,8 @@ int main(int argc, char* argv[])
 #endif
     out += test_fd_dense();
     out += test_fe_dense();
+    out += test_lobpcg(true);
+    out += test_lobpcg(false);
+    out += test_lobpcg_rel_tol();
     return out;
 }
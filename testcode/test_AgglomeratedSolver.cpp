@@ -0,0 +1,97 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_AgglomeratedSolver.cpp
+   @brief Test that solving a coarse level on fewer processes gives the same
+          solution as solving it on all processes.
+*/
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    Graph graph = TestGraph(comm, 300);
+
+    UpscaleParameters param;
+    param.coarse_factor = 16;
+    param.max_evects = 2;
+    param.max_traces = 2;
+    Hierarchy hierarchy(graph, param);
+
+    mfem::BlockVector rhs(hierarchy.BlockOffsets(0));
+    rhs.GetBlock(0) = 0.0;
+    rhs.GetBlock(1).Randomize(myid);
+    par_orthogonalize_from_constant(rhs.GetBlock(1), graph.VertexStarts().Last());
+    mfem::BlockVector coarse_rhs = hierarchy.Restrict(0, rhs);
+
+    MixedMatrix& coarse_mgL = hierarchy.GetMatrix(1);
+    coarse_mgL.BuildM();
+
+    BlockSolverFalse reference(coarse_mgL);
+    reference.SetRelTol(1e-12);
+
+    // everything on one process
+    AgglomeratedSolver agglomerated(coarse_mgL, nullptr, 1 << 30);
+    agglomerated.SetRelTol(1e-12);
+
+    int failures = 0;
+    if (agglomerated.NumActiveProcs() != 1)
+    {
+        failures++;
+        if (myid == 0)
+        {
+            std::cerr << "System should be agglomerated on one process!\n";
+        }
+    }
+
+    failures += CompareSolutions(comm, reference.Solve(coarse_rhs),
+                                 agglomerated.Solve(coarse_rhs), 1e-8, "AgglomeratedSolver");
+
+    mfem::Vector scaling_inverse(coarse_mgL.GetGraph().NumVertices());
+    for (int i = 0; i < scaling_inverse.Size(); ++i)
+    {
+        scaling_inverse[i] = 1.0 + ((i + myid) % 3);
+    }
+    reference.UpdateElemScaling(scaling_inverse);
+    agglomerated.UpdateElemScaling(scaling_inverse);
+    failures += CompareSolutions(comm, reference.Solve(coarse_rhs),
+                                 agglomerated.Solve(coarse_rhs), 1e-8,
+                                 "AgglomeratedSolver (rescaled)");
+
+    // the Krylov solver starts from the initial guess, which must not shift the pressure
+    mfem::BlockVector agglomerated_sol(coarse_mgL.BlockOffsets());
+    agglomerated_sol.Randomize(myid + 1);
+    agglomerated.Mult(coarse_rhs, agglomerated_sol);
+    failures += CompareSolutions(comm, reference.Solve(coarse_rhs), agglomerated_sol, 1e-8,
+                                 "AgglomeratedSolver (nonzero initial guess)");
+
+    // through Hierarchy, coarse level is agglomerated when run in parallel
+    param.agglomerate_dofs = 1 << 30;
+    Hierarchy agglomerated_hierarchy(graph, param);
+    agglomerated_hierarchy.SetRelTol(1e-12);
+    hierarchy.SetRelTol(1e-12);
+    failures += CompareSolutions(comm, hierarchy.Solve(1, coarse_rhs),
+                                 agglomerated_hierarchy.Solve(1, coarse_rhs), 1e-8, "Hierarchy");
+
+    return failures;
+}
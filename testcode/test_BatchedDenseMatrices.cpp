@@ -0,0 +1,123 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_BatchedDenseMatrices.cpp
+   @brief Compare the batched dense kernels with MFEM's one matrix at a time.
+*/
+
+#include "mfem.hpp"
+#include "../src/smoothG.hpp"
+
+using namespace smoothg;
+
+/// Random height x width matrix, plus size * identity if spd
+mfem::DenseMatrix RandomMatrix(int height, int width, int seed, bool spd = false)
+{
+    mfem::DenseMatrix A(height, width);
+    mfem::Vector A_data(A.Data(), height * width);
+    A_data.Randomize(seed);
+
+    if (spd)
+    {
+        mfem::DenseMatrix AAt(height);
+        mfem::MultAAt(A, AAt);
+        for (int i = 0; i < height; ++i)
+        {
+            AAt(i, i) += height;
+        }
+        return AAt;
+    }
+    return A;
+}
+
+double Difference(const mfem::DenseMatrix& A, const mfem::DenseMatrix& B)
+{
+    mfem::DenseMatrix diff(A);
+    diff -= B;
+    return diff.MaxMaxNorm() / std::max(A.MaxMaxNorm(), 1.0);
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+
+    const double tol = 1e-12;
+    const int height = 7;
+    const int width = 5;
+    const int inner = 4;
+
+    double error = 0.0;
+    for (int count : { 1, 3, 17 })
+    {
+        BatchedDenseMatrices A(height, inner, count), At(inner, height, count);
+        BatchedDenseMatrices B(inner, width, count), S(height, height, count);
+        std::vector<mfem::DenseMatrix> A_i(count), B_i(count), S_i(count);
+        for (int b = 0; b < count; ++b)
+        {
+            A_i[b] = RandomMatrix(height, inner, 3 * b + 1);
+            B_i[b] = RandomMatrix(inner, width, 3 * b + 2);
+            S_i[b] = RandomMatrix(height, height, 3 * b + 3, true);
+
+            mfem::DenseMatrix At_i(A_i[b], 't');
+            A.SetMatrix(b, A_i[b]);
+            At.SetMatrix(b, At_i);
+            B.SetMatrix(b, B_i[b]);
+            S.SetMatrix(b, S_i[b]);
+        }
+
+        BatchedDenseMatrices AB, AtB;
+        Mult(A, B, AB, 2.0);
+        MultAtB(At, B, AtB);
+        AddMultAtB(At, B, AtB);
+        S.InvertSPD();
+
+        mfem::DenseMatrix AB_i(height, width), result, Sinv_i;
+        for (int b = 0; b < count; ++b)
+        {
+            mfem::Mult(A_i[b], B_i[b], AB_i);
+            AB_i *= 2.0;
+
+            AB.GetMatrix(b, result);
+            error = std::max(error, Difference(AB_i, result));
+            AtB.GetMatrix(b, result);
+            error = std::max(error, Difference(AB_i, result));
+
+            mfem::DenseMatrixInverse S_inverse(S_i[b]);
+            S_inverse.GetInverseMatrix(Sinv_i);
+            S.GetMatrix(b, result);
+            error = std::max(error, Difference(Sinv_i, result));
+        }
+    }
+
+    std::cout << "Maximal relative difference: " << error << "\n";
+    if (error > tol)
+    {
+        std::cerr << "Batched kernels differ from MFEM!\n";
+        return 1;
+    }
+
+    // batches group equal keys, in chunks of at most max_count
+    std::vector<int> keys = { 2, 1, 2, 2, 1, 2 };
+    auto batches = MakeBatches(keys, 2);
+    std::vector<std::vector<int>> expected = { { 1, 4 }, { 0, 2 }, { 3, 5 } };
+    if (batches != expected)
+    {
+        std::cerr << "Wrong batches!\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   Test round trip of the binary graph format: text file -> binary file ->
+   memory-mapped matrix should reproduce the original vertex_edge and weights.
+   Also check that a Graph read in parallel from the binary file is complete,
+   and that a file with unsorted columns is read correctly.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <fstream>
+
+#include "mfem.hpp"
+#include "../src/BinaryGraph.hpp"
+#include "../src/Graph.hpp"
+#include "../src/MatrixUtilities.hpp"
+#include "../src/utilities.hpp"
+
+int main(int argc, char* argv[])
+{
+    // initialize MPI
+    smoothg::mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    int result = 0;
+
+    // parse command line options
+    mfem::OptionsParser args(argc, argv);
+    const char* graphFileName = "../../graphdata/vertex_edge_tiny.txt";
+    args.AddOption(&graphFileName, "-g", "--graph",
+                   "Graph connection data.");
+    const char* weightFileName = "../../graphdata/tiny_weights.txt";
+    args.AddOption(&weightFileName, "-w", "--weight",
+                   "Graph edge weights.");
+    args.Parse();
+
+    mfem::SparseMatrix vertex_edge = smoothg::ReadVertexEdge(graphFileName);
+
+    mfem::Vector weight;
+    std::ifstream weight_file(weightFileName);
+    weight.Load(weight_file, vertex_edge.Width());
+
+    const char* binaryFileName = "vertex_edge_tiny.bin";
+    if (myid == 0)
+    {
+        smoothg::ConvertVertexEdgeToBinary(graphFileName, binaryFileName, weightFileName);
+    }
+    MPI_Barrier(comm);
+
+    smoothg::BinaryGraphFile binary_graph(binaryFileName);
+    const mfem::SparseMatrix& binary_vertex_edge = binary_graph.VertexToEdge();
+
+    if (binary_vertex_edge.Height() != vertex_edge.Height() ||
+        binary_vertex_edge.Width() != vertex_edge.Width() ||
+        binary_vertex_edge.NumNonZeroElems() != vertex_edge.NumNonZeroElems())
+    {
+        std::cerr << "Binary graph has wrong dimensions!" << std::endl;
+        return 1;
+    }
+
+    for (int i = 0; i < vertex_edge.Height() + 1; ++i)
+    {
+        result += (binary_vertex_edge.GetI()[i] != vertex_edge.GetI()[i]);
+    }
+    for (int i = 0; i < vertex_edge.NumNonZeroElems(); ++i)
+    {
+        result += (binary_vertex_edge.GetJ()[i] != vertex_edge.GetJ()[i]);
+        result += (binary_vertex_edge.GetData()[i] != vertex_edge.GetData()[i]);
+    }
+
+    if (!binary_graph.HasEdgeWeight() || binary_graph.EdgeWeight().Size() != weight.Size())
+    {
+        std::cerr << "Binary graph has no (or wrong size of) edge weights!" << std::endl;
+        return 1;
+    }
+    for (int i = 0; i < weight.Size(); ++i)
+    {
+        result += (binary_graph.EdgeWeight()[i] != weight[i]);
+    }
+
+    // every vertex and edge of the graph read in parallel is somewhere
+    {
+        smoothg::Graph graph(comm, binaryFileName);
+
+        int nvertices_global;
+        int nvertices_local = graph.NumVertices();
+        MPI_Allreduce(&nvertices_local, &nvertices_global, 1, MPI_INT, MPI_SUM, comm);
+        result += (nvertices_global != vertex_edge.Height());
+        result += (graph.EdgeToTrueEdge().N() != vertex_edge.Width());
+
+        // 1 / (sum of 1 / split weights) over shared copies is the global weight
+        mfem::Vector inv_weight_local(graph.NumEdges());
+        inv_weight_local = 0.0;
+        mfem::Array<int> edges;
+        for (int vert = 0; vert < graph.NumVertices(); ++vert)
+        {
+            smoothg::GetTableRow(graph.VertexToEdge(), vert, edges);
+            for (int i = 0; i < edges.Size(); ++i)
+            {
+                inv_weight_local[edges[i]] += 1.0 / graph.EdgeWeight()[vert][i];
+            }
+        }
+        mfem::Vector inv_weight_true(graph.EdgeToTrueEdge().GetNumCols());
+        graph.EdgeToTrueEdge().MultTranspose(inv_weight_local, inv_weight_true);
+        // true edges are renumbered, so compare sums of the (inverse) weights
+        double local_sums[2] = {inv_weight_true.Sum(), inv_weight_true * inv_weight_true};
+        double sums[2];
+        MPI_Allreduce(local_sums, sums, 2, MPI_DOUBLE, MPI_SUM, comm);
+        for (int i = 0; i < weight.Size(); ++i)
+        {
+            sums[0] -= 1.0 / weight[i];
+            sums[1] -= 1.0 / (weight[i] * weight[i]);
+        }
+        const double error = std::fabs(sums[0]) + std::fabs(sums[1]);
+        if (error > 1e-12)
+        {
+            std::cerr << "Split weights of distributed graph are wrong!" << std::endl;
+            result++;
+        }
+    }
+    MPI_Barrier(comm);
+
+    // a file without weights
+    if (myid == 0)
+    {
+        const char* unweightedFileName = "vertex_edge_tiny_unweighted.bin";
+        smoothg::WriteVertexEdgeBinary(unweightedFileName, vertex_edge);
+        smoothg::BinaryGraphFile unweighted_graph(unweightedFileName);
+        result += unweighted_graph.HasEdgeWeight();
+        result += (unweighted_graph.VertexToEdge().NumNonZeroElems() !=
+                   vertex_edge.NumNonZeroElems());
+    }
+
+    // a file with the columns of every row in reverse order
+    if (myid == 0)
+    {
+        mfem::SparseMatrix reversed(vertex_edge);
+        for (int i = 0; i < reversed.Height(); ++i)
+        {
+            int* J = reversed.GetJ();
+            double* data = reversed.GetData();
+            std::reverse(J + reversed.GetI()[i], J + reversed.GetI()[i + 1]);
+            std::reverse(data + reversed.GetI()[i], data + reversed.GetI()[i + 1]);
+        }
+        const char* reversedFileName = "vertex_edge_tiny_reversed.bin";
+        smoothg::WriteVertexEdgeBinary(reversedFileName, reversed);
+        smoothg::BinaryGraphFile reversed_graph(reversedFileName);
+        const mfem::SparseMatrix& reversed_vertex_edge = reversed_graph.VertexToEdge();
+
+        mfem::Array<int> edges;
+        mfem::Vector values;
+        for (int i = 0; i < vertex_edge.Height(); ++i)
+        {
+            vertex_edge.GetRow(i, edges, values);
+            for (int j = 0; j < edges.Size(); ++j)
+            {
+                result += (reversed_vertex_edge(i, edges[j]) != vertex_edge(i, edges[j]));
+            }
+        }
+        std::unique_ptr<mfem::SparseMatrix> edge_vertex(
+            mfem::Transpose(reversed_vertex_edge));
+        std::unique_ptr<mfem::SparseMatrix> vertex_vertex(
+            mfem::Mult(reversed_vertex_edge, *edge_vertex));
+        std::unique_ptr<mfem::SparseMatrix> edge_vertex_ref(mfem::Transpose(vertex_edge));
+        std::unique_ptr<mfem::SparseMatrix> vertex_vertex_ref(
+            mfem::Mult(vertex_edge, *edge_vertex_ref));
+        std::unique_ptr<mfem::SparseMatrix> diff(
+            mfem::Add(1.0, *vertex_vertex, -1.0, *vertex_vertex_ref));
+        result += (diff->MaxNorm() > 1e-12);
+    }
+
+    if (result > 0)
+        std::cerr << "Unexpected difference after binary graph round trip!" << std::endl;
+    return result;
+}
@@ -0,0 +1,252 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+/**
+   @file test_CoefficientUpdate.cpp
+   @brief Test that updating the coefficient of the solvers in place (with and
+          without reusing the preconditioner or the Schur complement pattern)
+          gives the same solution as rebuilding the preconditioner.
+*/
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+template <typename Solver>
+int TestUpdate(const MixedMatrix& mgL, const mfem::BlockVector& rhs,
+               const std::string& solver_name)
+{
+    MPI_Comm comm = mgL.GetComm();
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    Solver reuse_solver(mgL);
+    reuse_solver.SetAMGReuseRatio(1.5);
+    reuse_solver.SetRelTol(1e-12);
+
+    int failures = 0;
+    const int num_updates = 4;
+    for (int k = 0; k < num_updates; ++k)
+    {
+        mfem::Vector scaling_inverse(mgL.GetGraph().NumVertices());
+        for (int i = 0; i < scaling_inverse.Size(); ++i)
+        {
+            scaling_inverse[i] = 1.0 + 0.5 * (k + 1) * ((i + myid) % 3);
+        }
+
+        reuse_solver.UpdateElemScaling(scaling_inverse);
+        mfem::BlockVector reuse_sol = reuse_solver.Solve(rhs);
+
+        // reference: without reuse ratio, every update sets up a new preconditioner
+        Solver fresh_solver(mgL);
+        fresh_solver.SetRelTol(1e-12);
+        fresh_solver.UpdateElemScaling(scaling_inverse);
+        mfem::BlockVector fresh_sol = fresh_solver.Solve(rhs);
+        if (fresh_solver.GetNumPreconditionerSetups() != 2)
+        {
+            failures++;
+            if (myid == 0)
+            {
+                std::cerr << solver_name << ": update without reuse ratio did not set up "
+                          << "the preconditioner once\n";
+            }
+        }
+
+        failures += CompareSolutions(comm, fresh_sol, reuse_sol, 1e-8,
+                                     solver_name + " update " + std::to_string(k));
+    }
+
+    if (reuse_solver.GetNumPreconditionerSetups() > 1 + num_updates)
+    {
+        failures++;
+        if (myid == 0)
+        {
+            std::cerr << solver_name << ": more than one preconditioner setup per update\n";
+        }
+    }
+
+    return failures;
+}
+
+/// Check that the preconditioner is set up again exactly when the iteration
+/// count crossed the reuse ratio
+template <typename Solver>
+int TestSetupCount(const MixedMatrix& mgL, const mfem::BlockVector& rhs,
+                   const std::string& solver_name)
+{
+    MPI_Comm comm = mgL.GetComm();
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    const double ratio = 1.5;
+    Solver solver(mgL);
+    solver.SetAMGReuseRatio(ratio);
+    solver.SetRelTol(1e-12);
+    solver.Solve(rhs);
+    int reference_iterations = solver.GetNumIterations();
+
+    int failures = 0;
+    int expected_setups = solver.GetNumPreconditionerSetups();
+    auto check_setups = [&](const std::string& step)
+    {
+        if (solver.GetNumPreconditionerSetups() != expected_setups)
+        {
+            failures++;
+            if (myid == 0)
+            {
+                std::cerr << solver_name << ", " << step << ": "
+                          << solver.GetNumPreconditionerSetups()
+                          << " preconditioner setups, expected " << expected_setups << "\n";
+            }
+        }
+    };
+
+    mfem::Vector scaling_inverse(mgL.GetGraph().NumVertices());
+
+    // a small rescale keeps the preconditioner
+    for (int i = 0; i < scaling_inverse.Size(); ++i)
+    {
+        scaling_inverse[i] = 1.0 + 0.01 * ((i + myid) % 3);
+    }
+    solver.UpdateElemScaling(scaling_inverse);
+    check_setups("small rescale");
+    solver.Solve(rhs);
+
+    // a high contrast rescale is first solved with the old preconditioner,
+    // which is set up again at the next update if the iterations degraded
+    for (int i = 0; i < scaling_inverse.Size(); ++i)
+    {
+        scaling_inverse[i] = std::pow(10.0, 2 * ((i + myid) % 3));
+    }
+    solver.UpdateElemScaling(scaling_inverse);
+    check_setups("high contrast rescale");
+    solver.Solve(rhs);
+
+    const bool degraded = solver.GetNumIterations() > ratio * reference_iterations;
+    solver.UpdateElemScaling(scaling_inverse);
+    expected_setups += degraded;
+    check_setups(degraded ? "update after degraded solve" : "update after solve");
+    solver.Solve(rhs);
+    if (degraded)
+    {
+        reference_iterations = solver.GetNumIterations();
+    }
+
+    // crossing the threshold gives exactly one setup, after which the first
+    // solve is the new reference
+    solver.SetAMGReuseRatio(0.5 * solver.GetNumIterations() / reference_iterations);
+    solver.UpdateElemScaling(scaling_inverse);
+    expected_setups++;
+    check_setups("ratio crossed");
+    solver.Solve(rhs);
+
+    solver.SetAMGReuseRatio(ratio);
+    solver.UpdateElemScaling(scaling_inverse);
+    check_setups("update after new reference");
+
+    return failures;
+}
+
+/// BlockSolverFalse with cached Schur complement pattern or diagonal Schur complement
+int TestSchurOptions(const MixedMatrix& mgL, const mfem::BlockVector& rhs)
+{
+    MPI_Comm comm = mgL.GetComm();
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    BlockSolverFalse pattern_solver(mgL);
+    pattern_solver.SetSchurPatternReuse(true);
+    pattern_solver.SetRelTol(1e-12);
+
+    BlockSolverFalse diagonal_solver(mgL, nullptr, true);
+    diagonal_solver.SetRelTol(1e-12);
+
+    BlockSolverFalse pattern_amg_solver(mgL);
+    pattern_amg_solver.SetSchurPatternReuse(true);
+    pattern_amg_solver.SetAMGReuseRatio(1.5);
+    pattern_amg_solver.SetRelTol(1e-12);
+
+    int failures = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        mfem::Vector scaling_inverse(mgL.GetGraph().NumVertices());
+        for (int i = 0; i < scaling_inverse.Size(); ++i)
+        {
+            scaling_inverse[i] = 1.0 + 0.5 * (k + 1) * ((i + myid) % 3);
+        }
+
+        BlockSolverFalse fresh_solver(mgL);
+        fresh_solver.SetRelTol(1e-12);
+        fresh_solver.UpdateElemScaling(scaling_inverse);
+        mfem::BlockVector fresh_sol = fresh_solver.Solve(rhs);
+
+        pattern_solver.UpdateElemScaling(scaling_inverse);
+        diagonal_solver.UpdateElemScaling(scaling_inverse);
+        pattern_amg_solver.UpdateElemScaling(scaling_inverse);
+
+        // the pattern is reused but AMG set up at every update, the Jacobi
+        // preconditioner of the diagonal Schur complement is never set up
+        // again, and AMG is kept at the first update with a reuse ratio
+        const BlockSolverFalse* solvers[3] =
+        { &pattern_solver, &diagonal_solver, &pattern_amg_solver };
+        const std::string names[3] =
+        { "Schur pattern reuse", "Diagonal Schur", "Schur pattern and AMG reuse" };
+        const int expected_setups[3] = { k + 2, 1, 1 };
+        for (int s = 0; s < 3; ++s)
+        {
+            if ((s < 2 || k == 0) &&
+                solvers[s]->GetNumPreconditionerSetups() != expected_setups[s])
+            {
+                failures++;
+                if (myid == 0)
+                {
+                    std::cerr << names[s] << " update " << k << ": "
+                              << solvers[s]->GetNumPreconditionerSetups()
+                              << " preconditioner setups, expected " << expected_setups[s]
+                              << "\n";
+                }
+            }
+            failures += CompareSolutions(comm, fresh_sol, solvers[s]->Solve(rhs), 1e-8,
+                                         names[s] + " update " + std::to_string(k));
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    Graph graph = TestGraph(comm, 300);
+    MixedMatrix mgL(graph);
+    mgL.BuildM();
+
+    mfem::BlockVector rhs(mgL.BlockOffsets());
+    rhs.GetBlock(0) = 0.0;
+    rhs.GetBlock(1).Randomize(myid);
+    par_orthogonalize_from_constant(rhs.GetBlock(1), graph.VertexStarts().Last());
+
+    int failures = 0;
+    failures += TestUpdate<BlockSolverFalse>(mgL, rhs, "BlockSolverFalse");
+    failures += TestUpdate<HybridSolver>(mgL, rhs, "HybridSolver");
+    failures += TestSetupCount<BlockSolverFalse>(mgL, rhs, "BlockSolverFalse");
+    failures += TestSetupCount<HybridSolver>(mgL, rhs, "HybridSolver");
+    failures += TestSchurOptions(mgL, rhs);
+
+    return failures;
+}
@@ -0,0 +1,127 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_HierarchyIO.cpp
+   @brief Test saving a Hierarchy to files and constructing it back from them.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+double MaxAbsDiff(MPI_Comm comm, const mfem::SparseMatrix& A, const mfem::SparseMatrix& B)
+{
+    double diff_loc = 0.0;
+    if (A.NumNonZeroElems() != B.NumNonZeroElems())
+    {
+        diff_loc = std::numeric_limits<double>::max();
+    }
+    else
+    {
+        for (int i = 0; i < A.NumNonZeroElems(); ++i)
+        {
+            diff_loc = std::max(diff_loc, std::fabs(A.GetData()[i] - B.GetData()[i]));
+        }
+    }
+
+    double diff;
+    MPI_Allreduce(&diff_loc, &diff, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return diff;
+}
+
+int TestSaveLoad(MPI_Comm comm, const Graph& graph, const UpscaleParameters& param)
+{
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    const std::string filename = "test_HierarchyIO.hier";
+
+    Hierarchy hierarchy(graph, param);
+    hierarchy.Save(filename);
+    MPI_Barrier(comm);
+
+    Hierarchy loaded(MixedMatrix(graph), filename, param);
+    MPI_Barrier(comm);
+    std::remove((filename + "." + std::to_string(myid)).c_str());
+
+    if (loaded.NumLevels() != hierarchy.NumLevels())
+    {
+        if (myid == 0)
+        {
+            std::cerr << "Loaded hierarchy has the wrong number of levels!\n";
+        }
+        return 1;
+    }
+
+    int failures = 0;
+    for (int level = 0; level < hierarchy.NumLevels() - 1; ++level)
+    {
+        const MixedMatrix& coarse = hierarchy.GetMatrix(level + 1);
+        const MixedMatrix& coarse_loaded = loaded.GetMatrix(level + 1);
+
+        const double tol = 1e-12;
+        const double diffs[5] =
+        {
+            MaxAbsDiff(comm, hierarchy.GetPsigma(level), loaded.GetPsigma(level)),
+            MaxAbsDiff(comm, hierarchy.GetPu(level), loaded.GetPu(level)),
+            MaxAbsDiff(comm, hierarchy.GetProjSigma(level), loaded.GetProjSigma(level)),
+            MaxAbsDiff(comm, coarse.GetD(), coarse_loaded.GetD()),
+            MaxAbsDiff(comm, coarse.GetM(), coarse_loaded.GetM())
+        };
+        if (*std::max_element(diffs, diffs + 5) > tol)
+        {
+            failures++;
+            if (myid == 0)
+            {
+                std::cerr << "Level " << level + 1 << " differs after loading"
+                          << (param.coarse_components ? " (coarse components):" : ":");
+                for (double diff : diffs)
+                {
+                    std::cerr << " " << diff;
+                }
+                std::cerr << "\n";
+            }
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    Graph graph = TestGraph(comm, 400);
+
+    UpscaleParameters param;
+    param.max_levels = 3;
+    param.coarse_factor = 8;
+    param.max_evects = 3;
+
+    int failures = TestSaveLoad(comm, graph, param);
+
+    // coarsening a level requires element matrices, so only two levels here
+    param.max_levels = 2;
+    param.coarse_components = true;
+    failures += TestSaveLoad(comm, graph, param);
+
+    return failures;
+}
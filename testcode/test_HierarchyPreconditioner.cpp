@@ -0,0 +1,148 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_HierarchyPreconditioner.cpp
+   @brief Test that GMRES preconditioned by the multilevel cycle of a
+          Hierarchy solves the fine level problem, in a number of iterations
+          that does not grow much with the problem size.
+
+   Also check that a coefficient update of the solver does not keep using
+   the (stale) external preconditioner.
+*/
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+int Check(MPI_Comm comm, const mfem::BlockVector& x, const mfem::BlockVector& y,
+          int num_iter, const std::string& name)
+{
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    if (myid == 0)
+    {
+        std::cout << name << ": " << num_iter << " iterations\n";
+    }
+    if (num_iter >= 200)
+    {
+        if (myid == 0)
+        {
+            std::cerr << name << ": solver did not converge in " << num_iter
+                      << " iterations!\n";
+        }
+        return 1;
+    }
+    return CompareSolutions(comm, x, y, 1e-6, name);
+}
+
+/// returns the number of failures, appends the iterations of V- and W-cycle
+int TestSize(MPI_Comm comm, int num_vertices, std::vector<int>& iterations)
+{
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    Graph graph = TestGraph(comm, num_vertices);
+
+    UpscaleParameters param;
+    param.coarse_factor = 8;
+    param.max_evects = 2;
+    param.max_traces = 2;
+    param.max_levels = 3;
+    Hierarchy hierarchy(graph, param);
+
+    mfem::BlockVector rhs(hierarchy.BlockOffsets(0));
+    rhs.GetBlock(0) = 0.0;
+    rhs.GetBlock(1).Randomize(myid);
+    par_orthogonalize_from_constant(rhs.GetBlock(1), graph.VertexStarts().Last());
+
+    MixedMatrix& mgL = hierarchy.GetMatrix(0);
+    mgL.BuildM();
+
+    BlockSolverFalse reference(mgL);
+    reference.SetRelTol(1e-10);
+    reference.SetMaxIter(1000);
+    mfem::BlockVector reference_sol = reference.Solve(rhs);
+
+    const std::string size = " (" + std::to_string(num_vertices) + " vertices)";
+
+    int failures = 0;
+    for (int cycle_index = 1; cycle_index <= 2; ++cycle_index)
+    {
+        HierarchyPreconditioner prec(hierarchy, nullptr, cycle_index);
+
+        BlockSolverFalse solver(mgL);
+        solver.SetRelTol(1e-10);
+        solver.SetMaxIter(200);
+        solver.SetPreconditioner(prec);
+
+        mfem::BlockVector sol = solver.Solve(rhs);
+        const std::string name = (cycle_index == 1 ? "V-cycle" : "W-cycle") + size;
+        failures += Check(comm, reference_sol, sol, solver.GetNumIterations(), name);
+        iterations.push_back(solver.GetNumIterations());
+
+        // prec was built for the old coefficient, the update must discard it
+        mfem::Vector scaling_inverse(mgL.GetGraph().NumVertices());
+        for (int i = 0; i < scaling_inverse.Size(); ++i)
+        {
+            scaling_inverse[i] = 1.0 + ((i + myid) % 3);
+        }
+        const int num_setups = solver.GetNumPreconditionerSetups();
+        solver.UpdateElemScaling(scaling_inverse);
+        reference.UpdateElemScaling(scaling_inverse);
+        if (solver.GetNumPreconditionerSetups() != num_setups + 1)
+        {
+            failures++;
+            if (myid == 0)
+            {
+                std::cerr << name << ": update did not restore the default preconditioner!\n";
+            }
+        }
+        failures += CompareSolutions(comm, reference.Solve(rhs), solver.Solve(rhs), 1e-6,
+                                     name + " after update");
+    }
+
+    return failures;
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    std::vector<int> small_iterations, large_iterations;
+    int failures = TestSize(comm, 400, small_iterations);
+    failures += TestSize(comm, 1600, large_iterations);
+
+    // the multilevel cycle should keep the iteration count bounded
+    for (int cycle = 0; cycle < 2; ++cycle)
+    {
+        if (large_iterations[cycle] > 2 * small_iterations[cycle] + 5)
+        {
+            failures++;
+            if (myid == 0)
+            {
+                std::cerr << (cycle == 0 ? "V-cycle" : "W-cycle") << ": iterations grow from "
+                          << small_iterations[cycle] << " to " << large_iterations[cycle]
+                          << " when the graph is 4 times larger!\n";
+            }
+        }
+    }
+
+    return failures;
+}
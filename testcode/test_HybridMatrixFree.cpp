@@ -0,0 +1,81 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_HybridMatrixFree.cpp
+   @brief Test that the matrix-free hybridized system gives the same solution
+          as the assembled one on a coarse level with several traces per face.
+*/
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    Graph graph = TestGraph(comm, 400);
+
+    UpscaleParameters param;
+    param.coarse_factor = 16;
+    param.max_evects = 3;
+    param.max_traces = 3;
+    Hierarchy hierarchy(graph, param);
+
+    mfem::BlockVector rhs(hierarchy.GetMatrix(0).BlockOffsets());
+    rhs.GetBlock(0) = 0.0;
+    rhs.GetBlock(1).Randomize(myid);
+    par_orthogonalize_from_constant(rhs.GetBlock(1), graph.VertexStarts().Last());
+    mfem::BlockVector coarse_rhs = hierarchy.Restrict(0, rhs);
+
+    const MixedMatrix& coarse_mgL = hierarchy.GetMatrix(1);
+
+    int failures = 0;
+    for (int rescale_iter : {-1, 0})
+    {
+        HybridSolver assembled(coarse_mgL, nullptr, rescale_iter);
+        assembled.SetRelTol(1e-12);
+        mfem::BlockVector assembled_sol = assembled.Solve(coarse_rhs);
+
+        HybridSolver matrix_free(coarse_mgL, nullptr, rescale_iter, nullptr, true);
+        matrix_free.SetRelTol(1e-12);
+        mfem::BlockVector matrix_free_sol = matrix_free.Solve(coarse_rhs);
+
+        if (!matrix_free.IsMatrixFree())
+        {
+            failures++;
+            if (myid == 0)
+            {
+                std::cerr << "Coarse hybridized system should be matrix-free!\n";
+            }
+        }
+
+        failures += CompareSolutions(comm, assembled_sol, matrix_free_sol, 1e-8,
+                                     "rescale_iter " + std::to_string(rescale_iter));
+
+        if (myid == 0)
+        {
+            std::cout << "rescale_iter " << rescale_iter << ": "
+                      << assembled.GetNumIterations() << " (assembled) and "
+                      << matrix_free.GetNumIterations() << " (matrix-free) iterations\n";
+        }
+    }
+
+    return failures;
+}
@@ -0,0 +1,171 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_LocalGraphEdgeSolver.cpp
+   @brief Compare the dense and sparse factorizations of LocalGraphEdgeSolver.
+*/
+
+#include "mfem.hpp"
+#include "../src/smoothG.hpp"
+
+using namespace smoothg;
+
+/// Signed vertex to edge incidence matrix of a size x size grid graph
+mfem::SparseMatrix GridD(int size)
+{
+    const int num_edges = 2 * size * (size - 1);
+    mfem::SparseMatrix D(size * size, num_edges);
+
+    int edge = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        for (int j = 0; j < size; ++j)
+        {
+            const int vertex = i * size + j;
+            if (j + 1 < size)
+            {
+                D.Add(vertex, edge, 1.0);
+                D.Add(vertex + 1, edge++, -1.0);
+            }
+            if (i + 1 < size)
+            {
+                D.Add(vertex, edge, 1.0);
+                D.Add(vertex + size, edge++, -1.0);
+            }
+        }
+    }
+    D.Finalize();
+
+    return D;
+}
+
+/// Edge weights in [1, 2], with a coupling of consecutive edges if coupled
+mfem::SparseMatrix EdgeMatrix(int num_edges, bool coupled)
+{
+    mfem::Vector weight(num_edges);
+    weight.Randomize(1);
+
+    mfem::SparseMatrix M(num_edges, num_edges);
+    for (int i = 0; i < num_edges; ++i)
+    {
+        M.Add(i, i, 1.0 + weight[i]);
+        if (coupled && i + 1 < num_edges)
+        {
+            M.Add(i, i + 1, 0.1);
+            M.Add(i + 1, i, 0.1);
+        }
+    }
+    M.Finalize();
+
+    return M;
+}
+
+/// Relative residual of the saddle point system (except the zeroth row of D)
+double Residual(const mfem::SparseMatrix& M, const mfem::SparseMatrix& D,
+                const mfem::Vector& rhs_sigma, const mfem::Vector& rhs_u,
+                const mfem::Vector& sol_sigma, const mfem::Vector& sol_u)
+{
+    mfem::Vector res_sigma(rhs_sigma.Size());
+    M.Mult(sol_sigma, res_sigma);
+    D.AddMultTranspose(sol_u, res_sigma, -1.0);
+    res_sigma -= rhs_sigma;
+
+    mfem::Vector res_u(rhs_u.Size());
+    D.Mult(sol_sigma, res_u);
+    res_u -= rhs_u;
+    res_u(0) = 0.0;
+
+    return (res_sigma.Norml2() + res_u.Norml2()) / (rhs_sigma.Norml2() + rhs_u.Norml2());
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+
+    const double tol = 1e-9;
+    int failures = 0;
+    auto check = [&](bool condition, const std::string& message)
+    {
+        if (!condition)
+        {
+            failures++;
+            std::cerr << message << "\n";
+        }
+    };
+
+    mfem::SparseMatrix D = GridD(6);
+
+    mfem::Vector rhs_sigma(D.Width());
+    mfem::Vector rhs_u(D.Height());
+    rhs_sigma.Randomize(2);
+    rhs_u.Randomize(3);
+
+    for (bool coupled : { false, true })
+    {
+        const std::string name = coupled ? "non-diagonal M" : "diagonal M";
+        mfem::SparseMatrix M = EdgeMatrix(D.Width(), coupled);
+
+        LocalGraphEdgeSolver dense(M, D);
+        LocalGraphEdgeSolver sparse(M, D, mfem::Vector(), nullptr, 0);
+        check(dense.UsesDenseFactorization(), "Dense factorization not used for " + name);
+        check(!sparse.UsesDenseFactorization(), "Dense factorization used for " + name);
+
+        mfem::Vector dense_sigma(D.Width()), dense_u(D.Height());
+        mfem::Vector sparse_sigma(D.Width()), sparse_u(D.Height());
+        dense.Mult(rhs_sigma, rhs_u, dense_sigma, dense_u);
+        sparse.Mult(rhs_sigma, rhs_u, sparse_sigma, sparse_u);
+
+        const double dense_res = Residual(M, D, rhs_sigma, rhs_u, dense_sigma, dense_u);
+        const double sparse_res = Residual(M, D, rhs_sigma, rhs_u, sparse_sigma, sparse_u);
+        std::cout << name << ": dense residual " << dense_res
+                  << ", sparse residual " << sparse_res << "\n";
+        check(dense_res < tol, "Dense solve is inaccurate for " + name);
+        check(sparse_res < tol, "Sparse solve is inaccurate for " + name);
+
+        sparse_sigma -= dense_sigma;
+        sparse_u -= dense_u;
+        check(sparse_sigma.Normlinf() < tol * dense_sigma.Normlinf(),
+              "Flux of dense and sparse solves differ for " + name);
+        check(sparse_u.Normlinf() < tol * dense_u.Normlinf(),
+              "Potential of dense and sparse solves differ for " + name);
+
+        // single right hand side version
+        dense.Mult(rhs_u, dense_sigma);
+        sparse.Mult(rhs_u, sparse_sigma);
+        sparse_sigma -= dense_sigma;
+        check(sparse_sigma.Normlinf() < tol * dense_sigma.Normlinf(),
+              "Flux of dense and sparse solves differ for " + name + " (no flux rhs)");
+    }
+
+    // local problems with identical patterns share one symbolic factorization,
+    // scaling M does not change the flux
+    CholmodSymbolicCache cache;
+    mfem::SparseMatrix M = EdgeMatrix(D.Width(), false);
+    mfem::SparseMatrix M2(M);
+    M2 *= 3.0;
+    LocalGraphEdgeSolver solver(M, D, mfem::Vector(), &cache, 0);
+    LocalGraphEdgeSolver solver2(M2, D, mfem::Vector(), &cache, 0);
+
+    mfem::Vector sigma(D.Width()), sigma2(D.Width());
+    solver.Mult(rhs_u, sigma);
+    solver2.Mult(rhs_u, sigma2);
+    sigma2 -= sigma;
+
+    check(cache.NumAnalyses() == 1 && cache.NumHits() == 1, "Symbolic analysis is not reused!");
+    check(sigma2.Normlinf() < tol * sigma.Normlinf(), "Solve with a cached analysis is wrong!");
+
+    return failures;
+}
@@ -0,0 +1,140 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_MLMCGroups.cpp
+   @brief Test that sampling concurrently in groups of processes merges the
+          statistics of the groups exactly, and that adaptive sampling
+          reaches its target error.
+
+   With a constant coefficient 1 + s for sample s (SimpleSampler), the
+   pressure and the quantity of interest scale like 1 / (1 + s), so the
+   merged mean and variance are known from a single solve.
+*/
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid, num_procs;
+    MPI_Comm_rank(comm, &myid);
+    MPI_Comm_size(comm, &num_procs);
+
+    const int num_groups = std::min(num_procs, 2);
+    MLMCGroups groups(comm, num_groups);
+    MPI_Comm group_comm = groups.GetGroupComm();
+
+    Graph graph = TestGraph(group_comm, 200);
+
+    UpscaleParameters param;
+    param.max_levels = 1;
+    Hierarchy hierarchy(graph, param);
+    hierarchy.SetRelTol(1e-12);
+
+    mfem::BlockVector rhs(hierarchy.BlockOffsets(0));
+    rhs.GetBlock(0) = 0.0;
+    rhs.GetBlock(1).Randomize(myid + 1);
+    par_orthogonalize_from_constant(rhs.GetBlock(1), graph.VertexStarts().Last());
+
+    // functional orthogonal to constants, so the QoI does not depend on the
+    // constant in the pressure
+    PressureFunctionalQoI qoi(hierarchy, rhs.GetBlock(1));
+
+    mfem::Vector unit_coeff(graph.NumVertices());
+    unit_coeff = 1.0;
+    hierarchy.RescaleCoefficient(0, unit_coeff);
+    const double unit_qoi = qoi.Evaluate(unit_coeff, hierarchy.Solve(0, rhs));
+
+    std::vector<int> sizes(1, graph.NumVertices());
+    SimpleSampler sampler(sizes);
+
+    const int num_samples = 7;
+    MLMCManager mlmc(sampler, qoi, hierarchy, rhs, 0, 1);
+    mlmc.SetInitialSamples(num_samples);
+    mlmc.Simulate(groups);
+
+    // the replicas of the groups differ (distribution of the graph, right
+    // hand side), so every group has its own unit_qoi
+    std::vector<double> unit_qois(num_procs);
+    std::vector<int> group_ids(num_procs);
+    const int group_id = groups.GroupId();
+    MPI_Allgather(&unit_qoi, 1, MPI_DOUBLE, unit_qois.data(), 1, MPI_DOUBLE, comm);
+    MPI_Allgather(&group_id, 1, MPI_INT, group_ids.data(), 1, MPI_INT, comm);
+    std::vector<double> group_unit_qoi(num_groups);
+    for (int p = 0; p < num_procs; ++p)
+    {
+        group_unit_qoi[group_ids[p]] = unit_qois[p];
+    }
+
+    // group g takes the samples k with k % num_groups == g, its sampler
+    // numbers them 0, 1, ...
+    double mean = 0.0;
+    std::vector<double> qois;
+    for (int k = 0; k < num_samples; ++k)
+    {
+        const int group_sample = k / num_groups;
+        qois.push_back(group_unit_qoi[k % num_groups] / (1.0 + group_sample));
+        mean += qois.back() / num_samples;
+    }
+    double variance = 0.0;
+    for (double q : qois)
+    {
+        variance += (q - mean) * (q - mean) / (num_samples - 1);
+    }
+
+    int failures = 0;
+    const double tol = 1e-8;
+    if (mlmc.GetNumSamples(0) != num_samples ||
+        std::fabs(mlmc.GetEstimate() - mean) > tol * std::fabs(mean) ||
+        std::fabs(mlmc.GetVariance(0) - variance) > tol * variance)
+    {
+        failures++;
+        if (myid == 0)
+        {
+            std::cerr << "Merged statistics are wrong: " << mlmc.GetNumSamples(0) << " samples, "
+                      << "mean " << mlmc.GetEstimate() << " (expected " << mean << "), "
+                      << "variance " << mlmc.GetVariance(0) << " (expected " << variance
+                      << ")!\n";
+        }
+    }
+
+    // adaptive sampling stops when the estimated error is within target,
+    // having taken at least the numbers of samples of the Giles formula
+    MLMCManager adaptive_mlmc(sampler, qoi, hierarchy, rhs, 0, 1);
+    adaptive_mlmc.SetInitialSamples(4);
+    const double target_rmse = 0.05 * std::fabs(mean);
+    const double rmse = adaptive_mlmc.SimulateToTolerance(groups, target_rmse, 2);
+
+    const int adaptive_samples = adaptive_mlmc.GetNumSamples(0);
+    const double adaptive_variance = adaptive_mlmc.GetVariance(0);
+    const double expected_rmse = std::sqrt(adaptive_variance / adaptive_samples);
+    if (rmse > target_rmse || std::fabs(rmse - expected_rmse) > tol * expected_rmse ||
+        adaptive_samples < std::ceil(adaptive_variance / (target_rmse * target_rmse)))
+    {
+        failures++;
+        if (myid == 0)
+        {
+            std::cerr << "Adaptive sampling stopped with " << adaptive_samples
+                      << " samples and estimated RMSE " << rmse << " (target "
+                      << target_rmse << ")!\n";
+        }
+    }
+
+    return failures;
+}
@@ -0,0 +1,260 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   Test ParMetis partitioning of a distributed chain of vertices: isolated
+   vertices, splitting of disconnected partitions and removal of empty
+   partitions, and the distribution of a global graph with ParMetis.
+*/
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "mfem.hpp"
+#include "../src/ParMetisGraphPartitioner.hpp"
+#include "../src/Graph.hpp"
+#include "../src/utilities.hpp"
+
+using namespace smoothg;
+
+/// Local rows (global columns) of the vertex to vertex table of a chain
+mfem::SparseMatrix ChainSlice(const mfem::Array<int>& vertex_starts, int myid)
+{
+    const int num_vertices = vertex_starts.Last();
+    const int begin = vertex_starts[myid];
+    const int end = vertex_starts[myid + 1];
+
+    mfem::SparseMatrix vertex_vertex(end - begin, num_vertices);
+    for (int i = begin; i < end; ++i)
+    {
+        if (i > 0)
+            vertex_vertex.Add(i - begin, i - 1, 1.0);
+        if (i < num_vertices - 1)
+            vertex_vertex.Add(i - begin, i + 1, 1.0);
+    }
+    vertex_vertex.Finalize();
+    return vertex_vertex;
+}
+
+/// Partition of all vertices, from the partitions of local vertices
+mfem::Array<int> GatherPartitioning(MPI_Comm comm, const mfem::Array<int>& vertex_starts,
+                                    const mfem::Array<int>& partitioning)
+{
+    int num_procs;
+    MPI_Comm_size(comm, &num_procs);
+
+    mfem::Array<int> sizes(num_procs);
+    for (int p = 0; p < num_procs; ++p)
+        sizes[p] = vertex_starts[p + 1] - vertex_starts[p];
+
+    mfem::Array<int> global_partitioning(vertex_starts.Last());
+    MPI_Allgatherv(partitioning.GetData(), partitioning.Size(), MPI_INT,
+                   global_partitioning.GetData(), sizes.GetData(), vertex_starts.GetData(),
+                   MPI_INT, comm);
+    return global_partitioning;
+}
+
+/// Check the partitions are numbered 0, ..., num_partitions - 1 and not empty
+int CheckNonEmpty(const mfem::Array<int>& global_partitioning, int num_partitions)
+{
+    std::vector<int> count(num_partitions, 0);
+    for (int part : global_partitioning)
+    {
+        if (part < 0 || part >= num_partitions)
+            return 1;
+        count[part]++;
+    }
+    return std::count(count.begin(), count.end(), 0);
+}
+
+/// Number of vertices in the partition of vertex
+int PartitionSize(const mfem::Array<int>& global_partitioning, int vertex)
+{
+    const int part = global_partitioning[vertex];
+    return std::count(global_partitioning.begin(), global_partitioning.end(), part);
+}
+
+/// Processes owning vertices of each partition
+std::vector<std::set<int>> PartitionProcs(const mfem::Array<int>& global_partitioning,
+                                          const mfem::Array<int>& vertex_starts,
+                                          int num_partitions)
+{
+    std::vector<std::set<int>> procs(num_partitions);
+    for (int p = 0; p < vertex_starts.Size() - 1; ++p)
+    {
+        for (int i = vertex_starts[p]; i < vertex_starts[p + 1]; ++i)
+        {
+            procs[global_partitioning[i]].insert(p);
+        }
+    }
+    return procs;
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    int num_procs;
+    MPI_Comm_rank(comm, &myid);
+    MPI_Comm_size(comm, &num_procs);
+
+    const int num_vertices = 40 * num_procs;
+    mfem::Array<int> vertex_starts(num_procs + 1);
+    for (int p = 0; p < num_procs + 1; ++p)
+        vertex_starts[p] = num_vertices * p / num_procs;
+
+    mfem::SparseMatrix vertex_vertex = ChainSlice(vertex_starts, myid);
+    const int requested_partitions = 4 * num_procs;
+
+    int result = 0;
+
+    // plain partitioning
+    int num_partitions = requested_partitions;
+    mfem::Array<int> partitioning;
+    {
+        ParMetisGraphPartitioner partitioner(comm);
+        partitioner.setUnbalanceTol(2);
+        partitioner.doPartition(vertex_vertex, vertex_starts, num_partitions, partitioning);
+    }
+    mfem::Array<int> global_partitioning =
+        GatherPartitioning(comm, vertex_starts, partitioning);
+    if (CheckNonEmpty(global_partitioning, num_partitions))
+    {
+        if (myid == 0)
+            std::cerr << "Partitions are not numbered contiguously!\n";
+        result++;
+    }
+
+    // pre-isolated vertices form their own partitions
+    {
+        const std::vector<int> iso_verts = { 0, num_vertices / 2 };
+        int num_iso_partitions = requested_partitions;
+        mfem::Array<int> iso_partitioning;
+        ParMetisGraphPartitioner partitioner(comm);
+        partitioner.setUnbalanceTol(2);
+        partitioner.SetPreIsolateVertices(iso_verts);
+        partitioner.doPartition(vertex_vertex, vertex_starts, num_iso_partitions,
+                                iso_partitioning);
+
+        auto global_iso = GatherPartitioning(comm, vertex_starts, iso_partitioning);
+        for (int vertex : iso_verts)
+        {
+            if (PartitionSize(global_iso, vertex) != 1)
+            {
+                if (myid == 0)
+                    std::cerr << "Vertex " << vertex << " is not isolated!\n";
+                result++;
+            }
+        }
+        if (CheckNonEmpty(global_iso, num_iso_partitions))
+        {
+            if (myid == 0)
+                std::cerr << "Partitions are not numbered contiguously (pre-isolation)!\n";
+            result++;
+        }
+    }
+
+    // post-isolating an interior vertex of a partition living on one process
+    // splits the rest of the partition into its two connected components
+    {
+        auto procs = PartitionProcs(global_partitioning, vertex_starts, num_partitions);
+        int vertex = -1;
+        for (int i = 1; i < num_vertices - 1 && vertex < 0; ++i)
+        {
+            const int part = global_partitioning[i];
+            if (procs[part].size() == 1 && global_partitioning[i - 1] == part &&
+                global_partitioning[i + 1] == part)
+            {
+                vertex = i;
+            }
+        }
+        MFEM_VERIFY(vertex >= 0, "No partition with an interior vertex!");
+
+        int num_post_partitions = requested_partitions;
+        mfem::Array<int> post_partitioning;
+        ParMetisGraphPartitioner partitioner(comm);
+        partitioner.setUnbalanceTol(2);
+        partitioner.SetPostIsolateVertices(vertex);
+        partitioner.doPartition(vertex_vertex, vertex_starts, num_post_partitions,
+                                post_partitioning);
+
+        auto global_post = GatherPartitioning(comm, vertex_starts, post_partitioning);
+        if (PartitionSize(global_post, vertex) != 1 ||
+            global_post[vertex - 1] == global_post[vertex + 1] ||
+            num_post_partitions != num_partitions + 2)
+        {
+            if (myid == 0)
+                std::cerr << "Partition of vertex " << vertex << " is not split!\n";
+            result++;
+        }
+        if (CheckNonEmpty(global_post, num_post_partitions))
+        {
+            if (myid == 0)
+                std::cerr << "Partitions are not numbered contiguously (post-isolation)!\n";
+            result++;
+        }
+    }
+
+    // a vertex isolated twice leaves the first of its partitions empty
+    {
+        std::vector<std::vector<int>> iso_sets = { { 1 }, { 1 } };
+        int num_iso_partitions = requested_partitions;
+        mfem::Array<int> iso_partitioning;
+        ParMetisGraphPartitioner partitioner(comm);
+        partitioner.setUnbalanceTol(2);
+        partitioner.SetPreIsolateVertices(iso_sets);
+        partitioner.doPartition(vertex_vertex, vertex_starts, num_iso_partitions,
+                                iso_partitioning);
+
+        auto global_iso = GatherPartitioning(comm, vertex_starts, iso_partitioning);
+        if (CheckNonEmpty(global_iso, num_iso_partitions) ||
+            num_iso_partitions > requested_partitions + 1)
+        {
+            if (myid == 0)
+                std::cerr << "Empty partitions are not removed!\n";
+            result++;
+        }
+    }
+
+    // distributing a global graph partitions it with ParMetis
+    {
+        mfem::SparseMatrix vertex_edge_global(num_vertices, num_vertices - 1);
+        for (int i = 0; i < num_vertices - 1; ++i)
+        {
+            vertex_edge_global.Add(i, i, 1.0);
+            vertex_edge_global.Add(i + 1, i, 1.0);
+        }
+        vertex_edge_global.Finalize();
+
+        Graph graph(comm, vertex_edge_global);
+
+        int num_local[2] = { graph.NumVertices(), graph.EdgeToTrueEdge().NumCols() };
+        int num_global[2];
+        MPI_Allreduce(num_local, num_global, 2, MPI_INT, MPI_SUM, comm);
+        if (num_global[0] != num_vertices || num_global[1] != num_vertices - 1 ||
+            graph.NumVertices() == 0)
+        {
+            if (myid == 0)
+                std::cerr << "Wrong distribution of the global graph!\n";
+            result++;
+        }
+    }
+
+    if (result > 0 && myid == 0)
+        std::cerr << "Unexpected partitioning from ParMetis!" << std::endl;
+    return result;
+}
@@ -0,0 +1,85 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_PipelinedKrylov.cpp
+   @brief Test that the pipelined CG and MINRES solvers give the same solution
+          as the standard ones, in about the same number of iterations.
+*/
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+template <typename Solver>
+int TestPipelined(const MixedMatrix& mgL, const mfem::BlockVector& rhs,
+                  const std::string& solver_name)
+{
+    MPI_Comm comm = mgL.GetComm();
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    Solver standard(mgL);
+    standard.SetRelTol(1e-10);
+    mfem::BlockVector standard_sol = standard.Solve(rhs);
+
+    Solver pipelined(mgL);
+    pipelined.SetPipelinedKrylov(true);
+    pipelined.SetRelTol(1e-10);
+    mfem::BlockVector pipelined_sol = pipelined.Solve(rhs);
+
+    if (myid == 0)
+    {
+        std::cout << solver_name << ": " << standard.GetNumIterations() << " (standard) and "
+                  << pipelined.GetNumIterations() << " (pipelined) iterations\n";
+    }
+
+    int failures = 0;
+    failures += CompareSolutions(comm, standard_sol, pipelined_sol, 1e-6, solver_name);
+
+    if (pipelined.GetNumIterations() > standard.GetNumIterations() + 5)
+    {
+        failures++;
+        if (myid == 0)
+        {
+            std::cerr << solver_name << ": pipelined solver needs too many iterations!\n";
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    Graph graph = TestGraph(comm, 300);
+    MixedMatrix mgL(graph);
+    mgL.BuildM();
+
+    mfem::BlockVector rhs(mgL.BlockOffsets());
+    rhs.GetBlock(0) = 0.0;
+    rhs.GetBlock(1).Randomize(myid);
+    par_orthogonalize_from_constant(rhs.GetBlock(1), graph.VertexStarts().Last());
+
+    int failures = 0;
+    failures += TestPipelined<BlockSolverFalse>(mgL, rhs, "MINRES (BlockSolverFalse)");
+    failures += TestPipelined<HybridSolver>(mgL, rhs, "CG (HybridSolver)");
+
+    return failures;
+}
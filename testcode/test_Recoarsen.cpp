@@ -0,0 +1,160 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_Recoarsen.cpp
+   @brief Test that recoarsening a Hierarchy for a new coefficient (with
+          cached and warm started local eigenproblems) gives the same upscaled
+          solution as a hierarchy built from scratch with that coefficient.
+*/
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+mfem::BlockVector UpscaledSolution(Hierarchy& hierarchy, const mfem::BlockVector& rhs)
+{
+    hierarchy.SetRelTol(1e-12);
+    mfem::BlockVector coarse_sol = hierarchy.Solve(1, hierarchy.Restrict(0, rhs));
+    return hierarchy.Interpolate(1, coarse_sol);
+}
+
+/// Hierarchy built from scratch for coeff, with the aggregates of agg_vert
+mfem::BlockVector ReferenceSolution(const Graph& graph, const UpscaleParameters& param,
+                                    const mfem::Vector& coeff,
+                                    const mfem::SparseMatrix& agg_vert,
+                                    const mfem::BlockVector& rhs)
+{
+    mfem::Array<int> partitioning = Partitioning(agg_vert);
+
+    MixedMatrix mgL(graph);
+    mgL.SetCoefficient(coeff);
+
+    UpscaleParameters fresh_param(param);
+    fresh_param.cache_targets = false;
+    Hierarchy fresh(std::move(mgL), fresh_param, &partitioning);
+    return UpscaledSolution(fresh, rhs);
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    Graph graph = TestGraph(comm, 400);
+
+    UpscaleParameters param;
+    param.coarse_factor = 8;
+    param.max_evects = 3;
+    param.cache_targets = true;
+    param.recoarsen_tol = 1e-2;
+    param.lobpcg_threshold = 1;
+
+    Hierarchy hierarchy(graph, param);
+
+    mfem::BlockVector rhs(hierarchy.BlockOffsets(0));
+    rhs.GetBlock(0) = 0.0;
+    rhs.GetBlock(1).Randomize(myid);
+    par_orthogonalize_from_constant(rhs.GetBlock(1), graph.VertexStarts().Last());
+
+    int failures = 0;
+    const int num_aggs = hierarchy.GetAggVert(0).NumRows();
+
+    // checks the (global) number of skipped and warm started aggregates
+    auto check_counts = [&](bool expect_all_skipped, bool expect_all_warm_started,
+                            const std::string& name)
+    {
+        const SpectralTargetsCache& cache = hierarchy.GetTargetsCache(0);
+        int counts[3] = { cache.num_skipped, cache.num_warm_started, num_aggs };
+        MPI_Allreduce(MPI_IN_PLACE, counts, 3, MPI_INT, MPI_SUM, comm);
+        const int skipped = counts[0], warm_started = counts[1], total = counts[2];
+        if (myid == 0)
+        {
+            std::cout << name << ": " << skipped << " skipped and " << warm_started
+                      << " warm started out of " << total << " aggregates\n";
+        }
+
+        bool ok = skipped + warm_started == total;
+        if (expect_all_skipped)
+        {
+            ok = ok && skipped == total;
+        }
+        else if (expect_all_warm_started)
+        {
+            ok = ok && warm_started == total;
+        }
+        else
+        {
+            ok = ok && skipped > 0 && warm_started > 0;
+        }
+        if (!ok)
+        {
+            failures++;
+            if (myid == 0)
+            {
+                std::cerr << name << ": wrong number of skipped / warm started aggregates!\n";
+            }
+        }
+    };
+
+    // unchanged coefficient: every aggregate keeps its targets
+    mfem::BlockVector initial_sol = UpscaledSolution(hierarchy, rhs);
+    mfem::Vector coeff(graph.NumVertices());
+    coeff = 1.0;
+    hierarchy.Recoarsen(coeff);
+    check_counts(true, false, "Unchanged coefficient");
+    failures += CompareSolutions(comm, initial_sol, UpscaledSolution(hierarchy, rhs), 1e-8,
+                                 "Unchanged coefficient");
+
+    // localized change in one aggregate (of the first process): only the
+    // extended aggregates touching it are recomputed, the others are skipped
+    if (myid == 0)
+    {
+        const mfem::SparseMatrix& agg_vert = hierarchy.GetAggVert(0);
+        for (int j = agg_vert.GetI()[0]; j < agg_vert.GetI()[1]; ++j)
+        {
+            coeff[agg_vert.GetJ()[j]] = 10.0;
+        }
+    }
+    hierarchy.Recoarsen(coeff);
+    check_counts(false, false, "Localized change");
+    failures += CompareSolutions(
+                    comm, ReferenceSolution(graph, param, coeff, hierarchy.GetAggVert(0), rhs),
+                    UpscaledSolution(hierarchy, rhs), 1e-6, "Localized change");
+
+    // new coefficient: every eigenproblem is warm started
+    for (int i = 0; i < coeff.Size(); ++i)
+    {
+        coeff[i] = 1.5 + 0.5 * ((i + myid) % 3);
+    }
+    hierarchy.Recoarsen(coeff);
+    check_counts(false, true, "Warm started targets");
+    failures += CompareSolutions(
+                    comm, ReferenceSolution(graph, param, coeff, hierarchy.GetAggVert(0), rhs),
+                    UpscaledSolution(hierarchy, rhs), 1e-6, "Warm started targets");
+
+    // uniform scaling of the coefficient below recoarsen_tol does not change
+    // the coarse spaces, so skipping every aggregate is exact
+    coeff *= 1.001;
+    hierarchy.Recoarsen(coeff);
+    check_counts(true, false, "Skipped aggregates");
+    failures += CompareSolutions(
+                    comm, ReferenceSolution(graph, param, coeff, hierarchy.GetAggVert(0), rhs),
+                    UpscaledSolution(hierarchy, rhs), 1e-6, "Skipped aggregates");
+
+    return failures;
+}
@@ -0,0 +1,287 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_SharedEntityCommunication.cpp
+   @brief Round trip of DenseMatrix, SparseMatrix and Vector data through
+          SharedEntityCommunication, with entities shared by all processes.
+
+   On process p, the local entities are (in this order):
+   - the entity Q_{p-1} shared with process p - 1 (cyclically),
+   - the private entity P_p,
+   - the entity T shared by all processes (owned by process 0),
+   - the entity Q_p shared with process p + 1 (cyclically).
+   A shared entity is owned by the smallest process sharing it. Every
+   exchange is done twice with the same object, and once more with an
+   object built from its plan.
+*/
+
+#include <algorithm>
+
+#include "mfem.hpp"
+#include "../src/sharedentitycommunication.hpp"
+#include "../src/MatrixUtilities.hpp"
+#include "../src/utilities.hpp"
+
+using namespace smoothg;
+
+/// Global number of the true entities of the local entities
+std::vector<int> LocalTrueEntities(int myid, int num_procs)
+{
+    // process p owns T (if p = 0), P_p, Q_p (if p + 1 < num_procs),
+    // Q_{num_procs - 1} (if p = 0 and num_procs > 1)
+    std::vector<int> true_starts(num_procs + 1, 0);
+    for (int p = 0; p < num_procs; ++p)
+    {
+        const int num_owned = 1 + (p == 0) + (p + 1 < num_procs) + (p == 0 && num_procs > 1);
+        true_starts[p + 1] = true_starts[p] + num_owned;
+    }
+    auto P = [&](int p) { return true_starts[p] + (p == 0); };
+    auto Q = [&](int p) { return (p + 1 < num_procs) ? P(p) + 1 : 3; };
+
+    std::vector<int> true_entities;
+    if (num_procs > 1)
+    {
+        true_entities.push_back(Q((myid + num_procs - 1) % num_procs));
+    }
+    true_entities.push_back(P(myid));
+    true_entities.push_back(0);
+    if (num_procs > 1)
+    {
+        true_entities.push_back(Q(myid));
+    }
+    return true_entities;
+}
+
+/// entity_trueentity of the entities above
+std::unique_ptr<mfem::HypreParMatrix> EntityTrueEntity(MPI_Comm comm,
+                                                       const std::vector<int>& true_entities,
+                                                       int num_owned)
+{
+    const int num_entities = true_entities.size();
+    mfem::Array<int> I(num_entities + 1);
+    mfem::Array<HYPRE_Int> J(num_entities);
+    mfem::Vector data(num_entities);
+    for (int i = 0; i < num_entities; ++i)
+    {
+        I[i] = i;
+        J[i] = true_entities[i];
+    }
+    I[num_entities] = num_entities;
+    data = 1.0;
+
+    mfem::Array<HYPRE_Int> row_starts, col_starts;
+    GenerateOffsets(comm, num_entities, row_starts);
+    GenerateOffsets(comm, num_owned, col_starts);
+
+    auto out = make_unique<mfem::HypreParMatrix>(
+                   comm, num_entities, row_starts.Last(), col_starts.Last(), I.GetData(),
+                   J.GetData(), data.GetData(), row_starts.GetData(), col_starts.GetData());
+    out->CopyRowStarts();
+    out->CopyColStarts();
+    return out;
+}
+
+/// Data sent by process proc for true entity, of size depending on both
+void MakeData(int true_entity, int proc, mfem::DenseMatrix& mat)
+{
+    mat.SetSize(1 + proc % 2, 1 + true_entity % 3);
+    for (int j = 0; j < mat.Width(); ++j)
+    {
+        for (int i = 0; i < mat.Height(); ++i)
+        {
+            mat(i, j) = 100.0 * true_entity + proc + 0.1 * i + 0.01 * j;
+        }
+    }
+}
+
+void MakeData(int true_entity, int proc, mfem::SparseMatrix& mat)
+{
+    mfem::SparseMatrix tmp(2 + proc % 2, 3);
+    for (int i = 0; i < tmp.Height(); ++i)
+    {
+        tmp.Add(i, (i + true_entity) % 3, 100.0 * true_entity + proc + 0.1 * i);
+    }
+    tmp.Finalize();
+    mat.Swap(tmp);
+}
+
+void MakeData(int true_entity, int proc, mfem::Vector& vec)
+{
+    vec.SetSize(1 + (true_entity + proc) % 4);
+    for (int i = 0; i < vec.Size(); ++i)
+    {
+        vec[i] = 100.0 * true_entity + proc + 0.1 * i;
+    }
+}
+
+bool Equal(const mfem::DenseMatrix& a, const mfem::DenseMatrix& b)
+{
+    return a.Height() == b.Height() && a.Width() == b.Width() &&
+           std::equal(a.Data(), a.Data() + a.Height() * a.Width(), b.Data());
+}
+
+bool Equal(const mfem::SparseMatrix& a, const mfem::SparseMatrix& b)
+{
+    const int nnz = a.NumNonZeroElems();
+    return a.Height() == b.Height() && a.Width() == b.Width() &&
+           nnz == b.NumNonZeroElems() &&
+           std::equal(a.GetI(), a.GetI() + a.Height() + 1, b.GetI()) &&
+           std::equal(a.GetJ(), a.GetJ() + nnz, b.GetJ()) &&
+           std::equal(a.GetData(), a.GetData() + nnz, b.GetData());
+}
+
+bool Equal(const mfem::Vector& a, const mfem::Vector& b)
+{
+    return a.Size() == b.Size() && std::equal(a.GetData(), a.GetData() + a.Size(),
+                                              b.GetData());
+}
+
+/// Collect from all sharing processes, then broadcast from the owner
+template <typename T>
+int TestExchange(SharedEntityCommunication<T>& sec, const std::vector<int>& true_entities,
+                 const std::string& name)
+{
+    int myid;
+    MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+
+    const int num_entities = true_entities.size();
+    int failures = 0;
+
+    sec.ReducePrepare();
+    for (int entity = 0; entity < num_entities; ++entity)
+    {
+        T mat;
+        MakeData(true_entities[entity], myid, mat);
+        sec.ReduceSend(entity, mat);
+    }
+    T** collected = sec.Collect();
+
+    mfem::Array<int> neighbors;
+    for (int entity = 0; entity < num_entities; ++entity)
+    {
+        if (!sec.OwnedByMe(entity))
+        {
+            failures += (collected[entity] != nullptr);
+            continue;
+        }
+
+        // own data first, then the other processes in the order of Neighbors()
+        sec.Neighbors(entity, neighbors);
+        int k = 0;
+        T expected;
+        MakeData(true_entities[entity], myid, expected);
+        failures += !Equal(collected[entity][k++], expected);
+        for (int proc : neighbors)
+        {
+            if (proc != myid)
+            {
+                MakeData(true_entities[entity], proc, expected);
+                failures += !Equal(collected[entity][k++], expected);
+            }
+        }
+        failures += (k != sec.NumNeighbors(entity));
+        delete [] collected[entity];
+    }
+    delete [] collected;
+
+    std::vector<T> data(num_entities);
+    std::vector<T*> data_ptr(num_entities);
+    for (int entity = 0; entity < num_entities; ++entity)
+    {
+        if (sec.OwnedByMe(entity))
+        {
+            MakeData(true_entities[entity], myid, data[entity]);
+        }
+        data_ptr[entity] = &data[entity];
+    }
+    sec.Broadcast(data_ptr.data());
+    for (int entity = 0; entity < num_entities; ++entity)
+    {
+        T expected;
+        MakeData(true_entities[entity], sec.Owner(entity), expected);
+        failures += !Equal(data[entity], expected);
+    }
+
+    std::vector<int> values(2 * num_entities, -1);
+    for (int entity = 0; entity < num_entities; ++entity)
+    {
+        if (sec.OwnedByMe(entity))
+        {
+            values[2 * entity] = true_entities[entity];
+            values[2 * entity + 1] = myid;
+        }
+    }
+    sec.BroadcastFixedSize(values.data(), 2);
+    for (int entity = 0; entity < num_entities; ++entity)
+    {
+        failures += (values[2 * entity] != true_entities[entity] ||
+                     values[2 * entity + 1] != sec.Owner(entity));
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (failures && myid == 0)
+    {
+        std::cerr << name << ": " << failures << " wrong entries!\n";
+    }
+    return failures;
+}
+
+template <typename T>
+int TestType(mfem::HypreParMatrix& entity_trueentity,
+             const std::vector<int>& true_entities, const std::string& name)
+{
+    MPI_Comm comm = entity_trueentity.GetComm();
+    int num_procs;
+    MPI_Comm_size(comm, &num_procs);
+
+    SharedEntityCommunication<T> sec(comm, entity_trueentity);
+
+    // T is entity 2 (or 1 on one process), shared by all processes
+    const int shared_entity = (num_procs > 1) ? 2 : 1;
+    int failures = (sec.NumNeighbors(shared_entity) != num_procs);
+    failures += (sec.Owner(shared_entity) != 0);
+
+    // repeated exchanges reuse the plan and the persistent requests
+    failures += TestExchange(sec, true_entities, name);
+    failures += TestExchange(sec, true_entities, name + " (repeated)");
+
+    SharedEntityCommunication<T> sec_same_plan(sec.GetPlan());
+    failures += TestExchange(sec_same_plan, true_entities, name + " (shared plan)");
+
+    return failures;
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    int num_procs;
+    MPI_Comm_rank(comm, &myid);
+    MPI_Comm_size(comm, &num_procs);
+
+    std::vector<int> true_entities = LocalTrueEntities(myid, num_procs);
+    const int num_owned = 1 + (myid == 0) + (myid + 1 < num_procs) +
+                          (myid == 0 && num_procs > 1);
+    auto entity_trueentity = EntityTrueEntity(comm, true_entities, num_owned);
+
+    int failures = 0;
+    failures += TestType<mfem::DenseMatrix>(*entity_trueentity, true_entities, "DenseMatrix");
+    failures += TestType<mfem::SparseMatrix>(*entity_trueentity, true_entities, "SparseMatrix");
+    failures += TestType<mfem::Vector>(*entity_trueentity, true_entities, "Vector");
+
+    return failures;
+}
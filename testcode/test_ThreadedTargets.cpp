@@ -0,0 +1,95 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+
+/**
+   @file test_ThreadedTargets.cpp
+   @brief Test that the coarse spaces built with several OpenMP threads are
+          exactly the same as the ones built with one thread.
+
+   The local eigenproblems are solved with the dense solver, with LOBPCG, and
+   (if enabled) with ARPACK, all of which must give reproducible results when
+   called concurrently.
+*/
+
+#include <algorithm>
+
+#include <omp.h>
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+bool Identical(const mfem::SparseMatrix& A, const mfem::SparseMatrix& B)
+{
+    if (A.NumRows() != B.NumRows() || A.NumCols() != B.NumCols() ||
+        A.NumNonZeroElems() != B.NumNonZeroElems())
+    {
+        return false;
+    }
+    return std::equal(A.GetI(), A.GetI() + A.NumRows() + 1, B.GetI()) &&
+           std::equal(A.GetJ(), A.GetJ() + A.NumNonZeroElems(), B.GetJ()) &&
+           std::equal(A.GetData(), A.GetData() + A.NumNonZeroElems(), B.GetData());
+}
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    int num_threads = 4;
+    mfem::OptionsParser args(argc, argv);
+    args.AddOption(&num_threads, "-nt", "--num-threads",
+                   "Number of threads compared to a single thread.");
+    args.Parse();
+    if (!args.Good())
+    {
+        if (myid == 0)
+        {
+            args.PrintUsage(std::cout);
+        }
+        return EXIT_FAILURE;
+    }
+
+    Graph graph = TestGraph(comm, 400);
+
+    int failures = 0;
+    for (int lobpcg_threshold : {0, 10})
+    {
+        UpscaleParameters param;
+        param.coarse_factor = 16;
+        param.max_evects = 3;
+        param.max_traces = 3;
+        param.lobpcg_threshold = lobpcg_threshold;
+
+        omp_set_num_threads(1);
+        Hierarchy serial(graph, param);
+
+        omp_set_num_threads(num_threads);
+        Hierarchy threaded(graph, param);
+
+        const std::string name = lobpcg_threshold > 0 ? "LOBPCG" : "default eigensolver";
+        if (!Identical(serial.GetPsigma(0), threaded.GetPsigma(0)) ||
+            !Identical(serial.GetPu(0), threaded.GetPu(0)))
+        {
+            failures++;
+            std::cerr << "Processor " << myid << ": coarse spaces (" << name
+                      << ") depend on the number of threads!\n";
+        }
+    }
+
+    return failures;
+}
@@ -0,0 +1,94 @@
+/*BHEADER**********************************************************************
+ *
+ * Copyright (c) 2018, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * LLNL-CODE-745247. All Rights reserved. See file COPYRIGHT for details.
+ *
+ * This file is part of smoothG. For more information and source code
+ * availability, see https://www.github.com/llnl/smoothG.
+ *
+ * smoothG is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License (as published by the Free
+ * Software Foundation) version 2.1 dated February 1999.
+ *
+ ***********************************************************************EHEADER*/
+/**
+   @file test_Timer.cpp
+   @brief Test nesting and parallel reduction of the phase timers.
+*/
+
+#include "TestUtilities.hpp"
+
+using namespace smoothg;
+
+int main(int argc, char* argv[])
+{
+    mpi_session session(argc, argv);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int myid;
+    MPI_Comm_rank(comm, &myid);
+
+    TimerRegistry& timers = TimerRegistry::Get();
+    timers.Clear();
+
+    Graph graph = TestGraph(comm, 200);
+
+    UpscaleParameters param;
+    param.max_levels = 2;
+    param.coarse_factor = 8;
+    param.max_evects = 3;
+
+    Hierarchy hierarchy(graph, param);
+
+    // a region recorded on rank 0 only still has to show up on all processes
+    if (myid == 0)
+    {
+        ScopedTimer timer("rank-zero-only");
+    }
+
+    picojson::object serialize = timers.Serialize(comm);
+
+    int failures = 0;
+    auto check = [&](bool condition, const std::string& message)
+    {
+        if (!condition)
+        {
+            failures++;
+            if (myid == 0)
+            {
+                std::cerr << message << "\n";
+            }
+        }
+    };
+
+    const std::string paths[] = { "hierarchy", "hierarchy/solver-level-0",
+                                  "hierarchy/coarsen-level-0",
+                                  "hierarchy/coarsen-level-0/vertex-targets",
+                                  "hierarchy/coarsen-level-0/coarse-matrix",
+                                  "hierarchy/solver-level-1", "rank-zero-only"
+                                };
+    for (const auto& path : paths)
+    {
+        if (serialize.count(path) == 0)
+        {
+            check(false, "Missing timer region " + path + "!");
+            continue;
+        }
+
+        picojson::object& timing = serialize[path].get<picojson::object>();
+        const double min = timing["min"].get<double>();
+        const double max = timing["max"].get<double>();
+        const double avg = timing["avg"].get<double>();
+        check(min >= 0.0 && min <= avg && avg <= max, "Inconsistent reduction of " + path + "!");
+        check(timing["count"].get<double>() == 1.0, "Wrong call count of " + path + "!");
+    }
+
+    check(timers.Time("hierarchy/coarsen-level-0/vertex-targets") <=
+          timers.Time("hierarchy/coarsen-level-0"), "Nested region outlasts its parent!");
+    check(timers.Time("hierarchy/coarsen-level-0") <= timers.Time("hierarchy"),
+          "Nested region outlasts its parent!");
+
+    timers.Print(comm);
+
+    return failures;
+}
@@ -224,6 +224,35 @@ int main(int argc, char* argv[])
         {
             some_solver_fails = true;
         }
+
+        // solve for several right hand sides at once
+        std::vector<mfem::BlockVector> rhs_batch(2, rhs);
+        rhs_batch[1] *= 2.0;
+        std::vector<mfem::BlockVector> sol_batch(2, rhs);
+        for (auto& sol_k : sol_batch)
+        {
+            sol_k = 0.0;
+        }
+        solver->Solve(rhs_batch, sol_batch);
+
+        for (int k = 0; k < 2; ++k)
+        {
+            if (!w_block)
+            {
+                mfem::Vector one(sol_batch[k].GetBlock(1).Size());
+                one = 1.0;
+                orthogonalize_from_vector(sol_batch[k].GetBlock(1), one);
+            }
+
+            sol_batch[k].GetBlock(1).Add(-(k + 1.0), truesol);
+            double batch_norm = sol_batch[k].GetBlock(1).Norml2() / (k + 1.0);
+            std::cout << "Error norm (rhs " << k << " of batch): " << batch_norm << std::endl;
+
+            if (batch_norm > equality_tolerance)
+            {
+                some_solver_fails = true;
+            }
+        }
     }
 
     if (some_solver_fails)